@@ -5,6 +5,33 @@
  *  This driver maintains the image in memory without displaying it,
  *  used by the graphics utility of the FreeType test suite.
  *
+ *  It reads its events from stdin or a script, and it can write
+ *  every refreshed frame to disk and report its rendering time,
+ *  controlled by the following environment variables.
+ *
+ *    GR_BATCH_SCRIPT  The name of an event script, `-' for stdin;
+ *                     see `grReadEventScript' for the syntax.  The
+ *                     script ends with an implicit `<Esc>'.
+ *
+ *    GR_BATCH_FRAMES  A file name pattern for the frames, with one
+ *                     `%d' or `%i' conversion (flags, width, and
+ *                     precision allowed) for the frame number and no
+ *                     other `%' except `%%', e.g., `frame%04d.png'.
+ *                     The frames are uncompressed PNG files if the
+ *                     name ends with `.png', binary PNM files
+ *                     otherwise.
+ *
+ *    GR_BATCH_REPORT  A file name for a report of all frames, `-' for
+ *                     stdout.  It lists the time between the previous
+ *                     frame or event and the refresh, the CRC-32 of
+ *                     the RGB or gray pixels, and the file name.  At
+ *                     the end, it gives the total time and percentiles
+ *                     of the latency of the events, which is the time
+ *                     of the frames refreshed after each of them.
+ *
+ *  Scripts of interactive sessions can be recorded by setting the
+ *  variable `GR_EVENT_RECORD' with any device; see grWriteEventScript.
+ *
  *  Copyright (C) 1999-2022 by
  *  David Turner, Robert Wilhelm, and Werner Lemberg.
  *
@@ -17,6 +44,8 @@
  ******************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 /* FT graphics subsystem */
 #include "grobjs.h"
@@ -24,17 +53,471 @@
 #include "grbatch.h"
 
 
+  /* the rows are cache-line aligned; nothing else sees the pixels */
+#define GR_BATCH_ALIGN  64
+
+
+  typedef struct  grBatchSurface_
+  {
+    grSurface       root;
+
+    int             frame;     /* number of the next frame       */
+    double          start;     /* start time of the next frame   */
+    double          total;     /* rendering time of all frames   */
+    unsigned char*  line;      /* a converted row                */
+    size_t          line_size;
+
+    int             events;    /* number of events read          */
+    double          latency;   /* of the current event           */
+    int             refreshed; /* since the current event        */
+    double*         latencies; /* of the previous events         */
+    int             num_latencies;
+    int             max_latencies;
+
+  } grBatchSurface;
+
+
+  static struct
+  {
+    grEventScript  script;
+    const char*    frames;
+    FILE*          report;
+
+  } gr_batch;
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* The frames are written as PNG files with `stored' deflate blocks,     */
+  /* avoiding a dependency on zlib or libpng, or as PNM files.  Both get   */
+  /* the same rows of 8-bit gray or RGB pixels.                            */
+  /*                                                                       */
+  /*************************************************************************/
+
+  static uint32_t  gr_crc_table[256];
+
+
+  static uint32_t
+  gr_crc32( uint32_t              crc,
+            const unsigned char*  p,
+            size_t                len )
+  {
+    if ( !gr_crc_table[1] )
+    {
+      uint32_t  n, k, c;
+
+
+      for ( n = 0; n < 256; n++ )
+      {
+        c = n;
+        for ( k = 0; k < 8; k++ )
+          c = c & 1 ? 0xEDB88320UL ^ ( c >> 1 ) : c >> 1;
+
+        gr_crc_table[n] = c;
+      }
+    }
+
+    crc = ~crc;
+    while ( len-- )
+      crc = gr_crc_table[( crc ^ *p++ ) & 0xFF] ^ ( crc >> 8 );
+
+    return ~crc;
+  }
+
+
+  typedef struct  grPNGWriter_
+  {
+    FILE*          file;
+    uint32_t       crc;        /* of the current chunk         */
+    uint32_t       adler_a;    /* Adler-32 of the image data   */
+    uint32_t       adler_b;
+    unsigned long  left;       /* in the current stored block  */
+    unsigned long  remaining;  /* of the image data            */
+
+  } grPNGWriter;
+
+
+  static void
+  gr_png_write( grPNGWriter*          png,
+                const unsigned char*  p,
+                size_t                len )
+  {
+    fwrite( p, 1, len, png->file );
+    png->crc = gr_crc32( png->crc, p, len );
+  }
+
+
+  static void
+  gr_png_write_u32( grPNGWriter*  png,
+                    uint32_t      value )
+  {
+    unsigned char  b[4];
+
+
+    b[0] = (unsigned char)( value >> 24 );
+    b[1] = (unsigned char)( value >> 16 );
+    b[2] = (unsigned char)( value >> 8 );
+    b[3] = (unsigned char)value;
+
+    gr_png_write( png, b, 4 );
+  }
+
+
+  static void
+  gr_png_chunk_start( grPNGWriter*  png,
+                      const char*   type,
+                      uint32_t      length )
+  {
+    gr_png_write_u32( png, length );
+
+    png->crc = 0;
+    gr_png_write( png, (const unsigned char*)type, 4 );
+  }
+
+
+  static void
+  gr_png_chunk_end( grPNGWriter*  png )
+  {
+    gr_png_write_u32( png, png->crc );
+  }
+
+
+  /* append image data, splitting it into stored blocks */
+  static void
+  gr_png_write_data( grPNGWriter*          png,
+                     const unsigned char*  p,
+                     size_t                len )
+  {
+    size_t  n, i;
+
+
+    while ( len )
+    {
+      if ( !png->left )
+      {
+        unsigned char  header[5];
+
+
+        png->left = png->remaining < 0xFFFFUL ? png->remaining : 0xFFFFUL;
+
+        header[0] = png->left == png->remaining;  /* BFINAL */
+        header[1] = (unsigned char)( png->left );
+        header[2] = (unsigned char)( png->left >> 8 );
+        header[3] = (unsigned char)~header[1];
+        header[4] = (unsigned char)~header[2];
+
+        gr_png_write( png, header, 5 );
+      }
+
+      n = len < png->left ? len : png->left;
+
+      gr_png_write( png, p, n );
+
+      for ( i = 0; i < n; i++ )
+      {
+        png->adler_a = ( png->adler_a + p[i] ) % 65521U;
+        png->adler_b = ( png->adler_b + png->adler_a ) % 65521U;
+      }
+
+      png->left      -= n;
+      png->remaining -= n;
+      p              += n;
+      len            -= n;
+    }
+  }
+
+
+  static void
+  gr_png_start( grPNGWriter*  png,
+                int           width,
+                int           height,
+                int           channels )
+  {
+    static const unsigned char  signature[8] =
+      { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    static const unsigned char  zlib_header[2] = { 0x78, 0x01 };
+
+    unsigned char  ihdr[5];
+    unsigned long  size   = (unsigned long)height *
+                              ( 1 + (unsigned long)width * channels );
+    unsigned long  blocks = ( size + 0xFFFEUL ) / 0xFFFFUL;
+
+
+    fwrite( signature, 1, 8, png->file );
+
+    gr_png_chunk_start( png, "IHDR", 13 );
+    gr_png_write_u32( png, (uint32_t)width );
+    gr_png_write_u32( png, (uint32_t)height );
+    ihdr[0] = 8;                       /* bit depth          */
+    ihdr[1] = channels == 3 ? 2 : 0;   /* RGB or gray        */
+    ihdr[2] = 0;                       /* compression method */
+    ihdr[3] = 0;                       /* filter method      */
+    ihdr[4] = 0;                       /* no interlace       */
+    gr_png_write( png, ihdr, 5 );
+    gr_png_chunk_end( png );
+
+    gr_png_chunk_start( png, "IDAT",
+                        (uint32_t)( 2 + 5 * blocks + size + 4 ) );
+    gr_png_write( png, zlib_header, 2 );
+
+    png->adler_a   = 1;
+    png->adler_b   = 0;
+    png->left      = 0;
+    png->remaining = size;
+  }
+
+
+  static void
+  gr_png_finish( grPNGWriter*  png )
+  {
+    gr_png_write_u32( png, ( png->adler_b << 16 ) | png->adler_a );
+    gr_png_chunk_end( png );
+
+    gr_png_chunk_start( png, "IEND", 0 );
+    gr_png_chunk_end( png );
+  }
+
+
+  /* convert a row of the surface to 8-bit gray or RGB */
+  static void
+  gr_batch_convert_line( grBitmap*       bitmap,
+                         unsigned char*  read,
+                         unsigned char*  write )
+  {
+    int  x;
+
+
+    switch ( bitmap->mode )
+    {
+    case gr_pixel_mode_mono:
+      for ( x = 0; x < bitmap->width; x++ )
+        write[x] = read[x >> 3] & ( 0x80 >> ( x & 7 ) ) ? 0xFF : 0;
+      break;
+
+    case gr_pixel_mode_pal8:
+    case gr_pixel_mode_gray:
+      memcpy( write, read, (size_t)bitmap->width );
+      break;
+
+    case gr_pixel_mode_rgb555:
+      for ( x = 0; x < bitmap->width; x++, write += 3 )
+      {
+        unsigned int  p = ( (unsigned short*)read )[x];
+
+
+        write[0] = (unsigned char)( ( p >> 7 & 0xF8 ) | ( p >> 12 & 7 ) );
+        write[1] = (unsigned char)( ( p >> 2 & 0xF8 ) | ( p >> 7  & 7 ) );
+        write[2] = (unsigned char)( ( p << 3 & 0xF8 ) | ( p >> 2  & 7 ) );
+      }
+      break;
+
+    case gr_pixel_mode_rgb565:
+      for ( x = 0; x < bitmap->width; x++, write += 3 )
+      {
+        unsigned int  p = ( (unsigned short*)read )[x];
+
+
+        write[0] = (unsigned char)( ( p >> 8 & 0xF8 ) | ( p >> 13 & 7 ) );
+        write[1] = (unsigned char)( ( p >> 3 & 0xFC ) | ( p >> 9  & 3 ) );
+        write[2] = (unsigned char)( ( p << 3 & 0xF8 ) | ( p >> 2  & 7 ) );
+      }
+      break;
+
+    case gr_pixel_mode_rgb24:
+      memcpy( write, read, (size_t)bitmap->width * 3 );
+      break;
+
+    default:  /* gr_pixel_mode_rgb32 */
+      for ( x = 0; x < bitmap->width; x++, write += 3 )
+      {
+        uint32_t  p = ( (uint32_t*)read )[x];
+
+
+        write[0] = (unsigned char)( p >> 16 );
+        write[1] = (unsigned char)( p >> 8 );
+        write[2] = (unsigned char)p;
+      }
+      break;
+    }
+  }
+
+
+  /* compute the CRC of a frame and write it to `filename' if set */
   static int
-  gr_batch_device_init( void )
+  gr_batch_write_frame( grBatchSurface*  surface,
+                        const char*      filename,
+                        uint32_t*        acrc )
   {
-    return 0;  /* success */
+    grBitmap*       bitmap   = &surface->root.bitmap;
+    int             channels = bitmap->mode == gr_pixel_mode_mono ||
+                               bitmap->mode == gr_pixel_mode_pal8 ||
+                               bitmap->mode == gr_pixel_mode_gray ? 1 : 3;
+    size_t          size     = 1 + (size_t)bitmap->width * channels;
+    unsigned char*  read     = bitmap->buffer;
+    FILE*           file     = NULL;
+    grPNGWriter     png;
+    int             png_mode = 0;
+    int             y;
+    uint32_t        crc      = 0;
+
+
+    if ( size > surface->line_size )
+    {
+      unsigned char*  line = (unsigned char*)realloc( surface->line, size );
+
+
+      if ( !line )
+        return -1;
+
+      surface->line      = line;
+      surface->line_size = size;
+    }
+
+    if ( filename )
+    {
+      size_t  len = strlen( filename );
+
+
+      file = fopen( filename, "wb" );
+      if ( !file )
+        return -1;
+
+      png_mode = len > 4 && !strcmp( filename + len - 4, ".png" );
+      if ( png_mode )
+      {
+        png.file = file;
+        gr_png_start( &png, bitmap->width, bitmap->rows, channels );
+      }
+      else
+        fprintf( file, "P%c\n%d %d\n255\n", channels == 3 ? '6' : '5',
+                 bitmap->width, bitmap->rows );
+    }
+
+    if ( bitmap->pitch < 0 )
+      read -= ( bitmap->rows - 1 ) * bitmap->pitch;
+
+    /* the first byte of the line is PNG's filter type */
+    surface->line[0] = 0;
+
+    for ( y = 0; y < bitmap->rows; y++, read += bitmap->pitch )
+    {
+      gr_batch_convert_line( bitmap, read, surface->line + 1 );
+
+      crc = gr_crc32( crc, surface->line + 1, size - 1 );
+
+      if ( png_mode )
+        gr_png_write_data( &png, surface->line, size );
+      else if ( file )
+        fwrite( surface->line + 1, 1, size - 1, file );
+    }
+
+    if ( png_mode )
+      gr_png_finish( &png );
+
+    *acrc = crc;
+
+    return file && fclose( file ) ? -1 : 0;
   }
 
 
   static void
   gr_batch_device_done( void )
   {
-    /* nothing to do */
+    if ( gr_batch.script.file && gr_batch.script.file != stdin )
+      fclose( gr_batch.script.file );
+
+    if ( gr_batch.report && gr_batch.report != stdout )
+      fclose( gr_batch.report );
+
+    gr_batch.script.file = NULL;
+    gr_batch.report      = NULL;
+  }
+
+
+  /* a frame name pattern must have exactly one conversion of an int */
+  static int
+  gr_batch_check_pattern( const char*  pattern )
+  {
+    const char*  p;
+    int          count = 0;
+
+
+    for ( p = pattern; *p; p++ )
+    {
+      if ( *p != '%' )
+        continue;
+
+      if ( p[1] == '%' )
+      {
+        p++;
+        continue;
+      }
+
+      /* flags, width, and precision, but not `*' */
+      p++;
+      while ( *p && strchr( "-+ #0", *p ) )
+        p++;
+      while ( *p >= '0' && *p <= '9' )
+        p++;
+      if ( *p == '.' )
+        for ( p++; *p >= '0' && *p <= '9'; p++ )
+          ;
+
+      if ( *p != 'd' && *p != 'i' )
+        return 0;
+
+      count++;
+    }
+
+    return count == 1;
+  }
+
+
+  static int
+  gr_batch_device_init( void )
+  {
+    const char*  script = getenv( "GR_BATCH_SCRIPT" );
+    const char*  report = getenv( "GR_BATCH_REPORT" );
+
+
+    gr_batch.frames          = getenv( "GR_BATCH_FRAMES" );
+    gr_batch.script.token[0] = '\0';
+    gr_batch.script.pos      = 0;
+
+    if ( gr_batch.frames && !*gr_batch.frames )
+      gr_batch.frames = NULL;
+
+    if ( gr_batch.frames && !gr_batch_check_pattern( gr_batch.frames ) )
+    {
+      fprintf( stderr, "frame name pattern `%s' needs exactly one"
+                       " `%%d' conversion\n", gr_batch.frames );
+      return -1;
+    }
+
+    if ( script && *script )
+    {
+      gr_batch.script.file = strcmp( script, "-" ) ? fopen( script, "r" )
+                                                   : stdin;
+      if ( !gr_batch.script.file )
+      {
+        fprintf( stderr, "cannot open event script `%s'\n", script );
+        return -1;
+      }
+    }
+
+    if ( report && *report )
+    {
+      gr_batch.report = strcmp( report, "-" ) ? fopen( report, "w" )
+                                              : stdout;
+      if ( !gr_batch.report )
+      {
+        fprintf( stderr, "cannot open report `%s'\n", report );
+        gr_batch_device_done();
+        return -1;
+      }
+    }
+
+    return 0;  /* success */
   }
 
 
@@ -47,9 +530,146 @@
   }
 
 
+  static void
+  gr_batch_surface_refresh_rect( grSurface*  surface,
+                                 int         x,
+                                 int         y,
+                                 int         width,
+                                 int         height )
+  {
+    grBatchSurface*  batch    = (grBatchSurface*)surface;
+    double           time     = grTime() - batch->start;
+    char             filename[1024];
+    uint32_t         crc;
+
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+
+
+    if ( gr_batch.frames || gr_batch.report )
+    {
+      if ( gr_batch.frames )
+        snprintf( filename, sizeof ( filename ), gr_batch.frames,
+                  batch->frame );
+
+      if ( gr_batch_write_frame( batch,
+                                 gr_batch.frames ? filename : NULL,
+                                 &crc ) )
+        fprintf( stderr, "cannot write frame %d\n", batch->frame );
+      else if ( gr_batch.report )
+      {
+        fprintf( gr_batch.report, "frame %5d  %10.3f ms  %08lx",
+                 batch->frame, time, (unsigned long)crc );
+        if ( gr_batch.frames )
+          fprintf( gr_batch.report, "  %s", filename );
+        fputc( '\n', gr_batch.report );
+      }
+    }
+
+    batch->total   += time;
+    batch->latency += time;
+    batch->refreshed = 1;
+    batch->frame++;
+
+    /* do not count the time to write the frame */
+    batch->start = grTime();
+  }
+
+
+  /* store the latency of the current event if it refreshed the surface; */
+  /* the first frames are not caused by an event                         */
+  static void
+  gr_batch_end_event( grBatchSurface*  batch )
+  {
+    if ( !batch->events || !batch->refreshed )
+    {
+      batch->latency   = 0;
+      batch->refreshed = 0;
+      return;
+    }
+
+    if ( batch->num_latencies == batch->max_latencies )
+    {
+      int      new_max   = batch->max_latencies ? 2 * batch->max_latencies
+                                                : 256;
+      double*  latencies = (double*)realloc( batch->latencies,
+                                             (size_t)new_max *
+                                               sizeof ( double ) );
+
+
+      if ( !latencies )
+        return;
+
+      batch->latencies     = latencies;
+      batch->max_latencies = new_max;
+    }
+
+    batch->latencies[batch->num_latencies++] = batch->latency;
+
+    batch->latency   = 0;
+    batch->refreshed = 0;
+  }
+
+
+  static int
+  gr_batch_compare_times( const void*  a,
+                          const void*  b )
+  {
+    double  ta = *(const double*)a;
+    double  tb = *(const double*)b;
+
+
+    return ta < tb ? -1 : ta > tb;
+  }
+
+
   static void
   gr_batch_surface_done( grSurface*  surface )
   {
+    grBatchSurface*  batch = (grBatchSurface*)surface;
+    double*          t;
+    int              n;
+
+
+    gr_batch_end_event( batch );
+
+    if ( gr_batch.report && batch->frame )
+    {
+      fprintf( gr_batch.report,
+               "%d frames  %.3f ms  %.3f ms/frame  %.1f frames/s\n",
+               batch->frame, batch->total,
+               batch->total / batch->frame,
+               batch->total > 0 ? 1E3 * batch->frame / batch->total : 0 );
+
+      t = batch->latencies;
+      n = batch->num_latencies;
+      if ( n )
+      {
+        qsort( t, (size_t)n, sizeof ( double ), gr_batch_compare_times );
+        fprintf( gr_batch.report,
+                 "%d events  p50 %.3f ms  p90 %.3f ms  p99 %.3f ms"
+                 "  max %.3f ms\n",
+                 n,
+                 t[( n - 1 ) * 50 / 100],
+                 t[( n - 1 ) * 90 / 100],
+                 t[( n - 1 ) * 99 / 100],
+                 t[n - 1] );
+      }
+
+      fflush( gr_batch.report );
+    }
+
+    free( batch->line );
+    batch->line      = NULL;
+    batch->line_size = 0;
+
+    free( batch->latencies );
+    batch->latencies     = NULL;
+    batch->num_latencies = 0;
+    batch->max_latencies = 0;
+
     grDoneBitmap( &(surface->bitmap) );
   }
 
@@ -59,11 +679,47 @@
                                  int         event_mode,
                                  grEvent*    event )
   {
-    (void)surface;    /* unused */
+    grBatchSurface*  batch = (grBatchSurface*)surface;
+    int              c;
+
     (void)event_mode;
 
-    event->type = gr_event_key;
-    event->key  = grKEY( getchar() );
+
+    if ( gr_batch.script.file )
+    {
+      while ( grReadEventScript( &gr_batch.script, event ) )
+      {
+        if ( event->type != gr_event_resize )
+          goto Exit;
+
+        if ( !grNewAlignedBitmap( surface->bitmap.mode,
+                                  surface->bitmap.grays,
+                                  event->x, event->y,
+                                  GR_BATCH_ALIGN, &surface->bitmap ) )
+        {
+          grTouchSurface( surface, 0, 0, event->x, event->y );
+          goto Exit;
+        }
+      }
+
+      /* the end of the script */
+      event->type = gr_event_key;
+      event->key  = grKeyEsc;
+    }
+    else
+    {
+      c = getchar();
+
+      event->type = gr_event_key;
+      event->key  = c == EOF ? grKeyEsc : grKEY( c );
+    }
+
+  Exit:
+    gr_batch_end_event( batch );
+    batch->events++;
+
+    /* the next frame starts with the processing of this event */
+    batch->start = grTime();
 
     return 1;
   }
@@ -73,30 +729,40 @@
   gr_batch_surface_init( grSurface*  surface,
                          grBitmap*   bitmap )
   {
+    grBatchSurface*  batch = (grBatchSurface*)surface;
+
+
     /* Set default mode */
     if ( bitmap->mode == gr_pixel_mode_none )
       bitmap->mode = gr_pixel_mode_rgb24;
 
-    if ( grNewBitmap( bitmap->mode, bitmap->grays,
-                      bitmap->width, bitmap->rows, bitmap ) )
+    if ( grNewAlignedBitmap( bitmap->mode, bitmap->grays,
+                             bitmap->width, bitmap->rows,
+                             GR_BATCH_ALIGN, bitmap ) )
       return 0;
 
     surface->bitmap     = *bitmap;
-    surface->refresh    = 0;
+    surface->refresh    = 1;       /* one refresh per frame */
     surface->owner      = 0;
 
-    surface->refresh_rect = (grRefreshRectFunc)NULL;  /* nothing to refresh */
+    surface->refresh_rect = gr_batch_surface_refresh_rect;
     surface->set_title    = gr_batch_surface_set_title;
     surface->listen_event = gr_batch_surface_listen_event;
     surface->done         = gr_batch_surface_done;
 
+    batch->frame     = 0;
+    batch->total     = 0;
+    batch->line      = NULL;
+    batch->line_size = 0;
+    batch->start     = grTime();
+
     return 1;
   }
 
 
   grDevice  gr_batch_device =
   {
-    sizeof( grSurface ),
+    sizeof( grBatchSurface ),
     "batch",
 
     gr_batch_device_init,
@@ -55,6 +55,14 @@ GCONCAT( _gblender_spans_, GDST_TYPE )( int            y,
 
   unsigned char*  dst_origin = surface->origin - y * surface->bitmap.pitch;
 
+  /* the spans of a row are sorted */
+  if ( surface->tracking && count > 0 )
+    grTouchSurface( surface,
+                    surface->pen_x + spans[0].x,
+                    surface->pen_y - 1 - y,
+                    spans[count - 1].x + spans[count - 1].len - spans[0].x,
+                    1 );
+
   for ( ; count--; spans++ )
   {
     unsigned char*  dst = dst_origin + spans->x * GDST_INCR;
@@ -71,7 +79,7 @@ GCONCAT( _gblender_spans_, GDST_TYPE )( int            y,
       {
         GDST_PIX( back, dst);
 
-        GBLENDER_LOOKUP( blender, back );
+        GBLENDER_LOOKUP( blender, back, a );
 
 #ifdef GBLENDER_STORE_BYTES
         GDST_STOREB(dst,_gcells,a);
@@ -121,7 +129,7 @@ GCONCAT( _gblender_blit_gray8_, GDST_TYPE )( GBlenderBlit  blit,
       {
         GDST_PIX( back, dst );
 
-        GBLENDER_LOOKUP( blender, back );
+        GBLENDER_LOOKUP( blender, back, a );
 
 #ifdef GBLENDER_STORE_BYTES
         GDST_STOREB(dst,_gcells,a);
@@ -183,11 +191,7 @@ GCONCAT( _gblender_blit_hrgb_, GDST_TYPE )( GBlenderBlit  blit,
       {
         GDST_CHANNELS( back, dst );
 
-        GBLENDER_LOOKUP_R( blender, back.r );
-
-        GBLENDER_LOOKUP_G( blender, back.g );
-
-        GBLENDER_LOOKUP_B( blender, back.b );
+        GBLENDER_LOOKUP_RGB( blender, GRGB_PACK( back.r, back.g, back.b ), aa );
 
         GDST_STOREC( dst, _grcells[ar], _ggcells[ag], _gbcells[ab] );
       }
@@ -245,11 +249,7 @@ GCONCAT( _gblender_blit_hbgr_, GDST_TYPE )( GBlenderBlit  blit,
       {
         GDST_CHANNELS( back, dst );
 
-        GBLENDER_LOOKUP_R( blender, back.r );
-
-        GBLENDER_LOOKUP_G( blender, back.g );
-
-        GBLENDER_LOOKUP_B( blender, back.b );
+        GBLENDER_LOOKUP_RGB( blender, GRGB_PACK( back.r, back.g, back.b ), aa );
 
         GDST_STOREC( dst, _grcells[ar], _ggcells[ag], _gbcells[ab] );
       }
@@ -308,11 +308,7 @@ GCONCAT( _gblender_blit_vrgb_, GDST_TYPE )( GBlenderBlit  blit,
       {
         GDST_CHANNELS( back, dst );
 
-        GBLENDER_LOOKUP_R( blender, back.r );
-
-        GBLENDER_LOOKUP_G( blender, back.g );
-
-        GBLENDER_LOOKUP_B( blender, back.b );
+        GBLENDER_LOOKUP_RGB( blender, GRGB_PACK( back.r, back.g, back.b ), aa );
 
         GDST_STOREC( dst, _grcells[ar], _ggcells[ag], _gbcells[ab] );
       }
@@ -371,11 +367,7 @@ GCONCAT( _gblender_blit_vbgr_, GDST_TYPE )( GBlenderBlit  blit,
       {
         GDST_CHANNELS( back, dst );
 
-        GBLENDER_LOOKUP_R( blender, back.r );
-
-        GBLENDER_LOOKUP_G( blender, back.g );
-
-        GBLENDER_LOOKUP_B( blender, back.b );
+        GBLENDER_LOOKUP_RGB( blender, GRGB_PACK( back.r, back.g, back.b ), aa );
 
         GDST_STOREC( dst, _grcells[ar], _ggcells[ag], _gbcells[ab] );
       }
@@ -297,7 +297,10 @@ gblender_blit_init( GBlenderBlit           blit,
     blit->blit_func = blit_funcs_gray8[src_format];
     break;
   case gr_pixel_mode_rgb32:
-    blit->blit_func = blit_funcs_rgb32[src_format];
+    blit->blit_func = gblender_simd_blit_func( src_format,
+                                               GBLENDER_TARGET_RGB32 );
+    if ( !blit->blit_func )
+      blit->blit_func = blit_funcs_rgb32[src_format];
     break;
   case gr_pixel_mode_rgb24:
     blit->blit_func = blit_funcs_rgb24[src_format];
@@ -345,6 +348,11 @@ gblender_blit_init( GBlenderBlit           blit,
   blit->width     = src_width;
   blit->height    = src_height;
 
+  /* vertical LCD glyphs have three rows per pixel */
+  if ( src_format == GBLENDER_SOURCE_VRGB ||
+       src_format == GBLENDER_SOURCE_VBGR )
+    src_y *= 3;
+
   blit->src_pitch = src_pitch;
   if ( src_pitch < 0 )
     src_y -= glyph->rows - 1;
@@ -412,6 +420,8 @@ grSetTargetPenBrush( grSurface*  surface,
   }
 
   surface->color = color;
+  surface->pen_x = x;
+  surface->pen_y = y;
 
   gblender_use_channels( surface->gblender, 0 );
 }
@@ -449,5 +459,28 @@ grBlitGlyphToSurface( grSurface*  surface,
   }
 
   gblender_blit_run( gblit, color );
+
+  /* the glyph can also be drawn on a plain bitmap, see `grfont.c' */
+  {
+    grSurface*  tracking = grTrackingSurface( &surface->bitmap );
+
+
+    if ( tracking )
+    {
+      int  width  = glyph->width;
+      int  height = glyph->rows;
+
+
+      if ( glyph->mode == gr_pixel_mode_lcd  ||
+           glyph->mode == gr_pixel_mode_lcd2 )
+        width /= 3;
+      else if ( glyph->mode == gr_pixel_mode_lcdv  ||
+                glyph->mode == gr_pixel_mode_lcdv2 )
+        height /= 3;
+
+      grTouchSurface( tracking, (int)x, (int)y, width, height );
+    }
+  }
+
   return 1;
 }
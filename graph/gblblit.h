@@ -60,4 +60,45 @@ typedef struct GBlenderBlitRec_
 
 #define  gblender_blit_run(b,color)  (b)->blit_func( (b), (color) )
 
+
+/*
+ * SIMD blitters
+ *
+ * Gray, HRGB, HBGR, and BGRA glyphs are blitted to RGB32 surfaces with
+ * vector instructions if available; the results are bit-identical to
+ * the generic routines.  The best instruction set supported by the CPU
+ * is selected at the first blit, unless the environment variable
+ * `GBLENDER_SIMD' names another one (`none' to disable).
+ */
+
+typedef enum
+{
+  GBLENDER_SIMD_NONE = 0,
+  GBLENDER_SIMD_SSE2,
+  GBLENDER_SIMD_AVX2,
+  GBLENDER_SIMD_NEON,
+
+  GBLENDER_SIMD_MAX
+
+} GBlenderSimd;
+
+
+GBLENDER_API( int )
+gblender_simd_supported( GBlenderSimd  level );
+
+ /* select an instruction set; unsupported ones select GBLENDER_SIMD_NONE */
+GBLENDER_API( GBlenderSimd )
+gblender_simd_set( GBlenderSimd  level );
+
+GBLENDER_API( GBlenderSimd )
+gblender_simd_get( void );
+
+GBLENDER_API( const char* )
+gblender_simd_name( GBlenderSimd  level );
+
+ /* return NULL if there is no SIMD routine for this format pair */
+GBLENDER_API( GBlenderBlitFunc )
+gblender_simd_blit_func( GBlenderSourceFormat  src_format,
+                         GBlenderTargetFormat  dst_format );
+
 #endif /* GBLBLIT_H_ */
@@ -1,5 +1,6 @@
 #include "gblender.h"
 #include <stdlib.h>
+#include <string.h>
 
 #if 0  /* using slow power functions */
 
@@ -115,6 +116,17 @@ gblender_set_gamma_table( double           gamma_value,
 
 #endif
 
+  /* number of lookups between two evaluations of the miss rate */
+#define GBLENDER_ADAPT_WINDOW      256
+#define GBLENDER_ADAPT_WINDOW_MAX  ( 64 * GBLENDER_ADAPT_WINDOW )
+
+  /* miss rate (in 1/256) above which pixels get blended directly */
+#define GBLENDER_DIRECT_THRESHOLD  192
+
+  /* number of directly blended pixels between two evaluations */
+#define GBLENDER_DIRECT_PERIOD     4096
+
+
 /* clear the cache
  */
 static void
@@ -127,7 +139,7 @@ gblender_clear( GBlender  blender )
   {
     GBlenderChanKey  chan_keys = (GBlenderChanKey) blender->keys;
 
-    for ( nn = 0; nn < GBLENDER_KEY_COUNT; nn++ )
+    for ( nn = 0; nn < blender->key_count; nn++ )
       chan_keys[nn].index = -1;
 
     blender->cache_r_back  = ~0U;
@@ -144,7 +156,7 @@ gblender_clear( GBlender  blender )
   }
   else
   {
-    for ( nn = 0; nn < GBLENDER_KEY_COUNT; nn++ )
+    for ( nn = 0; nn < blender->key_count; nn++ )
       keys[nn].cells = NULL;
 
     blender->cache_back  = ~0U;
@@ -153,23 +165,152 @@ gblender_clear( GBlender  blender )
   }
 }
 
+
+/* restart the measurements that drive the choice of direct blending
+ */
+static void
+gblender_reset_adapt( GBlender  blender )
+{
+  blender->direct         = blender->direct_mode == GBLENDER_DIRECT_ALWAYS;
+  blender->window         = GBLENDER_ADAPT_WINDOW;
+  blender->window_lookups = 0;
+  blender->window_misses  = 0;
+  blender->miss_rate      = 0;
+  blender->direct_pixels  = 0;
+  blender->direct_changes = 0;
+  blender->direct_back    = ~0U;
+  blender->direct_fore    = ~0U;
+}
+
+
+/* Switch between cached and direct blending if the other one looks
+ * cheaper.  A cache miss computes a whole row of GBLENDER_SHADE_COUNT-1
+ * cells, while direct blending computes a single cell per pixel; the
+ * latter wins if too few pixels share the same colors.
+ */
+static void
+gblender_adapt( GBlender  blender )
+{
+  if ( !blender->direct )
+  {
+    blender->miss_rate = (unsigned int)( blender->window_misses * 256 /
+                                         blender->window_lookups );
+
+    blender->window_lookups = 0;
+    blender->window_misses  = 0;
+
+    if ( blender->direct_mode == GBLENDER_DIRECT_AUTO &&
+         blender->miss_rate > GBLENDER_DIRECT_THRESHOLD )
+    {
+      blender->direct         = 1;
+      blender->direct_pixels  = 0;
+      blender->direct_changes = 0;
+      blender->stats.switches++;
+    }
+  }
+  else
+  {
+    if ( blender->direct_mode == GBLENDER_DIRECT_AUTO               &&
+         blender->direct_pixels * 256 >
+           blender->direct_changes * blender->miss_rate *
+             ( GBLENDER_SHADE_COUNT - 1 )                           )
+    {
+      blender->direct = 0;
+      blender->stats.switches++;
+
+      /* the miss rate was misleading; don't trust it too soon again */
+      if ( blender->window < GBLENDER_ADAPT_WINDOW_MAX )
+        blender->window *= 2;
+    }
+    else
+      blender->window = GBLENDER_ADAPT_WINDOW;
+
+    blender->direct_pixels  = 0;
+    blender->direct_changes = 0;
+  }
+}
+
+
 GBLENDER_APIDEF( void )
 gblender_init( GBlender   blender,
                double     gamma_value )
 {
+  int  count = blender->key_count;
+
+
   blender->channels = 0;
+  blender->gamma    = gamma_value;
 
   gblender_set_gamma_table ( gamma_value,
                              blender->gamma_ramp,
                              blender->gamma_ramp_inv );
 
+  /* keep the cache settings across gamma changes, if any */
+  if ( count < GBLENDER_KEY_MIN                  ||
+       count > GBLENDER_KEY_MAX                  ||
+       ( count & ( count - 1 ) )                 ||
+       (unsigned int)blender->policy      >= GBLENDER_POLICY_MAX ||
+       (unsigned int)blender->direct_mode >= GBLENDER_DIRECT_MAX )
+  {
+    blender->key_count   = GBLENDER_KEY_COUNT;
+    blender->policy      = GBLENDER_POLICY_FLUSH;
+    blender->direct_mode = GBLENDER_DIRECT_AUTO;
+  }
+
   gblender_clear( blender );
+  gblender_reset_adapt( blender );
+  gblender_reset_stats( blender );
+}
+
+
+GBLENDER_APIDEF( int )
+gblender_set_cache( GBlender        blender,
+                    int             key_count,
+                    GBlenderPolicy  policy )
+{
+  if ( key_count < GBLENDER_KEY_MIN             ||
+       key_count > GBLENDER_KEY_MAX             ||
+       ( key_count & ( key_count - 1 ) )        ||
+       (unsigned int)policy >= GBLENDER_POLICY_MAX )
+    return -1;
+
+  blender->key_count = key_count;
+  blender->policy    = policy;
+
+  gblender_clear( blender );
+  gblender_reset_adapt( blender );
+
+  return 0;
+}
+
+
+GBLENDER_APIDEF( void )
+gblender_set_direct( GBlender        blender,
+                     GBlenderDirect  mode )
+{
+  if ( (unsigned int)mode >= GBLENDER_DIRECT_MAX )
+    return;
+
+  blender->direct_mode = mode;
+  gblender_reset_adapt( blender );
+}
+
+
+GBLENDER_APIDEF( void )
+gblender_get_stats( GBlender       blender,
+                    GBlenderStats  stats )
+{
+  *stats = blender->stats;
+}
+
+
+GBLENDER_APIDEF( void )
+gblender_reset_stats( GBlender  blender )
+{
+  memset( &blender->stats, 0, sizeof ( blender->stats ) );
 
 #ifdef GBLENDER_STATS
-  blender->stat_hits    = 0;
-  blender->stat_lookups = 0;
-  blender->stat_keys    = 0;
-  blender->stat_clears  = 0;
+  blender->stat_hits = 0;
 #endif
 }
 
@@ -264,16 +405,27 @@ gblender_lookup( GBlender       blender,
                  GBlenderPixel  background,
                  GBlenderPixel  foreground )
 {
-  int          idx, idx0;
-  GBlenderKey  key;
+  unsigned int  mask  = (unsigned int)blender->key_count - 1;
+  /* Fibonacci hashing; with a plain sum, the blue channel alone picked
+   * the slot, and gradients ended up in a few long probe chains
+   */
+  unsigned int  idx0  = ( ( ( background ^ foreground*63 ) * 0x9E3779B1U )
+                            >> 16 ) & mask;
+  unsigned int  idx   = idx0;
+  int           probe = blender->policy == GBLENDER_POLICY_LRU
+                          ? GBLENDER_PROBE_COUNT
+                          : blender->key_count;
+  unsigned int  clock = ++blender->clock;
+  GBlenderKey   key;
+  GBlenderKey   victim = NULL;
 
 #ifdef GBLENDER_STATS
   blender->stat_hits--;
-  blender->stat_lookups++;
 #endif
 
-  idx0 = ( background + foreground*63 ) & (GBLENDER_KEY_COUNT-1);
-  idx  = idx0;
+  blender->stats.lookups++;
+  blender->window_lookups++;
+
   do
   {
     key = blender->keys + idx;
@@ -283,32 +435,51 @@ gblender_lookup( GBlender       blender,
 
     if ( key->background == background &&
          key->foreground == foreground )
+    {
+      blender->stats.hits++;
       goto Exit;
+    }
+
+    if ( !victim || clock - key->stamp > clock - victim->stamp )
+      victim = key;
 
-    idx = (idx+1) & (GBLENDER_KEY_COUNT-1);
+    idx = (idx+1) & mask;
   }
-  while ( idx != idx0 );
+  while ( --probe > 0 );
 
- /* the cache is full, clear it completely
-  */
-#ifdef GBLENDER_STATS
-  blender->stat_clears++;
-#endif
-  gblender_clear( blender );
+  if ( blender->policy == GBLENDER_POLICY_LRU )
+  {
+    key = victim;
+    blender->stats.evictions++;
+  }
+  else
+  {
+   /* the cache is full, clear it completely
+    */
+    blender->stats.flushes++;
+    blender->stats.evictions += (unsigned long)blender->key_count;
+    gblender_clear( blender );
+
+    key = blender->keys + idx0;
+  }
 
 NewNode:
+  blender->stats.misses++;
+  blender->window_misses++;
+
   key->background = background;
   key->foreground = foreground;
   key->cells      = blender->cells +
-                    idx*(GBLENDER_SHADE_COUNT*GBLENDER_CELL_SIZE);
+                    ( key - blender->keys )*(GBLENDER_SHADE_COUNT*GBLENDER_CELL_SIZE);
 
   gblender_reset_key( blender, key );
 
-#ifdef GBLENDER_STATS
-  blender->stat_keys++;
-#endif
-
 Exit:
+  key->stamp = clock;
+
+  if ( blender->window_lookups >= blender->window )
+    gblender_adapt( blender );
+
   return  key->cells;
 }
 
@@ -352,77 +523,288 @@ gblender_reset_channel_key( GBlender         blender,
 }
 
 
-GBLENDER_APIDEF( unsigned char* )
-gblender_lookup_channel( GBlender      blender,
-                         unsigned int  background,
-                         unsigned int  foreground )
+/* `pin1' and `pin2' are keys that must not be replaced, or NULL
+ */
+static GBlenderChanKey
+gblender_lookup_channel_key( GBlender         blender,
+                             unsigned int     background,
+                             unsigned int     foreground,
+                             GBlenderChanKey  pin1,
+                             GBlenderChanKey  pin2 )
 {
-  int              idx, idx0;
+  unsigned int     mask     = (unsigned int)blender->key_count - 1;
+  unsigned int     idx0     = ( background + foreground*17 ) & mask;
+  unsigned int     idx      = idx0;
+  int              probe    = blender->policy == GBLENDER_POLICY_LRU
+                                ? GBLENDER_PROBE_COUNT
+                                : blender->key_count;
+  unsigned int     clock    = ++blender->clock;
   unsigned short   backfore = (unsigned short)((foreground << 8) | background);
+  GBlenderChanKey  keys     = (GBlenderChanKey)blender->keys;
   GBlenderChanKey  key;
+  GBlenderChanKey  victim   = NULL;
 
 #ifdef GBLENDER_STATS
   blender->stat_hits--;
-  blender->stat_lookups++;
 #endif
 
-  idx0 = ( background + foreground*17 ) & (GBLENDER_KEY_COUNT-1);
-  idx  = idx0;
+  blender->stats.lookups++;
+  blender->window_lookups++;
+
   do
   {
-    key = (GBlenderChanKey)blender->keys + idx;
+    key = keys + idx;
 
     if ( key->index < 0 )
       goto NewNode;
 
     if ( key->backfore == backfore )
+    {
+      blender->stats.hits++;
       goto Exit;
+    }
+
+    if ( key != pin1 && key != pin2 &&
+         ( !victim || clock - key->stamp > clock - victim->stamp ) )
+      victim = key;
 
-    idx = (idx+1) & (GBLENDER_KEY_COUNT-1);
+    idx = (idx+1) & mask;
   }
-  while ( idx != idx0 );
+  while ( --probe > 0 );
 
- /* the cache is full, clear it completely
-  */
-#ifdef GBLENDER_STATS
-  blender->stat_clears++;
-#endif
-  gblender_clear( blender );
+  if ( blender->policy == GBLENDER_POLICY_LRU )
+  {
+    key = victim;
+    blender->stats.evictions++;
+  }
+  else
+  {
+   /* the cache is full, clear it completely
+    */
+    blender->stats.flushes++;
+    blender->stats.evictions += (unsigned long)blender->key_count;
+    gblender_clear( blender );
+
+    key = keys + idx0;
+  }
 
 NewNode:
+  blender->stats.misses++;
+  blender->window_misses++;
+
   key->backfore   = backfore;
-  key->index      = (signed short)( idx * GBLENDER_SHADE_COUNT );
+  key->index      = (signed short)( ( key - keys ) * GBLENDER_SHADE_COUNT );
 
   gblender_reset_channel_key( blender, key );
 
-#ifdef GBLENDER_STATS
-  blender->stat_keys++;
+Exit:
+  key->stamp = clock;
+
+  return key;
+}
+
+
+GBLENDER_APIDEF( unsigned char* )
+gblender_lookup_channel( GBlender      blender,
+                         unsigned int  background,
+                         unsigned int  foreground )
+{
+  GBlenderChanKey  key = gblender_lookup_channel_key( blender,
+                                                      background,
+                                                      foreground,
+                                                      NULL, NULL );
+
+
+  if ( blender->window_lookups >= blender->window )
+    gblender_adapt( blender );
+
+  return (unsigned char*)blender->cells + key->index;
+}
+
+
+GBLENDER_APIDEF( void )
+gblender_lookup_channels( GBlender        blender,
+                          GBlenderPixel   background,
+                          GBlenderPixel   foreground,
+                          unsigned char*  cells[3] )
+{
+  GBlenderChanKey  kr, kg, kb;
+  unsigned long    flushes;
+
+
+  /* a flush drops the keys found before it; the second round fits */
+  do
+  {
+    flushes = blender->stats.flushes;
+
+    kr = gblender_lookup_channel_key( blender,
+                                      ( background >> 16 ) & 255,
+                                      ( foreground >> 16 ) & 255,
+                                      NULL, NULL );
+    kg = gblender_lookup_channel_key( blender,
+                                      ( background >> 8 ) & 255,
+                                      ( foreground >> 8 ) & 255,
+                                      kr, NULL );
+    kb = gblender_lookup_channel_key( blender,
+                                      background & 255,
+                                      foreground & 255,
+                                      kr, kg );
+  }
+  while ( blender->stats.flushes != flushes );
+
+  cells[0] = (unsigned char*)blender->cells + kr->index;
+  cells[1] = (unsigned char*)blender->cells + kg->index;
+  cells[2] = (unsigned char*)blender->cells + kb->index;
+
+  if ( blender->window_lookups >= blender->window )
+    gblender_adapt( blender );
+}
+
+
+ /* count a directly blended pixel, and prepare the foreground
+  */
+static void
+gblender_direct_pixel( GBlender       blender,
+                       GBlenderPixel  background,
+                       GBlenderPixel  foreground )
+{
+  if ( foreground != blender->direct_fore )
+  {
+    blender->direct_fore           = foreground;
+    blender->direct_fore_linear[0] = blender->gamma_ramp[( foreground >> 16 ) & 255];
+    blender->direct_fore_linear[1] = blender->gamma_ramp[( foreground >>  8 ) & 255];
+    blender->direct_fore_linear[2] = blender->gamma_ramp[  foreground         & 255];
+
+    blender->direct_back = ~0U;
+  }
+
+  if ( background != blender->direct_back )
+  {
+    blender->direct_back = background;
+    blender->direct_changes++;
+  }
+
+  blender->direct_pixels++;
+  blender->stats.direct++;
+}
+
+
+ /* one cell of `gblender_reset_key' or `gblender_reset_channel_key'
+  */
+static unsigned int
+gblender_blend( GBlender      blender,
+                unsigned int  fore_linear,
+                unsigned int  back,
+                unsigned int  nn )
+{
+  unsigned int  a = 255 * nn / ( GBLENDER_SHADE_COUNT - 1 );
+
+
+  if ( nn == 0 )
+    return back;
+
+  return blender->gamma_ramp_inv[( fore_linear * a +
+                                   blender->gamma_ramp[back] * ( 255 - a ) +
+                                   127 ) / 255];
+}
+
+
+GBLENDER_APIDEF( GBlenderCell* )
+gblender_direct( GBlender       blender,
+                 GBlenderPixel  background,
+                 GBlenderPixel  foreground,
+                 unsigned int   a )
+{
+  const GBlenderPixel*  fore;
+  unsigned int          r, g, b;
+
+
+  gblender_direct_pixel( blender, background, foreground );
+  fore = blender->direct_fore_linear;
+
+  r = gblender_blend( blender, fore[0], ( background >> 16 ) & 255, a );
+  g = gblender_blend( blender, fore[1], ( background >>  8 ) & 255, a );
+  b = gblender_blend( blender, fore[2],   background         & 255, a );
+
+#ifdef GBLENDER_STORE_BYTES
+  blender->direct_cells[a*3 + 0] = (unsigned char)r;
+  blender->direct_cells[a*3 + 1] = (unsigned char)g;
+  blender->direct_cells[a*3 + 2] = (unsigned char)b;
+#else
+  blender->direct_cells[a] = ( r << 16 ) | ( g << 8 ) | b;
 #endif
 
-Exit:
-  return  (unsigned char*)blender->cells + key->index;
+  if ( blender->direct_pixels >= GBLENDER_DIRECT_PERIOD )
+    gblender_adapt( blender );
+
+  return blender->direct_cells;
 }
 
 
+GBLENDER_APIDEF( unsigned char* )
+gblender_direct_channels( GBlender       blender,
+                          GBlenderPixel  background,
+                          GBlenderPixel  foreground,
+                          unsigned int   a )
+{
+  const GBlenderPixel*  fore;
+  unsigned char*        cells = (unsigned char*)blender->direct_cells;
+  unsigned int          ar    = ( a >> 16 ) & 255;
+  unsigned int          ag    = ( a >>  8 ) & 255;
+  unsigned int          ab    =   a         & 255;
+
+
+  gblender_direct_pixel( blender, background, foreground );
+  fore = blender->direct_fore_linear;
+
+  cells[ar] = (unsigned char)
+    gblender_blend( blender, fore[0], ( background >> 16 ) & 255, ar );
+  cells[GBLENDER_SHADE_COUNT + ag] = (unsigned char)
+    gblender_blend( blender, fore[1], ( background >>  8 ) & 255, ag );
+  cells[2*GBLENDER_SHADE_COUNT + ab] = (unsigned char)
+    gblender_blend( blender, fore[2],   background         & 255, ab );
+
+  if ( blender->direct_pixels >= GBLENDER_DIRECT_PERIOD )
+    gblender_adapt( blender );
+
+  return cells;
+}
+
+
+GBLENDER_APIDEF( void )
+gblender_direct_account( GBlender       blender,
+                         unsigned long  pixels,
+                         unsigned long  changes )
+{
+  blender->stats.direct   += pixels;
+  blender->direct_pixels  += pixels;
+  blender->direct_changes += changes;
+
+  if ( blender->direct && blender->direct_pixels >= GBLENDER_DIRECT_PERIOD )
+    gblender_adapt( blender );
+}
+
 
-#ifdef GBLENDER_STATS
 #include <stdio.h>
 GBLENDER_APIDEF( void )
 gblender_dump_stats( GBlender  blender )
 {
+  GBlenderStatsRec*  st = &blender->stats;
+
+
   printf( "GBlender cache statistics:\n" );
-  printf( "  Hit rate:    %.2f%% ( %ld out of %ld )\n",
-          100.0f * blender->stat_hits /
-                   ( blender->stat_hits + blender->stat_lookups ),
-          blender->stat_hits,
-          blender->stat_hits + blender->stat_lookups );
-
-  printf( "  Lookup rate: %.2f%% ( %ld out of %ld )\n",
-          100.0f * ( blender->stat_lookups - blender->stat_keys ) /
-                   blender->stat_lookups,
-          blender->stat_lookups - blender->stat_keys,
-          blender->stat_lookups );
-  printf( "  Keys used:   %ld\n  Caches full: %ld\n",
-          blender->stat_keys, blender->stat_clears );
-}
+  printf( "  Keys:        %d, %s policy\n",
+          blender->key_count,
+          blender->policy == GBLENDER_POLICY_LRU ? "LRU" : "flush" );
+  printf( "  Hit rate:    %.2f%% ( %lu out of %lu )\n",
+          st->lookups ? 100.0 * st->hits / st->lookups : 0.0,
+          st->hits,
+          st->lookups );
+  printf( "  Misses:      %lu\n  Evictions:   %lu\n  Flushes:     %lu\n",
+          st->misses, st->evictions, st->flushes );
+  printf( "  Direct:      %lu pixels, %lu mode switches\n",
+          st->direct, st->switches );
+#ifdef GBLENDER_STATS
+  printf( "  Pixel hits:  %ld\n", blender->stat_hits );
 #endif
+}
@@ -21,7 +21,10 @@
 #define  GBLENDER_SHADE_BITS      4   /* must be <= 7 !! */
 #define  GBLENDER_SHADE_COUNT     ( 1 << GBLENDER_SHADE_BITS )
 #define  GBLENDER_SHADE_INDEX(n)  (((n) * (GBLENDER_SHADE_COUNT-1) + 128) >> 8)
-#define  GBLENDER_KEY_COUNT       256  /* must be a power of 2 */
+#define  GBLENDER_KEY_COUNT       256  /* default, must be a power of 2 */
+#define  GBLENDER_KEY_MIN         16
+#define  GBLENDER_KEY_MAX         1024 /* must be a power of 2 */
+#define  GBLENDER_PROBE_COUNT     8    /* keys scanned by the LRU policy */
 #define  GBLENDER_GAMMA_SHIFT     2
 
 #define  xGBLENDER_STORE_BYTES  /* define this to store (R,G,B) values on 3
@@ -31,8 +34,9 @@
                                 * Go figure what's really happening though :-)
                                 */
 
-#define  xGBLENDER_STATS        /* define this to collect statistics in the
-                                * blender
+#define  xGBLENDER_STATS        /* define this to count the cache hits of
+                                * every pixel; see `GBlenderStatsRec' for
+                                * the counters that are always available
                                 */
 
   typedef unsigned int    GBlenderPixel;  /* needs 32-bits here !! */
@@ -58,6 +62,7 @@
     GBlenderPixel  background;
     GBlenderPixel  foreground;
     GBlenderCell*  cells;
+    unsigned int   stamp;      /* time of last use, for GBLENDER_POLICY_LRU */
 
   } GBlenderKeyRec, *GBlenderKey;
 
@@ -66,14 +71,53 @@
   {
     unsigned short  backfore;  /* (fore << 8) | back               */
     signed short    index;     /* offset in (unsigned char*)cells  */
+    unsigned int    stamp;
 
   } GBlenderChanKeyRec, *GBlenderChanKey;
 
 
+ /* what to do when a new key doesn't fit in the table
+  */
+  typedef enum
+  {
+    GBLENDER_POLICY_FLUSH = 0,  /* clear the whole table                  */
+    GBLENDER_POLICY_LRU,        /* replace the least recently used key    */
+                                /* among GBLENDER_PROBE_COUNT candidates  */
+    GBLENDER_POLICY_MAX
+
+  } GBlenderPolicy;
+
+
+ /* when to blend pixels one by one instead of caching whole cell rows
+  */
+  typedef enum
+  {
+    GBLENDER_DIRECT_AUTO = 0,   /* if the miss rate is too high  */
+    GBLENDER_DIRECT_NEVER,
+    GBLENDER_DIRECT_ALWAYS,
+
+    GBLENDER_DIRECT_MAX
+
+  } GBlenderDirect;
+
+
+  typedef struct
+  {
+    unsigned long  lookups;    /* key table lookups                        */
+    unsigned long  hits;       /* lookups that found their key             */
+    unsigned long  misses;     /* lookups that computed a new cell row     */
+    unsigned long  evictions;  /* keys replaced or dropped by a flush      */
+    unsigned long  flushes;    /* complete table clears                    */
+    unsigned long  direct;     /* pixels blended without the cache         */
+    unsigned long  switches;   /* changes between cached and direct mode   */
+
+  } GBlenderStatsRec, *GBlenderStats;
+
+
   typedef struct GBlenderRec_
   {
-    GBlenderKeyRec        keys [ GBLENDER_KEY_COUNT ];
-    GBlenderCell          cells[ GBLENDER_KEY_COUNT*GBLENDER_SHADE_COUNT*GBLENDER_CELL_SIZE ];
+    GBlenderKeyRec        keys [ GBLENDER_KEY_MAX ];
+    GBlenderCell          cells[ GBLENDER_KEY_MAX*GBLENDER_SHADE_COUNT*GBLENDER_CELL_SIZE ];
 
    /* a small cache for normal modes
     */
@@ -103,23 +147,65 @@
     */
     unsigned short        gamma_ramp[256];                              /* voltage to linear */
     unsigned char         gamma_ramp_inv[256 << GBLENDER_GAMMA_SHIFT];  /* linear to voltage */
+    double                gamma;                                        /* of the ramps      */
+
+   /* cache configuration
+    */
+    int                   key_count;    /* power of 2, <= GBLENDER_KEY_MAX */
+    GBlenderPolicy        policy;
+    GBlenderDirect        direct_mode;
+
+   /* cache state; `direct' is set while blending without the cache
+    */
+    int                   direct;
+    unsigned int          clock;
+    unsigned long         window;         /* lookups between evaluations  */
+    unsigned long         window_lookups;
+    unsigned long         window_misses;
+    unsigned int          miss_rate;      /* last one measured, in 1/256  */
+    unsigned long         direct_pixels;  /* since the last evaluation    */
+    unsigned long         direct_changes;
+    GBlenderPixel         direct_back;
+    GBlenderPixel         direct_fore;
+    GBlenderPixel         direct_fore_linear[3];
+    GBlenderCell          direct_cells[ 3*GBLENDER_SHADE_COUNT*GBLENDER_CELL_SIZE ];
+
+    GBlenderStatsRec      stats;
 
 #ifdef GBLENDER_STATS
     long                  stat_hits;    /* number of direct hits             */
-    long                  stat_lookups; /* number of table lookups           */
-    long                  stat_keys;    /* number of table key recomputation */
-    long                  stat_clears;  /* number of table clears            */
 #endif
 
   } GBlenderRec, *GBlender;
 
 
- /* initialize with a given gamma */
+ /* initialize with a given gamma; the cache gets its default settings */
   GBLENDER_API( void )
   gblender_init( GBlender  blender,
                  double    gamma );
 
 
+ /* set the number of keys (a power of 2 between GBLENDER_KEY_MIN and
+  * GBLENDER_KEY_MAX) and the replacement policy; this clears the cache.
+  * Return 0 on success, -1 for invalid arguments.
+  */
+  GBLENDER_API( int )
+  gblender_set_cache( GBlender        blender,
+                      int             key_count,
+                      GBlenderPolicy  policy );
+
+  GBLENDER_API( void )
+  gblender_set_direct( GBlender        blender,
+                       GBlenderDirect  mode );
+
+  GBLENDER_API( void )
+  gblender_get_stats( GBlender       blender,
+                      GBlenderStats  stats );
+
+  GBLENDER_API( void )
+  gblender_reset_stats( GBlender  blender );
+
+
  /* clear blender, and reset stats */
   GBLENDER_API( void )
   gblender_reset( GBlender  blender );
@@ -141,12 +227,43 @@
                            unsigned int  background,
                            unsigned int  foreground );
 
-#ifdef GBLENDER_STATS
+ /* lookup the cell ranges of all three channels at once; contrary to
+  * three calls of `gblender_lookup_channel', a lookup never drops the
+  * range of another channel.  Pixels are 0xRRGGBB.
+  */
+  GBLENDER_API( void )
+  gblender_lookup_channels( GBlender        blender,
+                            GBlenderPixel   background,
+                            GBlenderPixel   foreground,
+                            unsigned char*  cells[3] );
+
+ /* compute cell `a' only, in `blender->direct_cells'; this is used
+  * instead of the lookup functions while `blender->direct' is set
+  */
+  GBLENDER_API( GBlenderCell* )
+  gblender_direct( GBlender       blender,
+                   GBlenderPixel  background,
+                   GBlenderPixel  foreground,
+                   unsigned int   a );
+
+ /* the same for channels; `a' holds three shade indices like a pixel,
+  * and the three cell ranges start at the returned address, separated
+  * by GBLENDER_SHADE_COUNT bytes
+  */
+  GBLENDER_API( unsigned char* )
+  gblender_direct_channels( GBlender       blender,
+                            GBlenderPixel  background,
+                            GBlenderPixel  foreground,
+                            unsigned int   a );
+
+ /* account for pixels blended directly by other means */
+  GBLENDER_API( void )
+  gblender_direct_account( GBlender       blender,
+                           unsigned long  pixels,
+                           unsigned long  changes );
+
   GBLENDER_API( void )
   gblender_dump_stats( GBlender  blender );
-#else
-# define gblender_dump_stats(b)  do { } while (0)
-#endif
 
 #ifdef GBLENDER_STATS
 #define GBLENDER_STAT_HIT(gb)   (gb)->stat_hits++
@@ -156,20 +273,27 @@
 
 
   /* no final `;'! */
-#define  GBLENDER_VARS(_gb,_fore)                                                                                              \
-  GBlenderPixel    _gback  = (_gb)->cache_back;                                                                                \
-  GBlenderCell*    _gcells = ( (_fore) == (_gb)->cache_fore ? (_gb)->cache_cells : gblender_lookup( (_gb), _gback, _fore ) );  \
+  /* a different foreground invalidates the cached background */
+#define  GBLENDER_VARS(_gb,_fore)                                                             \
+  GBlenderPixel    _gback  = ( (_fore) == (_gb)->cache_fore ? (_gb)->cache_back : ~0U );    \
+  GBlenderCell*    _gcells = (_gb)->cache_cells;                                             \
   GBlenderPixel    _gfore  = (_fore)
 
-#define  GBLENDER_LOOKUP(gb,back)                         \
-   GBLENDER_STAT_HIT(gb);                                 \
-   do                                                     \
-   {                                                      \
-     if ( _gback != (GBlenderPixel)(back) )               \
-     {                                                    \
-       _gback  = (GBlenderPixel)(back);                   \
-       _gcells = gblender_lookup( (gb), _gback, _gfore ); \
-     }                                                    \
+  /* `a' is the shade index of the pixel to be blended */
+#define  GBLENDER_LOOKUP(gb,back,a)                            \
+   GBLENDER_STAT_HIT(gb);                                      \
+   do                                                          \
+   {                                                           \
+     if ( (gb)->direct )                                       \
+     {                                                         \
+       _gback  = ~0U;                                          \
+       _gcells = gblender_direct( (gb), (back), _gfore, (a) ); \
+     }                                                         \
+     else if ( _gback != (GBlenderPixel)(back) )               \
+     {                                                         \
+       _gback  = (GBlenderPixel)(back);                        \
+       _gcells = gblender_lookup( (gb), _gback, _gfore );      \
+     }                                                         \
    } while ( 0 )
 
 #define  GBLENDER_CLOSE(_gb)     \
@@ -180,15 +304,18 @@
 
 
   /* no final `;'! */
-#define  GBLENDER_CHANNEL_VARS(_gb,_rfore,_gfore,_bfore)                                                                                        \
-  unsigned int     _grback  = (_gb)->cache_r_back;                                                                                              \
-  unsigned char*   _grcells = ( (_rfore) == (_gb)->cache_r_fore ? (_gb)->cache_r_cells : gblender_lookup_channel( (_gb), _grback, _rfore ));    \
-  unsigned int     _grfore  = (_rfore);                                                                                                         \
-  unsigned int     _ggback  = (_gb)->cache_g_back;                                                                                              \
-  unsigned char*   _ggcells = ( (_gfore) == (_gb)->cache_g_fore ? (_gb)->cache_g_cells : gblender_lookup_channel( (_gb), _ggback, _gfore ));    \
-  unsigned int     _ggfore  = (_gfore);                                                                                                         \
-  unsigned int     _gbback  = (_gb)->cache_b_back;                                                                                              \
-  unsigned char*   _gbcells = ( (_bfore) == (_gb)->cache_b_fore ? (_gb)->cache_b_cells : gblender_lookup_channel( (_gb), _gbback, _bfore ));    \
+#define  GBLENDER_CHANNEL_VARS(_gb,_rfore,_gfore,_bfore)                         \
+  int              _gsame   = ( (_rfore) == (_gb)->cache_r_fore &&              \
+                                (_gfore) == (_gb)->cache_g_fore &&              \
+                                (_bfore) == (_gb)->cache_b_fore );              \
+  unsigned int     _grback  = ( _gsame ? (_gb)->cache_r_back : ~0U );           \
+  unsigned char*   _grcells = (_gb)->cache_r_cells;                             \
+  unsigned int     _grfore  = (_rfore);                                         \
+  unsigned int     _ggback  = ( _gsame ? (_gb)->cache_g_back : ~0U );           \
+  unsigned char*   _ggcells = (_gb)->cache_g_cells;                             \
+  unsigned int     _ggfore  = (_gfore);                                         \
+  unsigned int     _gbback  = ( _gsame ? (_gb)->cache_b_back : ~0U );           \
+  unsigned char*   _gbcells = (_gb)->cache_b_cells;                             \
   unsigned int     _gbfore  = (_bfore)
 
 #define  GBLENDER_CHANNEL_CLOSE(_gb)   \
@@ -200,40 +327,45 @@
   (_gb)->cache_g_cells = _ggcells;     \
   (_gb)->cache_b_back  = _gbback;      \
   (_gb)->cache_b_fore  = _gbfore;      \
-  (_gb)->cache_b_cells = _gbcells
-
-
-#define  GBLENDER_LOOKUP_R(gb,back)                                  \
-   GBLENDER_STAT_HIT(gb);                                            \
-   do                                                                \
-   {                                                                 \
-     if ( _grback != (back) )                                        \
-     {                                                               \
-       _grback  = (GBlenderPixel)(back);                             \
-       _grcells = gblender_lookup_channel( (gb), _grback, _grfore ); \
-     }                                                               \
-   } while ( 0 )
-
-#define  GBLENDER_LOOKUP_G(gb,back)                                  \
-   GBLENDER_STAT_HIT(gb);                                            \
-   do                                                                \
-   {                                                                 \
-     if ( _ggback != (back) )                                        \
-     {                                                               \
-       _ggback  = (GBlenderPixel)(back);                             \
-       _ggcells = gblender_lookup_channel( (gb), _ggback, _ggfore ); \
-     }                                                               \
-   } while ( 0 )
-
-#define  GBLENDER_LOOKUP_B(gb,back)                                  \
-   GBLENDER_STAT_HIT(gb);                                            \
-   do                                                                \
-   {                                                                 \
-     if ( _gbback != (back) )                                        \
-     {                                                               \
-       _gbback  = (GBlenderPixel)(back);                             \
-       _gbcells = gblender_lookup_channel( (gb), _gbback, _gbfore ); \
-     }                                                               \
+  (_gb)->cache_b_cells = _gbcells;     \
+  (void)_gsame
+
+
+  /* `back' and `aa' hold the background channels and the shade    */
+  /* indices as 0xRRGGBB                                            */
+#define  GBLENDER_LOOKUP_RGB(gb,back,aa)                                      \
+   GBLENDER_STAT_HIT(gb);                                                     \
+   do                                                                         \
+   {                                                                          \
+     if ( (gb)->direct )                                                      \
+     {                                                                        \
+       _grback  = ~0U;                                                        \
+       _grcells = gblender_direct_channels( (gb), (back),                     \
+                                            ( _grfore << 16 ) |               \
+                                            ( _ggfore <<  8 ) | _gbfore,      \
+                                            (aa) );                           \
+       _ggcells = _grcells + GBLENDER_SHADE_COUNT;                            \
+       _gbcells = _ggcells + GBLENDER_SHADE_COUNT;                            \
+     }                                                                        \
+     else if ( _grback != ( ( (back) >> 16 ) & 255 ) ||                       \
+               _ggback != ( ( (back) >>  8 ) & 255 ) ||                       \
+               _gbback != (   (back)         & 255 ) )                        \
+     {                                                                        \
+       unsigned char*  _gc[3];                                                \
+                                                                              \
+                                                                              \
+       _grback = ( (back) >> 16 ) & 255;                                      \
+       _ggback = ( (back) >>  8 ) & 255;                                      \
+       _gbback =   (back)         & 255;                                      \
+                                                                              \
+       gblender_lookup_channels( (gb), (back),                                \
+                                 ( _grfore << 16 ) |                          \
+                                 ( _ggfore <<  8 ) | _gbfore,                 \
+                                 _gc );                                       \
+       _grcells = _gc[0];                                                     \
+       _ggcells = _gc[1];                                                     \
+       _gbcells = _gc[2];                                                     \
+     }                                                                        \
    } while ( 0 )
 
 
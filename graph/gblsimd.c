@@ -0,0 +1,439 @@
+/****************************************************************************/
+/*                                                                          */
+/*  The FreeType project -- a free and portable quality TrueType renderer.  */
+/*                                                                          */
+/*  Copyright (C) 2022 by                                                   */
+/*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
+/*                                                                          */
+/*  gblsimd.c: SIMD versions of the RGB32 blitters, with runtime selection  */
+/*             of the instruction set.                                      */
+/*                                                                          */
+/****************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "grobjs.h"
+#include "gblblit.h"
+
+
+/* the vector routines only know how to store 32-bit cells */
+#ifndef GBLENDER_STORE_BYTES
+
+#if defined( __SSE2__ ) || defined( _M_X64 )                 || \
+    ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define GBLENDER_SIMD_X86
+#endif
+
+#if defined( GBLENDER_SIMD_X86 )                                   && \
+    ( ( defined( __GNUC__ ) &&                                        \
+        ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) ) ) || \
+      defined( __clang__ ) || defined( _MSC_VER ) )
+#define GBLENDER_SIMD_X86_AVX2
+#endif
+
+#if defined( __aarch64__ ) || defined( _M_ARM64 )
+#define GBLENDER_SIMD_NEON
+#endif
+
+#endif /* !GBLENDER_STORE_BYTES */
+
+
+#ifdef GBLENDER_SIMD_X86
+
+#include <emmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* SSE2, always available on x86_64                                     */
+  /*                                                                       */
+
+static __inline __m128i
+gv_load_bytes_sse2( const unsigned char*  p )
+{
+  const __m128i  zero = _mm_setzero_si128();
+  int            x;
+
+
+  memcpy( &x, p, 4 );
+
+  return _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( x ),
+                                                zero ),
+                             zero );
+}
+
+
+static __inline __m128i
+gv_select_sse2( __m128i  m,
+                __m128i  a,
+                __m128i  b )
+{
+  return _mm_or_si128( _mm_and_si128( m, a ), _mm_andnot_si128( m, b ) );
+}
+
+
+#define GV_GATHER_SSE2( name, type )                                  \
+  static __inline __m128i                                             \
+  name( const type*  table,                                           \
+        __m128i      idx )                                            \
+  {                                                                   \
+    unsigned int  i[4];                                               \
+                                                                      \
+                                                                      \
+    _mm_storeu_si128( (__m128i*)i, idx );                             \
+                                                                      \
+    return _mm_set_epi32( (int)table[i[3]], (int)table[i[2]],         \
+                          (int)table[i[1]], (int)table[i[0]] );       \
+  }
+
+GV_GATHER_SSE2( gv_gather32_sse2, GBlenderPixel  )
+GV_GATHER_SSE2( gv_gather16_sse2, unsigned short )
+GV_GATHER_SSE2( gv_gather8_sse2,  unsigned char  )
+
+
+#define GV_T                __m128i
+#define GV_N                4
+#define GV_NAME( x )        x ## sse2
+#define GV_TARGET           /* baseline */
+#define GV_LOADU( p )       _mm_loadu_si128( (const __m128i*)(const void*)(p) )
+#define GV_STOREU( p, v )   _mm_storeu_si128( (__m128i*)(void*)(p), v )
+#define GV_LOAD_BYTES( p )  gv_load_bytes_sse2( p )
+#define GV_LANES( a )       _mm_set_epi32( (int)(a)[3], (int)(a)[2], \
+                                           (int)(a)[1], (int)(a)[0] )
+#define GV_SET1( x )        _mm_set1_epi32( (int)(x) )
+#define GV_AND( a, b )      _mm_and_si128( a, b )
+#define GV_OR( a, b )       _mm_or_si128( a, b )
+#define GV_ADD( a, b )      _mm_add_epi32( a, b )
+#define GV_SUB( a, b )      _mm_sub_epi32( a, b )
+#define GV_SRL( v, n )      _mm_srli_epi32( v, n )
+#define GV_SLL( v, n )      _mm_slli_epi32( v, n )
+#define GV_MUL16( a, b )    _mm_madd_epi16( a, b )
+#define GV_EQ( a, b )       _mm_cmpeq_epi32( a, b )
+#define GV_SELECT( m, a, b )  gv_select_sse2( m, a, b )
+#define GV_ALL( m )         ( _mm_movemask_epi8( m ) == 0xFFFF )
+#define GV_GATHER32( t, i ) gv_gather32_sse2( t, i )
+#define GV_GATHER16( t, i ) gv_gather16_sse2( t, i )
+#define GV_GATHER8( t, i )  gv_gather8_sse2( t, i )
+
+#include "gblvec.h"
+
+#endif /* GBLENDER_SIMD_X86 */
+
+
+#ifdef GBLENDER_SIMD_X86_AVX2
+
+#include <immintrin.h>
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* AVX2, compiled for the instruction set on demand                     */
+  /*                                                                       */
+
+#ifdef _MSC_VER
+#define GV_AVX2  /* nothing */
+#else
+#define GV_AVX2  __attribute__(( target( "avx2" ) ))
+#endif
+
+
+static __inline __m256i GV_AVX2
+gv_load_bytes_avx2( const unsigned char*  p )
+{
+  return _mm256_cvtepu8_epi32(
+           _mm_loadl_epi64( (const __m128i*)(const void*)p ) );
+}
+
+
+/*
+ * The hardware gathers always load 32 bits.  The tables used with 16-bit
+ * and 8-bit entries are all embedded in a `GBlenderRec', and the
+ * addresses are arranged so that the extra bytes read stay within it:
+ * for a `gamma_ramp' entry, the two following bytes are read (the last
+ * entry is followed by `gamma_ramp_inv'); for bytes, the three preceding
+ * bytes are read (`gamma_ramp_inv' is preceded by `gamma_ramp', and the
+ * channel cells are part of the `cells' array, preceded by `keys').
+ */
+#define GV_T                __m256i
+#define GV_N                8
+#define GV_NAME( x )        x ## avx2
+#define GV_TARGET           GV_AVX2
+#define GV_LOADU( p )       _mm256_loadu_si256( (const __m256i*)(const void*)(p) )
+#define GV_STOREU( p, v )   _mm256_storeu_si256( (__m256i*)(void*)(p), v )
+#define GV_LOAD_BYTES( p )  gv_load_bytes_avx2( p )
+#define GV_LANES( a )       _mm256_set_epi32( (int)(a)[7], (int)(a)[6], \
+                                              (int)(a)[5], (int)(a)[4], \
+                                              (int)(a)[3], (int)(a)[2], \
+                                              (int)(a)[1], (int)(a)[0] )
+#define GV_SET1( x )        _mm256_set1_epi32( (int)(x) )
+#define GV_AND( a, b )      _mm256_and_si256( a, b )
+#define GV_OR( a, b )       _mm256_or_si256( a, b )
+#define GV_ADD( a, b )      _mm256_add_epi32( a, b )
+#define GV_SUB( a, b )      _mm256_sub_epi32( a, b )
+#define GV_SRL( v, n )      _mm256_srli_epi32( v, n )
+#define GV_SLL( v, n )      _mm256_slli_epi32( v, n )
+#define GV_MUL16( a, b )    _mm256_madd_epi16( a, b )
+#define GV_EQ( a, b )       _mm256_cmpeq_epi32( a, b )
+#define GV_SELECT( m, a, b )  _mm256_blendv_epi8( b, a, m )
+#define GV_ALL( m )         ( _mm256_movemask_epi8( m ) == -1 )
+#define GV_GATHER32( t, i ) _mm256_i32gather_epi32( (const int*)(t), i, 4 )
+#define GV_GATHER16( t, i )                                              \
+          _mm256_and_si256(                                              \
+            _mm256_i32gather_epi32( (const int*)(const void*)(t), i, 2 ), \
+            _mm256_set1_epi32( 0xFFFF ) )
+#define GV_GATHER8( t, i )                                               \
+          _mm256_srli_epi32(                                             \
+            _mm256_i32gather_epi32(                                      \
+              (const int*)(const void*)( (const unsigned char*)(t) - 3 ), \
+              i, 1 ),                                                    \
+            24 )
+
+#include "gblvec.h"
+
+
+static int
+gv_has_avx2( void )
+{
+#ifdef _MSC_VER
+  int  info[4];
+
+
+  __cpuid( info, 0 );
+  if ( info[0] < 7 )
+    return 0;
+
+  /* OSXSAVE and AVX, then YMM state enabled by the OS */
+  __cpuid( info, 1 );
+  if ( ( info[2] & 0x18000000 ) != 0x18000000 )
+    return 0;
+  if ( ( _xgetbv( 0 ) & 6 ) != 6 )
+    return 0;
+
+  __cpuidex( info, 7, 0 );
+  return ( info[1] & 0x20 ) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports( "avx2" );
+#endif
+}
+
+#endif /* GBLENDER_SIMD_X86_AVX2 */
+
+
+#ifdef GBLENDER_SIMD_NEON
+
+#include <arm_neon.h>
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* NEON, always available on AArch64                                    */
+  /*                                                                       */
+
+static __inline uint32x4_t
+gv_load_bytes_neon( const unsigned char*  p )
+{
+  uint32_t  x;
+
+
+  memcpy( &x, p, 4 );
+
+  return vmovl_u16( vget_low_u16(
+                      vmovl_u8( vreinterpret_u8_u32( vdup_n_u32( x ) ) ) ) );
+}
+
+
+#define GV_GATHER_NEON( name, type )                     \
+  static __inline uint32x4_t                             \
+  name( const type*  table,                              \
+        uint32x4_t   idx )                               \
+  {                                                      \
+    uint32_t  i[4];                                      \
+                                                         \
+                                                         \
+    vst1q_u32( i, idx );                                 \
+    i[0] = table[i[0]];                                  \
+    i[1] = table[i[1]];                                  \
+    i[2] = table[i[2]];                                  \
+    i[3] = table[i[3]];                                  \
+                                                         \
+    return vld1q_u32( i );                               \
+  }
+
+GV_GATHER_NEON( gv_gather32_neon, GBlenderPixel  )
+GV_GATHER_NEON( gv_gather16_neon, unsigned short )
+GV_GATHER_NEON( gv_gather8_neon,  unsigned char  )
+
+
+#define GV_T                uint32x4_t
+#define GV_N                4
+#define GV_NAME( x )        x ## neon
+#define GV_TARGET           /* baseline */
+#define GV_LOADU( p )       vreinterpretq_u32_u8( vld1q_u8( (const uint8_t*)(p) ) )
+#define GV_STOREU( p, v )   vst1q_u8( (uint8_t*)(p), vreinterpretq_u8_u32( v ) )
+#define GV_LOAD_BYTES( p )  gv_load_bytes_neon( p )
+#define GV_LANES( a )       vld1q_u32( a )
+#define GV_SET1( x )        vdupq_n_u32( (uint32_t)(x) )
+#define GV_AND( a, b )      vandq_u32( a, b )
+#define GV_OR( a, b )       vorrq_u32( a, b )
+#define GV_ADD( a, b )      vaddq_u32( a, b )
+#define GV_SUB( a, b )      vsubq_u32( a, b )
+#define GV_SRL( v, n )      vshrq_n_u32( v, n )
+#define GV_SLL( v, n )      vshlq_n_u32( v, n )
+#define GV_MUL16( a, b )    vmulq_u32( a, b )
+#define GV_EQ( a, b )       vceqq_u32( a, b )
+#define GV_SELECT( m, a, b )  vbslq_u32( m, a, b )
+#define GV_ALL( m )         ( vminvq_u32( m ) == 0xFFFFFFFFU )
+#define GV_GATHER32( t, i ) gv_gather32_neon( t, i )
+#define GV_GATHER16( t, i ) gv_gather16_neon( t, i )
+#define GV_GATHER8( t, i )  gv_gather8_neon( t, i )
+
+#include "gblvec.h"
+
+#endif /* GBLENDER_SIMD_NEON */
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* runtime selection                                                     */
+  /*                                                                       */
+
+static const char*  gblender_simd_names[GBLENDER_SIMD_MAX] =
+{
+  "none",
+  "sse2",
+  "avx2",
+  "neon"
+};
+
+
+/* GBLENDER_SIMD_MAX until the first call to `gblender_simd_get' */
+static GBlenderSimd  gblender_simd = GBLENDER_SIMD_MAX;
+
+
+GBLENDER_APIDEF( int )
+gblender_simd_supported( GBlenderSimd  level )
+{
+  switch ( level )
+  {
+  case GBLENDER_SIMD_NONE:
+    return 1;
+
+#ifdef GBLENDER_SIMD_X86
+  case GBLENDER_SIMD_SSE2:
+    return 1;
+#endif
+
+#ifdef GBLENDER_SIMD_X86_AVX2
+  case GBLENDER_SIMD_AVX2:
+    return gv_has_avx2();
+#endif
+
+#ifdef GBLENDER_SIMD_NEON
+  case GBLENDER_SIMD_NEON:
+    return 1;
+#endif
+
+  default:
+    return 0;
+  }
+}
+
+
+GBLENDER_APIDEF( GBlenderSimd )
+gblender_simd_set( GBlenderSimd  level )
+{
+  if ( !gblender_simd_supported( level ) )
+    level = GBLENDER_SIMD_NONE;
+
+  gblender_simd = level;
+
+  return level;
+}
+
+
+GBLENDER_APIDEF( GBlenderSimd )
+gblender_simd_get( void )
+{
+  if ( gblender_simd == GBLENDER_SIMD_MAX )
+  {
+    const char*   env   = getenv( "GBLENDER_SIMD" );
+    GBlenderSimd  level = GBLENDER_SIMD_NONE;
+    int           n;
+
+
+    if ( env && *env )
+    {
+      for ( n = 0; n < GBLENDER_SIMD_MAX; n++ )
+        if ( !strcmp( env, gblender_simd_names[n] ) )
+        {
+          level = (GBlenderSimd)n;
+          break;
+        }
+    }
+    else
+    {
+      /* the best one available */
+      for ( n = GBLENDER_SIMD_MAX - 1; n > GBLENDER_SIMD_NONE; n-- )
+        if ( gblender_simd_supported( (GBlenderSimd)n ) )
+        {
+          level = (GBlenderSimd)n;
+          break;
+        }
+    }
+
+    gblender_simd_set( level );
+  }
+
+  return gblender_simd;
+}
+
+
+GBLENDER_APIDEF( const char* )
+gblender_simd_name( GBlenderSimd  level )
+{
+  if ( level < 0 || level >= GBLENDER_SIMD_MAX )
+    return "unknown";
+
+  return gblender_simd_names[level];
+}
+
+
+GBLENDER_APIDEF( GBlenderBlitFunc )
+gblender_simd_blit_func( GBlenderSourceFormat  src_format,
+                         GBlenderTargetFormat  dst_format )
+{
+  if ( dst_format != GBLENDER_TARGET_RGB32 )
+    return NULL;
+
+  switch ( gblender_simd_get() )
+  {
+#ifdef GBLENDER_SIMD_X86
+  case GBLENDER_SIMD_SSE2:
+    return blit_funcs_rgb32_sse2[src_format];
+#endif
+
+#ifdef GBLENDER_SIMD_X86_AVX2
+  case GBLENDER_SIMD_AVX2:
+    return blit_funcs_rgb32_avx2[src_format];
+#endif
+
+#ifdef GBLENDER_SIMD_NEON
+  case GBLENDER_SIMD_NEON:
+    return blit_funcs_rgb32_neon[src_format];
+#endif
+
+  default:
+    (void)src_format;
+    return NULL;
+  }
+}
+
+
+/* End */
@@ -0,0 +1,628 @@
+/****************************************************************************/
+/*                                                                          */
+/*  The FreeType project -- a free and portable quality TrueType renderer.  */
+/*                                                                          */
+/*  Copyright (C) 2022 by                                                   */
+/*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
+/*                                                                          */
+/*  gblvec.h: vectorized RGB32 blitters, to be included by `gblsimd.c'      */
+/*            once per instruction set, like `gblany.h'.                    */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * The including file defines a small set of operations on a vector
+ * `GV_T' of `GV_N' 32-bit lanes, each lane holding one pixel:
+ *
+ *   GV_NAME(x)          x, decorated with the instruction set name
+ *   GV_TARGET           function attributes needed for the instructions
+ *   GV_LOADU(p)         load GV_N pixels from `p'
+ *   GV_STOREU(p,v)      store GV_N pixels to `p'
+ *   GV_LOAD_BYTES(p)    load GV_N bytes from `p', zero-extended to lanes
+ *   GV_LANES(a)         build a vector from array `a' of GV_N pixels that
+ *                       have just been computed (a plain load would stall
+ *                       on store forwarding)
+ *   GV_SET1(x)          broadcast `x'
+ *   GV_AND, GV_OR       bitwise operations
+ *   GV_ADD, GV_SUB      32-bit arithmetic
+ *   GV_SRL(v,n)         logical shifts by a constant
+ *   GV_SLL(v,n)
+ *   GV_MUL16(a,b)       product of lanes that are both in the range
+ *                       [0;32767]
+ *   GV_EQ(a,b)          all bits set in lanes where `a' equals `b'
+ *   GV_SELECT(m,a,b)    `a' in lanes where mask `m' is set, else `b'
+ *   GV_ALL(m)           true if mask `m' is set in all lanes
+ *   GV_GATHER32(t,i)    t[i] for `GBlenderPixel' table `t'
+ *   GV_GATHER16(t,i)    t[i] for `unsigned short' table `t'
+ *   GV_GATHER8(t,i)     t[i] for `unsigned char' table `t'
+ *
+ * The results are bit-identical to the generic routines of `gblany.h'.
+ * Runs of pixels that overlay a uniform background use the blender's
+ * cell cache like the generic code; other runs are blended directly in
+ * linear space, using
+ *
+ *   (F * 17n + B * (255 - 17n) + 127) / 255 == (F * n + B * (15 - n) + 7) / 15
+ *
+ * for shade index `n' and linear values `F' and `B' (the right-hand side
+ * never exceeds 15 bits), and
+ *
+ *   x / 255 == (x + 1 + (x >> 8)) >> 8       for 0 <= x <= 65535
+ *   x / 15  == ((x + 1) * 4369) >> 16        for 0 <= x <  65535
+ *
+ * for the divisions.  Remaining pixels at the end of a row are handled
+ * one by one.
+ */
+
+#if GBLENDER_SHADE_COUNT != 16
+#error "gblvec.h needs 16 shades"
+#endif
+
+#undef  GV_SHADE_INDEX
+#define GV_SHADE_INDEX( v )  GV_SRL( GV_ADD( GV_MUL16( (v), GV_SET1( 15 ) ), \
+                                             GV_SET1( 128 ) ), 8 )
+
+  /* gamma_ramp_inv[(F * n + B * (15 - n) + 7) / 15] */
+#undef  GV_BLEND
+#define GV_BLEND( F, B, n, in )                                          \
+          GV_GATHER8( inv,                                               \
+                      GV_SRL( GV_MUL16( GV_ADD( GV_ADD( GV_MUL16( F, n ),  \
+                                                        GV_MUL16( B, in ) ), \
+                                                GV_SET1( 8 ) ),          \
+                                        GV_SET1( 4369 ) ), 16 ) )
+
+
+/* Return the first pixel of `back' whose lane is not set in mask `ok'. */
+static GBlenderPixel GV_TARGET
+GV_NAME( _gv_first_miss_ )( GV_T  back,
+                            GV_T  ok )
+{
+  GBlenderPixel  pixels[GV_N];
+  GBlenderPixel  mask[GV_N];
+  int            n;
+
+
+  GV_STOREU( (unsigned char*)pixels, back );
+  GV_STOREU( (unsigned char*)mask, ok );
+
+  for ( n = 0; n < GV_N - 1; n++ )
+    if ( !mask[n] )
+      break;
+
+  return pixels[n];
+}
+
+
+/*
+ * While the blender is in direct mode, the vector routines blend all
+ * runs arithmetically.  They only count the background changes to let
+ * the blender decide whether the cache would be worth it again.
+ */
+static void GV_TARGET
+GV_NAME( _gv_direct_ )( GV_T            back,
+                        GV_T            skip,
+                        GBlenderPixel*  last,
+                        unsigned long*  changes )
+{
+  GV_T  same = GV_OR( GV_EQ( back, GV_SET1( *last ) ), skip );
+
+
+  if ( !GV_ALL( same ) )
+  {
+    *last = GV_NAME( _gv_first_miss_ )( back, same );
+    (*changes)++;
+  }
+}
+
+
+static void GV_TARGET
+GV_NAME( _gblender_blit_gray8_rgb32_ )( GBlenderBlit  blit,
+                                        grColor       color )
+{
+  GBlender  blender = blit->blender;
+
+  GBlenderPixel  fore = color.value & 0xFFFFFF;
+
+  GBLENDER_VARS( blender, fore );
+
+  const unsigned short*  ramp = blender->gamma_ramp;
+  const unsigned char*   inv  = blender->gamma_ramp_inv;
+
+  const int      direct         = blender->direct;
+  GBlenderPixel  direct_back    = ~0U;
+  unsigned long  direct_pixels  = 0;
+  unsigned long  direct_changes = 0;
+
+  const GV_T  vzero  = GV_SET1( 0 );
+  const GV_T  vfull  = GV_SET1( GBLENDER_SHADE_COUNT - 1 );
+  const GV_T  vbyte  = GV_SET1( 0xFF );
+  const GV_T  vrgb   = GV_SET1( 0xFFFFFF );
+  const GV_T  vcolor = GV_SET1( color.value );
+  const GV_T  fr     = GV_SET1( ramp[( fore >> 16 ) & 255] );
+  const GV_T  fg     = GV_SET1( ramp[( fore >>  8 ) & 255] );
+  const GV_T  fb     = GV_SET1( ramp[  fore         & 255] );
+
+  int                   h        = blit->height;
+  const unsigned char*  src_line = blit->src_line + blit->src_x;
+  unsigned char*        dst_line = blit->dst_line + blit->dst_x*4;
+
+
+  do
+  {
+    const unsigned char*  src = src_line;
+    unsigned char*        dst = dst_line;
+    int                   w   = blit->width;
+
+
+    for ( ; w >= GV_N; w -= GV_N, src += GV_N, dst += 4*GV_N )
+    {
+      GV_T  a    = GV_SHADE_INDEX( GV_LOAD_BYTES( src ) );
+      GV_T  none = GV_EQ( a, vzero );
+      GV_T  full = GV_EQ( a, vfull );
+      GV_T  skip, pix, back, ok, res;
+
+
+      if ( GV_ALL( none ) )
+        continue;
+
+      if ( GV_ALL( full ) )
+      {
+        GV_STOREU( dst, vcolor );
+        continue;
+      }
+
+      pix  = GV_LOADU( dst );
+      back = GV_AND( pix, vrgb );
+      skip = GV_OR( none, full );
+
+      if ( GV_ALL( skip ) )
+      {
+        GV_STOREU( dst, GV_SELECT( full, vcolor, pix ) );
+        continue;
+      }
+
+      if ( direct )
+      {
+        GV_NAME( _gv_direct_ )( back, skip, &direct_back, &direct_changes );
+        direct_pixels += GV_N;
+        ok             = vzero;
+      }
+      else
+      {
+        ok = GV_OR( GV_EQ( back, GV_SET1( _gback ) ), skip );
+        if ( !GV_ALL( ok ) )
+        {
+          _gback  = GV_NAME( _gv_first_miss_ )( back, ok );
+          _gcells = gblender_lookup( blender, _gback, _gfore );
+
+          ok = GV_OR( GV_EQ( back, GV_SET1( _gback ) ), skip );
+        }
+      }
+
+      if ( GV_ALL( ok ) )
+        res = GV_GATHER32( _gcells, a );
+      else
+      {
+        GV_T  ia = GV_SUB( vfull, a );
+        GV_T  r, g, b;
+
+
+        r = GV_GATHER16( ramp, GV_AND( GV_SRL( back, 16 ), vbyte ) );
+        g = GV_GATHER16( ramp, GV_AND( GV_SRL( back,  8 ), vbyte ) );
+        b = GV_GATHER16( ramp, GV_AND( back, vbyte ) );
+
+        r = GV_BLEND( fr, r, a, ia );
+        g = GV_BLEND( fg, g, a, ia );
+        b = GV_BLEND( fb, b, a, ia );
+
+        res = GV_OR( GV_OR( GV_SLL( r, 16 ), GV_SLL( g, 8 ) ), b );
+      }
+
+      res = GV_SELECT( full, vcolor, res );
+      res = GV_SELECT( none, pix, res );
+      GV_STOREU( dst, res );
+    }
+
+    for ( ; w > 0; w--, src++, dst += 4 )
+    {
+      int  a = GBLENDER_SHADE_INDEX( src[0] );
+
+
+      if ( a == 0 )
+      {
+        /* nothing */
+      }
+      else if ( a == GBLENDER_SHADE_COUNT-1 )
+        *(GBlenderPixel*)dst = color.value;
+      else
+      {
+        GBlenderPixel  back = *(GBlenderPixel*)dst & 0xFFFFFF;
+
+
+        GBLENDER_LOOKUP( blender, back, a );
+        *(GBlenderPixel*)dst = _gcells[a];
+      }
+    }
+
+    src_line += blit->src_pitch;
+    dst_line += blit->dst_pitch;
+  }
+  while ( --h > 0 );
+
+  if ( direct_pixels )
+    gblender_direct_account( blender, direct_pixels, direct_changes );
+
+  GBLENDER_CLOSE( blender );
+}
+
+
+/* `bgr' is set for HBGR sources; it is a constant after inlining */
+static void GV_TARGET
+GV_NAME( _gblender_blit_lcd_rgb32_ )( GBlenderBlit  blit,
+                                      grColor       color,
+                                      int           bgr )
+{
+  GBlender  blender = blit->blender;
+
+  unsigned int  fore_r = ( color.value >> 16 ) & 255;
+  unsigned int  fore_g = ( color.value >>  8 ) & 255;
+  unsigned int  fore_b =   color.value         & 255;
+
+  GBLENDER_CHANNEL_VARS( blender, fore_r, fore_g, fore_b );
+
+  const unsigned short*  ramp = blender->gamma_ramp;
+  const unsigned char*   inv  = blender->gamma_ramp_inv;
+
+  const int      direct         = blender->direct;
+  GBlenderPixel  direct_back    = ~0U;
+  unsigned long  direct_pixels  = 0;
+  unsigned long  direct_changes = 0;
+
+  const GV_T  vzero  = GV_SET1( 0 );
+  const GV_T  vfull  = GV_SET1( GBLENDER_SHADE_COUNT - 1 );
+  const GV_T  vbyte  = GV_SET1( 0xFF );
+  const GV_T  vrgb   = GV_SET1( 0xFFFFFF );
+  const GV_T  vcolor = GV_SET1( color.value );
+  const GV_T  fr     = GV_SET1( ramp[fore_r] );
+  const GV_T  fg     = GV_SET1( ramp[fore_g] );
+  const GV_T  fb     = GV_SET1( ramp[fore_b] );
+
+  int                   h        = blit->height;
+  const unsigned char*  src_line = blit->src_line + blit->src_x*3;
+  unsigned char*        dst_line = blit->dst_line + blit->dst_x*4;
+
+  const int  ir = bgr ? 2 : 0;
+  const int  ib = bgr ? 0 : 2;
+
+
+  do
+  {
+    const unsigned char*  src = src_line;
+    unsigned char*        dst = dst_line;
+    int                   w   = blit->width;
+
+
+    for ( ; w >= GV_N; w -= GV_N, src += 3*GV_N, dst += 4*GV_N )
+    {
+      GBlenderPixel  shade[GV_N];
+      GBlenderPixel  word, low = 0, high = 0;
+      int            n;
+
+      GV_T  aa, none, full, skip, pix, back, ok, res;
+
+
+      /*
+       * Test all coverage bytes of the run at once: a byte has shade
+       * index 0 if it is less than 9, and index 15 if it is greater than
+       * 247.  This catches the runs outside of the glyph outline or
+       * within its stems cheaply.
+       */
+      for ( n = 0; n < 3*GV_N; n += 4 )
+      {
+        memcpy( &word, src + n, 4 );
+
+        low  |= ( word & 0xF0F0F0F0U ) |
+                ( ( ( word & 0x0F0F0F0FU ) + 0x07070707U ) & 0x10101010U );
+        high |= ~word & 0xF8F8F8F8U;
+      }
+
+      if ( !low )
+        continue;
+
+      if ( !high )
+      {
+        GV_STOREU( dst, vcolor );
+        continue;
+      }
+
+      /* the shade indices of each coverage triplet, as 0x00RRGGBB */
+      for ( n = 0; n < GV_N; n++ )
+        shade[n] = ( (GBlenderPixel)GBLENDER_SHADE_INDEX( src[3*n + ir] ) << 16 ) |
+                   ( (GBlenderPixel)GBLENDER_SHADE_INDEX( src[3*n + 1]  ) <<  8 ) |
+                     (GBlenderPixel)GBLENDER_SHADE_INDEX( src[3*n + ib] );
+
+      aa   = GV_LANES( shade );
+      none = GV_EQ( aa, vzero );
+      full = GV_EQ( aa, GV_SET1( ( GBLENDER_SHADE_COUNT-1 ) * 0x010101U ) );
+
+      if ( GV_ALL( none ) )
+        continue;
+
+      if ( GV_ALL( full ) )
+      {
+        GV_STOREU( dst, vcolor );
+        continue;
+      }
+
+      pix  = GV_LOADU( dst );
+      back = GV_AND( pix, vrgb );
+      skip = GV_OR( none, full );
+
+      if ( GV_ALL( skip ) )
+      {
+        GV_STOREU( dst, GV_SELECT( full, vcolor, pix ) );
+        continue;
+      }
+
+      if ( direct )
+      {
+        GV_NAME( _gv_direct_ )( back, skip, &direct_back, &direct_changes );
+        direct_pixels += GV_N;
+        ok             = vzero;
+      }
+      else
+      {
+        ok = GV_OR( GV_EQ( back, GV_SET1( ( _grback << 16 ) |
+                                          ( _ggback <<  8 ) |
+                                            _gbback         ) ),
+                    skip );
+        if ( !GV_ALL( ok ) )
+        {
+          GBlenderPixel   miss = GV_NAME( _gv_first_miss_ )( back, ok );
+          unsigned char*  cells[3];
+
+
+          gblender_lookup_channels( blender, miss,
+                                    ( _grfore << 16 ) |
+                                    ( _ggfore <<  8 ) | _gbfore,
+                                    cells );
+
+          _grback  = ( miss >> 16 ) & 255;
+          _ggback  = ( miss >>  8 ) & 255;
+          _gbback  =   miss         & 255;
+          _grcells = cells[0];
+          _ggcells = cells[1];
+          _gbcells = cells[2];
+
+          ok = GV_OR( GV_EQ( back, GV_SET1( miss ) ), skip );
+        }
+      }
+
+      if ( GV_ALL( ok ) )
+      {
+        /* cheaper than three gathers */
+        for ( n = 0; n < GV_N; n++ )
+          shade[n] = ( (GBlenderPixel)_grcells[shade[n] >> 16]       << 16 ) |
+                     ( (GBlenderPixel)_ggcells[shade[n] >> 8 & 255] <<  8 ) |
+                       (GBlenderPixel)_gbcells[shade[n] & 255];
+
+        res = GV_LANES( shade );
+      }
+      else
+      {
+        GV_T  ar, ag, ab;
+        GV_T  br = GV_AND( GV_SRL( back, 16 ), vbyte );
+        GV_T  bg = GV_AND( GV_SRL( back,  8 ), vbyte );
+        GV_T  bb = GV_AND( back, vbyte );
+        GV_T  r, g, b;
+
+
+        ar = GV_AND( GV_SRL( aa, 16 ), vbyte );
+        ag = GV_AND( GV_SRL( aa,  8 ), vbyte );
+        ab = GV_AND( aa, vbyte );
+
+        /* a zero channel coverage keeps the background value as is */
+        r = GV_BLEND( fr, GV_GATHER16( ramp, br ), ar, GV_SUB( vfull, ar ) );
+        g = GV_BLEND( fg, GV_GATHER16( ramp, bg ), ag, GV_SUB( vfull, ag ) );
+        b = GV_BLEND( fb, GV_GATHER16( ramp, bb ), ab, GV_SUB( vfull, ab ) );
+
+        r = GV_SELECT( GV_EQ( ar, vzero ), br, r );
+        g = GV_SELECT( GV_EQ( ag, vzero ), bg, g );
+        b = GV_SELECT( GV_EQ( ab, vzero ), bb, b );
+
+        res = GV_OR( GV_OR( GV_SLL( r, 16 ), GV_SLL( g, 8 ) ), b );
+      }
+
+      res = GV_SELECT( full, vcolor, res );
+      res = GV_SELECT( none, pix, res );
+      GV_STOREU( dst, res );
+    }
+
+    for ( ; w > 0; w--, src += 3, dst += 4 )
+    {
+      unsigned int  ar = GBLENDER_SHADE_INDEX( src[ir] );
+      unsigned int  ag = GBLENDER_SHADE_INDEX( src[1] );
+      unsigned int  ab = GBLENDER_SHADE_INDEX( src[ib] );
+      unsigned int  aa = ( ar << 16 ) | ( ag << 8 ) | ab;
+
+
+      if ( aa == 0 )
+      {
+        /* nothing */
+      }
+      else if ( aa == ( GBLENDER_SHADE_COUNT-1 ) * 0x010101U )
+        *(GBlenderPixel*)dst = color.value;
+      else
+      {
+        GBlenderPixel  back = *(GBlenderPixel*)dst & 0xFFFFFF;
+
+
+        GBLENDER_LOOKUP_RGB( blender, back, aa );
+
+        *(GBlenderPixel*)dst = ( (GBlenderPixel)_grcells[ar] << 16 ) |
+                               ( (GBlenderPixel)_ggcells[ag] <<  8 ) |
+                                 (GBlenderPixel)_gbcells[ab];
+      }
+    }
+
+    src_line += blit->src_pitch;
+    dst_line += blit->dst_pitch;
+  }
+  while ( --h > 0 );
+
+  if ( direct_pixels )
+    gblender_direct_account( blender, direct_pixels, direct_changes );
+
+  GBLENDER_CHANNEL_CLOSE( blender );
+}
+
+
+static void GV_TARGET
+GV_NAME( _gblender_blit_hrgb_rgb32_ )( GBlenderBlit  blit,
+                                       grColor       color )
+{
+  GV_NAME( _gblender_blit_lcd_rgb32_ )( blit, color, 0 );
+}
+
+
+static void GV_TARGET
+GV_NAME( _gblender_blit_hbgr_rgb32_ )( GBlenderBlit  blit,
+                                       grColor       color )
+{
+  GV_NAME( _gblender_blit_lcd_rgb32_ )( blit, color, 1 );
+}
+
+
+/* premultiplied blending without gamma correction, see `gblany.h' */
+static void GV_TARGET
+GV_NAME( _gblender_blit_bgra_rgb32_ )( GBlenderBlit  blit,
+                                       grColor       color )
+{
+  const GV_T  vzero = GV_SET1( 0 );
+  const GV_T  vbyte = GV_SET1( 0xFF );
+  const GV_T  vone  = GV_SET1( 1 );
+  const GV_T  vrgb  = GV_SET1( 0xFFFFFF );
+
+  int                   h        = blit->height;
+  const unsigned char*  src_line = blit->src_line + blit->src_x*4;
+  unsigned char*        dst_line = blit->dst_line + blit->dst_x*4;
+
+  (void)color; /* unused */
+
+
+  do
+  {
+    const unsigned char*  src = src_line;
+    unsigned char*        dst = dst_line;
+    int                   w   = blit->width;
+
+
+    for ( ; w >= GV_N; w -= GV_N, src += 4*GV_N, dst += 4*GV_N )
+    {
+      GV_T  s    = GV_LOADU( src );
+      GV_T  a    = GV_SRL( s, 24 );
+      GV_T  none = GV_EQ( a, vzero );
+      GV_T  full = GV_EQ( a, vbyte );
+      GV_T  pix, ba, x, r, g, b, res;
+
+
+      if ( GV_ALL( none ) )
+        continue;
+
+      if ( GV_ALL( full ) )
+      {
+        GV_STOREU( dst, GV_AND( s, vrgb ) );
+        continue;
+      }
+
+      pix = GV_LOADU( dst );
+      ba  = GV_SUB( vbyte, a );
+
+      /* back * (255 - a) / 255 + source; the sum may exceed 255 */
+      x = GV_MUL16( GV_AND( GV_SRL( pix, 16 ), vbyte ), ba );
+      r = GV_ADD( GV_SRL( GV_ADD( GV_ADD( x, vone ), GV_SRL( x, 8 ) ), 8 ),
+                  GV_AND( GV_SRL( s, 16 ), vbyte ) );
+
+      x = GV_MUL16( GV_AND( GV_SRL( pix, 8 ), vbyte ), ba );
+      g = GV_ADD( GV_SRL( GV_ADD( GV_ADD( x, vone ), GV_SRL( x, 8 ) ), 8 ),
+                  GV_AND( GV_SRL( s, 8 ), vbyte ) );
+
+      x = GV_MUL16( GV_AND( pix, vbyte ), ba );
+      b = GV_ADD( GV_SRL( GV_ADD( GV_ADD( x, vone ), GV_SRL( x, 8 ) ), 8 ),
+                  GV_AND( s, vbyte ) );
+
+      res = GV_OR( GV_OR( GV_SLL( r, 16 ), GV_SLL( g, 8 ) ), b );
+      res = GV_SELECT( full, GV_AND( s, vrgb ), res );
+      res = GV_SELECT( none, pix, res );
+      GV_STOREU( dst, res );
+    }
+
+    for ( ; w > 0; w--, src += 4, dst += 4 )
+    {
+      unsigned int  a = src[3];
+
+
+      if ( a == 0 )
+      {
+        /* nothing */
+      }
+      else if ( a == 255 )
+        *(GBlenderPixel*)dst = ( (GBlenderPixel)src[2] << 16 ) |
+                               ( (GBlenderPixel)src[1] <<  8 ) |
+                                 (GBlenderPixel)src[0];
+      else
+      {
+        GBlenderPixel  back = *(GBlenderPixel*)dst;
+        unsigned int   ba   = 255 - a;
+
+
+        *(GBlenderPixel*)dst =
+          ( ( ( back >> 16 & 255 ) * ba / 255 + src[2] ) << 16 ) |
+          ( ( ( back >>  8 & 255 ) * ba / 255 + src[1] ) <<  8 ) |
+            ( ( back       & 255 ) * ba / 255 + src[0] );
+      }
+    }
+
+    src_line += blit->src_pitch;
+    dst_line += blit->dst_pitch;
+  }
+  while ( --h > 0 );
+}
+
+
+static const GBlenderBlitFunc
+GV_NAME( blit_funcs_rgb32_ )[GBLENDER_SOURCE_MAX] =
+{
+  GV_NAME( _gblender_blit_gray8_rgb32_ ),
+  GV_NAME( _gblender_blit_hrgb_rgb32_ ),
+  GV_NAME( _gblender_blit_hbgr_rgb32_ ),
+  NULL,  /* VRGB */
+  NULL,  /* VBGR */
+  GV_NAME( _gblender_blit_bgra_rgb32_ ),
+  NULL   /* MONO */
+};
+
+
+#undef GV_T
+#undef GV_N
+#undef GV_NAME
+#undef GV_TARGET
+#undef GV_LOADU
+#undef GV_STOREU
+#undef GV_LOAD_BYTES
+#undef GV_LANES
+#undef GV_SET1
+#undef GV_AND
+#undef GV_OR
+#undef GV_ADD
+#undef GV_SUB
+#undef GV_SRL
+#undef GV_SLL
+#undef GV_MUL16
+#undef GV_EQ
+#undef GV_SELECT
+#undef GV_ALL
+#undef GV_GATHER32
+#undef GV_GATHER16
+#undef GV_GATHER8
+
+/* End */
@@ -194,6 +194,47 @@
                             grBitmap    *bit );
 
 
+ /**********************************************************************
+  *
+  * <Function>
+  *    grNewAlignedBitmap
+  *
+  * <Description>
+  *    Creates a new bitmap or resizes an existing one like grNewBitmap,
+  *    rounding the pitch up to a multiple of `align'.  On Unix, the
+  *    pixel buffer is aligned to it as well.
+  *
+  * <Input>
+  *    pixel_mode   :: the target surface's pixel_mode
+  *    num_grays    :: number of grays levels for PAL8 pixel mode
+  *    width        :: width in pixels
+  *    height       :: height in pixels
+  *    align        :: a power of two, e.g. 64 for cache lines; 0 gives
+  *                    the pitch of grNewBitmap
+  *
+  * <Output>
+  *    bit          :: descriptor of the new bitmap
+  *
+  * <Return>
+  *    Error code. 0 means success.
+  *
+  * <Note>
+  *    Aligned rows let the fill and blit functions use aligned vector
+  *    stores.  Devices handing the buffer to a window system that
+  *    computes its own pitch must not use this function.
+  *
+  *    The contents of a resized bitmap are lost.
+  *
+  **********************************************************************/
+
+  extern  int  grNewAlignedBitmap( grPixelMode  pixel_mode,
+                                   int          num_grays,
+                                   int          width,
+                                   int          height,
+                                   int          align,
+                                   grBitmap    *bit );
+
+
  /**********************************************************************
   *
   * <Function>
@@ -529,6 +570,34 @@
   extern void  grRefreshSurface( grSurface*  surface );
 
 
+ /**********************************************************************
+  *
+  * <Function>
+  *    grSetSurfaceTracking
+  *
+  * <Description>
+  *    enables or disables dirty rectangle tracking for a given surface.
+  *    While enabled, the drawing functions of the graphics library
+  *    record the areas of the surface's bitmap they change, and
+  *    grRefreshSurface only repaints these areas.  Filling also skips
+  *    the pixels that already have the fill color, so that clearing
+  *    the surface between frames only repaints what was drawn before.
+  *
+  * <Input>
+  *    surface :: handle to target surface
+  *    enable  :: 1 to enable tracking, 0 to disable it
+  *
+  * <Note>
+  *    Programs that write to the bitmap buffer directly must either
+  *    leave tracking disabled or call grRefreshRectangle for the areas
+  *    they have changed.
+  *
+  **********************************************************************/
+
+  extern void  grSetSurfaceTracking( grSurface*  surface,
+                                     int         enable );
+
+
  /**********************************************************************
   *
   * <Function>
@@ -566,6 +635,70 @@
                         grColor     color );
 
 
+  /* a glyph bitmap to blit, see grBlitGlyphsToSurface */
+  typedef struct grGlyphBlit_
+  {
+    grBitmap*  glyph;
+    grPos      x;
+    grPos      y;
+    grColor    color;
+
+  } grGlyphBlit;
+
+
+ /**********************************************************************
+  *
+  * <Function>
+  *    grBlitGlyphsToSurface
+  *
+  * <Description>
+  *    writes an array of glyph bitmaps to a target surface, with the
+  *    same result as calling grBlitGlyphToSurface for each one in
+  *    order.
+  *
+  * <Input>
+  *    surface :: handle to surface
+  *    blits   :: the glyph bitmaps, their positions and colors
+  *    count   :: number of elements in `blits'
+  *
+  * <Return>
+  *   Error code. 0 means success; -1 means that the surface or some
+  *   glyphs have unsupported pixel modes, the others are blitted.
+  *
+  * <Note>
+  *   The surface is split into tiles, which are blitted in parallel by
+  *   a pool of threads with a blender cache each.  Small batches are
+  *   blitted sequentially.  The number of threads defaults to the number
+  *   of processors, or the value of the environment variable
+  *   GR_BLIT_THREADS; see also grSetBlitThreads.
+  *
+  *   The bitmaps must not change until the function returns.  Only one
+  *   thread at a time may call it.
+  *
+  **********************************************************************/
+
+  extern int
+  grBlitGlyphsToSurface( grSurface*          surface,
+                         const grGlyphBlit*  blits,
+                         int                 count );
+
+
+ /**********************************************************************
+  *
+  * <Function>
+  *    grSetBlitThreads
+  *
+  * <Description>
+  *    sets the number of threads used by grBlitGlyphsToSurface,
+  *    including the calling thread.  1 disables parallel blitting;
+  *    0 restores the default.
+  *
+  **********************************************************************/
+
+  extern void
+  grSetBlitThreads( int  num_threads );
+
+
  /**********************************************************************
   *
   * <Function>
@@ -688,6 +821,14 @@
   * <Note>
   *    Only keypresses and resizing events are supported.
   *
+  *    If `event_mask' contains `gr_event_coalesce', the events that
+  *    are already pending are drained too: repetitions of the same key
+  *    are merged, setting `event->count' to their number, and of
+  *    consecutive resizing events only the last one is returned.  The
+  *    first different event is kept for the next call.  Without the
+  *    flag, or if the device cannot tell whether events are pending,
+  *    `event->count' is always 1.
+  *
   **********************************************************************/
 
   extern
@@ -695,6 +836,77 @@
                          int         event_mask,
                          grEvent    *event );
 
+
+ /**********************************************************************
+  *
+  * <Function>
+  *    grSurfaceEventPending
+  *
+  * <Description>
+  *    check whether grListenSurface would return without blocking
+  *
+  * <Input>
+  *    surface :: handle to target surface
+  *
+  * <Return>
+  *    1 if an event is pending, 0 if not or if the device cannot tell
+  *
+  **********************************************************************/
+
+  extern
+  int   grSurfaceEventPending( grSurface*  surface );
+
+
+ /**********************************************************************
+  *
+  * <Function>
+  *    grSetFrameBudget
+  *
+  * <Description>
+  *    set the time a frame may take to render before grFrameOverBudget
+  *    asks to abandon it in favour of pending input
+  *
+  * <Input>
+  *    surface :: handle to target surface
+  *    msec    :: frame budget in milliseconds, 0 for none
+  *
+  * <Note>
+  *    The initial value is taken from the environment variable
+  *    `GR_FRAME_BUDGET', if set.
+  *
+  **********************************************************************/
+
+  extern
+  void  grSetFrameBudget( grSurface*  surface,
+                          int         msec );
+
+
+ /**********************************************************************
+  *
+  * <Function>
+  *    grFrameOverBudget
+  *
+  * <Description>
+  *    check whether rendering since the last grListenSurface took longer
+  *    than the frame budget while events are waiting
+  *
+  * <Input>
+  *    surface :: handle to target surface
+  *
+  * <Return>
+  *    1 if the caller should stop drawing the current frame and
+  *    listen to the next event, 0 otherwise
+  *
+  * <Note>
+  *    This is cheap enough to be called for each glyph.  The partial
+  *    frame is still shown; the caller should draw it again after the
+  *    next event even if that event changes nothing.
+  *
+  **********************************************************************/
+
+  extern
+  int   grFrameOverBudget( grSurface*  surface );
+
  /**********************************************************************
   *
   * <Function>
@@ -1,9 +1,15 @@
 #include "grobjs.h"
 #include "grdevice.h"
+#include <stdlib.h>
 #include <string.h>
 
   grDeviceChain*  gr_device_chain;
 
+  /* the script written for `GR_EVENT_RECORD', see grWriteEventScript */
+  static FILE*       gr_record;
+  static grSurface*  gr_record_surface;
+
+
   static
   grDevice*  find_device( const char*  device_name )
   {
@@ -152,8 +158,17 @@
       surface = NULL;
     }
     else
+    {
+      const char*  budget = getenv( "GR_FRAME_BUDGET" );
+
+
       grSetTargetGamma( surface, 1.8 );
 
+      if ( budget )
+        grSetFrameBudget( surface, atoi( budget ) );
+      surface->frame_start = grTime();
+    }
+
     return surface;
   }
 
@@ -164,11 +179,22 @@
   {
     if (surface)
     {
+      if ( surface == gr_record_surface )
+      {
+        if ( gr_record != stdout )
+          fclose( gr_record );
+
+        gr_record         = NULL;
+        gr_record_surface = NULL;
+      }
 
 #ifdef GBLENDER_STATS
       gblender_dump_stats( surface->gblender );
 #endif
 
+      if ( surface->tracking )
+        grSetSurfaceTracking( surface, 0 );
+
       /* first of all, call the device-specific destructor */
       surface->done(surface);
 
@@ -176,6 +202,8 @@
       if (surface->owner)
         grFree( surface->bitmap.buffer );
 
+      grFree( surface->fill_row );
+
       surface->owner         = 0;
       surface->bitmap.buffer = NULL;
       grFree( surface );
@@ -305,10 +333,184 @@
 
   extern void  grRefreshSurface( grSurface*  surface )
   {
-    if (surface->refresh_rect)
+    grDirtyRect*  d     = surface->dirty;
+    grDirtyRect*  limit = d + surface->num_dirty;
+
+
+    if ( !surface->refresh_rect )
+      ;
+    else if ( !surface->tracking )
       surface->refresh_rect( surface, 0, 0,
                              surface->bitmap.width,
                              surface->bitmap.rows );
+    else if ( !surface->refresh )
+    {
+      for ( ; d < limit; d++ )
+        surface->refresh_rect( surface, d->x_min, d->y_min,
+                               d->x_max - d->x_min,
+                               d->y_max - d->y_min );
+    }
+    else
+    {
+      /* a single refresh per frame, even if nothing changed */
+      grDirtyRect  box = { 0, 0, 0, 0 };
+
+
+      if ( d < limit )
+        box = *d++;
+
+      for ( ; d < limit; d++ )
+      {
+        if ( d->x_min < box.x_min )
+          box.x_min = d->x_min;
+        if ( d->y_min < box.y_min )
+          box.y_min = d->y_min;
+        if ( d->x_max > box.x_max )
+          box.x_max = d->x_max;
+        if ( d->y_max > box.y_max )
+          box.y_max = d->y_max;
+      }
+
+      surface->refresh_rect( surface, box.x_min, box.y_min,
+                             box.x_max - box.x_min,
+                             box.y_max - box.y_min );
+    }
+
+    surface->num_dirty = 0;
+  }
+
+
+  /* the surfaces tracking dirty rectangles; rarely more than one */
+  static grSurface*  gr_tracked_surfaces = NULL;
+
+
+ /**********************************************************************
+  *
+  * <Function>
+  *    grSetSurfaceTracking
+  *
+  * <Description>
+  *    enables or disables dirty rectangle tracking for a given surface.
+  *
+  * <Input>
+  *    surface :: handle to target surface
+  *    enable  :: 1 to enable tracking, 0 to disable it
+  *
+  **********************************************************************/
+
+  extern void  grSetSurfaceTracking( grSurface*  surface,
+                                     int         enable )
+  {
+    grSurface**  p;
+
+
+    for ( p = &gr_tracked_surfaces; *p; p = &(*p)->next_tracked )
+      if ( *p == surface )
+      {
+        *p = surface->next_tracked;
+        break;
+      }
+
+    surface->next_tracked = NULL;
+    surface->tracking     = (grBool)( enable != 0 );
+    surface->num_dirty    = 0;
+
+    if ( enable )
+    {
+      surface->next_tracked = gr_tracked_surfaces;
+      gr_tracked_surfaces   = surface;
+
+      /* what has been drawn so far may not be on the screen yet */
+      grTouchSurface( surface, 0, 0,
+                      surface->bitmap.width, surface->bitmap.rows );
+    }
+  }
+
+
+  extern grSurface*  grTrackingSurface( grBitmap*  target )
+  {
+    grSurface*  surface = gr_tracked_surfaces;
+
+
+    while ( surface && &surface->bitmap != target )
+      surface = surface->next_tracked;
+
+    return surface;
+  }
+
+
+  extern void  grTouchSurface( grSurface*  surface,
+                               int         x,
+                               int         y,
+                               int         width,
+                               int         height )
+  {
+    grDirtyRect   r;
+    grDirtyRect*  d;
+    grDirtyRect*  limit;
+    grDirtyRect*  best        = NULL;
+    long          best_growth = 0;
+
+
+    if ( !surface->tracking )
+      return;
+
+    r.x_min = x < 0 ? 0 : x;
+    r.y_min = y < 0 ? 0 : y;
+    r.x_max = x + width  > surface->bitmap.width ? surface->bitmap.width
+                                                 : x + width;
+    r.y_max = y + height > surface->bitmap.rows  ? surface->bitmap.rows
+                                                 : y + height;
+
+    if ( r.x_min >= r.x_max || r.y_min >= r.y_max )
+      return;
+
+    d     = surface->dirty;
+    limit = d + surface->num_dirty;
+
+    for ( ; d < limit; d++ )
+    {
+      long  growth;
+
+
+      /* merge with a close rectangle */
+      if ( r.x_min <= d->x_max + GR_DIRTY_GAP &&
+           d->x_min <= r.x_max + GR_DIRTY_GAP &&
+           r.y_min <= d->y_max + GR_DIRTY_GAP &&
+           d->y_min <= r.y_max + GR_DIRTY_GAP )
+      {
+        best = d;
+        break;
+      }
+
+      /* otherwise, remember the one whose union adds the least area */
+      growth = (long)( ( d->x_max > r.x_max ? d->x_max : r.x_max ) -
+                       ( d->x_min < r.x_min ? d->x_min : r.x_min ) ) *
+               (long)( ( d->y_max > r.y_max ? d->y_max : r.y_max ) -
+                       ( d->y_min < r.y_min ? d->y_min : r.y_min ) ) -
+               (long)( d->x_max - d->x_min ) * ( d->y_max - d->y_min );
+
+      if ( !best || growth < best_growth )
+      {
+        best        = d;
+        best_growth = growth;
+      }
+    }
+
+    if ( d == limit && surface->num_dirty < GR_DIRTY_MAX )
+    {
+      surface->dirty[surface->num_dirty++] = r;
+      return;
+    }
+
+    if ( r.x_min < best->x_min )
+      best->x_min = r.x_min;
+    if ( r.y_min < best->y_min )
+      best->y_min = r.y_min;
+    if ( r.x_max > best->x_max )
+      best->x_max = r.x_max;
+    if ( r.y_max > best->y_max )
+      best->y_max = r.y_max;
   }
 
 
@@ -383,14 +585,360 @@
   * <Note>
   *    XXX : For now, only keypresses are supported.
   *
+  *    With `gr_event_coalesce', pending events are merged as far as
+  *    possible; the first one that cannot be merged is queued in the
+  *    surface.
+  *
   **********************************************************************/
 
+#define GR_COALESCE_MAX  256   /* bound the time spent draining */
+
+
+  static void
+  gr_record_event( grSurface*      surface,
+                   const grEvent*  event )
+  {
+    if ( !gr_record_surface )
+    {
+      const char*  name = getenv( "GR_EVENT_RECORD" );
+
+
+      if ( !name || !*name )
+        return;
+
+      gr_record = strcmp( name, "-" ) ? fopen( name, "w" ) : stdout;
+      if ( !gr_record )
+      {
+        fprintf( stderr, "cannot open event record `%s'\n", name );
+        return;
+      }
+
+      gr_record_surface = surface;
+    }
+
+    if ( surface != gr_record_surface )
+      return;
+
+    grWriteEventScript( gr_record, event );
+
+    /* keep the events of a session that crashes */
+    fflush( gr_record );
+  }
+
+  static int
+  gr_listen_event( grSurface*  surface,
+                   int         event_mask,
+                   grEvent*    event )
+  {
+    if ( surface->has_queued )
+    {
+      *event              = surface->queued;
+      surface->has_queued = 0;
+      return 1;
+    }
+
+    event->count = 1;
+
+    return surface->listen_event( surface,
+                                  event_mask & ~gr_event_coalesce,
+                                  event );
+  }
+
+
   extern
   int   grListenSurface( grSurface*  surface,
                          int         event_mask,
                          grEvent    *event )
   {
-    return surface->listen_event( surface, event_mask, event );
+    int  ret = gr_listen_event( surface, event_mask, event );
+
+
+    if ( event_mask & gr_event_coalesce )
+    {
+      grEvent  next;
+
+
+      while ( event->count < GR_COALESCE_MAX    &&
+              grSurfaceEventPending( surface ) )
+      {
+        gr_listen_event( surface, event_mask, &next );
+
+        if ( next.type  == gr_event_resize &&
+             event->type == gr_event_resize )
+          *event = next;    /* only the final size matters */
+        else if ( next.type  != gr_event_resize &&
+                  next.type  == event->type     &&
+                  next.key   == event->key      )
+          event->count++;
+        else
+        {
+          surface->queued     = next;
+          surface->has_queued = 1;
+          break;
+        }
+      }
+    }
+
+    if ( ret )
+      gr_record_event( surface, event );
+
+    surface->frame_start = grTime();
+
+    return ret;
+  }
+
+
+  extern
+  int   grSurfaceEventPending( grSurface*  surface )
+  {
+    if ( surface->has_queued )
+      return 1;
+
+    return surface->pending_event ? surface->pending_event( surface ) : 0;
+  }
+
+
+  extern
+  void  grSetFrameBudget( grSurface*  surface,
+                          int         msec )
+  {
+    surface->frame_budget = msec > 0 ? msec : 0;
+  }
+
+
+  extern
+  int   grFrameOverBudget( grSurface*  surface )
+  {
+    if ( surface->frame_budget <= 0 )
+      return 0;
+
+    if ( grTime() - surface->frame_start < surface->frame_budget )
+      return 0;
+
+    return grSurfaceEventPending( surface );
+  }
+
+
+  static const struct
+  {
+    const char*  name;
+    grKey        key;
+
+  } gr_key_names[] =
+  {
+    { "BackSpace", grKeyBackSpace },
+    { "Tab",       grKeyTab },
+    { "Return",    grKeyReturn },
+    { "Esc",       grKeyEsc },
+    { "Space",     grKeySpace },
+    { "Del",       grKeyDel },
+    { "Ins",       grKeyIns },
+    { "Home",      grKeyHome },
+    { "End",       grKeyEnd },
+    { "PageUp",    grKeyPageUp },
+    { "PageDown",  grKeyPageDown },
+    { "Left",      grKeyLeft },
+    { "Right",     grKeyRight },
+    { "Up",        grKeyUp },
+    { "Down",      grKeyDown },
+  };
+
+#define GR_NUM_KEY_NAMES  \
+          (int)( sizeof ( gr_key_names ) / sizeof ( gr_key_names[0] ) )
+
+
+  /* parse a named key or command without the angle brackets */
+  static int
+  gr_parse_event_name( char*     name,
+                       grEvent*  event )
+  {
+    int          modifiers = 0;
+    int          width, height;
+    int          n;
+    const char*  p         = name;
+    char*        star      = strrchr( name, '*' );
+
+
+    /* a repetition count like `Up*3', but not the `*' key */
+    if ( star && star > name && star[1] &&
+         strspn( star + 1, "0123456789" ) == strlen( star + 1 ) )
+    {
+      event->count = atoi( star + 1 );
+      if ( event->count < 1 )
+        return 0;
+
+      *star = '\0';
+    }
+
+    while ( p[0] && p[1] == '-' && p[2] )
+    {
+      if ( p[0] == 'C' )
+        modifiers |= grKeyCtrl;
+      else if ( p[0] == 'A' )
+        modifiers |= grKeyAlt;
+      else if ( p[0] == 'S' )
+        modifiers |= grKeyShift;
+      else
+        break;
+
+      p += 2;
+    }
+
+    event->type = gr_event_key;
+
+    if ( !p[1] )
+      event->key = grKEY( p[0] );
+    else if ( p[0] == 'F' && ( n = atoi( p + 1 ) ) >= 1 && n <= 12 )
+      event->key = (grKey)( grKeyF1 + n - 1 );
+    else if ( sscanf( p, "Resize=%dx%d", &width, &height ) == 2 &&
+              width > 0 && height > 0                           )
+    {
+      event->type = gr_event_resize;
+      event->key  = grKeyNone;
+      event->x    = width;
+      event->y    = height;
+
+      return 1;
+    }
+    else
+    {
+      for ( n = 0; n < GR_NUM_KEY_NAMES; n++ )
+        if ( !strcmp( p, gr_key_names[n].name ) )
+          break;
+
+      if ( n == GR_NUM_KEY_NAMES )
+        return 0;
+
+      event->key = gr_key_names[n].key;
+    }
+
+    event->key = (grKey)( event->key | modifiers );
+
+    return 1;
   }
 
 
+  extern int
+  grReadEventScript( grEventScript*  script,
+                     grEvent*        event )
+  {
+    char*  token = script->token;
+    int    c, len;
+
+
+    for ( ;; )
+    {
+      /* still typing a token? */
+      if ( token[script->pos] )
+      {
+        event->type = gr_event_key;
+        event->key  = grKEY( token[script->pos++] );
+        return 1;
+      }
+
+      do
+        c = getc( script->file );
+      while ( c == ' ' || c == '\t' || c == '\r' || c == '\n' );
+
+      if ( c == EOF )
+        return 0;
+
+      if ( c == '#' )
+      {
+        do
+          c = getc( script->file );
+        while ( c != '\n' && c != EOF );
+
+        continue;
+      }
+
+      for ( len = 0;
+            c != EOF && c != ' ' && c != '\t' && c != '\r' && c != '\n';
+            c = getc( script->file ) )
+        if ( len < (int)sizeof ( script->token ) - 1 )
+          token[len++] = (char)c;
+
+      token[len]  = '\0';
+      script->pos = 0;
+
+      if ( len > 2 && token[0] == '<' && token[len - 1] == '>' )
+      {
+        token[len - 1] = '\0';
+
+        if ( gr_parse_event_name( token + 1, event ) )
+        {
+          token[0] = '\0';
+          return 1;
+        }
+
+        fprintf( stderr, "unknown event `%s>' in script\n", token );
+        token[0] = '\0';
+      }
+    }
+  }
+
+
+  extern void
+  grWriteEventScript( FILE*           file,
+                      const grEvent*  event )
+  {
+    char   name[64];
+    int    modifiers = event->key & grKeyModifiers;
+    grKey  key       = (grKey)( event->key & ~grKeyModifiers );
+    int    n;
+
+
+    if ( event->type == gr_event_resize )
+    {
+      fprintf( file, "<Resize=%dx%d>\n", event->x, event->y );
+      return;
+    }
+
+    if ( event->type != gr_event_key )
+      return;
+
+    name[0] = '\0';
+
+    if ( key >= grKeyF1 && key <= grKeyF12 )
+      sprintf( name, "F%d", key - grKeyF1 + 1 );
+    else
+    {
+      for ( n = 0; n < GR_NUM_KEY_NAMES; n++ )
+        if ( gr_key_names[n].key == key )
+        {
+          strcpy( name, gr_key_names[n].name );
+          break;
+        }
+
+      if ( !name[0] && key > ' ' && key < 0x7F )
+      {
+        name[0] = (char)key;
+        name[1] = '\0';
+      }
+    }
+
+    if ( !name[0] )
+    {
+      fprintf( file, "# key 0x%04x cannot be written\n",
+               (unsigned int)event->key );
+      return;
+    }
+
+    /* plain characters are typed, except those the parser treats */
+    /* specially                                                  */
+    if ( !name[1] && !modifiers && event->count <= 1 &&
+         name[0] != '#' && name[0] != '<'              )
+    {
+      fprintf( file, "%s\n", name );
+      return;
+    }
+
+    fprintf( file, "<%s%s%s%s",
+             modifiers & grKeyCtrl  ? "C-" : "",
+             modifiers & grKeyAlt   ? "A-" : "",
+             modifiers & grKeyShift ? "S-" : "",
+             name );
+    if ( event->count > 1 )
+      fprintf( file, "*%d", event->count );
+    fputs( ">\n", file );
+  }
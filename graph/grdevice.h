@@ -13,6 +13,8 @@
 #ifndef GRDEVICE_H_
 #define GRDEVICE_H_
 
+#include <stdio.h>
+
 #include "graph.h"
 
 
@@ -123,6 +125,75 @@
   extern grDeviceChain*  gr_device_chain;
 
 
+ /********************************************************************
+  *
+  * <Struct>
+  *   grEventScript
+  *
+  * <Description>
+  *   An event script read by grReadEventScript.
+  *
+  * <Fields>
+  *   file  :: the script, opened by the device
+  *   token :: the characters of the current token
+  *   pos   :: the next character of the token to be typed
+  *
+  ********************************************************************/
+
+  typedef struct  grEventScript_
+  {
+    FILE*  file;
+    char   token[64];
+    int    pos;
+
+  } grEventScript;
+
+
+ /********************************************************************
+  *
+  * <Function>
+  *   grReadEventScript
+  *
+  * <Description>
+  *   Read the next event of a script.  Tokens are separated by white
+  *   space; `#' comments out the rest of a line.  Named keys are given
+  *   in angle brackets, like `<PageUp>', `<F3>', or `<C-Left>' with
+  *   modifiers `C-', `A-', and `S-', and with a repetition count for
+  *   gr_event_coalesce like `<Up*3>'.  `<Resize=WxH>' gives a resize
+  *   event with the new size in `x' and `y'; the device must resize the
+  *   surface before returning it.  Any other token types its
+  *   characters.
+  *
+  * <Return>
+  *   1 for an event, 0 at the end of the script.
+  *
+  ********************************************************************/
+
+  extern int
+  grReadEventScript( grEventScript*  script,
+                     grEvent*        event );
+
+
+ /********************************************************************
+  *
+  * <Function>
+  *   grWriteEventScript
+  *
+  * <Description>
+  *   Append an event to a script, one per line, in the syntax read by
+  *   grReadEventScript.  Keys without a name are written as comments.
+  *
+  *   grListenSurface writes every event it returns to the file named
+  *   by the environment variable `GR_EVENT_RECORD' (`-' for stdout),
+  *   so that a session can be replayed by the batch device.
+  *
+  ********************************************************************/
+
+  extern void
+  grWriteEventScript( FILE*           file,
+                      const grEvent*  event );
+
+
 extern void
 gr_swizzle_rgb24( unsigned char*    read_buff,
                   int               read_pitch,
@@ -22,6 +22,8 @@
 
 #define gr_event_type  ( gr_event_mouse | gr_event_key | gr_event_resize )
 
+#define gr_event_coalesce  0x200   /* listening mode, see grListenSurface */
+
 
   typedef enum grKey_
   {
@@ -170,6 +172,7 @@
     int    type;
     grKey  key;
     int    x, y;
+    int    count;   /* repetitions merged by gr_event_coalesce */
 
   } grEvent;
 
@@ -1,7 +1,437 @@
-#include "graph.h"
+#include "grobjs.h"
+#include "gblblit.h"    /* for the SIMD selection */
 #include <stdlib.h>
 #include <memory.h>
 
+#if defined( __SSE2__ ) || defined( _M_X64 )                 || \
+    ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define GR_FILL_SSE2
+#include <emmintrin.h>
+
+#if ( defined( __GNUC__ ) &&                                        \
+      ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) ) ) || \
+    defined( __clang__ ) || defined( _MSC_VER )
+#define GR_FILL_AVX2
+#include <immintrin.h>
+#endif
+
+#endif
+
+#if defined( __aarch64__ ) || defined( _M_ARM64 )
+#define GR_FILL_NEON
+#include <arm_neon.h>
+#endif
+
+
+/* Rows of byte-addressed pixels are filled by repeatedly storing a     */
+/* pattern of GR_FILL_PATTERN bytes, the least common multiple of the   */
+/* pixel sizes and of 32-byte vectors.  The pattern buffer has room for */
+/* starting at any of the first 64 bytes.                               */
+#define GR_FILL_PATTERN  96
+#define GR_FILL_BUFFER   ( GR_FILL_PATTERN + 64 )
+
+/* Fills larger than this bypass the cache with non-temporal stores  */
+/* where available, instead of evicting everything else.  Below, the */
+/* pixels would likely stay in the last level cache.                 */
+#define GR_FILL_STREAM_MIN  ( 16L << 20 )
+
+/* shorter rows are filled pixel by pixel */
+#define GR_FILL_SPAN_MIN  64
+
+typedef void  (*grFillSpanFunc)( unsigned char*        line,
+                                 size_t                len,
+                                 const unsigned char*  pattern,
+                                 int                   stream );
+
+
+/* copy the pattern once, then double the filled part */
+static void
+gr_fill_span_generic( unsigned char*        line,
+                      size_t                len,
+                      const unsigned char*  pattern,
+                      int                   stream )
+{
+  size_t  done = len < GR_FILL_PATTERN ? len : GR_FILL_PATTERN;
+
+  (void)stream;
+
+  memcpy( line, pattern, done );
+
+  while ( done < len )
+  {
+    size_t  n = done < len - done ? done : len - done;
+
+
+    memcpy( line + done, line, n );
+    done += n;
+  }
+}
+
+
+/* The vector functions store the first and the last vector of a span  */
+/* unaligned, and the rest aligned; the pattern is loaded at the phase  */
+/* of the first aligned address.  Non-temporal stores are only used for */
+/* whole cache lines, from a 64-byte aligned address in steps of 192    */
+/* bytes, the least common multiple of 64 and the pattern: mixing them  */
+/* with ordinary stores to the same line is slow.                       */
+
+#define GR_FILL_STREAM_LINE  192
+
+#ifdef GR_FILL_SSE2
+
+static void
+gr_fill_span_sse2( unsigned char*        line,
+                   size_t                len,
+                   const unsigned char*  pattern,
+                   int                   stream )
+{
+  unsigned char*  last;
+  size_t          head;
+  __m128i         v0, v1, v2, tail;
+
+
+  if ( len < 16 )
+  {
+    memcpy( line, pattern, len );
+    return;
+  }
+
+  if ( stream && len >= 4 * GR_FILL_STREAM_LINE )
+  {
+    head = ( 64 - ( (size_t)line & 63 ) ) & 63;
+    memcpy( line, pattern, head );
+    line    += head;
+    len     -= head;
+    pattern += head;
+
+    v0 = _mm_loadu_si128( (const __m128i*)( pattern      ) );
+    v1 = _mm_loadu_si128( (const __m128i*)( pattern + 16 ) );
+    v2 = _mm_loadu_si128( (const __m128i*)( pattern + 32 ) );
+
+    for ( ; len >= GR_FILL_STREAM_LINE; len  -= GR_FILL_STREAM_LINE,
+                                        line += GR_FILL_STREAM_LINE )
+    {
+      int  i;
+
+
+      for ( i = 0; i < GR_FILL_STREAM_LINE; i += 48 )
+      {
+        _mm_stream_si128( (__m128i*)( line + i      ), v0 );
+        _mm_stream_si128( (__m128i*)( line + i + 16 ), v1 );
+        _mm_stream_si128( (__m128i*)( line + i + 32 ), v2 );
+      }
+    }
+    _mm_sfence();
+  }
+  else
+  {
+    _mm_storeu_si128( (__m128i*)line,
+                      _mm_loadu_si128( (const __m128i*)pattern ) );
+
+    head     = ( 16 - ( (size_t)line & 15 ) ) & 15;
+    line    += head;
+    len     -= head;
+    pattern += head;
+
+    v0 = _mm_loadu_si128( (const __m128i*)( pattern      ) );
+    v1 = _mm_loadu_si128( (const __m128i*)( pattern + 16 ) );
+    v2 = _mm_loadu_si128( (const __m128i*)( pattern + 32 ) );
+  }
+
+  for ( ; len >= 48; len -= 48, line += 48 )
+  {
+    _mm_store_si128( (__m128i*)( line      ), v0 );
+    _mm_store_si128( (__m128i*)( line + 16 ), v1 );
+    _mm_store_si128( (__m128i*)( line + 32 ), v2 );
+  }
+
+  if ( len >= 16 )
+  {
+    _mm_store_si128( (__m128i*)line, v0 );
+    if ( len >= 32 )
+      _mm_store_si128( (__m128i*)( line + 16 ), v1 );
+  }
+
+  if ( stream && len < 16 )       /* keep off the streamed lines */
+  {
+    memcpy( line, pattern, len );
+    return;
+  }
+
+  last = line + len - 16;
+  tail = _mm_loadu_si128( (const __m128i*)( pattern + ( len + 32 ) % 48 ) );
+  _mm_storeu_si128( (__m128i*)last, tail );
+}
+
+#endif /* GR_FILL_SSE2 */
+
+
+#ifdef GR_FILL_AVX2
+
+#ifdef _MSC_VER
+#define GR_FILL_TARGET  /* nothing */
+#else
+#define GR_FILL_TARGET  __attribute__(( target( "avx2" ) ))
+#endif
+
+static void GR_FILL_TARGET
+gr_fill_span_avx2( unsigned char*        line,
+                   size_t                len,
+                   const unsigned char*  pattern,
+                   int                   stream )
+{
+  unsigned char*  last;
+  size_t          head;
+  __m256i         v0, v1, v2, tail;
+
+
+  if ( len < 32 )
+  {
+    memcpy( line, pattern, len );
+    return;
+  }
+
+  if ( stream && len >= 4 * GR_FILL_STREAM_LINE )
+  {
+    head = ( 64 - ( (size_t)line & 63 ) ) & 63;
+    memcpy( line, pattern, head );
+    line    += head;
+    len     -= head;
+    pattern += head;
+
+    v0 = _mm256_loadu_si256( (const __m256i*)( pattern      ) );
+    v1 = _mm256_loadu_si256( (const __m256i*)( pattern + 32 ) );
+    v2 = _mm256_loadu_si256( (const __m256i*)( pattern + 64 ) );
+
+    for ( ; len >= GR_FILL_STREAM_LINE; len  -= GR_FILL_STREAM_LINE,
+                                        line += GR_FILL_STREAM_LINE )
+    {
+      _mm256_stream_si256( (__m256i*)( line       ), v0 );
+      _mm256_stream_si256( (__m256i*)( line +  32 ), v1 );
+      _mm256_stream_si256( (__m256i*)( line +  64 ), v2 );
+      _mm256_stream_si256( (__m256i*)( line +  96 ), v0 );
+      _mm256_stream_si256( (__m256i*)( line + 128 ), v1 );
+      _mm256_stream_si256( (__m256i*)( line + 160 ), v2 );
+    }
+    _mm_sfence();
+  }
+  else
+  {
+    _mm256_storeu_si256( (__m256i*)line,
+                         _mm256_loadu_si256( (const __m256i*)pattern ) );
+
+    head     = ( 32 - ( (size_t)line & 31 ) ) & 31;
+    line    += head;
+    len     -= head;
+    pattern += head;
+
+    v0 = _mm256_loadu_si256( (const __m256i*)( pattern      ) );
+    v1 = _mm256_loadu_si256( (const __m256i*)( pattern + 32 ) );
+    v2 = _mm256_loadu_si256( (const __m256i*)( pattern + 64 ) );
+  }
+
+  for ( ; len >= 96; len -= 96, line += 96 )
+  {
+    _mm256_store_si256( (__m256i*)( line      ), v0 );
+    _mm256_store_si256( (__m256i*)( line + 32 ), v1 );
+    _mm256_store_si256( (__m256i*)( line + 64 ), v2 );
+  }
+
+  if ( len >= 32 )
+  {
+    _mm256_store_si256( (__m256i*)line, v0 );
+    if ( len >= 64 )
+      _mm256_store_si256( (__m256i*)( line + 32 ), v1 );
+  }
+
+  if ( stream && len < 32 )       /* keep off the streamed lines */
+  {
+    memcpy( line, pattern, len );
+    return;
+  }
+
+  last = line + len - 32;
+  tail = _mm256_loadu_si256( (const __m256i*)( pattern + ( len + 64 ) % 96 ) );
+  _mm256_storeu_si256( (__m256i*)last, tail );
+}
+
+#endif /* GR_FILL_AVX2 */
+
+
+#ifdef GR_FILL_NEON
+
+/* there are no non-temporal store intrinsics, and alignment hardly */
+/* matters                                                          */
+static void
+gr_fill_span_neon( unsigned char*        line,
+                   size_t                len,
+                   const unsigned char*  pattern,
+                   int                   stream )
+{
+  unsigned char*  last;
+  uint8x16_t      v0, v1, v2, tail;
+
+  (void)stream;
+
+  if ( len < 16 )
+  {
+    memcpy( line, pattern, len );
+    return;
+  }
+
+  last = line + len - 16;
+  tail = vld1q_u8( pattern + ( len - 16 ) % 48 );
+
+  v0 = vld1q_u8( pattern      );
+  v1 = vld1q_u8( pattern + 16 );
+  v2 = vld1q_u8( pattern + 32 );
+
+  for ( ; len >= 48; len -= 48, line += 48 )
+  {
+    vst1q_u8( line,      v0 );
+    vst1q_u8( line + 16, v1 );
+    vst1q_u8( line + 32, v2 );
+  }
+
+  if ( len >= 16 )
+  {
+    vst1q_u8( line, v0 );
+    if ( len >= 32 )
+      vst1q_u8( line + 16, v1 );
+  }
+
+  vst1q_u8( last, tail );
+}
+
+#endif /* GR_FILL_NEON */
+
+
+/* the span function for the selected instruction set */
+static grFillSpanFunc
+gr_fill_get_span( void )
+{
+  switch ( gblender_simd_get() )
+  {
+#ifdef GR_FILL_AVX2
+  case GBLENDER_SIMD_AVX2:
+    return gr_fill_span_avx2;
+#endif
+
+#ifdef GR_FILL_SSE2
+  case GBLENDER_SIMD_SSE2:
+    return gr_fill_span_sse2;
+#endif
+
+#ifdef GR_FILL_NEON
+  case GBLENDER_SIMD_NEON:
+    return gr_fill_span_neon;
+#endif
+
+  default:
+    return gr_fill_span_generic;
+  }
+}
+
+
+/* Fill `height' rows of `len' bytes each with copies of the `size'-byte */
+/* `pixel'.  Contiguous rows are filled as a single span.  Pixels of    */
+/* equal bytes, like black and white, are left to `memset' unless the   */
+/* fill is large enough to bypass the cache.                             */
+static void
+gr_fill_block( unsigned char*        line,
+               int                   pitch,
+               size_t                len,
+               int                   height,
+               const unsigned char*  pixel,
+               int                   size )
+{
+  unsigned char   pattern[GR_FILL_BUFFER];
+  grFillSpanFunc  span   = gr_fill_get_span();
+  int             stream = 0;
+  int             i;
+
+
+  if ( pitch > 0 && (size_t)pitch == len )
+  {
+    len   *= (size_t)height;
+    height = 1;
+  }
+
+  stream = len * (size_t)height >= GR_FILL_STREAM_MIN;
+
+  for ( i = 1; i < size && pixel[i] == pixel[0]; i++ )
+    ;
+
+  if ( i == size && ( !stream || span == gr_fill_span_generic ) )
+  {
+    for ( ; height > 0; height--, line += pitch )
+      memset( line, pixel[0], len );
+    return;
+  }
+
+  memcpy( pattern, pixel, (size_t)size );
+  for ( i = size; i < GR_FILL_BUFFER; i *= 2 )
+    memcpy( pattern + i, pattern,
+            (size_t)( i < GR_FILL_BUFFER - i ? i : GR_FILL_BUFFER - i ) );
+
+  if ( span == gr_fill_span_generic )
+  {
+    /* copying the first row is faster than filling short rows */
+    span( line, len, pattern, stream );
+    for ( ; --height > 0; line += pitch )
+      memcpy( line + pitch, line, len );
+    return;
+  }
+
+  for ( ; height > 0; height--, line += pitch )
+    span( line, len, pattern, stream );
+}
+
+
+/* store the bytes of a pixel as in the bitmap, return their number */
+static int
+gr_fill_pixel( grPixelMode     mode,
+               grColor         color,
+               unsigned char*  pixel )
+{
+  switch ( mode )
+  {
+  case gr_pixel_mode_rgb32:
+    {
+      uint32_t  value = color.value;
+
+
+      memcpy( pixel, &value, 4 );
+      return 4;
+    }
+
+  case gr_pixel_mode_rgb24:
+    pixel[0] = color.chroma[0];
+    pixel[1] = color.chroma[1];
+    pixel[2] = color.chroma[2];
+    return 3;
+
+  case gr_pixel_mode_rgb565:
+  case gr_pixel_mode_rgb555:
+    {
+      unsigned short  value = (unsigned short)color.value;
+
+
+      memcpy( pixel, &value, 2 );
+      return 2;
+    }
+
+  case gr_pixel_mode_gray:
+  case gr_pixel_mode_pal8:
+    pixel[0] = (unsigned char)color.value;
+    return 1;
+
+  default:
+    return 0;
+  }
+}
+
+
 static void
 gr_fill_hline_mono( unsigned char*   line,
                     int              x,
@@ -113,6 +543,17 @@ gr_fill_hline_16( unsigned char*  _line,
 {
   unsigned short*  line = (unsigned short*)_line + x;
 
+  if ( incr == 1 && width * 2 >= GR_FILL_SPAN_MIN )
+  {
+    unsigned char  pixel[2];
+
+
+    gr_fill_pixel( gr_pixel_mode_rgb565, color, pixel );
+    gr_fill_block( (unsigned char*)line, 0, (size_t)width * 2, 1,
+                   pixel, 2 );
+    return;
+  }
+
   /* adjust what looks like pitch */
   if ( incr & ~3 )
     incr >>= 1;
@@ -136,6 +577,14 @@ gr_fill_hline_24( unsigned char*  line,
 
   if ( incr == 1 && r == g && g == b )
     memset( line, r, (size_t)(width*3) );
+  else if ( incr == 1 && width * 3 >= GR_FILL_SPAN_MIN )
+  {
+    unsigned char  pixel[3];
+
+
+    gr_fill_pixel( gr_pixel_mode_rgb24, color, pixel );
+    gr_fill_block( line, 0, (size_t)width * 3, 1, pixel, 3 );
+  }
   else
   {
     /* adjust what does not look like pitch */
@@ -160,6 +609,17 @@ gr_fill_hline_32( unsigned char*  _line,
 {
   uint32_t*  line = (uint32_t*)_line + x;
 
+  if ( incr == 1 && width * 4 >= GR_FILL_SPAN_MIN )
+  {
+    unsigned char  pixel[4];
+
+
+    gr_fill_pixel( gr_pixel_mode_rgb32, color, pixel );
+    gr_fill_block( (unsigned char*)line, 0, (size_t)width * 4, 1,
+                   pixel, 4 );
+    return;
+  }
+
   /* adjust what looks like pitch */
   if ( incr & ~3 )
     incr >>= 2;
@@ -202,6 +662,7 @@ grFillHLine( grBitmap*  target,
   int              delta;
   unsigned char*   line;
   grFillHLineFunc  hline_func = gr_fill_hline_funcs[target->mode];
+  grSurface*       tracking;
 
   if ( x < 0 )
   {
@@ -220,6 +681,10 @@ grFillHLine( grBitmap*  target,
     line -= target->pitch*(target->rows-1);
 
   hline_func( line, x, width, 1, color );
+
+  tracking = grTrackingSurface( target );
+  if ( tracking )
+    grTouchSurface( tracking, x, y, width, 1 );
 }
 
 extern void
@@ -232,6 +697,7 @@ grFillVLine( grBitmap*  target,
   int              delta;
   unsigned char*   line;
   grFillHLineFunc  hline_func = gr_fill_hline_funcs[ target->mode ];
+  grSurface*       tracking;
 
   if ( y < 0 )
   {
@@ -250,6 +716,93 @@ grFillVLine( grBitmap*  target,
     line -= target->pitch*(target->rows-1);
 
   hline_func( line, x, height, target->pitch, color );
+
+  tracking = grTrackingSurface( target );
+  if ( tracking )
+    grTouchSurface( tracking, x, y, 1, height );
+}
+
+
+/* Fill a rectangle of a surface that tracks dirty rectangles, writing  */
+/* and recording only the pixels that change.  Clearing the surface     */
+/* between two frames thus only repaints what was drawn before.  Rows   */
+/* are compared with a filled one; a run of GR_DIRTY_GAP unchanged rows */
+/* ends the current rectangle; the filled row is kept by the surface.  */
+/* Return 0 if out of memory.                                           */
+static int
+gr_fill_rect_tracked( grSurface*       surface,
+                      unsigned char*   line,
+                      int              x,
+                      int              y,
+                      int              width,
+                      int              height,
+                      int              size,
+                      grFillHLineFunc  hline_func,
+                      grColor          color )
+{
+  size_t          len   = (size_t)size * (size_t)width;
+  int             pitch = surface->bitmap.pitch;
+  int             x_min = width, x_max = 0;
+  int             y_min = -1,    y_max = 0;
+  int             yy;
+  unsigned char*  row;
+
+
+  if ( len > surface->fill_row_size )
+  {
+    unsigned char*  p = (unsigned char*)realloc( surface->fill_row, len );
+
+
+    if ( !p )
+      return 0;
+
+    surface->fill_row      = p;
+    surface->fill_row_size = len;
+  }
+
+  row = surface->fill_row;
+
+  hline_func( row, 0, width, 1, color );
+
+  for ( line += size * x, yy = y; yy < y + height; yy++, line += pitch )
+  {
+    size_t  i, j;
+
+
+    if ( !memcmp( line, row, len ) )
+    {
+      if ( y_min >= 0 && yy - y_max >= GR_DIRTY_GAP )
+      {
+        grTouchSurface( surface, x + x_min, y_min,
+                        x_max - x_min, y_max - y_min );
+        x_min = width;
+        x_max = 0;
+        y_min = -1;
+      }
+      continue;
+    }
+
+    for ( i = 0; line[i] == row[i]; i++ )
+      ;
+    for ( j = len; line[j - 1] == row[j - 1]; j-- )
+      ;
+
+    memcpy( line + i, row + i, j - i );
+
+    if ( x_min > (int)( i / (size_t)size ) )
+      x_min = (int)( i / (size_t)size );
+    if ( x_max < (int)( ( j + (size_t)size - 1 ) / (size_t)size ) )
+      x_max = (int)( ( j + (size_t)size - 1 ) / (size_t)size );
+    if ( y_min < 0 )
+      y_min = yy;
+    y_max = yy + 1;
+  }
+
+  if ( y_min >= 0 )
+    grTouchSurface( surface, x + x_min, y_min,
+                    x_max - x_min, y_max - y_min );
+
+  return 1;
 }
 
 extern void
@@ -263,6 +816,7 @@ grFillRect( grBitmap*   target,
   int              delta;
   unsigned char*   line;
   grFillHLineFunc  hline_func;
+  grSurface*       tracking;
   int              size = 0;
 
   if ( x < 0 )
@@ -291,6 +845,7 @@ grFillRect( grBitmap*   target,
     line -= target->pitch*(target->rows-1);
 
   hline_func = gr_fill_hline_funcs[ target->mode ];
+  tracking   = grTrackingSurface( target );
 
   switch ( target->mode )
   {
@@ -302,14 +857,42 @@ grFillRect( grBitmap*   target,
     /* fall through */
   case gr_pixel_mode_rgb565:
   case gr_pixel_mode_rgb555:
-    size += 2;
-    hline_func( line, x, width, 1, color );
-    for ( line += size * x; --height > 0; line += target->pitch )
-      memcpy( line + target->pitch, line, (size_t)size * (size_t)width );
+    size++;
+    /* fall through */
+  case gr_pixel_mode_gray:
+  case gr_pixel_mode_pal8:
+    size++;
+    if ( tracking                                                 &&
+         gr_fill_rect_tracked( tracking, line, x, y, width, height,
+                               size, hline_func, color )          )
+      return;
     break;
 
+  default:
+    break;
+  }
+
+  if ( tracking )
+    grTouchSurface( tracking, x, y, width, height );
+
+  switch ( target->mode )
+  {
+  case gr_pixel_mode_rgb32:
+  case gr_pixel_mode_rgb24:
+  case gr_pixel_mode_rgb565:
+  case gr_pixel_mode_rgb555:
   case gr_pixel_mode_gray:
   case gr_pixel_mode_pal8:
+    {
+      unsigned char  pixel[4];
+
+
+      gr_fill_pixel( target->mode, color, pixel );
+      gr_fill_block( line + size * x, target->pitch,
+                     (size_t)size * (size_t)width, height, pixel, size );
+    }
+    break;
+
   case gr_pixel_mode_pal4:
   case gr_pixel_mode_mono:
     for ( ; height-- > 0; line += target->pitch )
@@ -37,6 +37,11 @@
 #include "beos/grbeos.h"
 #endif
 
+/* last, so that it becomes the default device when enabled */
+#ifdef DEVICE_SHM
+#include "shm/grshm.h"
+#endif
+
 
  /**********************************************************************
   *
@@ -75,10 +80,12 @@
 
     while (chain)
     {
+      /* unlink devices that fail; `chptr' must stay in the chain */
       if ( chain->device->init() != 0 )
         *chptr = chain->next;
+      else
+        chptr = &chain->next;
 
-      chptr = &chain->next;
       chain = chain->next;
     }
 
@@ -91,6 +98,8 @@
   {
     grDeviceChain*  chain = gr_device_chain;
 
+    grDoneBlitThreads();
+
     while (chain)
     {
       chain->device->done();
@@ -1,6 +1,18 @@
+#if !defined( _POSIX_C_SOURCE ) && !defined( _WIN32 )
+#define _POSIX_C_SOURCE  200112L   /* we use `posix_memalign' */
+#endif
+
 #include "grobjs.h"
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined( __unix__ ) || defined( __APPLE__ )
+#include <unistd.h>
+#define GR_HAVE_MEMALIGN
+#endif
 
   int  grError = 0;
 
@@ -118,6 +130,45 @@
   }
 
 
+ /********************************************************************
+  *
+  * <Function>
+  *   grTime
+  *
+  * <Description>
+  *   Monotonic time in milliseconds
+  *
+  ********************************************************************/
+
+  double  grTime( void )
+  {
+#if defined _WIN32
+    LARGE_INTEGER  ticks, freq;
+
+
+    QueryPerformanceCounter( &ticks );
+    QueryPerformanceFrequency( &freq );
+
+    return 1E3 * (double)ticks.QuadPart / (double)freq.QuadPart;
+
+#elif defined _POSIX_TIMERS && _POSIX_TIMERS > 0
+    struct timespec  tv;
+
+
+#ifdef _POSIX_MONOTONIC_CLOCK
+    clock_gettime( CLOCK_MONOTONIC, &tv );
+#else
+    clock_gettime( CLOCK_REALTIME, &tv );
+#endif
+
+    return 1E3 * (double)tv.tv_sec + 1E-6 * (double)tv.tv_nsec;
+
+#else
+    return 1E3 * (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
+  }
+
+
 
   static
   int  check_mode( grPixelMode  pixel_mode,
@@ -165,6 +216,29 @@
                             int          width,
                             int          height,
                             grBitmap    *bit )
+  {
+    return grNewAlignedBitmap( pixel_mode, num_grays, width, height,
+                               0, bit );
+  }
+
+
+ /**********************************************************************
+  *
+  * <Function>
+  *    grNewAlignedBitmap
+  *
+  * <Description>
+  *    Like grNewBitmap, but with the pitch rounded up to a multiple of
+  *    `align' and, where possible, a pixel buffer aligned to it.
+  *
+  **********************************************************************/
+
+  extern  int  grNewAlignedBitmap( grPixelMode  pixel_mode,
+                                   int          num_grays,
+                                   int          width,
+                                   int          height,
+                                   int          align,
+                                   grBitmap    *bit )
   {
     int             pitch;
     unsigned char*  buffer;
@@ -174,8 +248,8 @@
     if (check_mode(pixel_mode,num_grays))
       goto Fail;
 
-    /* check dimensions */
-    if (width < 0 || height < 0)
+    /* check dimensions and alignment */
+    if ( width < 0 || height < 0 || align < 0 || ( align & ( align - 1 ) ) )
     {
       grError = gr_err_bad_argument;
       goto Fail;
@@ -203,12 +277,36 @@
         return 0;
     }
 
-    buffer = (unsigned char*)realloc( bit->buffer,
-                                      (size_t)pitch * (size_t)height );
-    if ( !buffer && pitch && height )
+    if ( align > 1 )
+      pitch = ( pitch + align - 1 ) & -align;
+
+#ifdef GR_HAVE_MEMALIGN
+    /* the contents need not be kept, and `free' releases the buffer */
+    if ( align > (int)sizeof ( void* ) && pitch && height )
     {
-      grError = gr_err_memory;
-      goto Fail;
+      void*  block;
+
+
+      if ( posix_memalign( &block, (size_t)align,
+                           (size_t)pitch * (size_t)height ) )
+      {
+        grError = gr_err_memory;
+        goto Fail;
+      }
+
+      free( bit->buffer );
+      buffer = (unsigned char*)block;
+    }
+    else
+#endif
+    {
+      buffer = (unsigned char*)realloc( bit->buffer,
+                                        (size_t)pitch * (size_t)height );
+      if ( !buffer && pitch && height )
+      {
+        grError = gr_err_memory;
+        goto Fail;
+      }
     }
 
     bit->buffer = buffer;
@@ -41,6 +41,10 @@
                                      int        event_mode,
                                      grEvent   *event );
 
+  /* return 1 if `listen_event' can deliver an event without   */
+  /* blocking; devices that cannot tell leave it NULL          */
+  typedef int  (*grPendingEventFunc)( grSurface*  surface );
+
 
   typedef struct grSpan_
   {
@@ -58,6 +62,17 @@
 
 
 
+#define GR_DIRTY_MAX  4   /* dirty rectangles per surface */
+#define GR_DIRTY_GAP  8   /* merge rectangles closer than this */
+
+  typedef struct grDirtyRect_
+  {
+    int  x_min, y_min;
+    int  x_max, y_max;   /* exclusive */
+
+  } grDirtyRect;
+
+
   struct grSurface_
   {
     grBitmap           bitmap;
@@ -67,15 +82,30 @@
     unsigned char*     origin;      /* span origin   */
     grColor            color;       /* span color    */
     grSpanFunc         gray_spans;  /* span function */
+    int                pen_x;       /* span origin   */
+    int                pen_y;       /* coordinates   */
+
+    grBool             tracking;    /* see grSetSurfaceTracking */
+    int                num_dirty;
+    grDirtyRect        dirty[GR_DIRTY_MAX];
+    grSurface*         next_tracked;
+    unsigned char*     fill_row;    /* see gr_fill_rect_tracked */
+    size_t             fill_row_size;
 
     grDevice*          device;
-    grBool             refresh;
+    grBool             refresh;     /* one refresh_rect per frame */
     grBool             owner;
 
+    grEvent            queued;      /* read ahead by gr_event_coalesce */
+    grBool             has_queued;
+    double             frame_start; /* see grFrameOverBudget */
+    double             frame_budget; /* in milliseconds, 0 if none */
+
     grRefreshRectFunc  refresh_rect;
     grSetTitleFunc     set_title;
     grSetIconFunc      set_icon;
     grListenEventFunc  listen_event;
+    grPendingEventFunc pending_event;  /* optional */
     grDoneSurfaceFunc  done;
   };
 
@@ -117,4 +147,71 @@
   extern void  grFree( const void*  block );
 
 
+ /********************************************************************
+  *
+  * <Function>
+  *   grTime
+  *
+  * <Description>
+  *   Return a monotonic time in milliseconds, for measuring
+  *   intervals.
+  *
+  ********************************************************************/
+
+  extern double  grTime( void );
+
+
+ /********************************************************************
+  *
+  * <Function>
+  *   grTouchSurface
+  *
+  * <Description>
+  *   Record a changed area of a surface if it tracks dirty rectangles.
+  *   The area is clipped to the surface.
+  *
+  * <Input>
+  *   surface :: target surface
+  *   x, y    :: top-left corner of the area
+  *   width   :: width of the area in pixels
+  *   height  :: height of the area in pixels
+  *
+  ********************************************************************/
+
+  extern void  grTouchSurface( grSurface*  surface,
+                               int         x,
+                               int         y,
+                               int         width,
+                               int         height );
+
+
+ /********************************************************************
+  *
+  * <Function>
+  *   grTrackingSurface
+  *
+  * <Description>
+  *   Return the surface tracking dirty rectangles whose bitmap is
+  *   `target', or NULL.  The drawing functions that only get a bitmap
+  *   use it to find out whether they should call grTouchSurface.
+  *
+  ********************************************************************/
+
+  extern grSurface*  grTrackingSurface( grBitmap*  target );
+
+
+ /********************************************************************
+  *
+  * <Function>
+  *   grDoneBlitThreads
+  *
+  * <Description>
+  *   Stop the threads of grBlitGlyphsToSurface and release their
+  *   surfaces.  They are started again when needed.
+  *
+  ********************************************************************/
+
+  extern void  grDoneBlitThreads( void );
+
+
 #endif /* GROBJS_H_ */
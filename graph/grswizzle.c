@@ -8,6 +8,7 @@
 #include <memory.h>
 
 #include "grswizzle.h"
+#include "gblblit.h"    /* for the SIMD selection */
 
 /* technical note:
  *
@@ -146,7 +147,7 @@ filter_rect_generic( unsigned char*   read_buff,
                      unsigned char*   temp_lines )
 {
   unsigned char*  lines[3];
-  int             offset   = (x+y) % 3;
+  int             offset;
   int             delta, height2;
 
   /* clip rectangle, just to be sure */
@@ -171,6 +172,9 @@ filter_rect_generic( unsigned char*   read_buff,
   if (width <= 0 || height <= 0)  /* nothing to do */
     return;
 
+  /* after clipping, so that it isn't negative */
+  offset = (x+y) % 3;
+
   /* now setup the three work lines */
   read_buff  += y*read_pitch  + pix_bytes*x;
   write_buff += y*write_pitch + pix_bytes*x;
@@ -532,6 +536,249 @@ postprocess_line_xrgb32( unsigned char** lines,
 
 
 
+/************************************************************************/
+/************************************************************************/
+/*****                                                              *****/
+/*****               V E C T O R I Z E D   F I L T E R I N G        *****/
+/*****                                                              *****/
+/************************************************************************/
+/************************************************************************/
+
+/* the instruction sets are those of `gblsimd.c', and so is the choice
+ * among them, see `gblender_simd_get'; the anti-alias filter is needed
+ */
+#ifdef ANTIALIAS
+
+#if defined( __SSE2__ ) || defined( _M_X64 )                 || \
+    ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define GR_SWIZZLE_SSE2
+#endif
+
+#if defined( __aarch64__ ) || defined( _M_ARM64 )
+#define GR_SWIZZLE_NEON
+#endif
+
+#endif /* ANTIALIAS */
+
+
+#if defined( GR_SWIZZLE_SSE2 ) || defined( GR_SWIZZLE_NEON )
+
+/* channel masks repeating every three pixels, long enough for a vector
+ * load at any phase; the pixel at phase `n' keeps channel `n'
+ */
+static const unsigned char  swizzle_masks_rgb24[9 + 16] =
+{
+  0xFF, 0, 0,  0, 0xFF, 0,  0, 0, 0xFF,
+  0xFF, 0, 0,  0, 0xFF, 0,  0, 0, 0xFF,
+  0xFF, 0, 0,  0, 0xFF, 0,  0
+};
+
+static const unsigned int  swizzle_masks_xrgb32[3 + 4] =
+{
+  0xff0000, 0x00ff00, 0x0000ff,
+  0xff0000, 0x00ff00, 0x0000ff,
+  0xff0000
+};
+
+/* two more for the right neighbours of `postprocess_line_rgb565' */
+static const unsigned short  swizzle_masks_rgb565[3 + 8 + 2] =
+{
+  0xf800, 0x07e0, 0x001f,
+  0xf800, 0x07e0, 0x001f,
+  0xf800, 0x07e0, 0x001f,
+  0xf800, 0x07e0, 0x001f,
+  0xf800
+};
+
+#endif
+
+
+#ifdef GR_SWIZZLE_SSE2
+
+#include <emmintrin.h>
+
+
+static __inline __m128i
+gs_filter_sse2( __m128i  c,
+                __m128i  l,
+                __m128i  r,
+                __m128i  a,
+                __m128i  b )
+{
+  const __m128i  zero = _mm_setzero_si128();
+  __m128i        lo, hi;
+
+
+  lo = _mm_add_epi16( _mm_add_epi16( _mm_unpacklo_epi8( l, zero ),
+                                     _mm_unpacklo_epi8( r, zero ) ),
+                      _mm_add_epi16( _mm_unpacklo_epi8( a, zero ),
+                                     _mm_unpacklo_epi8( b, zero ) ) );
+  hi = _mm_add_epi16( _mm_add_epi16( _mm_unpackhi_epi8( l, zero ),
+                                     _mm_unpackhi_epi8( r, zero ) ),
+                      _mm_add_epi16( _mm_unpackhi_epi8( a, zero ),
+                                     _mm_unpackhi_epi8( b, zero ) ) );
+
+  lo = _mm_add_epi16( lo, _mm_slli_epi16( _mm_unpacklo_epi8( c, zero ), 2 ) );
+  hi = _mm_add_epi16( hi, _mm_slli_epi16( _mm_unpackhi_epi8( c, zero ), 2 ) );
+
+  return _mm_packus_epi16( _mm_srli_epi16( lo, 3 ), _mm_srli_epi16( hi, 3 ) );
+}
+
+
+/* `_mm_avg_epu8' rounds up */
+static __inline __m128i
+gs_avg_sse2( __m128i  a,
+             __m128i  b )
+{
+  return _mm_sub_epi8( _mm_avg_epu8( a, b ),
+                       _mm_and_si128( _mm_xor_si128( a, b ),
+                                      _mm_set1_epi8( 1 ) ) );
+}
+
+
+#define GS_T                __m128i
+#define GS_N                16
+#define GS_NAME( x )        x ## sse2
+#define GS_TARGET           /* baseline */
+#define GS_LOADU( p )       _mm_loadu_si128( (const __m128i*)(const void*)(p) )
+#define GS_STOREU( p, v )   _mm_storeu_si128( (__m128i*)(void*)(p), v )
+#define GS_AND( a, b )      _mm_and_si128( a, b )
+#define GS_OR( a, b )       _mm_or_si128( a, b )
+#define GS_XOR( a, b )      _mm_xor_si128( a, b )
+#define GS_AVG( a, b )      gs_avg_sse2( a, b )
+#define GS_FILTER( c, l, r, a, b )  gs_filter_sse2( c, l, r, a, b )
+#define GS_SET16( x )       _mm_set1_epi16( (short)(x) )
+#define GS_ADD16( a, b )    _mm_add_epi16( a, b )
+#define GS_SRL16( v, n )    _mm_srli_epi16( v, n )
+#define GS_SLL16( v, n )    _mm_slli_epi16( v, n )
+
+#include "grswzvec.h"
+
+#endif /* GR_SWIZZLE_SSE2 */
+
+
+#ifdef GR_SWIZZLE_NEON
+
+#include <arm_neon.h>
+
+
+static __inline uint8x16_t
+gs_filter_neon( uint8x16_t  c,
+                uint8x16_t  l,
+                uint8x16_t  r,
+                uint8x16_t  a,
+                uint8x16_t  b )
+{
+  uint16x8_t  lo, hi;
+
+
+  lo = vaddq_u16( vaddl_u8( vget_low_u8( l ), vget_low_u8( r ) ),
+                  vaddl_u8( vget_low_u8( a ), vget_low_u8( b ) ) );
+  hi = vaddq_u16( vaddl_u8( vget_high_u8( l ), vget_high_u8( r ) ),
+                  vaddl_u8( vget_high_u8( a ), vget_high_u8( b ) ) );
+
+  lo = vaddq_u16( lo, vshll_n_u8( vget_low_u8( c ), 2 ) );
+  hi = vaddq_u16( hi, vshll_n_u8( vget_high_u8( c ), 2 ) );
+
+  return vcombine_u8( vshrn_n_u16( lo, 3 ), vshrn_n_u16( hi, 3 ) );
+}
+
+
+#define GS_U16( v )         vreinterpretq_u16_u8( v )
+#define GS_U8( v )          vreinterpretq_u8_u16( v )
+
+#define GS_T                uint8x16_t
+#define GS_N                16
+#define GS_NAME( x )        x ## neon
+#define GS_TARGET           /* baseline */
+#define GS_LOADU( p )       vld1q_u8( (const uint8_t*)(const void*)(p) )
+#define GS_STOREU( p, v )   vst1q_u8( (uint8_t*)(void*)(p), v )
+#define GS_AND( a, b )      vandq_u8( a, b )
+#define GS_OR( a, b )       vorrq_u8( a, b )
+#define GS_XOR( a, b )      veorq_u8( a, b )
+#define GS_AVG( a, b )      vhaddq_u8( a, b )
+#define GS_FILTER( c, l, r, a, b )  gs_filter_neon( c, l, r, a, b )
+#define GS_SET16( x )       GS_U8( vdupq_n_u16( (uint16_t)(x) ) )
+#define GS_ADD16( a, b )    GS_U8( vaddq_u16( GS_U16( a ), GS_U16( b ) ) )
+#define GS_SRL16( v, n )    GS_U8( vshrq_n_u16( GS_U16( v ), n ) )
+#define GS_SLL16( v, n )    GS_U8( vshlq_n_u16( GS_U16( v ), n ) )
+
+#include "grswzvec.h"
+
+#undef GS_U16
+#undef GS_U8
+
+#endif /* GR_SWIZZLE_NEON */
+
+
+typedef enum  gr_swizzle_format_
+{
+  GR_SWIZZLE_RGB24 = 0,
+  GR_SWIZZLE_RGB565,
+  GR_SWIZZLE_XRGB32,
+
+  GR_SWIZZLE_MAX
+
+} gr_swizzle_format;
+
+
+typedef struct  gr_swizzle_funcs_
+{
+  filter_func_t  swizzle;
+  filter_func_t  postprocess;
+
+} gr_swizzle_funcs;
+
+
+static const gr_swizzle_funcs  swizzle_funcs_generic[GR_SWIZZLE_MAX] =
+{
+  { swizzle_line_rgb24,  postprocess_line_rgb24  },
+  { swizzle_line_rgb565, postprocess_line_rgb565 },
+  { swizzle_line_xrgb32, postprocess_line_xrgb32 }
+};
+
+#ifdef GR_SWIZZLE_SSE2
+static const gr_swizzle_funcs  swizzle_funcs_sse2[GR_SWIZZLE_MAX] =
+{
+  { swizzle_line_rgb24_sse2,  postprocess_line_rgb24_sse2  },
+  { swizzle_line_rgb565_sse2, postprocess_line_rgb565_sse2 },
+  { swizzle_line_xrgb32_sse2, postprocess_line_xrgb32_sse2 }
+};
+#endif
+
+#ifdef GR_SWIZZLE_NEON
+static const gr_swizzle_funcs  swizzle_funcs_neon[GR_SWIZZLE_MAX] =
+{
+  { swizzle_line_rgb24_neon,  postprocess_line_rgb24_neon  },
+  { swizzle_line_rgb565_neon, postprocess_line_rgb565_neon },
+  { swizzle_line_xrgb32_neon, postprocess_line_xrgb32_neon }
+};
+#endif
+
+
+/* the line functions of a format for the selected instruction set */
+static const gr_swizzle_funcs*
+gr_swizzle_get_funcs( gr_swizzle_format  format )
+{
+  switch ( gblender_simd_get() )
+  {
+#ifdef GR_SWIZZLE_SSE2
+  case GBLENDER_SIMD_SSE2:
+  case GBLENDER_SIMD_AVX2:   /* includes SSE2 */
+    return &swizzle_funcs_sse2[format];
+#endif
+
+#ifdef GR_SWIZZLE_NEON
+  case GBLENDER_SIMD_NEON:
+    return &swizzle_funcs_neon[format];
+#endif
+
+  default:
+    return &swizzle_funcs_generic[format];
+  }
+}
+
+
 static void
 gr_swizzle_generic( unsigned char*    read_buff,
                    int                read_pitch,
@@ -610,14 +857,17 @@ gr_swizzle_rect_rgb24( unsigned char*    read_buff,
                        int               width,
                        int               height )
 {
+  const gr_swizzle_funcs*  funcs = gr_swizzle_get_funcs( GR_SWIZZLE_RGB24 );
+
+
   gr_swizzle_generic( read_buff, read_pitch,
                       write_buff, write_pitch,
                       buff_width,
                       buff_height,
                       x, y, width, height,
                       3,
-                      swizzle_line_rgb24,
-                      postprocess_line_rgb24 );
+                      funcs->swizzle,
+                      funcs->postprocess );
 }
 
 
@@ -634,14 +884,17 @@ gr_swizzle_rect_rgb565( unsigned char*    read_buff,
                         int               width,
                         int               height )
 {
+  const gr_swizzle_funcs*  funcs = gr_swizzle_get_funcs( GR_SWIZZLE_RGB565 );
+
+
   gr_swizzle_generic( read_buff, read_pitch,
                       write_buff, write_pitch,
                       buff_width,
                       buff_height,
                       x, y, width, height,
                       2,
-                      swizzle_line_rgb565,
-                      postprocess_line_rgb565 );
+                      funcs->swizzle,
+                      funcs->postprocess );
 }
 
 
@@ -658,14 +911,17 @@ gr_swizzle_rect_xrgb32( unsigned char*    read_buff,
                         int               width,
                         int               height )
 {
+  const gr_swizzle_funcs*  funcs = gr_swizzle_get_funcs( GR_SWIZZLE_XRGB32 );
+
+
   gr_swizzle_generic( read_buff, read_pitch,
                       write_buff, write_pitch,
                       buff_width,
                       buff_height,
                       x, y, width, height,
                       4,
-                      swizzle_line_xrgb32,
-                      postprocess_line_xrgb32 );
+                      funcs->swizzle,
+                      funcs->postprocess );
 }
 
 
@@ -0,0 +1,365 @@
+/****************************************************************************/
+/*                                                                          */
+/*  The FreeType project -- a free and portable quality TrueType renderer.  */
+/*                                                                          */
+/*  Copyright (C) 2022 by                                                   */
+/*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
+/*                                                                          */
+/*  grswzvec.h: vectorized swizzling, to be included by `grswizzle.c'       */
+/*              once per instruction set, like `gblvec.h'.                  */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * The including file defines a set of operations on a vector `GS_T' of
+ * GS_N bytes, also seen as GS_N/2 16-bit lanes:
+ *
+ *   GS_NAME(x)          x, decorated with the instruction set name
+ *   GS_TARGET           function attributes needed for the instructions
+ *   GS_LOADU(p)         load GS_N bytes from `p'
+ *   GS_STOREU(p,v)      store GS_N bytes to `p'
+ *   GS_AND, GS_OR,      bitwise operations
+ *   GS_XOR
+ *   GS_AVG(a,b)         (a + b) >> 1 for each byte
+ *   GS_FILTER(c,l,      (4*c + l + r + a + b) >> 3 for each byte
+ *             r,a,b)
+ *   GS_SET16(x)         broadcast 16-bit `x'
+ *   GS_ADD16(a,b)       16-bit addition
+ *   GS_SRL16(v,n)       16-bit logical shifts by a constant
+ *   GS_SLL16(v,n)
+ *
+ * The scalar routines mask each pixel to the one channel (or two
+ * stolen neighbour channels) of its phase.  The kernels below compute
+ * all channels at once, which gives the same values, and then apply
+ * a mask pattern repeating every three pixels.  The last pixels of a
+ * line are left to the scalar routines.
+ */
+
+
+#define GS_FIELD( v, s, m )  GS_AND( GS_SRL16( v, s ), GS_SET16( m ) )
+
+  /* pass the pixels after `done' to the scalar routine `func' */
+#define GS_SCALAR_TAIL( func, pix_bytes )                            \
+          if ( done < width )                                        \
+          {                                                          \
+            unsigned char*  tail[3];                                 \
+                                                                     \
+                                                                     \
+            tail[0] = lines[0] + done * pix_bytes;                   \
+            tail[1] = lines[1] + done * pix_bytes;                   \
+            tail[2] = lines[2] + done * pix_bytes;                   \
+                                                                     \
+            func( tail, write + done * pix_bytes,                    \
+                  width - done, ( offset + done ) % 3 );             \
+          }
+
+
+  /* the 3x3 filter of one 5- or 6-bit field of RGB565 pixels */
+static __inline GS_T GS_TARGET
+GS_NAME( gs_filter_field_ )( GS_T  c,
+                             GS_T  l,
+                             GS_T  r,
+                             GS_T  a,
+                             GS_T  b,
+                             int   shift,
+                             int   mask )
+{
+  GS_T  sum;
+
+
+  /* shift counts must be constants, and NEON has no shifts by 0 */
+  switch ( shift )
+  {
+  case 11:
+    sum = GS_ADD16( GS_ADD16( GS_FIELD( l, 11, mask ),
+                              GS_FIELD( r, 11, mask ) ),
+                    GS_ADD16( GS_FIELD( a, 11, mask ),
+                              GS_FIELD( b, 11, mask ) ) );
+    sum = GS_ADD16( sum, GS_SLL16( GS_FIELD( c, 11, mask ), 2 ) );
+    return GS_SLL16( GS_SRL16( sum, 3 ), 11 );
+
+  case 5:
+    sum = GS_ADD16( GS_ADD16( GS_FIELD( l, 5, mask ),
+                              GS_FIELD( r, 5, mask ) ),
+                    GS_ADD16( GS_FIELD( a, 5, mask ),
+                              GS_FIELD( b, 5, mask ) ) );
+    sum = GS_ADD16( sum, GS_SLL16( GS_FIELD( c, 5, mask ), 2 ) );
+    return GS_SLL16( GS_SRL16( sum, 3 ), 5 );
+
+  default:
+    sum = GS_ADD16( GS_ADD16( GS_AND( l, GS_SET16( mask ) ),
+                              GS_AND( r, GS_SET16( mask ) ) ),
+                    GS_ADD16( GS_AND( a, GS_SET16( mask ) ),
+                              GS_AND( b, GS_SET16( mask ) ) ) );
+    sum = GS_ADD16( sum, GS_SLL16( GS_AND( c, GS_SET16( mask ) ), 2 ) );
+    return GS_SRL16( sum, 3 );
+  }
+}
+
+
+  /* (a + b) >> 1 for each field of RGB565 pixels */
+static __inline GS_T GS_TARGET
+GS_NAME( gs_avg565_ )( GS_T  a,
+                       GS_T  b )
+{
+  /* drop the low bit of each field so that none leaks into the next */
+  return GS_ADD16( GS_AND( a, b ),
+                   GS_SRL16( GS_AND( GS_XOR( a, b ),
+                                     GS_SET16( 0xF7DE ) ), 1 ) );
+}
+
+
+  /* filter and mask whole vectors of a line of 3- or 4-byte pixels; */
+  /* return the number of pixels done                                */
+static int GS_TARGET
+GS_NAME( gs_swizzle_bytes_ )( unsigned char**       lines,
+                              unsigned char*        write,
+                              int                   width,
+                              int                   pix_bytes,
+                              const unsigned char*  masks,
+                              int                   phase )
+{
+  const unsigned char*  above   = lines[0] + pix_bytes;
+  const unsigned char*  current = lines[1] + pix_bytes;
+  const unsigned char*  below   = lines[2] + pix_bytes;
+  int                   period  = 3 * pix_bytes;
+  int                   step    = GS_N % period;
+  int                   count   = width * pix_bytes;
+  int                   nn;
+
+
+  for ( nn = 0; nn + GS_N <= count; nn += GS_N )
+  {
+    GS_T  v = GS_FILTER( GS_LOADU( current + nn ),
+                         GS_LOADU( current + nn - pix_bytes ),
+                         GS_LOADU( current + nn + pix_bytes ),
+                         GS_LOADU( above + nn ),
+                         GS_LOADU( below + nn ) );
+
+
+    GS_STOREU( write + nn, GS_AND( v, GS_LOADU( masks + phase ) ) );
+
+    phase += step;
+    if ( phase >= period )
+      phase -= period;
+  }
+
+  return nn / pix_bytes;
+}
+
+
+  /* the same for the post-processing of 3- or 4-byte pixels, with */
+  /* the phases of the center, right, and left channel masks       */
+static int GS_TARGET
+GS_NAME( gs_postprocess_bytes_ )( unsigned char**       lines,
+                                  unsigned char*        write,
+                                  int                   width,
+                                  int                   pix_bytes,
+                                  const unsigned char*  masks,
+                                  int                   c_phase,
+                                  int                   r_phase,
+                                  int                   l_phase )
+{
+  const unsigned char*  above   = lines[0] + pix_bytes;
+  const unsigned char*  current = lines[1] + pix_bytes;
+  const unsigned char*  below   = lines[2] + pix_bytes;
+  int                   period  = 3 * pix_bytes;
+  int                   step    = GS_N % period;
+  int                   count   = width * pix_bytes;
+  int                   nn;
+
+
+  for ( nn = 0; nn + GS_N <= count; nn += GS_N )
+  {
+    GS_T  center = GS_LOADU( current + nn );
+    GS_T  right  = GS_AVG( GS_LOADU( current + nn + pix_bytes ),
+                           GS_LOADU( below + nn ) );
+    GS_T  left   = GS_AVG( GS_LOADU( current + nn - pix_bytes ),
+                           GS_LOADU( above + nn ) );
+
+
+    GS_STOREU( write + nn,
+               GS_OR( GS_OR( GS_AND( center, GS_LOADU( masks + c_phase ) ),
+                             GS_AND( right,  GS_LOADU( masks + r_phase ) ) ),
+                      GS_AND( left, GS_LOADU( masks + l_phase ) ) ) );
+
+    c_phase += step;
+    if ( c_phase >= period )
+      c_phase -= period;
+    r_phase += step;
+    if ( r_phase >= period )
+      r_phase -= period;
+    l_phase += step;
+    if ( l_phase >= period )
+      l_phase -= period;
+  }
+
+  return nn / pix_bytes;
+}
+
+
+static void GS_TARGET
+GS_NAME( swizzle_line_rgb24_ )( unsigned char**  lines,
+                                unsigned char*   write,
+                                int              width,
+                                int              offset )
+{
+  int  done = GS_NAME( gs_swizzle_bytes_ )( lines, write, width, 3,
+                                            swizzle_masks_rgb24,
+                                            3 * offset );
+
+
+  GS_SCALAR_TAIL( swizzle_line_rgb24, 3 );
+}
+
+
+static void GS_TARGET
+GS_NAME( postprocess_line_rgb24_ )( unsigned char**  lines,
+                                    unsigned char*   write,
+                                    int              width,
+                                    int              offset )
+{
+  int  done = GS_NAME( gs_postprocess_bytes_ )( lines, write, width, 3,
+                                                swizzle_masks_rgb24,
+                                                3 * offset,
+                                                3 * ( ( offset + 1 ) % 3 ),
+                                                3 * ( ( offset + 2 ) % 3 ) );
+
+
+  GS_SCALAR_TAIL( postprocess_line_rgb24, 3 );
+}
+
+
+static void GS_TARGET
+GS_NAME( swizzle_line_xrgb32_ )( unsigned char**  lines,
+                                 unsigned char*   write,
+                                 int              width,
+                                 int              offset )
+{
+  int  done = GS_NAME( gs_swizzle_bytes_ )(
+                lines, write, width, 4,
+                (const unsigned char*)swizzle_masks_xrgb32,
+                4 * offset );
+
+
+  GS_SCALAR_TAIL( swizzle_line_xrgb32, 4 );
+}
+
+
+static void GS_TARGET
+GS_NAME( postprocess_line_xrgb32_ )( unsigned char**  lines,
+                                     unsigned char*   write,
+                                     int              width,
+                                     int              offset )
+{
+  int  done = GS_NAME( gs_postprocess_bytes_ )(
+                lines, write, width, 4,
+                (const unsigned char*)swizzle_masks_xrgb32,
+                4 * ( ( offset + 1 ) % 3 ),
+                4 * ( ( offset + 2 ) % 3 ),
+                4 * offset );
+
+
+  GS_SCALAR_TAIL( postprocess_line_xrgb32, 4 );
+}
+
+
+static void GS_TARGET
+GS_NAME( swizzle_line_rgb565_ )( unsigned char**  lines,
+                                 unsigned char*   write,
+                                 int              width,
+                                 int              offset )
+{
+  const unsigned short*  above   = (const unsigned short*)lines[0] + 1;
+  const unsigned short*  current = (const unsigned short*)lines[1] + 1;
+  const unsigned short*  below   = (const unsigned short*)lines[2] + 1;
+  unsigned short*        out     = (unsigned short*)write;
+  int                    phase   = offset;
+  int                    done;
+
+
+  for ( done = 0; done + GS_N / 2 <= width; done += GS_N / 2 )
+  {
+    GS_T  c = GS_LOADU( current + done );
+    GS_T  l = GS_LOADU( current + done - 1 );
+    GS_T  r = GS_LOADU( current + done + 1 );
+    GS_T  a = GS_LOADU( above + done );
+    GS_T  b = GS_LOADU( below + done );
+    GS_T  v;
+
+
+    v = GS_OR( GS_OR( GS_NAME( gs_filter_field_ )( c, l, r, a, b, 11, 31 ),
+                      GS_NAME( gs_filter_field_ )( c, l, r, a, b,  5, 63 ) ),
+               GS_NAME( gs_filter_field_ )( c, l, r, a, b, 0, 31 ) );
+
+    GS_STOREU( out + done,
+               GS_AND( v, GS_LOADU( swizzle_masks_rgb565 + phase ) ) );
+
+    phase += ( GS_N / 2 ) % 3;
+    if ( phase >= 3 )
+      phase -= 3;
+  }
+
+  GS_SCALAR_TAIL( swizzle_line_rgb565, 2 );
+}
+
+
+static void GS_TARGET
+GS_NAME( postprocess_line_rgb565_ )( unsigned char**  lines,
+                                     unsigned char*   write,
+                                     int              width,
+                                     int              offset )
+{
+  const unsigned short*  above   = (const unsigned short*)lines[0] + 1;
+  const unsigned short*  current = (const unsigned short*)lines[1] + 1;
+  const unsigned short*  below   = (const unsigned short*)lines[2] + 1;
+  unsigned short*        out     = (unsigned short*)write;
+  int                    phase   = offset;
+  int                    done;
+
+
+  for ( done = 0; done + GS_N / 2 <= width; done += GS_N / 2 )
+  {
+    GS_T  center = GS_LOADU( current + done );
+    GS_T  right  = GS_NAME( gs_avg565_ )( GS_LOADU( current + done + 1 ),
+                                          GS_LOADU( below + done ) );
+    GS_T  left   = GS_NAME( gs_avg565_ )( GS_LOADU( current + done - 1 ),
+                                          GS_LOADU( above + done ) );
+    const unsigned short*  m = swizzle_masks_rgb565 + phase;
+
+
+    GS_STOREU( out + done,
+               GS_OR( GS_OR( GS_AND( left,   GS_LOADU( m ) ),
+                             GS_AND( center, GS_LOADU( m + 1 ) ) ),
+                      GS_AND( right, GS_LOADU( m + 2 ) ) ) );
+
+    phase += ( GS_N / 2 ) % 3;
+    if ( phase >= 3 )
+      phase -= 3;
+  }
+
+  GS_SCALAR_TAIL( postprocess_line_rgb565, 2 );
+}
+
+
+#undef GS_FIELD
+#undef GS_SCALAR_TAIL
+
+#undef GS_T
+#undef GS_N
+#undef GS_NAME
+#undef GS_TARGET
+#undef GS_LOADU
+#undef GS_STOREU
+#undef GS_AND
+#undef GS_OR
+#undef GS_XOR
+#undef GS_AVG
+#undef GS_FILTER
+#undef GS_SET16
+#undef GS_ADD16
+#undef GS_SRL16
+#undef GS_SLL16
+
+
+/* END */
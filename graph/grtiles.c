@@ -0,0 +1,664 @@
+/****************************************************************************/
+/*                                                                          */
+/*  The FreeType project -- a free and portable quality TrueType renderer.  */
+/*                                                                          */
+/*  Copyright (C) 2022 by                                                   */
+/*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
+/*                                                                          */
+/*  grtiles.c: Tile-parallel glyph blitting.                                */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * grBlitGlyphsToSurface splits the surface into tiles and lists the
+ * glyphs overlapping each tile, in their original order.  The tiles are
+ * then handed out to a pool of threads, each of which owns a private
+ * surface (and therefore a private blender cache) that it points at the
+ * tile before blitting the listed glyphs into it.  The blitters clip to
+ * the tile, so every pixel is written by one thread only, in the same
+ * order as with sequential blitting; the output is identical.
+ */
+
+#include "grobjs.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( _WIN32 )
+#define GR_THREADS_WIN32
+#include <windows.h>
+#elif defined( __unix__ ) || defined( __APPLE__ )
+#define GR_THREADS_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+#define GR_TILE_WIDTH     128
+#define GR_TILE_HEIGHT     64
+#define GR_THREADS_MAX     16
+
+/* batches covering fewer glyph pixels are not worth waking the pool */
+#define GR_PARALLEL_MIN  16384
+
+
+#if defined( GR_THREADS_PTHREAD )
+
+  typedef pthread_mutex_t  grMutex;
+  typedef pthread_cond_t   grCond;
+  typedef pthread_t        grThread;
+
+#define GR_MUTEX_INIT( m )    pthread_mutex_init( &(m), NULL )
+#define GR_MUTEX_DONE( m )    pthread_mutex_destroy( &(m) )
+#define GR_LOCK( m )          pthread_mutex_lock( &(m) )
+#define GR_UNLOCK( m )        pthread_mutex_unlock( &(m) )
+#define GR_COND_INIT( c )     pthread_cond_init( &(c), NULL )
+#define GR_COND_DONE( c )     pthread_cond_destroy( &(c) )
+#define GR_WAIT( c, m )       pthread_cond_wait( &(c), &(m) )
+#define GR_BROADCAST( c )     pthread_cond_broadcast( &(c) )
+
+#elif defined( GR_THREADS_WIN32 )
+
+  typedef CRITICAL_SECTION    grMutex;
+  typedef CONDITION_VARIABLE  grCond;
+  typedef HANDLE              grThread;
+
+#define GR_MUTEX_INIT( m )    InitializeCriticalSection( &(m) )
+#define GR_MUTEX_DONE( m )    DeleteCriticalSection( &(m) )
+#define GR_LOCK( m )          EnterCriticalSection( &(m) )
+#define GR_UNLOCK( m )        LeaveCriticalSection( &(m) )
+#define GR_COND_INIT( c )     InitializeConditionVariable( &(c) )
+#define GR_COND_DONE( c )     (void)0
+#define GR_WAIT( c, m )       SleepConditionVariableCS( &(c), &(m), INFINITE )
+#define GR_BROADCAST( c )     WakeAllConditionVariable( &(c) )
+
+#endif
+
+
+  typedef struct  grTilePool_
+  {
+    int                 requested;    /* by grSetBlitThreads, 0 if none */
+    int                 num_threads;  /* including the caller           */
+    grSurface*          surfaces[GR_THREADS_MAX];
+
+    /* the current batch */
+    grSurface*          target;
+    const grGlyphBlit*  blits;
+    int*                tile_start;   /* `num_tiles + 1' offsets          */
+    int*                tile_list;    /* indices into `blits'             */
+    int                 tile_start_size;
+    int                 tile_list_size;
+    int                 tiles_x;
+    int                 num_tiles;
+    int                 next_tile;
+
+#if defined( GR_THREADS_PTHREAD ) || defined( GR_THREADS_WIN32 )
+    grMutex             lock;
+    grCond              work;         /* signals a new batch or `quit'    */
+    grCond              done;         /* signals `busy' reaching zero     */
+    grThread            threads[GR_THREADS_MAX];
+    unsigned int        batch;        /* incremented for each batch       */
+    int                 busy;         /* threads still working on it      */
+    int                 quit;
+#endif
+
+  } grTilePool;
+
+
+  static grTilePool  gr_tiles;
+
+
+  static int
+  gr_tiles_bytes_per_pixel( grPixelMode  mode )
+  {
+    switch ( mode )
+    {
+    case gr_pixel_mode_gray:
+      return 1;
+    case gr_pixel_mode_rgb555:
+    case gr_pixel_mode_rgb565:
+      return 2;
+    case gr_pixel_mode_rgb24:
+      return 3;
+    case gr_pixel_mode_rgb32:
+      return 4;
+    default:
+      return 0;
+    }
+  }
+
+
+  /* the visible box of a glyph, or 0 if it is empty or unsupported */
+  static int
+  gr_tiles_glyph_box( const grBitmap*     target,
+                      const grGlyphBlit*  blit,
+                      int*                box )
+  {
+    int  x0 = (int)blit->x;
+    int  y0 = (int)blit->y;
+    int  x1, y1;
+
+
+    if ( !blit->glyph )
+      return 0;
+
+    x1 = x0 + blit->glyph->width;
+    y1 = y0 + blit->glyph->rows;
+
+    switch ( blit->glyph->mode )
+    {
+    case gr_pixel_mode_lcd:
+    case gr_pixel_mode_lcd2:
+      x1 = x0 + blit->glyph->width / 3;
+      break;
+    case gr_pixel_mode_lcdv:
+    case gr_pixel_mode_lcdv2:
+      y1 = y0 + blit->glyph->rows / 3;
+      break;
+    case gr_pixel_mode_gray:
+    case gr_pixel_mode_bgra:
+    case gr_pixel_mode_mono:
+      break;
+    default:
+      return 0;
+    }
+
+    if ( x0 < 0 )
+      x0 = 0;
+    if ( y0 < 0 )
+      y0 = 0;
+    if ( x1 > target->width )
+      x1 = target->width;
+    if ( y1 > target->rows )
+      y1 = target->rows;
+
+    if ( x0 >= x1 || y0 >= y1 )
+      return 0;
+
+    box[0] = x0 / GR_TILE_WIDTH;
+    box[1] = y0 / GR_TILE_HEIGHT;
+    box[2] = ( x1 - 1 ) / GR_TILE_WIDTH;
+    box[3] = ( y1 - 1 ) / GR_TILE_HEIGHT;
+
+    return ( x1 - x0 ) * ( y1 - y0 );
+  }
+
+
+  static int
+  gr_tiles_grow( int**  buffer,
+                 int*   size,
+                 int    needed )
+  {
+    int*  block;
+
+
+    if ( needed <= *size )
+      return 1;
+
+    needed += needed / 2;
+    block   = (int*)realloc( *buffer, (size_t)needed * sizeof ( int ) );
+    if ( !block )
+      return 0;
+
+    *buffer = block;
+    *size   = needed;
+
+    return 1;
+  }
+
+
+  /* blit the glyphs of a tile through a worker's surface */
+  static void
+  gr_tiles_blit_tile( grSurface*  worker,
+                      int         tile )
+  {
+    grBitmap*  target = &gr_tiles.target->bitmap;
+    int        tx     = ( tile % gr_tiles.tiles_x ) * GR_TILE_WIDTH;
+    int        ty     = ( tile / gr_tiles.tiles_x ) * GR_TILE_HEIGHT;
+    int        bpp    = gr_tiles_bytes_per_pixel( target->mode );
+    int        n      = gr_tiles.tile_start[tile];
+    int        limit  = gr_tiles.tile_start[tile + 1];
+
+
+    worker->bitmap        = *target;
+    worker->bitmap.width  = target->width - tx;
+    worker->bitmap.rows   = target->rows - ty;
+
+    if ( worker->bitmap.width > GR_TILE_WIDTH )
+      worker->bitmap.width = GR_TILE_WIDTH;
+    if ( worker->bitmap.rows > GR_TILE_HEIGHT )
+      worker->bitmap.rows = GR_TILE_HEIGHT;
+
+    /* with a negative pitch, the buffer starts with the bottom row */
+    if ( target->pitch < 0 )
+      worker->bitmap.buffer -= ( target->rows - ty - worker->bitmap.rows ) *
+                               target->pitch;
+    else
+      worker->bitmap.buffer += ty * target->pitch;
+
+    worker->bitmap.buffer += tx * bpp;
+
+    for ( ; n < limit; n++ )
+    {
+      const grGlyphBlit*  blit = gr_tiles.blits + gr_tiles.tile_list[n];
+
+
+      grBlitGlyphToSurface( worker, blit->glyph,
+                            blit->x - tx, blit->y - ty, blit->color );
+    }
+  }
+
+
+  /* take tiles until there are none left */
+  static void
+  gr_tiles_run( int  index )
+  {
+    grSurface*  worker = gr_tiles.surfaces[index];
+
+
+    for (;;)
+    {
+      int  tile;
+
+
+#if defined( GR_THREADS_PTHREAD ) || defined( GR_THREADS_WIN32 )
+      GR_LOCK( gr_tiles.lock );
+      tile = gr_tiles.next_tile++;
+      GR_UNLOCK( gr_tiles.lock );
+#else
+      tile = gr_tiles.next_tile++;
+#endif
+
+      if ( tile >= gr_tiles.num_tiles )
+        break;
+
+      if ( gr_tiles.tile_start[tile] < gr_tiles.tile_start[tile + 1] )
+        gr_tiles_blit_tile( worker, tile );
+    }
+  }
+
+
+#if defined( GR_THREADS_PTHREAD ) || defined( GR_THREADS_WIN32 )
+
+  static void
+  gr_tiles_thread( int  index )
+  {
+    unsigned int  seen = 0;
+
+
+    GR_LOCK( gr_tiles.lock );
+
+    for (;;)
+    {
+      while ( gr_tiles.batch == seen && !gr_tiles.quit )
+        GR_WAIT( gr_tiles.work, gr_tiles.lock );
+
+      if ( gr_tiles.quit )
+        break;
+
+      seen = gr_tiles.batch;
+      GR_UNLOCK( gr_tiles.lock );
+
+      gr_tiles_run( index );
+
+      GR_LOCK( gr_tiles.lock );
+      if ( --gr_tiles.busy == 0 )
+        GR_BROADCAST( gr_tiles.done );
+    }
+
+    GR_UNLOCK( gr_tiles.lock );
+  }
+
+
+#if defined( GR_THREADS_PTHREAD )
+
+  static void*
+  gr_tiles_thread_main( void*  arg )
+  {
+    gr_tiles_thread( (int)(size_t)arg );
+    return NULL;
+  }
+
+#else
+
+  static DWORD WINAPI
+  gr_tiles_thread_main( LPVOID  arg )
+  {
+    gr_tiles_thread( (int)(size_t)arg );
+    return 0;
+  }
+
+#endif
+
+
+  static int
+  gr_tiles_default_threads( void )
+  {
+    const char*  env = getenv( "GR_BLIT_THREADS" );
+    int          n   = 1;
+
+
+    if ( env && *env )
+      return atoi( env );
+
+#if defined( GR_THREADS_PTHREAD ) && defined( _SC_NPROCESSORS_ONLN )
+    n = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#elif defined( GR_THREADS_WIN32 )
+    {
+      SYSTEM_INFO  info;
+
+
+      GetSystemInfo( &info );
+      n = (int)info.dwNumberOfProcessors;
+    }
+#endif
+
+    return n;
+  }
+
+
+  /* start the pool; it is left with one thread if anything fails */
+  static void
+  gr_tiles_start( void )
+  {
+    int  n = gr_tiles.requested ? gr_tiles.requested
+                                : gr_tiles_default_threads();
+    int  i;
+
+
+    if ( n < 1 )
+      n = 1;
+    if ( n > GR_THREADS_MAX )
+      n = GR_THREADS_MAX;
+
+    gr_tiles.surfaces[0] = (grSurface*)grAlloc( sizeof ( grSurface ) );
+    if ( !gr_tiles.surfaces[0] )
+      return;
+
+    gr_tiles.num_threads = 1;
+    if ( n == 1 )
+      return;
+
+    GR_MUTEX_INIT( gr_tiles.lock );
+    GR_COND_INIT( gr_tiles.work );
+    GR_COND_INIT( gr_tiles.done );
+
+    gr_tiles.batch = 0;
+    gr_tiles.busy  = 0;
+    gr_tiles.quit  = 0;
+
+    for ( i = 1; i < n; i++ )
+    {
+      gr_tiles.surfaces[i] = (grSurface*)grAlloc( sizeof ( grSurface ) );
+      if ( !gr_tiles.surfaces[i] )
+        break;
+
+#if defined( GR_THREADS_PTHREAD )
+      if ( pthread_create( &gr_tiles.threads[i], NULL,
+                           gr_tiles_thread_main, (void*)(size_t)i ) )
+#else
+      gr_tiles.threads[i] = CreateThread( NULL, 0, gr_tiles_thread_main,
+                                          (LPVOID)(size_t)i, 0, NULL );
+      if ( !gr_tiles.threads[i] )
+#endif
+      {
+        grFree( gr_tiles.surfaces[i] );
+        gr_tiles.surfaces[i] = NULL;
+        break;
+      }
+
+      gr_tiles.num_threads++;
+    }
+  }
+
+#endif /* GR_THREADS_PTHREAD || GR_THREADS_WIN32 */
+
+
+  /* give the private blenders the configuration of the target's */
+  static void
+  gr_tiles_sync_blender( GBlender  blender,
+                         GBlender  model )
+  {
+    if ( blender->gamma != model->gamma )
+      gblender_init( blender, model->gamma );
+
+    if ( blender->key_count != model->key_count ||
+         blender->policy    != model->policy    )
+      gblender_set_cache( blender, model->key_count, model->policy );
+
+    if ( blender->direct_mode != model->direct_mode )
+      gblender_set_direct( blender, model->direct_mode );
+  }
+
+
+  extern int
+  grBlitGlyphsToSurface( grSurface*          surface,
+                         const grGlyphBlit*  blits,
+                         int                 count )
+  {
+    grBitmap*   target;
+    grSurface*  tracking;
+    long        area   = 0;
+    int         error  = 0;
+    int         num_entries;
+    int         tiles_y;
+    int         box[4];
+    int         i, x, y;
+
+
+    if ( !surface || ( !blits && count > 0 ) )
+    {
+      grError = gr_err_bad_argument;
+      return -1;
+    }
+
+    target = &surface->bitmap;
+    if ( !gr_tiles_bytes_per_pixel( target->mode ) )
+    {
+      grError = gr_err_bad_target_depth;
+      return -1;
+    }
+
+#if defined( GR_THREADS_PTHREAD ) || defined( GR_THREADS_WIN32 )
+    if ( !gr_tiles.num_threads )
+      gr_tiles_start();
+#endif
+
+    if ( gr_tiles.num_threads <= 1 )
+      goto Sequential;
+
+    /* count the tiles of each glyph */
+    gr_tiles.tiles_x   = ( target->width  + GR_TILE_WIDTH  - 1 ) /
+                         GR_TILE_WIDTH;
+    tiles_y            = ( target->rows   + GR_TILE_HEIGHT - 1 ) /
+                         GR_TILE_HEIGHT;
+    gr_tiles.num_tiles = gr_tiles.tiles_x * tiles_y;
+
+    if ( !gr_tiles_grow( &gr_tiles.tile_start, &gr_tiles.tile_start_size,
+                         gr_tiles.num_tiles + 1 ) )
+      goto Sequential;
+
+    memset( gr_tiles.tile_start, 0,
+            (size_t)( gr_tiles.num_tiles + 1 ) * sizeof ( int ) );
+
+    for ( i = 0; i < count; i++ )
+    {
+      int  size = gr_tiles_glyph_box( target, blits + i, box );
+
+
+      if ( !size )
+        continue;
+
+      area += size;
+
+      for ( y = box[1]; y <= box[3]; y++ )
+        for ( x = box[0]; x <= box[2]; x++ )
+          gr_tiles.tile_start[y * gr_tiles.tiles_x + x]++;
+    }
+
+    if ( area < GR_PARALLEL_MIN )
+      goto Sequential;
+
+    /* turn the counts into the end offsets of each tile's list */
+    for ( i = 1; i <= gr_tiles.num_tiles; i++ )
+      gr_tiles.tile_start[i] += gr_tiles.tile_start[i - 1];
+
+    num_entries = gr_tiles.tile_start[gr_tiles.num_tiles - 1];
+    gr_tiles.tile_start[gr_tiles.num_tiles] = num_entries;
+
+    if ( !gr_tiles_grow( &gr_tiles.tile_list, &gr_tiles.tile_list_size,
+                         num_entries ) )
+      goto Sequential;
+
+    /* filling the lists backwards leaves the offsets at their starts */
+    /* and the glyphs in their original order                          */
+    for ( i = count - 1; i >= 0; i-- )
+    {
+      if ( !gr_tiles_glyph_box( target, blits + i, box ) )
+        continue;
+
+      for ( y = box[1]; y <= box[3]; y++ )
+        for ( x = box[0]; x <= box[2]; x++ )
+          gr_tiles.tile_list[--gr_tiles.tile_start[y * gr_tiles.tiles_x +
+                                                   x]] = i;
+    }
+
+    for ( i = 0; i < gr_tiles.num_threads; i++ )
+      gr_tiles_sync_blender( gr_tiles.surfaces[i]->gblender,
+                             surface->gblender );
+
+    gr_tiles.target    = surface;
+    gr_tiles.blits     = blits;
+    gr_tiles.next_tile = 0;
+
+#if defined( GR_THREADS_PTHREAD ) || defined( GR_THREADS_WIN32 )
+    GR_LOCK( gr_tiles.lock );
+    gr_tiles.busy = gr_tiles.num_threads - 1;
+    gr_tiles.batch++;
+    GR_BROADCAST( gr_tiles.work );
+    GR_UNLOCK( gr_tiles.lock );
+
+    gr_tiles_run( 0 );
+
+    GR_LOCK( gr_tiles.lock );
+    while ( gr_tiles.busy )
+      GR_WAIT( gr_tiles.done, gr_tiles.lock );
+    GR_UNLOCK( gr_tiles.lock );
+#else
+    gr_tiles_run( 0 );
+#endif
+
+    gr_tiles.target = NULL;
+    gr_tiles.blits  = NULL;
+
+    /* the private surfaces are not tracked; do it like the blitter */
+    tracking = grTrackingSurface( target );
+
+    for ( i = 0; i < count; i++ )
+    {
+      const grGlyphBlit*  blit = blits + i;
+      int                 width, height;
+
+
+      if ( !blit->glyph )
+      {
+        grError = gr_err_bad_argument;
+        error   = -1;
+        continue;
+      }
+
+      /* off-surface glyphs are fine, unsupported ones are not */
+      if ( !gr_tiles_glyph_box( target, blit, box ) )
+      {
+        if ( grBlitGlyphToSurface( surface, blit->glyph,
+                                   blit->x, blit->y, blit->color ) < 0 )
+          error = -1;
+        continue;
+      }
+
+      if ( !tracking )
+        continue;
+
+      width  = blit->glyph->width;
+      height = blit->glyph->rows;
+
+      if ( blit->glyph->mode == gr_pixel_mode_lcd  ||
+           blit->glyph->mode == gr_pixel_mode_lcd2 )
+        width /= 3;
+      else if ( blit->glyph->mode == gr_pixel_mode_lcdv  ||
+                blit->glyph->mode == gr_pixel_mode_lcdv2 )
+        height /= 3;
+
+      grTouchSurface( tracking, (int)blit->x, (int)blit->y, width, height );
+    }
+
+    return error;
+
+  Sequential:
+    for ( i = 0; i < count; i++ )
+      if ( grBlitGlyphToSurface( surface, blits[i].glyph,
+                                 blits[i].x, blits[i].y,
+                                 blits[i].color ) < 0 )
+        error = -1;
+
+    return error;
+  }
+
+
+  extern void
+  grSetBlitThreads( int  num_threads )
+  {
+    grDoneBlitThreads();
+
+    gr_tiles.requested = num_threads < 0 ? 0 : num_threads;
+  }
+
+
+  extern void
+  grDoneBlitThreads( void )
+  {
+    int  i;
+
+
+#if defined( GR_THREADS_PTHREAD ) || defined( GR_THREADS_WIN32 )
+    if ( gr_tiles.num_threads > 1 )
+    {
+      GR_LOCK( gr_tiles.lock );
+      gr_tiles.quit = 1;
+      GR_BROADCAST( gr_tiles.work );
+      GR_UNLOCK( gr_tiles.lock );
+
+      for ( i = 1; i < gr_tiles.num_threads; i++ )
+      {
+#if defined( GR_THREADS_PTHREAD )
+        pthread_join( gr_tiles.threads[i], NULL );
+#else
+        WaitForSingleObject( gr_tiles.threads[i], INFINITE );
+        CloseHandle( gr_tiles.threads[i] );
+#endif
+      }
+
+      GR_COND_DONE( gr_tiles.done );
+      GR_COND_DONE( gr_tiles.work );
+      GR_MUTEX_DONE( gr_tiles.lock );
+    }
+#endif
+
+    for ( i = 0; i < gr_tiles.num_threads; i++ )
+    {
+      grFree( gr_tiles.surfaces[i] );
+      gr_tiles.surfaces[i] = NULL;
+    }
+
+    gr_tiles.num_threads = 0;
+
+    free( gr_tiles.tile_start );
+    free( gr_tiles.tile_list );
+
+    gr_tiles.tile_start      = NULL;
+    gr_tiles.tile_list       = NULL;
+    gr_tiles.tile_start_size = 0;
+    gr_tiles.tile_list_size  = 0;
+  }
+
+
+/* END */
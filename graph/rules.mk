@@ -18,6 +18,7 @@ GRAPH := $(TOP_DIR_2)/graph
 GRAPH_H := $(GRAPH)/gblany.h    \
            $(GRAPH)/gblblit.h   \
            $(GRAPH)/gblender.h  \
+           $(GRAPH)/gblvec.h    \
            $(GRAPH)/graph.h     \
            $(GRAPH)/grconfig.h  \
            $(GRAPH)/grdevice.h  \
@@ -25,17 +26,20 @@ GRAPH_H := $(GRAPH)/gblany.h    \
            $(GRAPH)/grfont.h    \
            $(GRAPH)/grobjs.h    \
            $(GRAPH)/grswizzle.h \
+           $(GRAPH)/grswzvec.h  \
            $(GRAPH)/grtypes.h
 
 
 GRAPH_OBJS := $(OBJ_DIR_2)/gblblit.$(O)   \
               $(OBJ_DIR_2)/gblender.$(O)  \
+              $(OBJ_DIR_2)/gblsimd.$(O)   \
               $(OBJ_DIR_2)/grdevice.$(O)  \
               $(OBJ_DIR_2)/grfill.$(O)    \
               $(OBJ_DIR_2)/grfont.$(O)    \
               $(OBJ_DIR_2)/grinit.$(O)    \
               $(OBJ_DIR_2)/grobjs.$(O)    \
-              $(OBJ_DIR_2)/grswizzle.$(O)
+              $(OBJ_DIR_2)/grswizzle.$(O) \
+              $(OBJ_DIR_2)/grtiles.$(O)
 
 
 
@@ -52,6 +56,11 @@ else
 endif
 
 
+# `grtiles.c' uses POSIX threads.
+#
+GRAPH_LINK += $(THREADS)
+
+
 # Add the rules used to detect and compile graphics driver depending
 # on the current platform.
 #
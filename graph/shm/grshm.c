@@ -0,0 +1,390 @@
+/*******************************************************************
+ *
+ *  grshm.c  Shared memory driver.
+ *
+ *  This driver keeps the surface bitmap in a POSIX shared memory
+ *  object, so that another process can map and display its frames
+ *  without copying them.  The segment layout is `grShmHeader' of
+ *  `grshm.h'.  The driver is only available if the environment
+ *  variable GR_SHM_NAME is set; it then becomes the default device.
+ *
+ *    GR_SHM_NAME    The name of the shared memory object, like
+ *                   `/ftview'.  It is removed when the surface is
+ *                   closed.
+ *
+ *    GR_SHM_NOTIFY  A file descriptor number or the name of a FIFO
+ *                   for notifications.  It must be given, since the
+ *                   demo programs also write to stdout.  The driver
+ *                   writes a line for each event:
+ *
+ *                     frame <number> <x> <y> <width> <height>
+ *                     title <text>
+ *                     done
+ *
+ *                   The area is the part of the frame that has changed.
+ *
+ *    GR_SHM_EVENTS  A file descriptor number or the name of a FIFO
+ *                   for events, in the syntax of `grReadEventScript';
+ *                   the default is stdin.  The demo programs only
+ *                   draw in response to events, so a frame stays
+ *                   intact until the viewer sends the next one.
+ *
+ *  Copyright (C) 2022 by
+ *  D. Turner, R.Wilhelm, and W. Lemberg
+ *
+ *  This file is part of the FreeType project, and may only be used
+ *  modified and distributed under the terms of the FreeType project
+ *  license, LICENSE.TXT. By continuing to use, modify or distribute
+ *  this file you indicate that you have read the license and
+ *  understand and accept it fully.
+ *
+ ******************************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* FT graphics subsystem */
+#include "grobjs.h"
+#include "grdevice.h"
+#include "grshm.h"
+
+
+  typedef struct  grShmSurface_
+  {
+    grSurface       root;
+
+    int             fd;       /* of the shared memory object */
+    unsigned char*  base;     /* its mapping                 */
+    size_t          size;
+
+  } grShmSurface;
+
+
+  static struct
+  {
+    const char*    name;
+    int            notify;
+    grEventScript  events;
+
+  } gr_shm;
+
+
+  /* open a file descriptor given by number or name */
+  static int
+  gr_shm_open_channel( const char*  spec,
+                       int          flags,
+                       int          default_fd )
+  {
+    const char*  p = spec;
+
+
+    if ( !spec || !*spec )
+      return default_fd;
+
+    while ( *p >= '0' && *p <= '9' )
+      p++;
+
+    if ( !*p )
+      return atoi( spec );
+
+    return open( spec, flags );
+  }
+
+
+  static void
+  gr_shm_notify( const char*  format,
+                 ... )
+  {
+    char     line[512];
+    int      len;
+    va_list  ap;
+
+
+    va_start( ap, format );
+    len = vsnprintf( line, sizeof ( line ), format, ap );
+    va_end( ap );
+
+    if ( len >= (int)sizeof ( line ) )
+    {
+      len                       = sizeof ( line ) - 1;
+      line[sizeof ( line ) - 2] = '\n';
+    }
+
+    /* a single write keeps short lines intact on pipes */
+    if ( len > 0 && write( gr_shm.notify, line, (size_t)len ) < 0 )
+      perror( "grshm" );
+  }
+
+
+  static int
+  gr_shm_device_init( void )
+  {
+    const char*  spec;
+    int          fd;
+
+
+    gr_shm.name = getenv( "GR_SHM_NAME" );
+    if ( !gr_shm.name || !*gr_shm.name )
+      return -1;  /* not requested */
+
+    spec = getenv( "GR_SHM_NOTIFY" );
+    if ( !spec || !*spec )
+    {
+      fprintf( stderr, "grshm: GR_SHM_NOTIFY is not set\n" );
+      return -1;
+    }
+
+    /* opening a FIFO waits for the viewer */
+    gr_shm.notify = gr_shm_open_channel( spec, O_WRONLY, -1 );
+    if ( gr_shm.notify < 0 )
+    {
+      perror( "GR_SHM_NOTIFY" );
+      return -1;
+    }
+
+    fd = gr_shm_open_channel( getenv( "GR_SHM_EVENTS" ),
+                              O_RDONLY, STDIN_FILENO );
+
+    gr_shm.events.file     = fd < 0 ? NULL : fdopen( fd, "r" );
+    gr_shm.events.token[0] = '\0';
+    gr_shm.events.pos      = 0;
+
+    if ( !gr_shm.events.file )
+    {
+      perror( "GR_SHM_EVENTS" );
+      if ( gr_shm.notify > STDERR_FILENO )
+        close( gr_shm.notify );
+      return -1;
+    }
+
+    return 0;  /* success */
+  }
+
+
+  static void
+  gr_shm_device_done( void )
+  {
+    if ( gr_shm.events.file && gr_shm.events.file != stdin )
+      fclose( gr_shm.events.file );
+
+    if ( gr_shm.notify > STDERR_FILENO )
+      close( gr_shm.notify );
+
+    gr_shm.events.file = NULL;
+    gr_shm.notify      = -1;
+  }
+
+
+  /* (re)map the segment for a bitmap of the given size */
+  static int
+  gr_shm_surface_map( grShmSurface*  surface,
+                      int            width,
+                      int            height )
+  {
+    grBitmap*       bitmap = &surface->root.bitmap;
+    grBitmap        probe;
+    grShmHeader*    header;
+    size_t          size;
+    unsigned char*  base;
+
+
+    /* get the pitch without allocating any rows */
+    memset( &probe, 0, sizeof ( probe ) );
+    if ( grNewBitmap( bitmap->mode, bitmap->grays, width, 0, &probe ) )
+      return 0;
+    grDoneBitmap( &probe );
+
+    size = GR_SHM_OFFSET + (size_t)probe.pitch * (size_t)height;
+
+    /* never shrink, so that a viewer's old mapping stays valid */
+    if ( size < surface->size )
+      size = surface->size;
+    else if ( ftruncate( surface->fd, (off_t)size ) )
+      return 0;
+
+    base = (unsigned char*)mmap( NULL, size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, surface->fd, 0 );
+    if ( base == (unsigned char*)MAP_FAILED )
+      return 0;
+
+    if ( surface->base )
+      munmap( surface->base, surface->size );
+
+    surface->base = base;
+    surface->size = size;
+
+    bitmap->buffer = base + GR_SHM_OFFSET;
+    bitmap->width  = width;
+    bitmap->rows   = height;
+    bitmap->pitch  = probe.pitch;
+
+    header          = (grShmHeader*)base;
+    header->magic   = GR_SHM_MAGIC;
+    header->version = GR_SHM_VERSION;
+    header->offset  = GR_SHM_OFFSET;
+    header->size    = (unsigned int)size;
+    header->width   = width;
+    header->rows    = height;
+    header->pitch   = probe.pitch;
+    header->mode    = bitmap->mode;
+    header->grays   = bitmap->grays;
+
+    return 1;
+  }
+
+
+  static void
+  gr_shm_surface_set_title( grSurface*   surface,
+                            const char*  title_string )
+  {
+    (void)surface;
+
+    gr_shm_notify( "title %s\n", title_string );
+  }
+
+
+  static void
+  gr_shm_surface_refresh_rect( grSurface*  surface,
+                               int         x,
+                               int         y,
+                               int         width,
+                               int         height )
+  {
+    grShmSurface*  shm    = (grShmSurface*)surface;
+    grShmHeader*   header = (grShmHeader*)shm->base;
+
+
+    header->x = x;
+    header->y = y;
+    header->w = width;
+    header->h = height;
+
+    header->frame++;
+
+    gr_shm_notify( "frame %u %d %d %d %d\n",
+                   header->frame, x, y, width, height );
+  }
+
+
+  static void
+  gr_shm_surface_done( grSurface*  surface )
+  {
+    grShmSurface*  shm = (grShmSurface*)surface;
+
+
+    gr_shm_notify( "done\n" );
+
+    if ( shm->base )
+      munmap( shm->base, shm->size );
+
+    if ( shm->fd >= 0 )
+    {
+      close( shm->fd );
+      shm_unlink( gr_shm.name );
+    }
+
+    shm->base   = NULL;
+    shm->size   = 0;
+    shm->fd     = -1;
+
+    /* the pixels were not allocated by grNewBitmap */
+    surface->bitmap.buffer = NULL;
+  }
+
+
+  static int
+  gr_shm_surface_listen_event( grSurface*  surface,
+                               int         event_mode,
+                               grEvent*    event )
+  {
+    (void)event_mode;
+
+
+    while ( grReadEventScript( &gr_shm.events, event ) )
+    {
+      if ( event->type != gr_event_resize )
+        return 1;
+
+      if ( gr_shm_surface_map( (grShmSurface*)surface,
+                               event->x, event->y ) )
+      {
+        grTouchSurface( surface, 0, 0, event->x, event->y );
+        return 1;
+      }
+    }
+
+    /* the viewer has gone */
+    event->type = gr_event_key;
+    event->key  = grKeyEsc;
+
+    return 1;
+  }
+
+
+  static int
+  gr_shm_surface_init( grSurface*  surface,
+                       grBitmap*   bitmap )
+  {
+    grShmSurface*  shm = (grShmSurface*)surface;
+
+
+    /* Set default mode */
+    if ( bitmap->mode == gr_pixel_mode_none )
+      bitmap->mode = gr_pixel_mode_rgb32;
+
+    shm->fd = shm_open( gr_shm.name, O_RDWR | O_CREAT, 0600 );
+    if ( shm->fd < 0 )
+    {
+      perror( gr_shm.name );
+      return 0;
+    }
+
+    surface->bitmap.mode  = bitmap->mode;
+    surface->bitmap.grays = bitmap->grays;
+
+    if ( !gr_shm_surface_map( shm, bitmap->width, bitmap->rows ) )
+    {
+      perror( gr_shm.name );
+      gr_shm_surface_done( surface );
+      return 0;
+    }
+
+    ( (grShmHeader*)shm->base )->frame = 0;
+
+    *bitmap = surface->bitmap;
+
+    surface->refresh    = 1;       /* one notification per frame */
+    surface->owner      = 0;
+
+    surface->refresh_rect = gr_shm_surface_refresh_rect;
+    surface->set_title    = gr_shm_surface_set_title;
+    surface->listen_event = gr_shm_surface_listen_event;
+    surface->done         = gr_shm_surface_done;
+
+    return 1;
+  }
+
+
+  grDevice  gr_shm_device =
+  {
+    sizeof( grShmSurface ),
+    "shm",
+
+    gr_shm_device_init,
+    gr_shm_device_done,
+
+    gr_shm_surface_init,
+
+    0,
+    0
+  };
+
+
+/* END */
@@ -0,0 +1,56 @@
+#ifndef GRSHM_H_
+#define GRSHM_H_
+
+  /*
+   * The layout of the shared memory segment, for viewers.  The segment
+   * starts with this header, followed by the pixels at `offset'.  The
+   * pixel mode is a `grPixelMode' value of `graph.h'; rows are `pitch'
+   * bytes apart, top to bottom.  The device resizes the segment if the
+   * surface is resized, so viewers must check `size' for each frame.
+   */
+
+#define GR_SHM_MAGIC    0x4D485347UL  /* `GSHM' in little-endian memory */
+#define GR_SHM_VERSION  1
+#define GR_SHM_OFFSET   64            /* keeps the pixels aligned       */
+
+  typedef struct  grShmHeader_
+  {
+    unsigned int  magic;
+    unsigned int  version;
+    unsigned int  offset;       /* of the pixels               */
+    unsigned int  size;         /* of the whole segment        */
+
+    int           width;
+    int           rows;
+    int           pitch;
+    int           mode;         /* grPixelMode                 */
+    int           grays;
+
+    unsigned int  frame;        /* the last complete frame     */
+    int           x, y;         /* the area changed in it      */
+    int           w, h;
+
+  } grShmHeader;
+
+
+#ifdef GR_INIT_BUILD
+
+#include "grobjs.h"
+
+  extern
+  grDevice  gr_shm_device;
+
+  static
+  grDeviceChain  gr_shm_device_chain =
+  {
+    "shm",
+    &gr_shm_device,
+    GR_INIT_DEVICE_CHAIN
+  };
+
+#undef GR_INIT_DEVICE_CHAIN
+#define GR_INIT_DEVICE_CHAIN  &gr_shm_device_chain
+
+#endif  /* GR_INIT_BUILD */
+
+#endif /* GRSHM_H_ */
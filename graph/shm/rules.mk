@@ -0,0 +1,43 @@
+#**************************************************************************
+#*
+#*  Shared memory driver makefile
+#*
+#**************************************************************************
+
+ifneq ($(findstring $(PLATFORM),unix unixdev),)
+
+  # directory of shared memory driver
+  #
+  GR_SHM := $(GRAPH)/shm
+
+  # add shared memory driver to lib objects
+  #
+  GRAPH_OBJS += $(OBJ_DIR_2)/grshm.$O
+
+  # add shared memory driver to list of devices
+  #
+  DEVICES += SHM
+
+  # older C libraries have `shm_open' in librt
+  #
+  ifeq ($(shell uname),Linux)
+    GRAPH_LINK += -lrt
+  endif
+
+  # shared memory driver compilation rule
+  #
+  $(OBJ_DIR_2)/grshm.$O : $(GR_SHM)/grshm.c $(GR_SHM)/grshm.h \
+                          $(GRAPH_H)
+  ifneq ($(LIBTOOL),)
+	  $(LIBTOOL) --mode=compile $(CC) -static $(CFLAGS) \
+                     $(GRAPH_INCLUDES:%=$I%) \
+                     $I$(subst /,$(COMPILER_SEP),$(GR_SHM)) \
+                     $T$(subst /,$(COMPILER_SEP),$@ $<)
+  else
+	  $(CC) $(CFLAGS) $(GRAPH_INCLUDES:%=$I%) \
+                $I$(subst /,$(COMPILER_SEP),$(GR_SHM)) \
+                $T$(subst /,$(COMPILER_SEP),$@ $<)
+  endif
+endif
+
+# EOF
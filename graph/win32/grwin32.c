@@ -381,6 +381,19 @@ gr_win32_surface_listen_event( grWin32Surface*  surface,
 }
 
 
+/* resizing messages are not checked since they may leave the size alone */
+static int
+gr_win32_surface_pending_event( grWin32Surface*  surface )
+{
+  MSG  msg;
+
+  (void)surface;
+
+  return PeekMessage( &msg, (HWND)-1, WM_CHAR, WM_CHAR, PM_NOREMOVE )       ||
+         PeekMessage( &msg, (HWND)-1, WM_GR_KEY, WM_GR_KEY, PM_NOREMOVE );
+}
+
+
 DWORD WINAPI Window_ThreadProc( LPVOID lpParameter )
 {
   grWin32Surface*  surface = (grWin32Surface*)lpParameter;
@@ -548,6 +561,7 @@ gr_win32_surface_init( grWin32Surface*  surface,
   surface->root.set_title    = (grSetTitleFunc)    gr_win32_surface_set_title;
   surface->root.set_icon     = (grSetIconFunc)     gr_win32_surface_set_icon;
   surface->root.listen_event = (grListenEventFunc) gr_win32_surface_listen_event;
+  surface->root.pending_event = (grPendingEventFunc)gr_win32_surface_pending_event;
 
   LOG(( "Surface initialized: %dx%dx%d\n",
         surface->root.bitmap.width, surface->root.bitmap.rows,
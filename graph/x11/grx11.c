@@ -30,6 +30,12 @@
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
 
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
+
 #include "grtypes.h"
 #include "grobjs.h"
 #include "grx11.h"
@@ -828,6 +834,7 @@
     const grX11Format*  format;
     int                 scanline_pad;
     Visual*             visual;
+    int                 shm;          /* MIT-SHM is available */
 
   } grX11Device;
 
@@ -863,6 +870,12 @@
       return -1;
     }
 
+#ifdef HAVE_XSHM
+    /* it may still fail later for remote displays */
+    x11dev.shm = XShmQueryExtension( x11dev.display ) &&
+                 !getenv( "GR_X11_NO_SHM" );
+#endif
+
     x11dev.idle = XCreateFontCursor( x11dev.display, XC_left_ptr );
     x11dev.busy = XCreateFontCursor( x11dev.display, XC_watch );
     x11dev.scanline_pad = BitmapPad( x11dev.display );
@@ -959,13 +972,160 @@
     XImage*             ximage;
     grX11ConvertFunc    convert;
 
+#ifdef HAVE_XSHM
+    int                 shm;          /* `ximage' is in shared memory, */
+                                      /* and so is the bitmap unless   */
+                                      /* converted                     */
+    int                 shm_busy;     /* the server may still read it  */
+    XShmSegmentInfo     shm_info;
+#endif
+
     char                key_buffer[10];
     int                 key_cursor;
     int                 key_number;
 
+    unsigned char       modifiers[32];  /* bit set of modifier keycodes */
+    int                 pending;        /* see gr_x11_surface_pending */
+
   } grX11Surface;
 
 
+#ifdef HAVE_XSHM
+
+  static int  gr_x11_shm_error;
+
+
+  static int
+  gr_x11_shm_error_handler( Display*      display,
+                            XErrorEvent*  event )
+  {
+    (void)display;
+    (void)event;
+
+    gr_x11_shm_error = 1;
+    return 0;
+  }
+
+
+  /* create an image in shared memory; return NULL to fall back to */
+  /* XPutImage                                                     */
+  static XImage*
+  gr_x11_shm_create( grX11Surface*     surface,
+                     XShmSegmentInfo*  info,
+                     int               width,
+                     int               height )
+  {
+    Display*  display = surface->display;
+    XImage*   ximage;
+
+    int  (*handler)( Display*, XErrorEvent* );
+
+
+    ximage = XShmCreateImage( display,
+                              surface->visual,
+                              (unsigned int)x11dev.format->x_depth,
+                              ZPixmap,
+                              NULL,
+                              info,
+                              (unsigned int)( width  > 0 ? width  : 1 ),
+                              (unsigned int)( height > 0 ? height : 1 ) );
+    if ( !ximage )
+      return NULL;
+
+    info->shmid = shmget( IPC_PRIVATE,
+                          (size_t)ximage->bytes_per_line *
+                            (size_t)ximage->height,
+                          IPC_CREAT | 0600 );
+    if ( info->shmid < 0 )
+      goto Fail;
+
+    info->shmaddr  = (char*)shmat( info->shmid, NULL, 0 );
+    info->readOnly = False;
+
+    if ( info->shmaddr == (char*)-1 )
+    {
+      shmctl( info->shmid, IPC_RMID, NULL );
+      goto Fail;
+    }
+
+    ximage->data = info->shmaddr;
+
+    /* the server cannot attach to the segment of a remote client */
+    gr_x11_shm_error = 0;
+    handler          = XSetErrorHandler( gr_x11_shm_error_handler );
+
+    XShmAttach( display, info );
+    XSync( display, False );
+
+    XSetErrorHandler( handler );
+
+    /* the segment goes away with the last detachment */
+    shmctl( info->shmid, IPC_RMID, NULL );
+
+    if ( !gr_x11_shm_error )
+      return ximage;
+
+    shmdt( info->shmaddr );
+
+  Fail:
+    ximage->data = NULL;
+    XDestroyImage( ximage );
+
+    return NULL;
+  }
+
+
+  static void
+  gr_x11_shm_destroy( grX11Surface*     surface,
+                      XImage*           ximage,
+                      XShmSegmentInfo*  info )
+  {
+    XShmDetach( surface->display, info );
+    XSync( surface->display, False );
+
+    ximage->data = NULL;
+    XDestroyImage( ximage );
+
+    shmdt( info->shmaddr );
+  }
+
+#endif /* HAVE_XSHM */
+
+
+  /* send part of the image to the window */
+  static void
+  gr_x11_surface_put( grX11Surface*  surface,
+                      int            x,
+                      int            y,
+                      int            width,
+                      int            height )
+  {
+#ifdef HAVE_XSHM
+    if ( surface->shm )
+    {
+      XShmPutImage( surface->display,
+                    surface->win,
+                    surface->gc,
+                    surface->ximage,
+                    x, y, x, y,
+                    (unsigned int)width,
+                    (unsigned int)height,
+                    False );
+      surface->shm_busy = 1;
+      return;
+    }
+#endif
+
+    XPutImage( surface->display,
+               surface->win,
+               surface->gc,
+               surface->ximage,
+               x, y, x, y,
+               (unsigned int)width,
+               (unsigned int)height );
+  }
+
+
   /* close a given window */
   static void
   gr_x11_surface_done( grX11Surface*  surface )
@@ -977,6 +1137,17 @@
     {
       XFreeGC( display, surface->gc );
 
+#ifdef HAVE_XSHM
+      if ( surface->ximage && surface->shm )
+      {
+        gr_x11_shm_destroy( surface, surface->ximage, &surface->shm_info );
+        surface->ximage = NULL;
+
+        if ( !surface->convert )
+          surface->root.bitmap.buffer = NULL;
+      }
+#endif
+
       if ( surface->ximage )
       {
         if ( !surface->convert )
@@ -1116,6 +1287,53 @@
     char*      buffer;
 
 
+#ifdef HAVE_XSHM
+    if ( surface->shm )
+    {
+      XShmSegmentInfo  info;
+
+
+      ximage = gr_x11_shm_create( surface, &info, width, height );
+      if ( !ximage )
+        return 0;
+
+      if ( !surface->convert )
+      {
+        /* the pitch was checked by `gr_x11_surface_init' */
+        bitmap->width  = width;
+        bitmap->rows   = height;
+        bitmap->pitch  = ximage->bytes_per_line;
+        bitmap->buffer = (unsigned char*)ximage->data;
+      }
+      else if ( grNewBitmap( bitmap->mode,
+                             bitmap->grays,
+                             width,
+                             height,
+                             bitmap ) )
+      {
+        gr_x11_shm_destroy( surface, ximage, &info );
+        return 0;
+      }
+
+      gr_x11_shm_destroy( surface, surface->ximage, &surface->shm_info );
+
+      /* XShmPutImage finds the segment through `obdata' */
+      surface->ximage   = ximage;
+      surface->shm_info = info;
+      surface->shm_busy = 0;
+      ximage->obdata    = (char*)&surface->shm_info;
+
+      /* the blitters clip to these */
+      ximage->width  = width;
+      ximage->height = height;
+
+      /* the new image has to be painted completely */
+      grTouchSurface( &surface->root, 0, 0, width, height );
+
+      return 1;
+    }
+#endif
+
     /* resize the bitmap */
     if ( grNewBitmap( bitmap->mode,
                       bitmap->grays,
@@ -1124,6 +1342,9 @@
                       bitmap ) )
       return 0;
 
+    /* the new image has to be painted completely */
+    grTouchSurface( &surface->root, 0, 0, width, height );
+
     /* reallocate surface image */
     pitch  = width * ximage->bits_per_pixel >> 3;
 
@@ -1254,16 +1475,11 @@
              x_event.xexpose.y + x_event.xexpose.height
                    > exposed.y +         exposed.height )
         {
-          XPutImage( surface->display,
-                     surface->win,
-                     surface->gc,
-                     surface->ximage,
-                     x_event.xexpose.x,
-                     x_event.xexpose.y,
-                     x_event.xexpose.x,
-                     x_event.xexpose.y,
-                     (unsigned int)x_event.xexpose.width,
-                     (unsigned int)x_event.xexpose.height );
+          gr_x11_surface_put( surface,
+                              x_event.xexpose.x,
+                              x_event.xexpose.y,
+                              x_event.xexpose.width,
+                              x_event.xexpose.height );
 
           exposed = x_event.xexpose;
           LOG(( "painted\n" ));
@@ -1287,12 +1503,102 @@
     grevent->type = gr_key_down;
     grevent->key  = grkey;
 
+#ifdef HAVE_XSHM
+    /* the caller draws next; wait until the server has read the image */
+    if ( surface->shm_busy )
+    {
+      XSync( display, False );
+      surface->shm_busy = 0;
+    }
+#endif
+
     XDefineCursor( display, surface->win, x11dev.busy );
 
     return 1;
   }
 
 
+  /* Called by XCheckIfEvent for each queued event; it must not call */
+  /* Xlib.  Modifier keys and unchanged sizes are skipped, since the   */
+  /* listener ignores them and would block.                            */
+  static Bool
+  gr_x11_surface_check_event( Display*  display,
+                              XEvent*   x_event,
+                              XPointer  arg )
+  {
+    grX11Surface*  surface = (grX11Surface*)arg;
+    unsigned int   code;
+
+    (void)display;
+
+    switch ( x_event->type )
+    {
+    case ClientMessage:
+      if ( (Atom)x_event->xclient.data.l[0] == surface->wm_delete_window )
+        surface->pending = 1;
+      break;
+
+    case KeyPress:
+      code = x_event->xkey.keycode;
+      if ( code > 255                                      ||
+           !( surface->modifiers[code >> 3] & ( 1 << ( code & 7 ) ) ) )
+        surface->pending = 1;
+      break;
+
+    case ConfigureNotify:
+      if ( x_event->xconfigure.width  != surface->ximage->width  ||
+           x_event->xconfigure.height != surface->ximage->height )
+        surface->pending = 1;
+      break;
+    }
+
+    return False;   /* never remove anything from the queue */
+  }
+
+
+  static int
+  gr_x11_surface_pending( grX11Surface*  surface )
+  {
+    XEvent  x_event;
+
+
+    if ( surface->key_cursor < surface->key_number )
+      return 1;
+
+    if ( !XEventsQueued( surface->display, QueuedAfterReading ) )
+      return 0;
+
+    surface->pending = 0;
+    XCheckIfEvent( surface->display, &x_event,
+                   gr_x11_surface_check_event, (XPointer)surface );
+
+    return surface->pending;
+  }
+
+
+  static void
+  gr_x11_surface_init_modifiers( grX11Surface*  surface )
+  {
+    XModifierKeymap*  map = XGetModifierMapping( surface->display );
+    int               i;
+
+
+    if ( !map )
+      return;
+
+    for ( i = 0; i < 8 * map->max_keypermod; i++ )
+    {
+      unsigned int  code = map->modifiermap[i];
+
+
+      if ( code && code <= 255 )
+        surface->modifiers[code >> 3] |= (unsigned char)( 1 << ( code & 7 ) );
+    }
+
+    XFreeModifiermap( map );
+  }
+
+
   static int
   gr_x11_surface_init( grX11Surface*  surface,
                        grBitmap*      bitmap )
@@ -1373,38 +1679,82 @@
 
     surface->root.bitmap = *bitmap;
 
-    /* Now create the surface X11 image */
-    surface->ximage = XCreateImage( display,
-                                    surface->visual,
-                                    (unsigned int)x11dev.format->x_depth,
-                                    ZPixmap,
-                                    0,
-                                    NULL,
-                                    (unsigned int)bitmap->width,
-                                    (unsigned int)bitmap->rows,
-                                    x11dev.scanline_pad,
-                                    0 );
-    if ( !surface->ximage )
-      return 0;
-
-    /* Allocate or link surface image data */
-    if ( surface->convert )
+#ifdef HAVE_XSHM
+    /* Try a shared memory image first; the server reads it in its   */
+    /* own byte order, so the bitmap can only be drawn directly into */
+    /* it if that matches ours, and if the pitches agree             */
+    if ( x11dev.shm )
     {
-      surface->ximage->data = (char*)malloc( (size_t)bitmap->rows *
-                              (size_t)surface->ximage->bytes_per_line );
-      if ( !surface->ximage->data )
-        return 0;
+      const int  x = 1;
+
+
+      if ( surface->convert                                   ||
+           ImageByteOrder( display ) == ( *(char*)&x ? LSBFirst
+                                                     : MSBFirst ) )
+        surface->ximage = gr_x11_shm_create( surface, &surface->shm_info,
+                                             bitmap->width, bitmap->rows );
+
+      if ( surface->ximage                                  &&
+           !surface->convert                                &&
+           surface->ximage->bytes_per_line != bitmap->pitch )
+      {
+        gr_x11_shm_destroy( surface, surface->ximage, &surface->shm_info );
+        surface->ximage = NULL;
+      }
+
+      if ( surface->ximage )
+      {
+        surface->shm = 1;
+
+        if ( !surface->convert )
+        {
+          grDoneBitmap( &surface->root.bitmap );
+
+          surface->root.bitmap.buffer = (unsigned char*)surface->ximage->data;
+          bitmap->buffer              = surface->root.bitmap.buffer;
+        }
+
+        surface->ximage->width  = bitmap->width;
+        surface->ximage->height = bitmap->rows;
+      }
     }
-    else
+
+    if ( !surface->ximage )
+#endif
     {
-      const int x = 1;
-
-      surface->ximage->byte_order = *(char*)&x ? LSBFirst : MSBFirst;
-      surface->ximage->bitmap_pad = 32;
-      surface->ximage->red_mask   = x11dev.format->x_red_mask;
-      surface->ximage->green_mask = x11dev.format->x_green_mask;
-      surface->ximage->blue_mask  = x11dev.format->x_blue_mask;
-      surface->ximage->data       = (char*)bitmap->buffer;
+      /* Now create the surface X11 image */
+      surface->ximage = XCreateImage( display,
+                                      surface->visual,
+                                      (unsigned int)x11dev.format->x_depth,
+                                      ZPixmap,
+                                      0,
+                                      NULL,
+                                      (unsigned int)bitmap->width,
+                                      (unsigned int)bitmap->rows,
+                                      x11dev.scanline_pad,
+                                      0 );
+      if ( !surface->ximage )
+        return 0;
+
+      /* Allocate or link surface image data */
+      if ( surface->convert )
+      {
+        surface->ximage->data = (char*)malloc( (size_t)bitmap->rows *
+                                (size_t)surface->ximage->bytes_per_line );
+        if ( !surface->ximage->data )
+          return 0;
+      }
+      else
+      {
+        const int x = 1;
+
+        surface->ximage->byte_order = *(char*)&x ? LSBFirst : MSBFirst;
+        surface->ximage->bitmap_pad = 32;
+        surface->ximage->red_mask   = x11dev.format->x_red_mask;
+        surface->ximage->green_mask = x11dev.format->x_green_mask;
+        surface->ximage->blue_mask  = x11dev.format->x_blue_mask;
+        surface->ximage->data       = (char*)bitmap->buffer;
+      }
     }
 
     {
@@ -1472,6 +1822,9 @@
     surface->root.set_icon     = (grSetIconFunc)    gr_x11_surface_set_icon;
     surface->root.listen_event = (grListenEventFunc)gr_x11_surface_listen_event;
 
+    surface->root.pending_event = (grPendingEventFunc)gr_x11_surface_pending;
+    gr_x11_surface_init_modifiers( surface );
+
     return 1;
   }
 
@@ -18,6 +18,14 @@ ifneq ($(X11_LIBS),)
   #
   GRAPH_LINK += $(X11_LIBS)
 
+  # The MIT-SHM extension is optional.
+  #
+  XEXT_LIBS ?= $(shell $(PKG_CONFIG) --libs xext)
+  ifneq ($(XEXT_LIBS),)
+    GRAPH_LINK += $(XEXT_LIBS)
+    X11_FLAGS  := $DHAVE_XSHM
+  endif
+
   # Solaris needs a -lsocket in GRAPH_LINK.
   #
   UNAME := $(shell uname)
@@ -41,12 +49,12 @@ ifneq ($(X11_LIBS),)
 	  $(LIBTOOL) --mode=compile $(CC) -static $(CFLAGS) \
                      $(GRAPH_INCLUDES:%=$I%) \
                      $I$(subst /,$(COMPILER_SEP),$(GR_X11)) \
-                     $(X11_CFLAGS:%=$I%) \
+                     $(X11_CFLAGS:%=$I%) $(X11_FLAGS) \
                      $T$(subst /,$(COMPILER_SEP),$@ $<)
   else
 	  $(CC) $(CFLAGS) $(GRAPH_INCLUDES:%=$I%) \
                 $I$(subst /,$(COMPILER_SEP),$(GR_X11)) \
-                $(X11_CFLAGS:%=$I%) \
+                $(X11_CFLAGS:%=$I%) $(X11_FLAGS) \
                 $T$(subst /,$(COMPILER_SEP),$@ $<)
   endif
 endif
@@ -0,0 +1,585 @@
+/****************************************************************************/
+/*                                                                          */
+/*  The FreeType project -- a free and portable quality TrueType renderer.  */
+/*                                                                          */
+/*  Copyright (C) 2022 by                                                   */
+/*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
+/*                                                                          */
+/*                                                                          */
+/*  ftalloc.c - alternative `FT_Memory' allocators for the demo programs.   */
+/*                                                                          */
+/****************************************************************************/
+
+
+#include "ftalloc.h"
+
+#include <freetype/ftmodapi.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+
+  /*
+   * Every block handed out by the pool and arena allocators is preceded
+   * by a header that tells `free' where the block comes from: either the
+   * arena chunk it has been carved from, or its size class.  The header
+   * size is also the alignment of all blocks.
+   */
+  typedef union  BlockHeader_
+  {
+    struct
+    {
+      struct ArenaChunk_*  chunk;   /* NULL if not an arena block */
+      size_t               cls;     /* size class or CLASS_LARGE  */
+
+    } h;
+
+    double  align_double;
+    long    align_long;
+
+  } BlockHeader;
+
+
+#define ALIGNMENT  sizeof ( BlockHeader )
+#define ALIGN( x )  ( ( (x) + ALIGNMENT - 1 ) & ~( ALIGNMENT - 1 ) )
+
+  /* size classes include the header; all of them are multiples of 16 */
+#define NUM_CLASSES     28
+#define MAX_CLASS_SIZE  4096
+#define CLASS_LARGE     ( (size_t)-1 )
+
+#define SLAB_SIZE       65536   /* pool refill unit          */
+#define CHUNK_SIZE      32768   /* arena chunk size          */
+#define MAX_SPARES      4       /* recycled arena chunks     */
+
+  static const size_t  class_sizes[NUM_CLASSES] =
+  {
+      16,   32,   48,   64,   80,   96,  112,  128,
+     160,  192,  224,  256,  320,  384,  448,  512,
+     640,  768,  896, 1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096
+  };
+
+
+  typedef struct  FreeBlock_
+  {
+    struct FreeBlock_*  next;
+
+  } FreeBlock;
+
+
+  typedef struct  Slab_
+  {
+    struct Slab_*  next;
+
+  } Slab;
+
+
+  typedef struct  ArenaChunk_
+  {
+    size_t  used;   /* bytes carved so far, including this header */
+    size_t  live;   /* number of blocks not yet freed             */
+
+  } ArenaChunk;
+
+#define CHUNK_HEADER  ALIGN( sizeof ( ArenaChunk ) )
+
+
+  typedef struct  FTAllocRec_
+  {
+    FTAlloc_Mode  mode;
+
+    /* pool */
+    FreeBlock*     free_lists[NUM_CLASSES];
+    Slab*          slabs;
+
+    /* arena */
+    ArenaChunk*    current;
+    ArenaChunk*    spares[MAX_SPARES];
+    int            num_spares;
+
+    /* size class lookup, indexed by `size / 16' (rounded up) */
+    unsigned char  class_of[MAX_CLASS_SIZE / 16 + 1];
+
+    struct FT_MemoryRec_  memory;
+
+  } FTAllocRec, *FTAlloc;
+
+
+#define ALLOC_OF( memory )  ( (FTAlloc)(memory)->user )
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* System allocator.                                                     */
+  /*                                                                       */
+
+  static void*
+  system_alloc( FT_Memory  memory,
+                long       size )
+  {
+    FT_UNUSED( memory );
+
+    return malloc( (size_t)size );
+  }
+
+
+  static void
+  system_free( FT_Memory  memory,
+               void*      block )
+  {
+    FT_UNUSED( memory );
+
+    free( block );
+  }
+
+
+  static void*
+  system_realloc( FT_Memory  memory,
+                  long       cur_size,
+                  long       new_size,
+                  void*      block )
+  {
+    FT_UNUSED( memory );
+    FT_UNUSED( cur_size );
+
+    return realloc( block, (size_t)new_size );
+  }
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* Size-class pool.                                                      */
+  /*                                                                       */
+
+  static BlockHeader*
+  pool_alloc_header( FTAlloc  alloc,
+                     size_t   total )
+  {
+    BlockHeader*  header;
+
+
+    if ( total > MAX_CLASS_SIZE )
+    {
+      header = (BlockHeader*)malloc( total );
+      if ( header )
+        header->h.cls = CLASS_LARGE;
+    }
+    else
+    {
+      size_t      cls  = alloc->class_of[( total + 15 ) / 16];
+      FreeBlock*  free_block;
+
+
+      if ( !alloc->free_lists[cls] )
+      {
+        /* refill the free list of this class with a new slab */
+        Slab*   slab = (Slab*)malloc( SLAB_SIZE );
+        size_t  size = class_sizes[cls];
+        char*   p;
+        char*   limit;
+
+
+        if ( !slab )
+          return NULL;
+
+        slab->next   = alloc->slabs;
+        alloc->slabs = slab;
+
+        p     = (char*)slab + ALIGN( sizeof ( Slab ) );
+        limit = (char*)slab + SLAB_SIZE - size;
+        for ( ; p <= limit; p += size )
+        {
+          free_block       = (FreeBlock*)p;
+          free_block->next = alloc->free_lists[cls];
+
+          alloc->free_lists[cls] = free_block;
+        }
+      }
+
+      free_block             = alloc->free_lists[cls];
+      alloc->free_lists[cls] = free_block->next;
+
+      header        = (BlockHeader*)free_block;
+      header->h.cls = cls;
+    }
+
+    if ( header )
+      header->h.chunk = NULL;
+
+    return header;
+  }
+
+
+  static void
+  pool_free_header( FTAlloc       alloc,
+                    BlockHeader*  header )
+  {
+    size_t      cls = header->h.cls;
+    FreeBlock*  free_block;
+
+
+    if ( cls == CLASS_LARGE )
+    {
+      free( header );
+      return;
+    }
+
+    free_block             = (FreeBlock*)header;
+    free_block->next       = alloc->free_lists[cls];
+    alloc->free_lists[cls] = free_block;
+  }
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* Arena.                                                                */
+  /*                                                                       */
+
+  static void
+  arena_release_chunk( FTAlloc      alloc,
+                       ArenaChunk*  chunk )
+  {
+    if ( alloc->num_spares < MAX_SPARES )
+      alloc->spares[alloc->num_spares++] = chunk;
+    else
+      free( chunk );
+  }
+
+
+  /* stop carving from the current chunk */
+  static void
+  arena_retire_current( FTAlloc  alloc )
+  {
+    ArenaChunk*  chunk = alloc->current;
+
+
+    if ( !chunk )
+      return;
+
+    /* a chunk with live blocks gets released by its last `free' */
+    if ( !chunk->live )
+      arena_release_chunk( alloc, chunk );
+
+    alloc->current = NULL;
+  }
+
+
+  static BlockHeader*
+  arena_alloc_header( FTAlloc  alloc,
+                      size_t   total )
+  {
+    ArenaChunk*   chunk = alloc->current;
+    BlockHeader*  header;
+
+
+    /* large blocks would waste too much of a chunk */
+    if ( total > MAX_CLASS_SIZE )
+      return pool_alloc_header( alloc, total );
+
+    if ( !chunk || chunk->used + total > CHUNK_SIZE )
+    {
+      arena_retire_current( alloc );
+
+      if ( alloc->num_spares )
+        chunk = alloc->spares[--alloc->num_spares];
+      else
+      {
+        chunk = (ArenaChunk*)malloc( CHUNK_SIZE );
+        if ( !chunk )
+          return NULL;
+      }
+
+      chunk->used = CHUNK_HEADER;
+      chunk->live = 0;
+
+      alloc->current = chunk;
+    }
+
+    header = (BlockHeader*)( (char*)chunk + chunk->used );
+
+    header->h.chunk = chunk;
+    header->h.cls   = total;
+
+    chunk->used += total;
+    chunk->live++;
+
+    return header;
+  }
+
+
+  static void
+  arena_free_header( FTAlloc       alloc,
+                     BlockHeader*  header )
+  {
+    ArenaChunk*  chunk = header->h.chunk;
+
+
+    if ( !chunk )
+    {
+      pool_free_header( alloc, header );
+      return;
+    }
+
+    if ( --chunk->live )
+      return;
+
+    if ( chunk == alloc->current )
+      chunk->used = CHUNK_HEADER;
+    else
+      arena_release_chunk( alloc, chunk );
+  }
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* `FT_Memory' interface for pool and arena.                             */
+  /*                                                                       */
+
+  static void*
+  pool_alloc( FT_Memory  memory,
+              long       size )
+  {
+    FTAlloc       alloc = ALLOC_OF( memory );
+    size_t        total = ALIGN( (size_t)size ) + ALIGNMENT;
+    BlockHeader*  header;
+
+
+    if ( alloc->mode == FTALLOC_ARENA )
+      header = arena_alloc_header( alloc, total );
+    else
+      header = pool_alloc_header( alloc, total );
+
+    if ( !header )
+      return NULL;
+
+    /* Recycled blocks are dirty, unlike the fresh pages `malloc' mostly */
+    /* returns.  Some FreeType versions don't initialize all fields of   */
+    /* objects created with `FT_QNEW' (for example, the weight counter   */
+    /* of the cache manager), so we must clear the block.                */
+    memset( header + 1, 0, (size_t)size );
+
+    return header + 1;
+  }
+
+
+  static void
+  pool_free( FT_Memory  memory,
+             void*      block )
+  {
+    FTAlloc       alloc  = ALLOC_OF( memory );
+    BlockHeader*  header = (BlockHeader*)block - 1;
+
+
+    if ( alloc->mode == FTALLOC_ARENA )
+      arena_free_header( alloc, header );
+    else
+      pool_free_header( alloc, header );
+  }
+
+
+  static void*
+  pool_realloc( FT_Memory  memory,
+                long       cur_size,
+                long       new_size,
+                void*      block )
+  {
+    FTAlloc       alloc  = ALLOC_OF( memory );
+    BlockHeader*  header = (BlockHeader*)block - 1;
+    size_t        total  = ALIGN( (size_t)new_size ) + ALIGNMENT;
+    void*         p;
+
+
+    if ( header->h.chunk )
+    {
+      ArenaChunk*  chunk = header->h.chunk;
+      size_t       old   = header->h.cls;
+
+
+      /* the last block of the current chunk can change its size in place */
+      if ( chunk == alloc->current                                  &&
+           (char*)header + old == (char*)chunk + chunk->used         &&
+           chunk->used - old + total <= CHUNK_SIZE                   &&
+           total <= MAX_CLASS_SIZE                                   )
+      {
+        chunk->used   = chunk->used - old + total;
+        header->h.cls = total;
+
+        return block;
+      }
+    }
+    else if ( header->h.cls == CLASS_LARGE )
+    {
+      if ( total > MAX_CLASS_SIZE )
+      {
+        header = (BlockHeader*)realloc( header, total );
+
+        return header ? header + 1 : NULL;
+      }
+    }
+    else if ( total <= class_sizes[header->h.cls] )
+      return block;
+
+    p = pool_alloc( memory, new_size );
+    if ( !p )
+      return NULL;
+
+    memcpy( p, block, (size_t)( cur_size < new_size ? cur_size : new_size ) );
+    pool_free( memory, block );
+
+    return p;
+  }
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* Public interface.                                                     */
+  /*                                                                       */
+
+  FT_Memory
+  ftalloc_new( FTAlloc_Mode  mode )
+  {
+    FTAlloc  alloc;
+    size_t   n, cls;
+
+
+    alloc = (FTAlloc)calloc( 1, sizeof ( FTAllocRec ) );
+    if ( !alloc )
+      return NULL;
+
+    alloc->mode = mode;
+
+    for ( n = 0, cls = 0; n <= MAX_CLASS_SIZE / 16; n++ )
+    {
+      while ( class_sizes[cls] < n * 16 )
+        cls++;
+      alloc->class_of[n] = (unsigned char)cls;
+    }
+
+    alloc->memory.user = alloc;
+
+    if ( mode == FTALLOC_POOL || mode == FTALLOC_ARENA )
+    {
+      alloc->memory.alloc   = pool_alloc;
+      alloc->memory.free    = pool_free;
+      alloc->memory.realloc = pool_realloc;
+    }
+    else
+    {
+      alloc->memory.alloc   = system_alloc;
+      alloc->memory.free    = system_free;
+      alloc->memory.realloc = system_realloc;
+    }
+
+    return &alloc->memory;
+  }
+
+
+  void
+  ftalloc_done( FT_Memory  memory )
+  {
+    FTAlloc  alloc;
+    Slab*    slab;
+    int      n;
+
+
+    if ( !memory )
+      return;
+
+    alloc = ALLOC_OF( memory );
+
+    slab = alloc->slabs;
+    while ( slab )
+    {
+      Slab*  next = slab->next;
+
+
+      free( slab );
+      slab = next;
+    }
+
+    /* chunks still holding live blocks at this point are leaked */
+    /* by the library and we don't track them                   */
+    if ( alloc->current )
+      free( alloc->current );
+    for ( n = 0; n < alloc->num_spares; n++ )
+      free( alloc->spares[n] );
+
+    free( alloc );
+  }
+
+
+  FT_Error
+  ftalloc_new_library( FT_Memory    memory,
+                       FT_Library*  alibrary )
+  {
+    FT_Error  error;
+
+
+    error = FT_New_Library( memory, alibrary );
+    if ( error )
+      return error;
+
+    FT_Add_Default_Modules( *alibrary );
+    FT_Set_Default_Properties( *alibrary );
+
+    return FT_Err_Ok;
+  }
+
+
+  void
+  ftalloc_arena_reset( FT_Memory  memory )
+  {
+    FTAlloc  alloc;
+
+
+    if ( !memory || memory->alloc != pool_alloc )
+      return;
+
+    alloc = ALLOC_OF( memory );
+    if ( alloc->mode != FTALLOC_ARENA || !alloc->current )
+      return;
+
+    if ( alloc->current->live )
+      arena_retire_current( alloc );
+    else
+      alloc->current->used = CHUNK_HEADER;
+  }
+
+
+  static const char*  mode_names[FTALLOC_MAX] =
+  {
+    "system",
+    "pool",
+    "arena"
+  };
+
+
+  int
+  ftalloc_parse_mode( const char*    name,
+                      FTAlloc_Mode*  amode )
+  {
+    int  n;
+
+
+    for ( n = 0; n < FTALLOC_MAX; n++ )
+    {
+      if ( name && !strcmp( name, mode_names[n] ) )
+      {
+        *amode = (FTAlloc_Mode)n;
+        return 0;
+      }
+    }
+
+    return 1;
+  }
+
+
+  const char*
+  ftalloc_mode_name( FTAlloc_Mode  mode )
+  {
+    return (unsigned int)mode < FTALLOC_MAX ? mode_names[mode] : "unknown";
+  }
+
+
+/* End */
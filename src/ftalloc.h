@@ -0,0 +1,111 @@
+/****************************************************************************/
+/*                                                                          */
+/*  The FreeType project -- a free and portable quality TrueType renderer.  */
+/*                                                                          */
+/*  Copyright (C) 2022 by                                                   */
+/*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
+/*                                                                          */
+/*                                                                          */
+/*  ftalloc.h - alternative `FT_Memory' allocators for the demo programs.   */
+/*                                                                          */
+/****************************************************************************/
+
+
+#ifndef FTALLOC_H
+#define FTALLOC_H
+
+#include <ft2build.h>
+#include <freetype/freetype.h>
+#include <freetype/ftsystem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+  /*
+   * Allocation strategies for an `FT_Memory' object.
+   *
+   *   FTALLOC_SYSTEM
+   *     Use `malloc', `free', and `realloc' directly, like the default
+   *     memory manager of FreeType.
+   *
+   *   FTALLOC_POOL
+   *     Serve small blocks from per-size-class free lists that are
+   *     refilled from large slabs; slabs are only returned to the system
+   *     by `ftalloc_done'.  Large blocks go to `malloc'.
+   *
+   *   FTALLOC_ARENA
+   *     Like FTALLOC_POOL, but small blocks are carved from the current
+   *     chunk of an arena with a simple pointer bump.  Each chunk counts
+   *     its live blocks and gets recycled as soon as this count drops to
+   *     zero.  Calling `ftalloc_arena_reset' after each glyph starts a new
+   *     chunk so that temporary allocations of a glyph load or rendering
+   *     operation are released together.  Blocks that live longer simply
+   *     keep their chunk alive; there is no dangling memory.
+   *
+   * None of the allocators uses locks; use one `FT_Memory' object per
+   * `FT_Library' and thread.
+   */
+  typedef enum  FTAlloc_Mode_
+  {
+    FTALLOC_SYSTEM = 0,
+    FTALLOC_POOL,
+    FTALLOC_ARENA,
+
+    FTALLOC_MAX
+
+  } FTAlloc_Mode;
+
+
+  /* Create a new memory object; return NULL if out of memory. */
+  extern FT_Memory
+  ftalloc_new( FTAlloc_Mode  mode );
+
+
+  /*
+   * Release `memory' and all blocks still allocated from it.  It must be
+   * called after the library using it has been destroyed with
+   * `FT_Done_Library' (and *not* `FT_Done_FreeType').
+   */
+  extern void
+  ftalloc_done( FT_Memory  memory );
+
+
+  /*
+   * Create a library object using `memory', with the default modules and
+   * properties, just like `FT_Init_FreeType' does.
+   */
+  extern FT_Error
+  ftalloc_new_library( FT_Memory    memory,
+                       FT_Library*  alibrary );
+
+
+  /*
+   * Mark the end of a glyph operation.  For FTALLOC_ARENA, the current
+   * chunk is rewound if all its blocks have been freed, otherwise a new
+   * chunk gets started.  Does nothing for other modes or if `memory' is
+   * NULL.
+   */
+  extern void
+  ftalloc_arena_reset( FT_Memory  memory );
+
+
+  /* Map `system', `pool', or `arena' to a mode; return 0 on success. */
+  extern int
+  ftalloc_parse_mode( const char*    name,
+                      FTAlloc_Mode*  amode );
+
+
+  extern const char*
+  ftalloc_mode_name( FTAlloc_Mode  mode );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTALLOC_H */
+
+
+/* End */
@@ -34,6 +34,8 @@
 #include <freetype/ftstroke.h>
 #include <freetype/ftsynth.h>
 
+#include "ftalloc.h"
+
 #ifdef UNIX
 #include <unistd.h>
 #else
@@ -52,6 +54,13 @@
   double  interval;
 #endif
 
+#define BENCH_THREADS_WIN32
+
+#elif defined UNIX || defined __unix__
+#include <pthread.h>
+#include <unistd.h>   /* for `_POSIX_TIMERS' */
+
+#define BENCH_THREADS_PTHREAD
 #endif
 
 
@@ -86,7 +95,8 @@
 
 
   static FT_Error
-  get_face( FT_Face*  face );
+  get_face( FT_Library  library,
+            FT_Face*    face );
 
 
   /*
@@ -99,6 +109,7 @@
 
 
   static FT_Library        lib;
+  static FT_Memory         bench_memory;    /* NULL for FT_Init_FreeType */
   static FTC_Manager       cache_man;
   static FTC_CMapCache     cmap_cache;
   static FTC_ImageCache    image_cache;
@@ -168,6 +179,11 @@
   static char  ps_hinting_engine_names[2][10] = { "freetype",
                                                   "adobe" };
 
+  /* properties set with options, also applied to additional libraries */
+  static int  bench_tt_version = -1;
+  static int  bench_ps_engine  = -1;
+  static int  bench_lcd_filter = -1;
+
 
   /*
    * Dummy face requester (the face object is already loaded)
@@ -251,6 +267,40 @@
 #define TIMER_RESET( timer )  ( timer )->total = 0
 
 
+  /*
+   * wall-clock timer in microseconds, for multi-threaded tests
+   */
+
+  static double
+  get_wall_time( void )
+  {
+#if defined _WIN32
+    LARGE_INTEGER  ticks, freq;
+
+
+    QueryPerformanceCounter( &ticks );
+    QueryPerformanceFrequency( &freq );
+
+    return 1E6 * (double)ticks.QuadPart / (double)freq.QuadPart;
+
+#elif defined _POSIX_TIMERS && _POSIX_TIMERS > 0
+    struct timespec  tv;
+
+
+#ifdef _POSIX_MONOTONIC_CLOCK
+    clock_gettime( CLOCK_MONOTONIC, &tv );
+#else
+    clock_gettime( CLOCK_REALTIME, &tv );
+#endif
+
+    return 1E6 * (double)tv.tv_sec + 1E-3 * (double)tv.tv_nsec;
+
+#else
+    return 1E6 * (double)time( NULL );
+#endif
+  }
+
+
   /*
    * Bench code
    */
@@ -324,6 +374,8 @@
     {
       if ( !FT_Load_Glyph( face, (FT_UInt)i, load_flags ) )
         done++;
+
+      ftalloc_arena_reset( bench_memory );
     }
 
     TIMER_STOP( timer );
@@ -389,6 +441,7 @@
       TIMER_START( timer );
       if ( !FT_Render_Glyph( face->glyph, render_mode ) )
         done++;
+      ftalloc_arena_reset( bench_memory );
       TIMER_STOP( timer );
     }
 
@@ -648,6 +701,8 @@
                                    &glyph,
                                    NULL ) )
         done++;
+
+      ftalloc_arena_reset( bench_memory );
     }
 
     TIMER_STOP( timer );
@@ -685,6 +740,8 @@
                                   &glyph,
                                   NULL ) )
         done++;
+
+      ftalloc_arena_reset( bench_memory );
     }
 
     TIMER_STOP( timer );
@@ -729,7 +786,7 @@
 
     TIMER_START( timer );
 
-    if ( !get_face( &bench_face ) )
+    if ( !get_face( lib, &bench_face ) )
       FT_Done_Face( bench_face );
 
     TIMER_STOP( timer );
@@ -753,12 +810,14 @@
 
     TIMER_START( timer );
 
-    if ( !get_face( &bench_face ) )
+    if ( !get_face( lib, &bench_face ) )
     {
       FOREACH( i )
       {
         if ( !FT_Load_Glyph( bench_face, (FT_UInt)i, load_flags ) )
           done++;
+
+        ftalloc_arena_reset( bench_memory );
       }
 
       FT_Done_Face( bench_face );
@@ -770,6 +829,345 @@
   }
 
 
+
+  /*
+   * Allocator comparison
+   *
+   * Each thread creates its own library with the allocator under test,
+   * opens the face, and runs a test for the given time.  The throughput
+   * of all threads gets summed up.
+   */
+
+  enum {
+    ABENCH_LOAD,
+    ABENCH_RENDER,
+    ABENCH_SBIT_CACHE,
+    N_ABENCH
+  };
+
+
+  static const char*  abench_names[N_ABENCH] =
+  {
+    "Load",
+    "Render",
+    "Load (sbit cached)"
+  };
+
+
+  typedef struct  athread_t_
+  {
+    FTAlloc_Mode   mode;
+    int            test;
+    unsigned int   size;
+    unsigned long  max_bytes;
+    double         max_time;
+
+    unsigned long  done;
+    double         elapsed;
+
+  } athread_t;
+
+
+  static void
+  setup_library( FT_Library  library )
+  {
+    if ( bench_tt_version >= 0 )
+      FT_Property_Set( library,
+                       "truetype",
+                       "interpreter-version", &bench_tt_version );
+
+    if ( bench_ps_engine >= 0 )
+    {
+      FT_Property_Set( library,
+                       "cff",
+                       "hinting-engine", &bench_ps_engine );
+      FT_Property_Set( library,
+                       "type1",
+                       "hinting-engine", &bench_ps_engine );
+      FT_Property_Set( library,
+                       "t1cid",
+                       "hinting-engine", &bench_ps_engine );
+    }
+
+    if ( bench_lcd_filter >= 0 )
+      FT_Library_SetLcdFilter( library, (FT_LcdFilter)bench_lcd_filter );
+  }
+
+
+  static void
+  abench_run( athread_t*  arg )
+  {
+    FT_Memory         memory;
+    FT_Library        library;
+    FT_Face           face;
+    FTC_Manager       manager = NULL;
+    FTC_SBitCache     cache   = NULL;
+    FTC_ImageTypeRec  type;
+    FTC_SBit          sbit;
+
+    double  t0;
+    int     i;
+
+
+    arg->done    = 0;
+    arg->elapsed = 0;
+
+    memory = ftalloc_new( arg->mode );
+    if ( !memory )
+      return;
+
+    if ( ftalloc_new_library( memory, &library ) )
+    {
+      ftalloc_done( memory );
+      return;
+    }
+
+    setup_library( library );
+
+    if ( get_face( library, &face ) )
+      goto Exit;
+
+    if ( arg->size )
+    {
+      if ( FT_IS_SCALABLE( face ) )
+        FT_Set_Pixel_Sizes( face, arg->size, arg->size );
+      else
+        FT_Select_Size( face, 0 );
+    }
+
+    if ( arg->test == ABENCH_SBIT_CACHE )
+    {
+      if ( FTC_Manager_New( library, 0, 0, arg->max_bytes,
+                            face_requester, face, &manager ) ||
+           FTC_SBitCache_New( manager, &cache )               )
+        goto Exit;
+
+      type        = font_type;
+      type.width  = arg->size;
+      type.height = arg->size;
+    }
+
+    t0 = get_wall_time();
+
+    do
+    {
+      FOREACH( i )
+      {
+        switch ( arg->test )
+        {
+        case ABENCH_LOAD:
+          if ( !FT_Load_Glyph( face, (FT_UInt)i, load_flags ) )
+            arg->done++;
+          break;
+
+        case ABENCH_RENDER:
+          if ( !FT_Load_Glyph( face, (FT_UInt)i, load_flags ) &&
+               !FT_Render_Glyph( face->glyph, render_mode )   )
+            arg->done++;
+          break;
+
+        case ABENCH_SBIT_CACHE:
+          if ( !FTC_SBitCache_Lookup( cache, &type, (FT_UInt)i,
+                                      &sbit, NULL ) )
+            arg->done++;
+          break;
+        }
+
+        ftalloc_arena_reset( memory );
+      }
+
+      arg->elapsed = get_wall_time() - t0;
+
+    } while ( arg->elapsed < arg->max_time );
+
+  Exit:
+    /* this also discards `face' if the cache has used it; */
+    /* otherwise `FT_Done_Library' does                     */
+    if ( manager )
+      FTC_Manager_Done( manager );
+
+    FT_Done_Library( library );
+    ftalloc_done( memory );
+  }
+
+
+#if defined BENCH_THREADS_PTHREAD
+
+  static void*
+  abench_thread( void*  arg )
+  {
+    abench_run( (athread_t*)arg );
+
+    return NULL;
+  }
+
+#elif defined BENCH_THREADS_WIN32
+
+  static DWORD WINAPI
+  abench_thread( LPVOID  arg )
+  {
+    abench_run( (athread_t*)arg );
+
+    return 0;
+  }
+
+#endif
+
+
+  /* run `num_threads' copies of a test in parallel; */
+  /* return the combined throughput in glyphs/s      */
+  static double
+  abench_launch( athread_t*  arg,
+                 int         num_threads )
+  {
+    athread_t*  args;
+    double      rate = 0;
+    int         n;
+
+
+    args = (athread_t*)calloc( (size_t)num_threads, sizeof ( athread_t ) );
+    if ( !args )
+      return 0;
+
+    for ( n = 0; n < num_threads; n++ )
+      args[n] = *arg;
+
+#if defined BENCH_THREADS_PTHREAD
+    {
+      pthread_t*  threads;
+      int         started = 0;
+
+
+      threads = (pthread_t*)calloc( (size_t)num_threads,
+                                    sizeof ( pthread_t ) );
+      if ( threads )
+      {
+        for ( ; started < num_threads; started++ )
+          if ( pthread_create( &threads[started], NULL,
+                               abench_thread, &args[started] ) )
+            break;
+
+        for ( n = 0; n < started; n++ )
+          pthread_join( threads[n], NULL );
+
+        free( threads );
+      }
+
+      num_threads = started;
+    }
+#elif defined BENCH_THREADS_WIN32
+    {
+      HANDLE*  threads;
+      int      started = 0;
+
+
+      threads = (HANDLE*)calloc( (size_t)num_threads, sizeof ( HANDLE ) );
+      if ( threads )
+      {
+        for ( ; started < num_threads; started++ )
+        {
+          threads[started] = CreateThread( NULL, 0, abench_thread,
+                                           &args[started], 0, NULL );
+          if ( !threads[started] )
+            break;
+        }
+
+        for ( n = 0; n < started; n++ )
+        {
+          WaitForSingleObject( threads[n], INFINITE );
+          CloseHandle( threads[n] );
+        }
+
+        free( threads );
+      }
+
+      num_threads = started;
+    }
+#else
+    /* no thread support; run the copies one after the other */
+    for ( n = 0; n < num_threads; n++ )
+      abench_run( &args[n] );
+#endif
+
+    for ( n = 0; n < num_threads; n++ )
+      if ( args[n].elapsed > 0 )
+        rate += 1E6 * (double)args[n].done / args[n].elapsed;
+
+    free( args );
+
+    return rate;
+  }
+
+
+  static void
+  allocator_benchmark( int            max_threads,
+                       unsigned int   size,
+                       unsigned long  max_bytes,
+                       double         max_time )
+  {
+    athread_t  arg;
+    int        test, threads, mode;
+
+
+    printf( "\n"
+            "allocator comparison (glyphs/s, sum of all threads)\n"
+            "\n"
+            "  %-20s %7s", "test", "threads" );
+    for ( mode = 0; mode < FTALLOC_MAX; mode++ )
+      printf( " %17s", ftalloc_mode_name( (FTAlloc_Mode)mode ) );
+    printf( "\n" );
+
+    arg.size      = size;
+    arg.max_bytes = max_bytes;
+    arg.max_time  = 1E6 * max_time;
+
+    for ( test = 0; test < N_ABENCH; test++ )
+    {
+      if ( !size && test != ABENCH_LOAD )
+      {
+        printf( "  %-20s disabled (size = 0)\n", abench_names[test] );
+        continue;
+      }
+
+      for ( threads = 1; threads <= max_threads; threads = max_threads )
+      {
+        double  system_rate = 0;
+
+
+        arg.test = test;
+
+        printf( "  %-20s %7d", abench_names[test], threads );
+        fflush( stdout );
+
+        for ( mode = 0; mode < FTALLOC_MAX; mode++ )
+        {
+          double  rate;
+
+
+          arg.mode = (FTAlloc_Mode)mode;
+          rate     = abench_launch( &arg, threads );
+
+          if ( mode == FTALLOC_SYSTEM )
+          {
+            system_rate = rate;
+            printf( " %17.0f", rate );
+          }
+          else if ( system_rate > 0 )
+            printf( " %9.0f (%+5.1f%%)",
+                    rate, 100.0 * ( rate / system_rate - 1.0 ) );
+          else
+            printf( " %17.0f", rate );
+          fflush( stdout );
+        }
+        printf( "\n" );
+
+        if ( threads == max_threads )
+          break;
+      }
+    }
+  }
+
+
   /*
    * main
    */
@@ -900,7 +1298,8 @@
 
 
   static FT_Error
-  get_face( FT_Face*  face )
+  get_face( FT_Library  library,
+            FT_Face*    face )
   {
     static unsigned char*  memory_file = NULL;
     static size_t          memory_size;
@@ -945,14 +1344,14 @@
         }
       }
 
-      error = FT_New_Memory_Face( lib,
+      error = FT_New_Memory_Face( library,
                                   memory_file,
                                   (FT_Long)memory_size,
                                   face_index,
                                   face );
     }
     else
-      error = FT_New_Face( lib, filename, face_index, face );
+      error = FT_New_Face( library, filename, face_index, face );
 
     if ( error )
       fprintf( stderr, "couldn't load font resource\n");
@@ -1001,6 +1400,8 @@
       "\n"
       "Usage: ftbench [options] fontname\n"
       "\n"
+      "  -a N      Compare memory allocators for some tests, using 1 and N\n"
+      "            threads, after the normal tests.\n"
       "  -C        Compare with cached version (if available).\n"
       "  -c N      Use at most N iterations for each test\n"
       "            (0 means time limited).\n"
@@ -1013,6 +1414,8 @@
       "            (default is from 0 to the number of glyphs minus one).\n"
       "  -l N      Set LCD filter to N\n"
       "              0: none, 1: default, 2: light, 16: legacy\n"
+      "  -M NAME   Use memory allocator NAME (`system', `pool', or `arena';\n"
+      "            default is `system').\n"
       "  -m M      Set maximum cache size to M KiByte (default is %d).\n",
              hinting_engines,
              ps_hinting_engine_names[dflt_ps_hinting_engine],
@@ -1069,6 +1472,8 @@
     int            max_iter       = 0;
     double         max_time       = BENCH_TIME;
     int            compare_cached = 0;
+    int            alloc_threads  = 0;
+    FTAlloc_Mode   alloc_mode     = FTALLOC_SYSTEM;
     int            j;
 
     unsigned int  versions[3] = { TT_INTERPRETER_VERSION_35,
@@ -1141,13 +1546,19 @@
       int  opt;
 
 
-      opt = getopt( argc, argv, "b:Cc:f:H:I:i:l:m:pr:s:t:v" );
+      opt = getopt( argc, argv, "a:b:Cc:f:H:I:i:l:M:m:pr:s:t:v" );
 
       if ( opt == -1 )
         break;
 
       switch ( opt )
       {
+      case 'a':
+        alloc_threads = atoi( optarg );
+        if ( alloc_threads < 1 )
+          alloc_threads = 1;
+        break;
+
       case 'b':
         test_string = optarg;
         break;
@@ -1182,6 +1593,7 @@
             FT_Property_Set( lib,
                              "t1cid",
                              "hinting-engine", &j );
+            bench_ps_engine = j;
             break;
           }
         }
@@ -1201,6 +1613,7 @@
             FT_Property_Set( lib,
                              "truetype",
                              "interpreter-version", &version );
+            bench_tt_version = version;
             break;
           }
         }
@@ -1235,10 +1648,17 @@
           case FT_LCD_FILTER_LEGACY1:
           case FT_LCD_FILTER_LEGACY:
             FT_Library_SetLcdFilter( lib, (FT_LcdFilter)filter );
+            bench_lcd_filter = filter;
           }
         }
         break;
 
+      case 'M':
+        if ( ftalloc_parse_mode( optarg, &alloc_mode ) )
+          fprintf( stderr,
+                   "warning: unknown memory allocator `%s'\n", optarg );
+        break;
+
       case 'm':
         {
           int  mb = atoi( optarg );
@@ -1313,7 +1733,25 @@
 
     filename = *argv;
 
-    if ( get_face( &face ) )
+    /* the options have been applied to the default library; */
+    /* recreate it with the requested allocator if necessary */
+    if ( alloc_mode != FTALLOC_SYSTEM )
+    {
+      FT_Done_FreeType( lib );
+      lib = NULL;
+
+      bench_memory = ftalloc_new( alloc_mode );
+      if ( !bench_memory || ftalloc_new_library( bench_memory, &lib ) )
+      {
+        fprintf( stderr, "could not initialize font library\n" );
+
+        return 1;
+      }
+
+      setup_library( lib );
+    }
+
+    if ( get_face( lib, &face ) )
       goto Exit;
 
     j = printf( "\n"
@@ -1369,9 +1807,11 @@
 
     printf( "\n"
             "font preloading into memory: %s\n"
-            "maximum cache size: %lu KiByte\n",
+            "maximum cache size: %lu KiByte\n"
+            "memory allocator: %s\n",
             preload ? "yes" : face->stream->base ? "mapped" : "no",
-            max_bytes / 1024 );
+            max_bytes / 1024,
+            ftalloc_mode_name( alloc_mode ) );
 
     printf( "\n"
             "testing glyph indices from %d to %d at %u ppem\n"
@@ -1537,6 +1977,9 @@
       }
     }
 
+    if ( alloc_threads )
+      allocator_benchmark( alloc_threads, size, max_bytes, max_time );
+
   Exit:
     /* The following is a bit subtle: When we call FTC_Manager_Done, this
      * normally destroys all FT_Face objects that the cache might have
@@ -1556,7 +1999,13 @@
     if ( cache_man )
       FTC_Manager_Done( cache_man );
 
-    FT_Done_FreeType( lib );
+    if ( bench_memory )
+    {
+      FT_Done_Library( lib );
+      ftalloc_done( bench_memory );
+    }
+    else
+      FT_Done_FreeType( lib );
 
     return 0;
   }
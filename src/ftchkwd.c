@@ -14,22 +14,106 @@
 
 #include <ft2build.h>
 #include <freetype/freetype.h>
+#include <freetype/ftadvanc.h>
+
+#include "strbuf.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef UNIX
+#include <unistd.h>
+#else
+#include "mlgetopt.h"
+#endif
+
+  /* directory scanning and worker threads need POSIX */
+#if defined UNIX || defined __unix__
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CHKWD_POSIX
+#endif
+
 
   FT_Error  error;
 
 
+#define ADVANCE_CHUNK   256   /* glyphs per `FT_Get_Advances' call    */
+#define MAX_HISTOGRAM   8     /* most frequent advance widths to show */
+#define NO_ADVANCE      -1    /* marks glyphs that can't be loaded    */
+
+
+  static int  use_load_glyph;   /* -l: load glyphs one by one (slow)  */
+  static int  count_all;        /* -a: don't stop at the first glyph  */
+  static int  show_histogram;   /* -H: print advance width histogram  */
+  static int  num_threads = 1;  /* -j: number of worker threads       */
+
+
+  /* input files; directories get expanded into this list */
+  typedef struct  FileList_
+  {
+    char**  names;
+    int     num_names;
+    int     max_names;
+    int     num_given;      /* files not found by scanning a directory */
+
+  } FileList;
+
+
+  /* all state shared by the worker threads */
+  typedef struct  CheckState_
+  {
+    FileList*  files;
+    char**     results;     /* output of each file, in order    */
+    int        next_file;   /* next file to check               */
+    int        next_print;  /* first result not printed yet     */
+
+    long       num_faces;
+    long       num_fixed;
+    long       num_proportional;
+    long       num_ko;
+    long       num_errors;
+    long       num_unknown;
+
+#ifdef CHKWD_POSIX
+    pthread_mutex_t  lock;
+#endif
+
+  } CheckState;
+
+
+  typedef struct  AdvanceCount_
+  {
+    FT_Fixed  advance;
+    FT_ULong  count;
+
+  } AdvanceCount;
+
+
   static void
   Usage( char*  name )
   {
     printf( "ftchkwd: test fixed font width -- part of the FreeType project\n" );
     printf( "---------------------------------------------------------------------\n" );
     printf( "\n" );
-    printf( "Usage: %s fontname[.ttf|.ttc] [fontname2..]\n", name );
+    printf( "Usage: %s [options] fontname[.ttf|.ttc]|directory [...]\n", name );
+    printf( "\n" );
+    printf( "  -a        Count all `proportional' glyphs instead of stopping\n" );
+    printf( "            at the first one.\n" );
+    printf( "  -H        Show the most frequent advance widths of each face\n" );
+    printf( "            (implies -a).\n" );
+    printf( "  -l        Load all glyphs with `FT_Load_Glyph' instead of using\n" );
+    printf( "            `FT_Get_Advances' (slow).\n" );
+#ifdef CHKWD_POSIX
+    printf( "  -j N      Check files with N threads (default is 1;\n" );
+    printf( "            0 means one thread per CPU).\n" );
+    printf( "\n" );
+    printf( "Directories are scanned recursively; files with an unknown\n" );
+    printf( "format found there are silently skipped.\n" );
+#endif
     printf( "\n" );
 
     exit( 1 );
@@ -63,127 +147,710 @@
   }
 
 
+  /*************************************************************************/
+  /*                                                                       */
+  /* Collecting advance widths.                                            */
+  /*                                                                       */
+
+  /* fill `advances' for glyphs `start' to `start+count-1' (in font units) */
   static void
-  check_face( FT_Face      face,
-              const char*  filepathname,
-              int          idx )
+  get_advances( FT_Face    face,
+                FT_UInt    start,
+                FT_UInt    count,
+                FT_Fixed*  advances )
   {
-    int  face_has_fixed_flag = FT_IS_FIXED_WIDTH(face);
-    int  face_max_advance    = face->max_advance_width;
-    int  num_proportional    = 0;
-    int  n;
+    FT_UInt  n;
 
-    FT_UNUSED( idx );
 
+    if ( !use_load_glyph )
+    {
+      /* for most formats, this is a mere table lookup */
+      if ( !FT_Get_Advances( face, start, count,
+                             FT_LOAD_NO_SCALE, advances ) )
+        return;
+
+      /* some glyph in the range is broken; find out which */
+      for ( n = 0; n < count; n++ )
+        if ( FT_Get_Advance( face, start + n,
+                             FT_LOAD_NO_SCALE, &advances[n] ) )
+          advances[n] = NO_ADVANCE;
+
+      return;
+    }
 
-    printf( "%15s : %20s : ",
-            file_basename( filepathname ),
-            face->family_name ? face->family_name : "UNKNOWN FAMILY" );
-
-    for ( n = 0; n < face->num_glyphs; n++ )
+    for ( n = 0; n < count; n++ )
     {
       /* load the glyph outline */
-      error = FT_Load_Glyph( face, n, FT_LOAD_NO_SCALE );
-      if ( error )
+      if ( FT_Load_Glyph( face, start + n, FT_LOAD_NO_SCALE ) )
+        advances[n] = NO_ADVANCE;
+      else
+        advances[n] = face->glyph->metrics.horiAdvance;
+    }
+  }
+
+
+  static int
+  compare_fixed( const void*  a,
+                 const void*  b )
+  {
+    FT_Fixed  x = *(const FT_Fixed*)a;
+    FT_Fixed  y = *(const FT_Fixed*)b;
+
+
+    return x < y ? -1 : x > y;
+  }
+
+
+  static int
+  compare_counts( const void*  a,
+                  const void*  b )
+  {
+    const AdvanceCount*  x = (const AdvanceCount*)a;
+    const AdvanceCount*  y = (const AdvanceCount*)b;
+
+
+    /* larger counts first, then smaller widths */
+    if ( x->count != y->count )
+      return x->count > y->count ? -1 : 1;
+
+    return compare_fixed( &x->advance, &y->advance );
+  }
+
+
+  /* sort `advances' and append the most frequent values to `out' */
+  static void
+  format_histogram( StrBuf*    out,
+                    FT_Fixed*  advances,
+                    FT_Long    num_advances )
+  {
+    AdvanceCount*  counts;
+    FT_Long        num_counts = 0;
+    FT_Long        n;
+
+
+    qsort( advances, (size_t)num_advances, sizeof ( FT_Fixed ),
+           compare_fixed );
+
+    counts = (AdvanceCount*)malloc( (size_t)num_advances *
+                                    sizeof ( AdvanceCount ) + 1 );
+    if ( !counts )
+      return;
+
+    for ( n = 0; n < num_advances; n++ )
+    {
+      if ( advances[n] == NO_ADVANCE )
         continue;
 
-      if ( face->glyph->metrics.horiAdvance != face_max_advance )
+      if ( num_counts && counts[num_counts - 1].advance == advances[n] )
+        counts[num_counts - 1].count++;
+      else
+      {
+        counts[num_counts].advance = advances[n];
+        counts[num_counts].count   = 1;
+        num_counts++;
+      }
+    }
+
+    qsort( counts, (size_t)num_counts, sizeof ( AdvanceCount ),
+           compare_counts );
+
+    strbuf_format( out, "\n    %ld distinct width%s:", num_counts,
+                   num_counts == 1 ? "" : "s" );
+    for ( n = 0; n < num_counts && n < MAX_HISTOGRAM; n++ )
+      strbuf_format( out, " %ld (%lu)",
+                     counts[n].advance, counts[n].count );
+    if ( num_counts > MAX_HISTOGRAM )
+      strbuf_add( out, " ..." );
+
+    free( counts );
+  }
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* Checking a face.  Return -1 on error, 0 if the face is OK, and 1 for  */
+  /* a mismatch between its flags and its advance widths.                  */
+  /*                                                                       */
+
+  static int
+  check_face( FT_Face      face,
+              const char*  filepathname,
+              int          idx,
+              StrBuf*      out,
+              int*         is_fixed )
+  {
+    int        face_has_fixed_flag = FT_IS_FIXED_WIDTH( face );
+    FT_Fixed   face_max_advance    = face->max_advance_width;
+    FT_Long    num_proportional    = 0;
+    FT_Long    first_proportional  = -1;
+    FT_Long    num_glyphs          = face->num_glyphs;
+    FT_Fixed   chunk[ADVANCE_CHUNK];
+    FT_Fixed*  advances            = NULL;
+    FT_Long    start, n;
+    int        result;
+
+
+    if ( face->num_faces > 1 )
+      strbuf_format( out, "%15s:%d : %20s : ",
+                     file_basename( filepathname ), idx,
+                     face->family_name ? face->family_name
+                                       : "UNKNOWN FAMILY" );
+    else
+      strbuf_format( out, "%15s : %20s : ",
+                     file_basename( filepathname ),
+                     face->family_name ? face->family_name
+                                       : "UNKNOWN FAMILY" );
+
+    if ( show_histogram )
+    {
+      advances = (FT_Fixed*)malloc( (size_t)num_glyphs *
+                                    sizeof ( FT_Fixed ) + 1 );
+      if ( !advances )
+      {
+        strbuf_add( out, "out of memory\n" );
+        return -1;
+      }
+    }
+
+    for ( start = 0; start < num_glyphs; start += ADVANCE_CHUNK )
+    {
+      FT_UInt    count = (FT_UInt)( num_glyphs - start );
+      FT_Fixed*  p     = advances ? advances + start : chunk;
+
+
+      if ( count > ADVANCE_CHUNK )
+        count = ADVANCE_CHUNK;
+
+      get_advances( face, (FT_UInt)start, count, p );
+
+      for ( n = 0; n < (FT_Long)count; n++ )
+      {
+        if ( p[n] == NO_ADVANCE || p[n] == face_max_advance )
+          continue;
+
+        if ( first_proportional < 0 )
+          first_proportional = start + n;
         num_proportional++;
+      }
+
+      /* the verdict is settled by the first `proportional' glyph */
+      if ( num_proportional && !count_all && !show_histogram )
+        break;
     }
 
     if ( num_proportional > 0 )
     {
+      *is_fixed = 0;
+
       if ( face_has_fixed_flag )
-        printf( "KO!  Tagged as fixed, but has %d `proportional' glyphs",
-                 num_proportional );
+      {
+        if ( count_all || show_histogram )
+          strbuf_format( out,
+                         "KO!  Tagged as fixed, but has %ld"
+                         " `proportional' glyphs",
+                         num_proportional );
+        else
+          strbuf_format( out,
+                         "KO!  Tagged as fixed, but glyph %ld"
+                         " is `proportional'",
+                         first_proportional );
+        result = 1;
+      }
       else
-        printf( "OK (proportional)" );
+      {
+        strbuf_add( out, "OK (proportional)" );
+        result = 0;
+      }
     }
     else
     {
+      *is_fixed = 1;
+
       if ( face_has_fixed_flag )
-        printf( "OK (fixed-width)" );
+      {
+        strbuf_add( out, "OK (fixed-width)" );
+        result = 0;
+      }
       else
-        printf( "KO!  Tagged as proportional but has fixed width" );
+      {
+        strbuf_add( out, "KO!  Tagged as proportional but has fixed width" );
+        result = 1;
+      }
     }
-    printf( "\n" );
+
+    if ( advances )
+    {
+      format_histogram( out, advances, num_glyphs );
+      free( advances );
+    }
+
+    strbuf_add( out, "\n" );
+
+    return result;
   }
 
 
-  int
-  main( int     argc,
-        char**  argv )
+  /*************************************************************************/
+  /*                                                                       */
+  /* Checking a file.                                                      */
+  /*                                                                       */
+
+  static void
+  lock_state( CheckState*  state )
   {
-    FT_Face     face;
-    FT_Library  library;
+#ifdef CHKWD_POSIX
+    pthread_mutex_lock( &state->lock );
+#else
+    FT_UNUSED( state );
+#endif
+  }
 
-    int         i, file_index;
-    char        filename[1024 + 4];
-    char*       execname;
-    char*       fname;
 
+  static void
+  unlock_state( CheckState*  state )
+  {
+#ifdef CHKWD_POSIX
+    pthread_mutex_unlock( &state->lock );
+#else
+    FT_UNUSED( state );
+#endif
+  }
 
-    execname = argv[0];
 
-    if ( argc < 2 )
-      Usage( execname );
+  /* open face `idx' of `fname', trying to append `.ttf' if necessary */
+  static FT_Error
+  open_face( FT_Library   library,
+             const char*  fname,
+             int          idx,
+             int          from_directory,
+             FT_Face*     aface )
+  {
+    FT_Error  err;
+    char      filename[1024 + 4];
+    long      i;
 
-    error = FT_Init_FreeType( &library );
-    if ( error )
-      Panic( "Could not create library object" );
 
-    /* Now check all files */
-    for ( file_index = 1; file_index < argc; file_index++ )
+    /* try to open the file with no extra extension first */
+    err = FT_New_Face( library, fname, idx, aface );
+    if ( !err || err == FT_Err_Unknown_File_Format || from_directory )
+      return err;
+
+    /* Ok, we could not load the file.  Try to add an extension to */
+    /* its name if possible.                                       */
+
+    i = (long)strlen( fname );
+    while ( i > 0 && fname[i] != '\\' && fname[i] != '/' )
     {
-      fname = argv[file_index];
+      if ( fname[i] == '.' )
+        i = 0;
+      i--;
+    }
+
+#ifndef macintosh
+    snprintf( filename, sizeof ( filename ), "%s%s", fname,
+              ( i >= 0 ? ".ttf" : "" ) );
+#else
+    snprintf( filename, sizeof ( filename ), "%s", fname );
+#endif
+
+    /* Load face */
+    return FT_New_Face( library, filename, idx, aface );
+  }
 
-      /* try to open the file with no extra extension first */
-      error = FT_New_Face( library, fname, 0, &face );
-      if ( !error )
-        goto Success;
 
-      if ( error == FT_Err_Unknown_File_Format )
+  static void
+  check_file( FT_Library   library,
+              CheckState*  state,
+              int          file_index )
+  {
+    const char*  fname          = state->files->names[file_index];
+    int          from_directory = file_index >= state->files->num_given;
+    long         num_faces      = 1;
+    long         faces = 0, fixed = 0, proportional = 0, ko = 0, errors = 0;
+    long         unknown        = 0;
+    int          idx;
+    FT_Error     err;
+    FT_Face      face;
+    StrBuf       out[1];
+    char*        buffer;
+    size_t       buffer_size    = 256;
+
+
+    buffer = (char*)malloc( buffer_size );
+    if ( !buffer )
+      return;
+    buffer[0] = '\0';
+    strbuf_init( out, buffer, buffer_size );
+
+    for ( idx = 0; idx < num_faces; idx++ )
+    {
+      size_t  len = strbuf_len( out );
+      int     result, is_fixed;
+
+
+      err = open_face( library, fname, idx, from_directory, &face );
+      if ( err )
       {
-        fprintf( stderr, "%s: unknown format\n", fname );
-        continue;
+        if ( err == FT_Err_Unknown_File_Format )
+        {
+          unknown++;
+          if ( !from_directory )
+            strbuf_format( out, "%s: unknown format\n", fname );
+        }
+        else
+        {
+          errors++;
+          strbuf_format( out, "%s: could not find/open file (error: %d)\n",
+                         fname, err );
+        }
+        break;
       }
 
-      /* Ok, we could not load the file.  Try to add an extension to */
-      /* its name if possible.                                       */
+      num_faces = face->num_faces;
 
-      i = strlen( fname );
-      while ( i > 0 && fname[i] != '\\' && fname[i] != '/' )
+      /* make sure the output of a face fits */
+      if ( buffer_size - len < 1024 )
       {
-        if ( fname[i] == '.' )
-          i = 0;
-        i--;
+        char*  new_buffer;
+
+
+        buffer_size = 2 * buffer_size + 1024;
+        new_buffer  = (char*)realloc( buffer, buffer_size );
+        if ( !new_buffer )
+        {
+          FT_Done_Face( face );
+          break;
+        }
+
+        /* `strbuf_init' keeps the current content */
+        buffer = new_buffer;
+        strbuf_init( out, buffer, buffer_size );
       }
 
-#ifndef macintosh
-      snprintf( filename, sizeof ( filename ), "%s%s", fname,
-                ( i >= 0 ? ".ttf" : "" ) );
-#else
-      snprintf( filename, sizeof ( filename ), "%s", fname );
+      result = check_face( face, fname, idx, out, &is_fixed );
+      if ( result < 0 )
+        errors++;
+      else
+      {
+        faces++;
+        if ( is_fixed )
+          fixed++;
+        else
+          proportional++;
+        if ( result > 0 )
+          ko++;
+      }
+
+      FT_Done_Face( face );
+    }
+
+    /* print results in the order of the file list */
+    lock_state( state );
+
+    state->num_faces        += faces;
+    state->num_fixed        += fixed;
+    state->num_proportional += proportional;
+    state->num_ko           += ko;
+    state->num_errors       += errors;
+    state->num_unknown      += unknown;
+
+    state->results[file_index] = buffer;
+    while ( state->next_print < state->files->num_names &&
+            state->results[state->next_print]           )
+    {
+      char**  result = &state->results[state->next_print++];
+
+
+      fputs( *result, stdout );
+      free( *result );
+      *result = NULL;
+    }
+    fflush( stdout );
+
+    unlock_state( state );
+  }
+
+
+  static void
+  check_files( CheckState*  state )
+  {
+    FT_Library  library;
+    int         file_index;
+
+
+    /* each thread has its own library */
+    if ( FT_Init_FreeType( &library ) )
+      return;
+
+    for (;;)
+    {
+      lock_state( state );
+      file_index = state->next_file++;
+      unlock_state( state );
+
+      if ( file_index >= state->files->num_names )
+        break;
+
+      check_file( library, state, file_index );
+    }
+
+    FT_Done_FreeType( library );
+  }
+
+
+#ifdef CHKWD_POSIX
+
+  static void*
+  check_thread( void*  arg )
+  {
+    check_files( (CheckState*)arg );
+
+    return NULL;
+  }
+
 #endif
 
-      /* Load face */
-      error = FT_New_Face( library, filename, 0, &face );
-      if ( error )
+
+  /*************************************************************************/
+  /*                                                                       */
+  /* Collecting files.                                                     */
+  /*                                                                       */
+
+  static void
+  add_file( FileList*    list,
+            const char*  name )
+  {
+    if ( list->num_names == list->max_names )
+    {
+      list->max_names = list->max_names ? 2 * list->max_names : 64;
+      list->names     = (char**)realloc( list->names,
+                                         (size_t)list->max_names *
+                                           sizeof ( char* ) );
+      if ( !list->names )
+        Panic( "out of memory" );
+    }
+
+    list->names[list->num_names] = strdup( name );
+    if ( !list->names[list->num_names] )
+      Panic( "out of memory" );
+
+    list->num_names++;
+  }
+
+
+  static int
+  compare_names( const void*  a,
+                 const void*  b )
+  {
+    return strcmp( *(char* const*)a, *(char* const*)b );
+  }
+
+
+#ifdef CHKWD_POSIX
+
+  static int
+  is_directory( const char*  name )
+  {
+    struct stat  st;
+
+
+    return !stat( name, &st ) && S_ISDIR( st.st_mode );
+  }
+
+
+  static void
+  add_directory( FileList*    list,
+                 const char*  dirname )
+  {
+    DIR*            dir;
+    struct dirent*  entry;
+    size_t          len = strlen( dirname );
+
+
+    dir = opendir( dirname );
+    if ( !dir )
+    {
+      fprintf( stderr, "%s: cannot open directory\n", dirname );
+      return;
+    }
+
+    while ( ( entry = readdir( dir ) ) != NULL )
+    {
+      char*        path;
+      struct stat  st;
+
+
+      if ( entry->d_name[0] == '.' )
+        continue;
+
+      path = (char*)malloc( len + strlen( entry->d_name ) + 2 );
+      if ( !path )
+        Panic( "out of memory" );
+
+      sprintf( path, "%s%s%s", dirname,
+               len && dirname[len - 1] == '/' ? "" : "/", entry->d_name );
+
+      if ( !stat( path, &st ) )
       {
-        if ( error == FT_Err_Unknown_File_Format )
-          printf( "unknown format\n" );
-        else
-          printf( "could not find/open file (error: %d)\n", error );
+        if ( S_ISDIR( st.st_mode ) )
+          add_directory( list, path );
+        else if ( S_ISREG( st.st_mode ) )
+          add_file( list, path );
+      }
+
+      free( path );
+    }
+
+    closedir( dir );
+  }
+
+#endif /* CHKWD_POSIX */
+
+
+  int
+  main( int     argc,
+        char**  argv )
+  {
+    FileList    files;
+    CheckState  state;
+    char*       execname;
+    int         option, i;
+
+
+    execname = argv[0];
+
+    while ( 1 )
+    {
+      option = getopt( argc, argv, "aHj:l" );
+
+      if ( option == -1 )
+        break;
+
+      switch ( option )
+      {
+      case 'a':
+        count_all = 1;
+        break;
+
+      case 'H':
+        show_histogram = 1;
+        break;
+
+      case 'j':
+        num_threads = atoi( optarg );
+#ifdef CHKWD_POSIX
+        if ( num_threads <= 0 )
+          num_threads = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+        if ( num_threads <= 0 )
+          num_threads = 1;
+        break;
+
+      case 'l':
+        use_load_glyph = 1;
+        break;
+
+      default:
+        Usage( execname );
+        break;
+      }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if ( argc < 1 )
+      Usage( execname );
+
+    memset( &files, 0, sizeof ( files ) );
+    memset( &state, 0, sizeof ( state ) );
+
+    /* Now collect all files; files given directly come first */
+    /* (in command line order), then the directory contents   */
+    for ( i = 0; i < argc; i++ )
+    {
+#ifdef CHKWD_POSIX
+      if ( is_directory( argv[i] ) )
         continue;
+#endif
+      add_file( &files, argv[i] );
+    }
+
+    files.num_given = files.num_names;
+
+#ifdef CHKWD_POSIX
+    for ( i = 0; i < argc; i++ )
+    {
+      if ( is_directory( argv[i] ) )
+        add_directory( &files, argv[i] );
+    }
+#endif
+
+    qsort( files.names + files.num_given,
+           (size_t)( files.num_names - files.num_given ),
+           sizeof ( char* ), compare_names );
+
+    state.files   = &files;
+    state.results = (char**)calloc( (size_t)files.num_names + 1,
+                                    sizeof ( char* ) );
+    if ( !state.results )
+      Panic( "out of memory" );
+
+    if ( num_threads > files.num_names )
+      num_threads = files.num_names;
+
+#ifdef CHKWD_POSIX
+    pthread_mutex_init( &state.lock, NULL );
+
+    if ( num_threads > 1 )
+    {
+      pthread_t*  threads;
+      int         started = 0;
+
+
+      threads = (pthread_t*)calloc( (size_t)num_threads,
+                                    sizeof ( pthread_t ) );
+      if ( threads )
+      {
+        for ( ; started < num_threads; started++ )
+          if ( pthread_create( &threads[started], NULL,
+                               check_thread, &state ) )
+            break;
+
+        for ( i = 0; i < started; i++ )
+          pthread_join( threads[i], NULL );
+
+        free( threads );
       }
 
-  Success:
-      check_face( face, fname, face->face_index );
+      /* fall back to the main thread for anything left */
+      check_files( &state );
+    }
+    else
+#endif
+      check_files( &state );
 
-      FT_Done_Face( face );
+#ifdef CHKWD_POSIX
+    pthread_mutex_destroy( &state.lock );
+#endif
+
+    if ( state.num_faces + state.num_errors > 1 )
+    {
+      printf( "\n%ld faces: %ld fixed-width, %ld proportional, %ld KO",
+              state.num_faces, state.num_fixed, state.num_proportional,
+              state.num_ko );
+      if ( state.num_errors )
+        printf( ", %ld errors", state.num_errors );
+      if ( state.num_unknown )
+        printf( " (%ld files of unknown format)", state.num_unknown );
+      printf( "\n" );
     }
 
-    FT_Done_FreeType( library );
+    for ( i = 0; i < files.num_names; i++ )
+      free( files.names[i] );
+    free( files.names );
+    free( state.results );
+
     exit( 0 );      /* for safety reasons */
 
     return 0;       /* never reached */
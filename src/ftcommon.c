@@ -23,6 +23,7 @@
 #include <freetype/ftdriver.h>  /* access driver name and properties */
 #include <freetype/ftfntfmt.h>
 #include <freetype/ftmodapi.h>
+#include <freetype/ftoutln.h>
 
 
   /* error messages */
@@ -34,8 +35,11 @@
 #include "common.h"
 #include "strbuf.h"
 #include "ftcommon.h"
+#include "ftalloc.h"
+#include "ftindex.h"
 #include "rsvg-port.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,9 +50,31 @@
 #define strcasecmp  _stricmp
 #endif
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define FTDEMO_HAVE_MAP
+#elif defined( __unix__ ) || defined( __APPLE__ )
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define FTDEMO_HAVE_MAP
+#endif
+
 
 #define N_HINTING_ENGINES  2
 
+  /* FreeType's defaults are 2 faces and 4 sizes; `ftview' keeps the */
+  /* fonts around the current one open                               */
+#define FTDEMO_MAX_FACES  8
+#define FTDEMO_MAX_SIZES  16
+
+  /* one budget for the glyphs of the FTC manager and those of */
+  /* `FTDemo_Outline_Add', split evenly                        */
+#define FTDEMO_MAX_BYTES  ( 4UL << 20 )
+#define FTDEMO_FTC_BYTES  ( FTDEMO_MAX_BYTES / 2 )
+
 
   FT_Error  error;
 
@@ -256,23 +282,33 @@
                      FT_Pointer  request_data,
                      FT_Face*    aface )
   {
-    PFont  font = (PFont)face_id;
+    PFont     font = (PFont)face_id;
+    FT_Error  err;
 
     FT_UNUSED( request_data );
 
 
+    /* don't touch `error'; `FTDemo_Open_Face' is called by threads */
     if ( font->file_address != NULL )
-      error = FT_New_Memory_Face( lib,
-                                  (const FT_Byte*)font->file_address,
-                                  (FT_Long)font->file_size,
-                                  font->face_index,
-                                  aface );
+    {
+#ifdef MADV_WILLNEED
+      /* only now that a face is used, page in its mapped file ahead */
+      if ( font->file_mapped )
+        madvise( font->file_address, font->file_size, MADV_WILLNEED );
+#endif
+
+      err = FT_New_Memory_Face( lib,
+                                (const FT_Byte*)font->file_address,
+                                (FT_Long)font->file_size,
+                                font->face_index,
+                                aface );
+    }
     else
-      error = FT_New_Face( lib,
-                           font->filepathname,
-                           font->face_index,
-                           aface );
-    if ( !error )
+      err = FT_New_Face( lib,
+                         font->filepathname,
+                         font->face_index,
+                         aface );
+    if ( !err )
     {
       const char*  format = FT_Get_Font_Format( *aface );
 
@@ -326,369 +362,1862 @@
         (*aface)->charmap = (*aface)->charmaps[font->cmap_index];
     }
 
-    return error;
+    return err;
   }
 
 
-  FTDemo_Handle*
-  FTDemo_New( void )
+  /* read or map the file of `font' into memory */
+  static FT_Error
+  preload_file( PFont  font,
+                int    preload )
   {
-    FTDemo_Handle*  handle;
+    FILE*   file;
+    size_t  file_size;
 
 
-    handle = (FTDemo_Handle *)malloc( sizeof ( FTDemo_Handle ) );
-    if ( !handle )
-      return NULL;
+#ifdef FTDEMO_HAVE_MAP
 
-    memset( handle, 0, sizeof ( FTDemo_Handle ) );
+    if ( preload == PRELOAD_MAP )
+    {
+      void*  address = NULL;
 
-    error = FT_Init_FreeType( &handle->library );
-    if ( error )
-      PanicZ( "could not initialize FreeType" );
+#ifdef _WIN32
 
-    /* The use of an external SVG rendering library is optional. */
-    (void)FT_Property_Set( handle->library,
-                           "ot-svg", "svg-hooks", &rsvg_hooks );
+      HANDLE         fh, mh;
+      LARGE_INTEGER  size;
 
-    error = FTC_Manager_New( handle->library, 0, 0, 0,
-                             my_face_requester, 0, &handle->cache_manager );
-    if ( error )
-      PanicZ( "could not initialize cache manager" );
 
-    error = FTC_SBitCache_New( handle->cache_manager, &handle->sbits_cache );
-    if ( error )
-      PanicZ( "could not initialize small bitmaps cache" );
+      fh = CreateFileA( font->filepathname, GENERIC_READ, FILE_SHARE_READ,
+                        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+      if ( fh == INVALID_HANDLE_VALUE )
+        return FT_Err_Cannot_Open_Resource;
 
-    error = FTC_ImageCache_New( handle->cache_manager, &handle->image_cache );
-    if ( error )
-      PanicZ( "could not initialize glyph image cache" );
+      if ( !GetFileSizeEx( fh, &size ) || size.QuadPart <= 0 ||
+           (unsigned long long)size.QuadPart > (size_t)-1     )
+      {
+        CloseHandle( fh );
+        return FT_Err_Invalid_Stream_Operation;
+      }
+      file_size = (size_t)size.QuadPart;
 
-    error = FTC_CMapCache_New( handle->cache_manager, &handle->cmap_cache );
-    if ( error )
-      PanicZ( "could not initialize charmap cache" );
+      mh = CreateFileMappingA( fh, NULL, PAGE_READONLY, 0, 0, NULL );
+      if ( mh )
+      {
+        address = MapViewOfFile( mh, FILE_MAP_READ, 0, 0, 0 );
+        CloseHandle( mh );
+      }
+      CloseHandle( fh );
 
-    FT_Bitmap_Init( &handle->bitmap );
+#else /* !_WIN32 */
 
-    FT_Stroker_New( handle->library, &handle->stroker );
+      struct stat  st;
+      int          fd = open( font->filepathname, O_RDONLY );
 
-    handle->encoding = FT_ENCODING_ORDER;
 
-    handle->hinted     = 1;
-    handle->use_sbits  = 1;
-    handle->use_color  = 1;
-    handle->use_layers = 1;
-    handle->autohint   = 0;
-    handle->lcd_mode   = LCD_MODE_AA;
+      if ( fd < 0 )
+        return FT_Err_Cannot_Open_Resource;
 
-    handle->use_sbits_cache = 1;
+      if ( fstat( fd, &st ) || st.st_size <= 0 )
+      {
+        close( fd );
+        return FT_Err_Invalid_Stream_Operation;
+      }
+      file_size = (size_t)st.st_size;
+
+      address = mmap( NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if ( address == MAP_FAILED )
+        address = NULL;
+      close( fd );
+
+#ifdef MADV_RANDOM
+      /* Glyph data is accessed in no particular order; nothing is read */
+      /* before a face of the file is opened by `my_face_requester'.    */
+      if ( address )
+        madvise( address, file_size, MADV_RANDOM );
+#endif
 
-    /* string_init */
-    memset( handle->string, 0, sizeof ( TGlyph ) * MAX_GLYPHS );
-    handle->string_length = 0;
+#endif /* !_WIN32 */
 
-    return handle;
-  }
+      if ( address )
+      {
+        font->file_address = address;
+        font->file_size    = file_size;
+        font->file_preload = PRELOAD_MAP;
+        font->file_mapped  = 1;
 
+        return FT_Err_Ok;
+      }
 
-  void
-  FTDemo_Done( FTDemo_Handle*  handle )
-  {
-    int  i;
+      /* otherwise read the file */
+    }
 
+#endif /* FTDEMO_HAVE_MAP */
 
-    if ( !handle )
-      return;
+    file = fopen( font->filepathname, "rb" );
+    if ( file == NULL )  /* shouldn't happen */
+      return FT_Err_Invalid_Argument;
 
-    for ( i = 0; i < handle->max_fonts; i++ )
+    fseek( file, 0, SEEK_END );
+    file_size = (size_t)ftell( file );
+    fseek( file, 0, SEEK_SET );
+
+    if ( file_size <= 0 )
     {
-      if ( handle->fonts[i] )
-      {
-        if ( handle->fonts[i]->filepathname )
-          free( (void*)handle->fonts[i]->filepathname );
-        free( handle->fonts[i] );
-      }
+      fclose( file );
+      return FT_Err_Invalid_Stream_Operation;
     }
-    free( handle->fonts );
 
-    /* string_done */
-    for ( i = 0; i < MAX_GLYPHS; i++ )
+    font->file_address = malloc( file_size );
+    if ( !font->file_address )
     {
-      PGlyph  glyph = handle->string + i;
-
+      fclose( file );
+      return FT_Err_Out_Of_Memory;
+    }
 
-      if ( glyph->image )
-        FT_Done_Glyph( glyph->image );
+    if ( !fread( font->file_address, file_size, 1, file ) )
+    {
+      free( font->file_address );
+      font->file_address = NULL;
+      fclose( file );
+      return FT_Err_Invalid_Stream_Read;
     }
 
-    FT_Stroker_Done( handle->stroker );
-    FT_Bitmap_Done( handle->library, &handle->bitmap );
-    FTC_Manager_Done( handle->cache_manager );
-    FT_Done_FreeType( handle->library );
+    font->file_size    = file_size;
+    font->file_preload = PRELOAD_READ;
 
-    free( handle );
+    fclose( file );
 
-    fflush( stdout );  /* clean mintty pipes */
+    return FT_Err_Ok;
   }
 
 
-  void
-  FTDemo_Version( FTDemo_Handle*  handle,
-                  FT_String       str[64] )
+  static void
+  release_file( PFont  font )
   {
-    FT_Int     major, minor, patch;
-    FT_String  format[] = "%d.%d.%d";
-    StrBuf     sb;
+    switch ( font->file_preload )
+    {
+    case PRELOAD_READ:
+      free( font->file_address );
+      break;
 
+#ifdef FTDEMO_HAVE_MAP
+    case PRELOAD_MAP:
+#ifdef _WIN32
+      UnmapViewOfFile( font->file_address );
+#else
+      munmap( font->file_address, font->file_size );
+#endif
+      break;
+#endif
+    }
 
-    FT_Library_Version( handle->library, &major, &minor, &patch );
+    font->file_address = NULL;
+    font->file_size    = 0;
+    font->file_preload = PRELOAD_NONE;
+    font->file_mapped  = 0;
+  }
 
-    if ( !patch )
-      format[5] = '\0';   /* terminate early */
 
-    /* append the version string */
-    strbuf_init( &sb, str, 64 );
-    strbuf_format( &sb, format, major, minor, patch );
-  }
+  /* The HUD counters; times are only taken while it is shown. */
+#define HUD_START( handle )  ( (handle)->hud.shown ? grTime() : 0.0 )
 
+#define HUD_STOP( handle, field, t0 )                \
+          do                                         \
+          {                                          \
+            if ( (handle)->hud.shown )               \
+              (handle)->hud.field += grTime() - t0;  \
+          } while ( 0 )
 
-  static void
-  icon_span( int              y,
-             int              count,
-             const FT_Span*   spans,
-             grBitmap*        icon )
+
+  /* FTC does not tell whether a lookup hits.  On a miss, it loads the */
+  /* glyph into the slot of the face, which we mark beforehand.        */
+  static FT_GlyphSlot
+  hud_mark_slot( FTDemo_Handle*    handle,
+                 FT_Glyph_Format*  aformat )
   {
-    FT_UInt32*      dst_line;
-    FT_UInt32*      dst;
-    FT_UInt32       color = 0xFF7F00;
-    unsigned short  w;
+    FT_Face  face;
 
 
-    if ( icon->pitch > 0 )
-      y -= icon->rows - 1;
+    if ( !handle->hud.shown                                    ||
+         FTC_Manager_LookupFace( handle->cache_manager,
+                                 handle->scaler.face_id, &face ) )
+      return NULL;
 
-    dst_line = (FT_UInt32*)( icon->buffer - y * icon->pitch );
+    *aformat            = face->glyph->format;
+    face->glyph->format = FT_GLYPH_FORMAT_NONE;
 
-    for ( ; count--; spans++ )
-      for ( dst = dst_line + spans->x, w = spans->len; w--; dst++ )
-        *dst = ( (FT_UInt32)spans->coverage << 24 ) | color;
+    return face->glyph;
   }
 
 
-  void
-  FTDemo_Icon( FTDemo_Handle*   handle,
-               FTDemo_Display*  display )
+  /* tell whether the marked slot has been loaded, otherwise unmark it */
+  static int
+  hud_slot_loaded( FT_GlyphSlot     slot,
+                   FT_Glyph_Format  format )
   {
-    FT_Vector   p[] = { { 4, 8}, { 4,10}, { 8,12}, { 8,52}, { 4,54},
-                        { 4,56}, {60,56}, {60,44}, {58,44}, {56,52},
-                        {44,52}, {44,12}, {48,10}, {48, 8}, {32, 8},
-                        {32,10}, {36,12}, {36,52}, {16,52}, {16,36},
-                        {24,36}, {26,40}, {28,40}, {28,28}, {26,28},
-                        {24,32}, {16,32}, {16,12}, {20,10}, {20, 8} };
-    char        t[] = { 1,1,1,1,1, 1,1,1,1,1, 1,1,1,1,1,
-                        1,1,1,1,1, 1,1,1,1,1, 1,1,1,1,1 };
-    short       c[] = {29};
-    FT_Outline  FT  = { sizeof ( c ) / sizeof ( c[0] ),
-                        sizeof ( p ) / sizeof ( p[0] ),
-                        p, t, c, FT_OUTLINE_NONE };
-    grBitmap    icon = { 0 };
-    grBitmap*   picon = NULL;
-    int         size, i;
+    if ( !slot )
+      return 0;
 
-    FT_Raster_Params  params = { NULL, NULL,
-                                 FT_RASTER_FLAG_AA | FT_RASTER_FLAG_DIRECT,
-                                 (FT_SpanFunc)icon_span, NULL, NULL, NULL,
-                                 &icon, { 0, 0, 0, 0 } };
+    if ( slot->format != FT_GLYPH_FORMAT_NONE )
+      return 1;
 
+    slot->format = format;
 
-    while ( ( size = grSetIcon( display->surface, picon ) ) )
+    return 0;
+  }
+
+
+  /* about the weight FTC gives to a glyph image */
+  static unsigned long
+  hud_glyph_bytes( FT_Glyph  glyph )
+  {
+    if ( glyph->format == FT_GLYPH_FORMAT_OUTLINE )
     {
-      grNewBitmap( gr_pixel_mode_rgb32, 256, size, size, &icon );
-      memset( icon.buffer, 0, (size_t)icon.rows * (size_t)icon.pitch );
+      FT_Outline*  outline = &( (FT_OutlineGlyph)glyph )->outline;
 
-      for ( i = 0; i < FT.n_points; i++ )
-      {
-        FT.points[i].x *= size;
-        FT.points[i].y *= size;
-      }
 
-      FT_Outline_Render( handle->library, &FT, &params );
+      return sizeof ( FT_OutlineGlyphRec )                          +
+             (unsigned long)outline->n_points *
+               ( sizeof ( FT_Vector ) + sizeof ( char ) )            +
+             (unsigned long)outline->n_contours * sizeof ( short );
+    }
+    else if ( glyph->format == FT_GLYPH_FORMAT_BITMAP )
+    {
+      FT_Bitmap*  bitmap = &( (FT_BitmapGlyph)glyph )->bitmap;
 
-      for ( i = 0; i < FT.n_points; i++ )
+
+      return sizeof ( FT_BitmapGlyphRec ) +
+             (unsigned long)bitmap->rows *
+               (unsigned long)( bitmap->pitch < 0 ? -bitmap->pitch
+                                                  : bitmap->pitch );
+    }
+    else
+      return sizeof ( FT_GlyphRec );
+  }
+
+
+  /* `FTC_ImageCache_LookupScaler' with the current scaler and flags */
+  static FT_Error
+  image_cache_lookup( FTDemo_Handle*  handle,
+                      FT_UInt         gindex,
+                      FT_Glyph*       aglyph )
+  {
+    double           t0 = HUD_START( handle );
+    FT_Glyph_Format  format;
+    FT_GlyphSlot     slot = hud_mark_slot( handle, &format );
+
+
+    error = FTC_ImageCache_LookupScaler( handle->image_cache,
+                                         &handle->scaler,
+                                         (FT_ULong)handle->load_flags,
+                                         gindex,
+                                         aglyph,
+                                         NULL );
+
+    if ( handle->hud.shown )
+    {
+      handle->hud.image_lookups++;
+
+      if ( hud_slot_loaded( slot, format ) )
       {
-        FT.points[i].x /= size;
-        FT.points[i].y /= size;
+        handle->hud.image_misses++;
+        handle->hud.glyphs_loaded++;
+
+        if ( !error )
+          handle->hud.cache_bytes += hud_glyph_bytes( *aglyph );
       }
 
-      picon = &icon;
+      HUD_STOP( handle, load_time, t0 );
     }
 
-    if ( picon )
-      grDoneBitmap( picon );
+    return error;
   }
 
 
-  FT_Error
-  FTDemo_Install_Font( FTDemo_Handle*  handle,
-                       const char*     filepath,
-                       FT_Bool         outline_only,
-                       FT_Bool         no_instances )
+  /* The caches below keep their entries in a hash table and in a list */
+  /* ordered by last use; the least recently used ones are dropped if  */
+  /* they take more than the budget.  Entries start with a `TLruNode'. */
+  typedef struct  TLruNode_
   {
-    long          i, num_faces;
-    FT_Face       face;
+    struct TLruNode_*  next;         /* in the bucket */
+    struct TLruNode_*  prev_used;
+    struct TLruNode_*  next_used;
+    unsigned int       hash;
+    size_t             size;         /* in bytes, all included */
 
+  } TLruNode;
 
-    /* We use a conservative approach here, at the cost of calling     */
-    /* `FT_New_Face' quite often.  The idea is that our demo programs  */
-    /* should be able to try all faces and named instances of a font,  */
-    /* expecting that some faces don't work for various reasons, e.g., */
-    /* a broken subfont, or an unsupported NFNT bitmap font in a Mac   */
-    /* dfont resource that holds more than a single font.              */
 
-    error = FT_New_Face( handle->library, filepath, -1, &face );
-    if ( error )
-      return error;
-    num_faces = face->num_faces;
-    FT_Done_Face( face );
+  typedef void
+  (*TLruFreeFunc)( TLruNode*  node );
 
-    /* allocate new font object(s) */
-    for ( i = 0; i < num_faces; i++ )
-    {
-      PFont  font;
-      long   j, instance_count;
 
+  typedef struct  TLru_
+  {
+    TLruNode**    buckets;
+    unsigned int  mask;              /* the number of buckets minus 1 */
+    TLruNode*     first_used;        /* most recently                 */
+    TLruNode*     last_used;
+    size_t        size;
 
-      error = FT_New_Face( handle->library, filepath, -( i + 1 ), &face );
-      if ( error )
-        continue;
-      instance_count = no_instances ? 0 : face->style_flags >> 16;
-      FT_Done_Face( face );
+    TLruFreeFunc  free_node;
 
-      /* load face with and without named instances */
-      for ( j = 0; j < instance_count + 1; j++ )
-      {
-        error = FT_New_Face( handle->library,
-                             filepath,
-                             ( j << 16 ) + i,
-                             &face );
-        if ( error )
-          continue;
+  } TLru;
 
-        if ( outline_only && !FT_IS_SCALABLE( face ) )
-        {
-          FT_Done_Face( face );
-          continue;
-        }
 
-        font = (PFont)malloc( sizeof ( *font ) );
+#define LRU_HASH_INIT  2166136261U   /* FNV-1a */
 
-        font->filepathname = ft_strdup( filepath );
-        if ( !font->filepathname )
-          return FT_Err_Out_Of_Memory;
+  static unsigned int
+  lru_hash( unsigned int  h,
+            const void*   data,
+            size_t        size )
+  {
+    const unsigned char*  p   = (const unsigned char*)data;
+    const unsigned char*  end = p + size;
 
-        font->face_index = ( j << 16 ) + i;
 
-        if ( handle-> encoding != FT_ENCODING_ORDER                      &&
-             FT_Select_Charmap( face, (FT_Encoding)handle->encoding ) ==
-                                                               FT_Err_Ok )
-          font->cmap_index = FT_Get_Charmap_Index( face->charmap );
-        else
-          font->cmap_index = face->num_charmaps;  /* FT_ENCODING_ORDER */
+    while ( p < end )
+      h = ( h ^ *p++ ) * 16777619U;
 
-        font->palette_index = 0;
+    return h;
+  }
 
-        if ( handle->preload )
-        {
-          FILE*   file = fopen( filepath, "rb" );
-          size_t  file_size;
 
+  /* `num_buckets' must be a power of 2 */
+  static void
+  lru_init( TLru*         lru,
+            TLruNode**    buckets,
+            unsigned int  num_buckets,
+            TLruFreeFunc  free_node )
+  {
+    lru->buckets   = buckets;
+    lru->mask      = num_buckets - 1;
+    lru->free_node = free_node;
+  }
 
-          if ( file == NULL )  /* shouldn't happen */
-          {
-            free( (void*)font->filepathname );
-            free( font );
-            return FT_Err_Invalid_Argument;
-          }
 
-          fseek( file, 0, SEEK_END );
-          file_size = (size_t)ftell( file );
-          fseek( file, 0, SEEK_SET );
+  /* the first node of the bucket of `hash' */
+  static TLruNode*
+  lru_bucket( TLru*         lru,
+              unsigned int  hash )
+  {
+    return lru->buckets[hash & lru->mask];
+  }
 
-          if ( file_size <= 0 )
-          {
-            free( font );
-            fclose( file );
-            return FT_Err_Invalid_Stream_Operation;
-          }
 
-          font->file_address = malloc( file_size );
-          if ( !font->file_address )
-          {
-            free( font );
-            fclose( file );
-            return FT_Err_Out_Of_Memory;
-          }
+  /* move `node' to the front */
+  static void
+  lru_touch( TLru*      lru,
+             TLruNode*  node )
+  {
+    if ( !node->prev_used )
+      return;
 
-          if ( !fread( font->file_address, file_size, 1, file ) )
-          {
-            free( font->file_address );
-            free( font );
-            fclose( file );
-            return FT_Err_Invalid_Stream_Read;
-          }
+    node->prev_used->next_used = node->next_used;
+    if ( node->next_used )
+      node->next_used->prev_used = node->prev_used;
+    else
+      lru->last_used = node->prev_used;
 
-          font->file_size = file_size;
+    node->prev_used            = NULL;
+    node->next_used            = lru->first_used;
+    lru->first_used->prev_used = node;
+    lru->first_used            = node;
+  }
 
-          fclose( file );
-        }
-        else
-        {
-          font->file_address = NULL;
-          font->file_size    = 0;
-        }
 
-        FT_Done_Face( face );
-        face = NULL;
+  static void
+  lru_insert( TLru*      lru,
+              TLruNode*  node )
+  {
+    TLruNode**  pnode = lru->buckets + ( node->hash & lru->mask );
 
-        if ( handle->max_fonts == 0 )
-        {
-          handle->max_fonts = 16;
-          handle->fonts     = (PFont*)calloc( (size_t)handle->max_fonts,
-                                              sizeof ( PFont ) );
-        }
-        else if ( handle->num_fonts >= handle->max_fonts )
-        {
-          handle->max_fonts *= 2;
-          handle->fonts      = (PFont*)realloc( handle->fonts,
-                                                (size_t)handle->max_fonts *
-                                                  sizeof ( PFont ) );
-
-          memset( &handle->fonts[handle->num_fonts], 0,
-                  (size_t)( handle->max_fonts - handle->num_fonts ) *
-                    sizeof ( PFont ) );
-        }
 
-        handle->fonts[handle->num_fonts++] = font;
-      }
-    }
+    node->next = *pnode;
+    *pnode     = node;
 
-    return FT_Err_Ok;
+    node->prev_used = NULL;
+    node->next_used = lru->first_used;
+    if ( lru->first_used )
+      lru->first_used->prev_used = node;
+    else
+      lru->last_used = node;
+    lru->first_used = node;
+
+    lru->size += node->size;
   }
 
 
-  /* binary search for the last charcode */
-  static int
-  get_last_char( FT_Face     face,
-                 FT_Int      idx,
-                 FT_ULong    max )
+  static void
+  lru_remove( TLru*      lru,
+              TLruNode*  node )
   {
-    FT_ULong  res, mid, min = 0;
-    FT_UInt   gidx;
+    TLruNode**  pnode = lru->buckets + ( node->hash & lru->mask );
 
 
-    if ( FT_Set_Charmap ( face, face->charmaps[idx] ) )
-      return -1;
+    while ( *pnode != node )
+      pnode = &(*pnode)->next;
+    *pnode = node->next;
 
-    do
+    if ( node->prev_used )
+      node->prev_used->next_used = node->next_used;
+    else
+      lru->first_used = node->next_used;
+
+    if ( node->next_used )
+      node->next_used->prev_used = node->prev_used;
+    else
+      lru->last_used = node->prev_used;
+
+    lru->size -= node->size;
+    lru->free_node( node );
+  }
+
+
+  /* make room for `size' more bytes within `budget' */
+  static void
+  lru_trim( TLru*   lru,
+            size_t  size,
+            size_t  budget )
+  {
+    while ( lru->size + size > budget && lru->last_used )
+      lru_remove( lru, lru->last_used );
+  }
+
+
+  static void
+  lru_clear( TLru*  lru )
+  {
+    while ( lru->first_used )
+      lru_remove( lru, lru->first_used );
+  }
+
+
+  /* The rows of `FTDemo_Row_Record'. */
+#define ROW_CACHE_BUCKETS  256           /* a power of 2         */
+#define ROW_CACHE_BUDGET   ( 16L << 20 )  /* in bytes             */
+#define ROW_CACHE_BLITS    256           /* blits per batch drawn */
+
+  /* what all rows depend on, followed by the key of the caller */
+  typedef struct  TRowKey_
+  {
+    PFont          font;
+    FTC_ScalerRec  scaler;
+    FT_Int32       load_flags;
+    int            lcd_mode;
+    int            use_sbits_cache;
+    unsigned long  encoding;
+    int            cmap_index;
+    int            palette_index;
+    grColor        color;
+
+  } TRowKey;
+
+
+  typedef struct  TRow_
+  {
+    TLruNode        node;
+    FTDemo_Row      root;
+
+    unsigned char*  key;
+    size_t          key_size;
+
+    grGlyphBlit*    blits;         /* relative to the origin */
+    grBitmap*       bitmaps;       /* of `blits'             */
+    int             num_blits;
+    int             max_blits;
+
+    unsigned char*  data;          /* the bitmap buffers     */
+    size_t          data_size;
+    size_t          data_max;
+    int             incomplete;    /* out of memory          */
+
+  } TRow;
+
+#define ROW_OF( arow )  ( (TRow*)( (char*)(arow) - offsetof( TRow, root ) ) )
+
+
+  typedef struct  TRowCache_
+  {
+    TLru            lru;
+    TLruNode*       buckets[ROW_CACHE_BUCKETS];
+
+    TRow*           recording;
+    TRow*           orphan;        /* the last incomplete row */
+
+    unsigned char*  key;           /* of the last lookup      */
+    size_t          key_size;
+    size_t          key_max;
+    unsigned int    hash;
+
+  } TRowCache;
+
+
+  static void
+  row_free( TRow*  row )
+  {
+    if ( !row )
+      return;
+
+    free( row->key );
+    free( row->blits );
+    free( row->bitmaps );
+    free( row->data );
+    free( row );
+  }
+
+
+  static void
+  row_free_node( TLruNode*  node )
+  {
+    row_free( (TRow*)node );
+  }
+
+
+  /* make `cache->key' the full key of a row; return 0 if out of memory */
+  static int
+  row_cache_key( FTDemo_Handle*   handle,
+                 FTDemo_Display*  display,
+                 const void*      key,
+                 size_t           key_size )
+  {
+    TRowCache*  cache = handle->row_cache;
+    TRowKey     common;
+
+
+    if ( !cache )
+    {
+      cache = (TRowCache*)calloc( 1, sizeof ( TRowCache ) );
+      if ( !cache )
+        return 0;
+
+      lru_init( &cache->lru, cache->buckets, ROW_CACHE_BUCKETS,
+                row_free_node );
+      handle->row_cache = cache;
+    }
+
+    memset( &common, 0, sizeof ( common ) );  /* also the padding */
+    common.font            = handle->current_font;
+    common.scaler          = handle->scaler;
+    common.load_flags      = handle->load_flags;
+    common.lcd_mode        = handle->lcd_mode;
+    common.use_sbits_cache = handle->use_sbits_cache;
+    common.encoding        = handle->encoding;
+    common.cmap_index      = handle->current_font->cmap_index;
+    common.palette_index   = handle->current_font->palette_index;
+    common.color           = display->fore_color;
+
+    cache->key_size = sizeof ( common ) + key_size;
+    if ( cache->key_size > cache->key_max )
+    {
+      unsigned char*  new_key = (unsigned char*)realloc( cache->key,
+                                                         cache->key_size );
+
+
+      if ( !new_key )
+        return 0;
+
+      cache->key     = new_key;
+      cache->key_max = cache->key_size;
+    }
+
+    memcpy( cache->key, &common, sizeof ( common ) );
+    memcpy( cache->key + sizeof ( common ), key, key_size );
+
+    cache->hash = lru_hash( LRU_HASH_INIT, cache->key, cache->key_size );
+
+    return 1;
+  }
+
+
+  /* append a blit to the row being recorded */
+  static void
+  row_cache_add( TRowCache*  cache,
+                 grBitmap*   bitmap,
+                 grPos       x,
+                 grPos       y,
+                 grColor     color )
+  {
+    TRow*   row  = cache->recording;
+    size_t  size = (size_t)bitmap->rows *
+                     (size_t)( bitmap->pitch < 0 ? -bitmap->pitch
+                                                 : bitmap->pitch );
+
+
+    if ( row->incomplete )
+      return;
+
+    if ( row->num_blits == row->max_blits )
+    {
+      int           new_max = row->max_blits ? 2 * row->max_blits : 64;
+      grGlyphBlit*  blits;
+      grBitmap*     bitmaps;
+
+
+      blits = (grGlyphBlit*)realloc( row->blits,
+                                     (size_t)new_max * sizeof ( *blits ) );
+      if ( blits )
+        row->blits = blits;
+
+      bitmaps = (grBitmap*)realloc( row->bitmaps,
+                                    (size_t)new_max * sizeof ( *bitmaps ) );
+      if ( bitmaps )
+        row->bitmaps = bitmaps;
+
+      if ( !blits || !bitmaps )
+      {
+        row->incomplete = 1;
+        return;
+      }
+
+      row->max_blits = new_max;
+    }
+
+    if ( row->data_size + size > row->data_max )
+    {
+      size_t          new_max = 2 * row->data_max + size;
+      unsigned char*  data    = (unsigned char*)realloc( row->data,
+                                                         new_max );
+
+
+      if ( !data )
+      {
+        row->incomplete = 1;
+        return;
+      }
+
+      row->data     = data;
+      row->data_max = new_max;
+    }
+
+    /* the buffers are set by `FTDemo_Row_End' */
+    row->bitmaps[row->num_blits] = *bitmap;
+    if ( size )
+      memcpy( row->data + row->data_size, bitmap->buffer, size );
+
+    row->blits[row->num_blits].x     = x;
+    row->blits[row->num_blits].y     = y;
+    row->blits[row->num_blits].color = color;
+
+    row->num_blits++;
+    row->data_size += size;
+  }
+
+
+  static void
+  row_cache_done( TRowCache*  cache )
+  {
+    if ( !cache )
+      return;
+
+    lru_clear( &cache->lru );
+
+    row_free( cache->recording );
+    row_free( cache->orphan );
+    free( cache->key );
+    free( cache );
+  }
+
+
+  FTDemo_Row*
+  FTDemo_Row_Lookup( FTDemo_Handle*   handle,
+                     FTDemo_Display*  display,
+                     const void*      key,
+                     size_t           key_size )
+  {
+    TRowCache*  cache;
+    TLruNode*   node;
+
+
+    if ( !row_cache_key( handle, display, key, key_size ) )
+      return NULL;
+
+    cache = handle->row_cache;
+
+    for ( node = lru_bucket( &cache->lru, cache->hash );
+          node;
+          node = node->next )
+    {
+      TRow*  row = (TRow*)node;
+
+
+      if ( node->hash == cache->hash                          &&
+           row->key_size == cache->key_size                   &&
+           !memcmp( row->key, cache->key, cache->key_size )   )
+      {
+        lru_touch( &cache->lru, node );
+        return &row->root;
+      }
+    }
+
+    return NULL;
+  }
+
+
+  FTDemo_Row*
+  FTDemo_Row_Record( FTDemo_Handle*   handle,
+                     FTDemo_Display*  display,
+                     const void*      key,
+                     size_t           key_size )
+  {
+    TRowCache*  cache;
+    TRow*       row;
+
+
+    if ( !row_cache_key( handle, display, key, key_size ) )
+      return NULL;
+
+    cache = handle->row_cache;
+
+    row = (TRow*)calloc( 1, sizeof ( TRow ) );
+    if ( !row )
+      return NULL;
+
+    row->key = (unsigned char*)malloc( cache->key_size );
+    if ( !row->key )
+    {
+      free( row );
+      return NULL;
+    }
+
+    memcpy( row->key, cache->key, cache->key_size );
+    row->key_size  = cache->key_size;
+    row->node.hash = cache->hash;
+
+    row_free( cache->recording );
+    cache->recording = row;
+
+    return &row->root;
+  }
+
+
+  FTDemo_Row*
+  FTDemo_Row_End( FTDemo_Handle*  handle )
+  {
+    TRowCache*  cache = handle->row_cache;
+    TRow*       row   = cache ? cache->recording : NULL;
+    size_t      offset;
+    int         n;
+
+
+    if ( !row )
+      return NULL;
+
+    cache->recording = NULL;
+
+    for ( offset = 0, n = 0; n < row->num_blits; n++ )
+    {
+      grBitmap*  bitmap = row->bitmaps + n;
+
+
+      bitmap->buffer = row->data + offset;
+      offset        += (size_t)bitmap->rows *
+                         (size_t)( bitmap->pitch < 0 ? -bitmap->pitch
+                                                     : bitmap->pitch );
+
+      row->blits[n].glyph = bitmap;
+    }
+
+    /* draw it once but don't keep it */
+    if ( row->incomplete )
+    {
+      row_free( cache->orphan );
+      cache->orphan = row;
+
+      return &row->root;
+    }
+
+    row->node.size = sizeof ( TRow ) + row->key_size +
+                     (size_t)row->max_blits * ( sizeof ( grGlyphBlit ) +
+                                                sizeof ( grBitmap )    ) +
+                     row->data_max;
+
+    lru_trim( &cache->lru, row->node.size, ROW_CACHE_BUDGET );
+    lru_insert( &cache->lru, &row->node );
+
+    return &row->root;
+  }
+
+
+  void
+  FTDemo_Row_Draw( FTDemo_Handle*   handle,
+                   FTDemo_Display*  display,
+                   FTDemo_Row*      arow,
+                   int              x,
+                   int              y )
+  {
+    TRow*        row = ROW_OF( arow );
+    grGlyphBlit  blits[ROW_CACHE_BLITS];
+    double       t0  = HUD_START( handle );
+    int          n, i;
+
+
+    for ( n = 0; n < row->num_blits; n += ROW_CACHE_BLITS )
+    {
+      int  count = row->num_blits - n;
+
+
+      if ( count > ROW_CACHE_BLITS )
+        count = ROW_CACHE_BLITS;
+
+      for ( i = 0; i < count; i++ )
+      {
+        blits[i]    = row->blits[n + i];
+        blits[i].x += x;
+        blits[i].y += y;
+      }
+
+      grBlitGlyphsToSurface( display->surface, blits, count );
+    }
+
+    handle->hud.glyphs_blitted += row->num_blits;
+    HUD_STOP( handle, blit_time, t0 );
+  }
+
+
+  void
+  FTDemo_Row_Flush( FTDemo_Handle*  handle )
+  {
+    TRowCache*  cache = handle->row_cache;
+
+
+    if ( cache )
+      lru_clear( &cache->lru );
+  }
+
+
+  /* The glyphs of `FTDemo_Outline_Add'; they are weighed like FTC */
+  /* weighs glyph images.                                          */
+#define OUTLINE_CACHE_BUCKETS  1024  /* a power of 2 */
+#define OUTLINE_CACHE_BUDGET   ( FTDEMO_MAX_BYTES - FTDEMO_FTC_BYTES )
+
+  /* what all glyphs depend on, followed by the key of the caller */
+  typedef struct  TOutlineKey_
+  {
+    FTC_ScalerRec  scaler;
+    FT_Int32       load_flags;
+    FT_UInt        glyph_index;
+
+  } TOutlineKey;
+
+
+  typedef struct  TOutline_
+  {
+    TLruNode     node;
+    TOutlineKey  key;
+    size_t       key_size;     /* of the caller's key, which */
+                               /* follows the entry          */
+    FT_Glyph     glyph;
+
+  } TOutline;
+
+
+  typedef struct  TOutlineCache_
+  {
+    TLru       lru;
+    TLruNode*  buckets[OUTLINE_CACHE_BUCKETS];
+
+    FT_Glyph   orphan;         /* the last glyph not kept */
+
+  } TOutlineCache;
+
+
+  static unsigned int
+  outline_cache_key( FTDemo_Handle*  handle,
+                     FT_UInt         glyph_index,
+                     const void*     key,
+                     size_t          key_size,
+                     TOutlineKey*    akey )
+  {
+    memset( akey, 0, sizeof ( *akey ) );  /* also the padding */
+    akey->scaler      = handle->scaler;
+    akey->load_flags  = handle->load_flags;
+    akey->glyph_index = glyph_index;
+
+    return lru_hash( lru_hash( LRU_HASH_INIT, akey, sizeof ( *akey ) ),
+                     key, key_size );
+  }
+
+
+  static void
+  outline_free_node( TLruNode*  node )
+  {
+    FT_Done_Glyph( ( (TOutline*)node )->glyph );
+    free( node );
+  }
+
+
+  static void
+  outline_cache_done( TOutlineCache*  cache )
+  {
+    if ( !cache )
+      return;
+
+    lru_clear( &cache->lru );
+
+    if ( cache->orphan )
+      FT_Done_Glyph( cache->orphan );
+
+    free( cache );
+  }
+
+
+  FT_Glyph
+  FTDemo_Outline_Lookup( FTDemo_Handle*  handle,
+                         FT_UInt         glyph_index,
+                         const void*     key,
+                         size_t          key_size )
+  {
+    TOutlineCache*  cache = handle->outline_cache;
+    TOutlineKey     base;
+    TLruNode*       node;
+    unsigned int    hash;
+
+
+    if ( !cache )
+      return NULL;
+
+    hash = outline_cache_key( handle, glyph_index, key, key_size, &base );
+
+    for ( node = lru_bucket( &cache->lru, hash ); node; node = node->next )
+    {
+      TOutline*  entry = (TOutline*)node;
+
+
+      if ( node->hash == hash                                 &&
+           entry->key_size == key_size                        &&
+           !memcmp( &entry->key, &base, sizeof ( base ) )     &&
+           !memcmp( entry + 1, key, key_size )                )
+      {
+        lru_touch( &cache->lru, node );
+        return entry->glyph;
+      }
+    }
+
+    return NULL;
+  }
+
+
+  FT_Glyph
+  FTDemo_Outline_Add( FTDemo_Handle*  handle,
+                      FT_UInt         glyph_index,
+                      const void*     key,
+                      size_t          key_size,
+                      FT_Glyph        glyph )
+  {
+    TOutlineCache*  cache = handle->outline_cache;
+    TOutline*       entry;
+    size_t          size;
+
+
+    if ( !cache )
+    {
+      cache = (TOutlineCache*)calloc( 1, sizeof ( TOutlineCache ) );
+      if ( !cache )
+      {
+        FT_Done_Glyph( glyph );
+        return NULL;
+      }
+
+      lru_init( &cache->lru, cache->buckets, OUTLINE_CACHE_BUCKETS,
+                outline_free_node );
+      handle->outline_cache = cache;
+    }
+
+    if ( cache->orphan )
+    {
+      FT_Done_Glyph( cache->orphan );
+      cache->orphan = NULL;
+    }
+
+    size  = sizeof ( TOutline ) + key_size + hud_glyph_bytes( glyph );
+    entry = NULL;
+    if ( size <= OUTLINE_CACHE_BUDGET )
+      entry = (TOutline*)malloc( sizeof ( TOutline ) + key_size );
+
+    /* use it once but don't keep it */
+    if ( !entry )
+    {
+      cache->orphan = glyph;
+
+      return glyph;
+    }
+
+    entry->node.hash = outline_cache_key( handle, glyph_index,
+                                          key, key_size, &entry->key );
+    entry->node.size = size;
+    memcpy( entry + 1, key, key_size );
+    entry->key_size  = key_size;
+    entry->glyph     = glyph;
+
+    lru_trim( &cache->lru, size, OUTLINE_CACHE_BUDGET );
+    lru_insert( &cache->lru, &entry->node );
+
+    return glyph;
+  }
+
+
+  void
+  FTDemo_Outline_Flush( FTDemo_Handle*  handle )
+  {
+    TOutlineCache*  cache = handle->outline_cache;
+
+
+    if ( cache )
+      lru_clear( &cache->lru );
+  }
+
+
+#if defined( FTDEMO_THREADS_PTHREAD ) || defined( FTDEMO_THREADS_WIN32 )
+
+  /* The thread of `FTDemo_Idle_Start'; it only runs while the main */
+  /* thread waits for input, so no data needs protection.           */
+  typedef struct  TIdle_
+  {
+    FTDemo_Handle*    handle;
+    FTDemo_Idle_Func  func;
+    void*             data;
+
+    TMutex            lock;
+    TCond             cond;        /* signals any change of the flags */
+    TThread           thread;
+    int               running;     /* `func' has been started         */
+    int               stop;
+    int               quit;
+
+  } TIdle;
+
+
+  static void
+  idle_thread( TIdle*  idle )
+  {
+    FT_Error    saved_error;
+    FTDemo_HUD  saved_hud;
+
+
+    FTDEMO_LOCK( idle->lock );
+
+    for (;;)
+    {
+      while ( !idle->running && !idle->quit )
+        FTDEMO_WAIT( idle->cond, idle->lock );
+
+      if ( idle->quit )
+        break;
+
+      FTDEMO_UNLOCK( idle->lock );
+
+      /* `error' and the counters belong to the main thread */
+      saved_error = error;
+      saved_hud   = idle->handle->hud;
+      idle->func( idle->handle, idle->data );
+      error              = saved_error;
+      idle->handle->hud  = saved_hud;
+
+      FTDEMO_LOCK( idle->lock );
+
+      idle->running = 0;
+      FTDEMO_BROADCAST( idle->cond );
+    }
+
+    FTDEMO_UNLOCK( idle->lock );
+  }
+
+
+#if defined( FTDEMO_THREADS_PTHREAD )
+
+  static void*
+  idle_thread_main( void*  arg )
+  {
+    idle_thread( (TIdle*)arg );
+    return NULL;
+  }
+
+#else
+
+  static DWORD WINAPI
+  idle_thread_main( LPVOID  arg )
+  {
+    idle_thread( (TIdle*)arg );
+    return 0;
+  }
+
+#endif
+
+
+  void
+  FTDemo_Idle_Start( FTDemo_Handle*    handle,
+                     FTDemo_Idle_Func  func,
+                     void*             data )
+  {
+    TIdle*  idle = handle->idle;
+
+
+    if ( !idle )
+    {
+      idle = (TIdle*)calloc( 1, sizeof ( TIdle ) );
+      if ( !idle )
+        return;
+
+      idle->handle = handle;
+
+      FTDEMO_MUTEX_INIT( idle->lock );
+      FTDEMO_COND_INIT( idle->cond );
+
+#if defined( FTDEMO_THREADS_PTHREAD )
+      if ( pthread_create( &idle->thread, NULL, idle_thread_main, idle ) )
+#else
+      idle->thread = CreateThread( NULL, 0, idle_thread_main, idle, 0,
+                                   NULL );
+      if ( !idle->thread )
+#endif
+      {
+        FTDEMO_COND_DONE( idle->cond );
+        FTDEMO_MUTEX_DONE( idle->lock );
+        free( idle );
+
+        return;
+      }
+
+      handle->idle = idle;
+    }
+
+    FTDEMO_LOCK( idle->lock );
+
+    idle->func    = func;
+    idle->data    = data;
+    idle->stop    = 0;
+    idle->running = 1;
+    FTDEMO_BROADCAST( idle->cond );
+
+    FTDEMO_UNLOCK( idle->lock );
+  }
+
+
+  void
+  FTDemo_Idle_Stop( FTDemo_Handle*  handle )
+  {
+    TIdle*  idle = handle->idle;
+
+
+    if ( !idle )
+      return;
+
+    FTDEMO_LOCK( idle->lock );
+
+    idle->stop = 1;
+    while ( idle->running )
+      FTDEMO_WAIT( idle->cond, idle->lock );
+
+    FTDEMO_UNLOCK( idle->lock );
+  }
+
+
+  int
+  FTDemo_Idle_Stopping( FTDemo_Handle*  handle )
+  {
+    TIdle*  idle = handle->idle;
+    int     stop;
+
+
+    FTDEMO_LOCK( idle->lock );
+    stop = idle->stop;
+    FTDEMO_UNLOCK( idle->lock );
+
+    return stop;
+  }
+
+
+  static void
+  idle_done( TIdle*  idle )
+  {
+    if ( !idle )
+      return;
+
+    FTDEMO_LOCK( idle->lock );
+
+    idle->stop = 1;
+    while ( idle->running )
+      FTDEMO_WAIT( idle->cond, idle->lock );
+
+    idle->quit = 1;
+    FTDEMO_BROADCAST( idle->cond );
+
+    FTDEMO_UNLOCK( idle->lock );
+
+#if defined( FTDEMO_THREADS_PTHREAD )
+    pthread_join( idle->thread, NULL );
+#else
+    WaitForSingleObject( idle->thread, INFINITE );
+    CloseHandle( idle->thread );
+#endif
+
+    FTDEMO_COND_DONE( idle->cond );
+    FTDEMO_MUTEX_DONE( idle->lock );
+    free( idle );
+  }
+
+#else /* !FTDEMO_THREADS_PTHREAD && !FTDEMO_THREADS_WIN32 */
+
+  void
+  FTDemo_Idle_Start( FTDemo_Handle*    handle,
+                     FTDemo_Idle_Func  func,
+                     void*             data )
+  {
+    FT_UNUSED( handle );
+    FT_UNUSED( func );
+    FT_UNUSED( data );
+  }
+
+
+  void
+  FTDemo_Idle_Stop( FTDemo_Handle*  handle )
+  {
+    FT_UNUSED( handle );
+  }
+
+
+  int
+  FTDemo_Idle_Stopping( FTDemo_Handle*  handle )
+  {
+    FT_UNUSED( handle );
+
+    return 1;
+  }
+
+
+  static void
+  idle_done( struct TIdle_*  idle )
+  {
+    FT_UNUSED( idle );
+  }
+
+#endif /* !FTDEMO_THREADS_PTHREAD && !FTDEMO_THREADS_WIN32 */
+
+
+  static void
+  hud_blit( FTDemo_Handle*  handle,
+            grSurface*      surface,
+            grBitmap*       bitmap,
+            grPos           x,
+            grPos           y,
+            grColor         color )
+  {
+    double  t0 = HUD_START( handle );
+
+
+    if ( handle->row_cache && handle->row_cache->recording )
+    {
+      row_cache_add( handle->row_cache, bitmap, x, y, color );
+      return;
+    }
+
+    grBlitGlyphToSurface( surface, bitmap, x, y, color );
+
+    handle->hud.glyphs_blitted++;
+    HUD_STOP( handle, blit_time, t0 );
+  }
+
+
+  /* The bitmaps rendered by `FTDemo_String_Draw', in a `TLru'. */
+#define GLYPH_CACHE_BUCKETS  4096          /* a power of 2            */
+#define GLYPH_CACHE_BUDGET   ( 4L << 20 )  /* in bytes                */
+#define GLYPH_CACHE_BLITS    1024          /* pending blits per batch */
+
+  /* pen positions are rounded to 1/STRING_SUBPIXELS pixel (a power of 2) */
+#define STRING_SUBPIXELS  4
+
+  typedef struct  TGlyphKey_
+  {
+    FTC_ScalerRec  scaler;
+    FT_Int32       load_flags;
+    int            lcd_mode;
+    int            vertical;
+    FT_UInt        glyph_index;
+    FT_Matrix      matrix;
+    FT_Vector      fraction;     /* of the pen position, 26.6 */
+
+  } TGlyphKey;
+
+
+  typedef struct  TCachedGlyph_
+  {
+    TLruNode   node;
+    TGlyphKey  key;
+    grBitmap   bitmap;      /* the buffer follows the entry */
+    int        left;        /* relative to the integer part */
+    int        top;         /* of the pen position          */
+
+  } TCachedGlyph;
+
+
+  typedef struct  TGlyphCache_
+  {
+    TLru           lru;
+    TLruNode*      buckets[GLYPH_CACHE_BUCKETS];
+
+    unsigned long  hits;
+    unsigned long  misses;
+
+    grGlyphBlit    blits[GLYPH_CACHE_BLITS];
+    int            num_blits;
+
+  } TGlyphCache;
+
+
+  static void
+  glyph_free_node( TLruNode*  node )
+  {
+    free( node );
+  }
+
+
+  static void
+  glyph_cache_flush( FTDemo_Handle*  handle,
+                     grSurface*      surface )
+  {
+    TGlyphCache*  cache = handle->glyph_cache;
+    double        t0    = HUD_START( handle );
+    int           n;
+
+
+    if ( handle->row_cache && handle->row_cache->recording )
+    {
+      for ( n = 0; n < cache->num_blits; n++ )
+        row_cache_add( handle->row_cache, cache->blits[n].glyph,
+                       cache->blits[n].x, cache->blits[n].y,
+                       cache->blits[n].color );
+
+      cache->num_blits = 0;
+      return;
+    }
+
+    if ( cache->num_blits )
+      grBlitGlyphsToSurface( surface, cache->blits, cache->num_blits );
+
+    handle->hud.glyphs_blitted += cache->num_blits;
+    HUD_STOP( handle, blit_time, t0 );
+
+    cache->num_blits = 0;
+  }
+
+
+  /* drop all bitmaps; none may be pending */
+  static void
+  glyph_cache_clear( TGlyphCache*  cache )
+  {
+    if ( cache )
+      lru_clear( &cache->lru );
+  }
+
+
+  static void
+  glyph_cache_done( TGlyphCache*  cache )
+  {
+    glyph_cache_clear( cache );
+    free( cache );
+  }
+
+
+  /*
+   * The string is laid out in chunks of STRING_CHUNK glyphs.  For each
+   * chunk, `FTDemo_String_Load' only keeps the sums of the kerned
+   * advances and the extents of the control boxes (112 bytes on 64-bit
+   * systems); the metrics (104 bytes) are kept once for each distinct
+   * glyph, which long texts have few of.  `FTDemo_String_Draw' centers
+   * and wraps the string with the sums and lays out again, one at a
+   * time, only the chunks it draws.  A string thus needs 4 bytes per
+   * character, plus about 120 bytes per distinct glyph and 26kB for the
+   * chunk being drawn.
+   */
+#define STRING_CHUNK  256
+
+  typedef struct  TStringChunk_
+  {
+    FT_Vector  hadvance;    /* sums of the advances */
+    FT_Vector  vadvance;
+    FT_Pos     hmin, hmax;  /* extremes of the partial sums of hadvance.x */
+    FT_BBox    hbox;        /* control boxes in horizontal layout */
+    FT_BBox    vbox;        /* control boxes in vertical layout   */
+
+  } TStringChunk;
+
+
+  typedef struct  TStringLayout_
+  {
+    int            length;        /* of the string laid out, or 0 */
+    FT_Pos         track_kern;
+    int            kerning_mode;
+    int            lcd_mode;
+    int            hinted;
+
+    TStringChunk*  chunks;
+    int            max_chunks;
+
+    TGlyph*        metrics;       /* of the distinct glyphs */
+    int            num_metrics;
+    int            max_metrics;
+    int*           slots;         /* hash table of indices to `metrics', */
+    int            num_slots;     /* plus 1, with a power of 2 entries   */
+
+    int            chunk;         /* the chunk in `glyphs', or -1 */
+    TGlyph         glyphs[STRING_CHUNK];
+
+  } TStringLayout;
+
+
+  static void
+  string_layout_done( TStringLayout*  layout )
+  {
+    if ( !layout )
+      return;
+
+    free( layout->chunks );
+    free( layout->metrics );
+    free( layout->slots );
+    free( layout );
+  }
+
+
+  /* return the entry for `key', rendering the glyph if necessary */
+  static TCachedGlyph*
+  glyph_cache_get( FTDemo_Handle*   handle,
+                   FTDemo_Display*  display,
+                   PGlyph           glyph,
+                   TGlyphKey*       key )
+  {
+    TGlyphCache*    cache = handle->glyph_cache;
+    unsigned int    hash  = lru_hash( LRU_HASH_INIT, key, sizeof ( *key ) );
+    TLruNode*       node;
+    TCachedGlyph*   entry = NULL;
+    FT_Glyph        image, glyf;
+    grBitmap        bit3;
+    int             left, top, dummy1, dummy2;
+    size_t          size;
+
+
+    handle->hud.string_lookups++;
+
+    for ( node = lru_bucket( &cache->lru, hash ); node; node = node->next )
+      if ( node->hash == hash                                           &&
+           !memcmp( &( (TCachedGlyph*)node )->key, key, sizeof ( *key ) ) )
+      {
+        cache->hits++;
+
+        lru_touch( &cache->lru, node );
+        return (TCachedGlyph*)node;
+      }
+
+    cache->misses++;
+    handle->hud.string_misses++;
+
+    error = image_cache_lookup( handle, glyph->glyph_index, &image );
+
+    /* copy image */
+    if ( !error )
+      error = FT_Glyph_Copy( image, &image );
+    if ( error )
+      return NULL;
+
+    if ( image->format != FT_GLYPH_FORMAT_BITMAP )
+    {
+      if ( key->vertical )
+        error = FT_Glyph_Transform( image, NULL, &glyph->vvector );
+
+      if ( !error )
+        error = FT_Glyph_Transform( image, &key->matrix, &key->fraction );
+    }
+
+    if ( !error )
+      error = FTDemo_Glyph_To_Bitmap( handle, image, &bit3, &left, &top,
+                                      &dummy1, &dummy2, &glyf );
+    if ( !error )
+    {
+      size  = (size_t)bit3.rows * (size_t)( bit3.pitch < 0 ? -bit3.pitch
+                                                           : bit3.pitch );
+      entry = (TCachedGlyph*)malloc( sizeof ( TCachedGlyph ) + size );
+      if ( entry )
+      {
+        entry->node.hash     = hash;
+        entry->node.size     = sizeof ( TCachedGlyph ) + size;
+        entry->key           = *key;
+        entry->bitmap        = bit3;
+        entry->bitmap.buffer = (unsigned char*)( entry + 1 );
+        entry->left          = left;
+        entry->top           = top;
+
+        if ( size )
+          memcpy( entry->bitmap.buffer, bit3.buffer, size );
+      }
+
+      if ( glyf )
+        FT_Done_Glyph( glyf );
+    }
+
+    FT_Done_Glyph( image );
+    ftalloc_arena_reset( handle->memory );
+
+    if ( !entry )
+      return NULL;
+
+    /* make room; pending blits might use the dropped bitmaps */
+    if ( cache->lru.size + entry->node.size > GLYPH_CACHE_BUDGET &&
+         cache->lru.last_used                                    )
+    {
+      glyph_cache_flush( handle, display->surface );
+      lru_trim( &cache->lru, entry->node.size, GLYPH_CACHE_BUDGET );
+    }
+
+    lru_insert( &cache->lru, &entry->node );
+
+    return entry;
+  }
+
+
+  FTDemo_Handle*
+  FTDemo_New( void )
+  {
+    FTDemo_Handle*  handle;
+    const char*     allocator;
+    FTAlloc_Mode    mode = FTALLOC_SYSTEM;
+
+
+    handle = (FTDemo_Handle *)malloc( sizeof ( FTDemo_Handle ) );
+    if ( !handle )
+      return NULL;
+
+    memset( handle, 0, sizeof ( FTDemo_Handle ) );
+
+    allocator = getenv( "FTDEMO_ALLOCATOR" );
+    if ( allocator && *allocator                   &&
+         ftalloc_parse_mode( allocator, &mode ) )
+      fprintf( stderr, "unknown allocator `%s', using `system'\n",
+                       allocator );
+
+    if ( mode == FTALLOC_SYSTEM )
+      error = FT_Init_FreeType( &handle->library );
+    else
+    {
+      handle->memory = ftalloc_new( mode );
+      if ( !handle->memory )
+        PanicZ( "could not create memory allocator" );
+
+      error = ftalloc_new_library( handle->memory, &handle->library );
+    }
+    if ( error )
+      PanicZ( "could not initialize FreeType" );
+
+    handle->font_index = ftindex_new( handle->library,
+                                      getenv( "FTDEMO_FONT_INDEX" ) );
+    if ( !handle->font_index )
+      PanicZ( "could not create font index" );
+
+    /* The use of an external SVG rendering library is optional. */
+    (void)FT_Property_Set( handle->library,
+                           "ot-svg", "svg-hooks", &rsvg_hooks );
+
+    error = FTC_Manager_New( handle->library,
+                             FTDEMO_MAX_FACES, FTDEMO_MAX_SIZES,
+                             FTDEMO_FTC_BYTES,
+                             my_face_requester, 0, &handle->cache_manager );
+    if ( error )
+      PanicZ( "could not initialize cache manager" );
+
+    error = FTC_SBitCache_New( handle->cache_manager, &handle->sbits_cache );
+    if ( error )
+      PanicZ( "could not initialize small bitmaps cache" );
+
+    error = FTC_ImageCache_New( handle->cache_manager, &handle->image_cache );
+    if ( error )
+      PanicZ( "could not initialize glyph image cache" );
+
+    error = FTC_CMapCache_New( handle->cache_manager, &handle->cmap_cache );
+    if ( error )
+      PanicZ( "could not initialize charmap cache" );
+
+    FT_Bitmap_Init( &handle->bitmap );
+
+    FT_Stroker_New( handle->library, &handle->stroker );
+
+    handle->encoding = FT_ENCODING_ORDER;
+
+    handle->hinted     = 1;
+    handle->use_sbits  = 1;
+    handle->use_color  = 1;
+    handle->use_layers = 1;
+    handle->autohint   = 0;
+    handle->lcd_mode   = LCD_MODE_AA;
+
+    handle->use_sbits_cache = 1;
+
+    /* string_init */
+    handle->string        = NULL;
+    handle->string_length = 0;
+    handle->string_max    = 0;
+    handle->string_layout = NULL;
+
+    return handle;
+  }
+
+
+  void
+  FTDemo_Done( FTDemo_Handle*  handle )
+  {
+    int  i;
+
+
+    if ( !handle )
+      return;
+
+    idle_done( handle->idle );
+    row_cache_done( handle->row_cache );
+    outline_cache_done( handle->outline_cache );
+
+    /* string_done */
+    free( handle->string );
+    string_layout_done( handle->string_layout );
+    glyph_cache_done( handle->glyph_cache );
+
+    FT_Stroker_Done( handle->stroker );
+    FT_Bitmap_Done( handle->library, &handle->bitmap );
+    FTC_Manager_Done( handle->cache_manager );
+
+    /* the faces are gone, which might have used preloaded files */
+    for ( i = 0; i < handle->max_fonts; i++ )
+    {
+      if ( handle->fonts[i] )
+      {
+        if ( handle->fonts[i]->filepathname )
+          free( (void*)handle->fonts[i]->filepathname );
+        release_file( handle->fonts[i] );
+        free( handle->fonts[i] );
+      }
+    }
+    free( handle->fonts );
+
+    ftindex_done( handle->font_index );
+
+    if ( handle->memory )
+    {
+      FT_Done_Library( handle->library );
+      ftalloc_done( handle->memory );
+    }
+    else
+      FT_Done_FreeType( handle->library );
+
+    free( handle );
+
+    fflush( stdout );  /* clean mintty pipes */
+  }
+
+
+  void
+  FTDemo_Version( FTDemo_Handle*  handle,
+                  FT_String       str[64] )
+  {
+    FT_Int     major, minor, patch;
+    FT_String  format[] = "%d.%d.%d";
+    StrBuf     sb;
+
+
+    FT_Library_Version( handle->library, &major, &minor, &patch );
+
+    if ( !patch )
+      format[5] = '\0';   /* terminate early */
+
+    /* append the version string */
+    strbuf_init( &sb, str, 64 );
+    strbuf_format( &sb, format, major, minor, patch );
+  }
+
+
+  static void
+  icon_span( int              y,
+             int              count,
+             const FT_Span*   spans,
+             grBitmap*        icon )
+  {
+    FT_UInt32*      dst_line;
+    FT_UInt32*      dst;
+    FT_UInt32       color = 0xFF7F00;
+    unsigned short  w;
+
+
+    if ( icon->pitch > 0 )
+      y -= icon->rows - 1;
+
+    dst_line = (FT_UInt32*)( icon->buffer - y * icon->pitch );
+
+    for ( ; count--; spans++ )
+      for ( dst = dst_line + spans->x, w = spans->len; w--; dst++ )
+        *dst = ( (FT_UInt32)spans->coverage << 24 ) | color;
+  }
+
+
+  void
+  FTDemo_Icon( FTDemo_Handle*   handle,
+               FTDemo_Display*  display )
+  {
+    FT_Vector   p[] = { { 4, 8}, { 4,10}, { 8,12}, { 8,52}, { 4,54},
+                        { 4,56}, {60,56}, {60,44}, {58,44}, {56,52},
+                        {44,52}, {44,12}, {48,10}, {48, 8}, {32, 8},
+                        {32,10}, {36,12}, {36,52}, {16,52}, {16,36},
+                        {24,36}, {26,40}, {28,40}, {28,28}, {26,28},
+                        {24,32}, {16,32}, {16,12}, {20,10}, {20, 8} };
+    char        t[] = { 1,1,1,1,1, 1,1,1,1,1, 1,1,1,1,1,
+                        1,1,1,1,1, 1,1,1,1,1, 1,1,1,1,1 };
+    short       c[] = {29};
+    FT_Outline  FT  = { sizeof ( c ) / sizeof ( c[0] ),
+                        sizeof ( p ) / sizeof ( p[0] ),
+                        p, t, c, FT_OUTLINE_NONE };
+    grBitmap    icon = { 0 };
+    grBitmap*   picon = NULL;
+    int         size, i;
+
+    FT_Raster_Params  params = { NULL, NULL,
+                                 FT_RASTER_FLAG_AA | FT_RASTER_FLAG_DIRECT,
+                                 (FT_SpanFunc)icon_span, NULL, NULL, NULL,
+                                 &icon, { 0, 0, 0, 0 } };
+
+
+    while ( ( size = grSetIcon( display->surface, picon ) ) )
+    {
+      grNewBitmap( gr_pixel_mode_rgb32, 256, size, size, &icon );
+      memset( icon.buffer, 0, (size_t)icon.rows * (size_t)icon.pitch );
+
+      for ( i = 0; i < FT.n_points; i++ )
+      {
+        FT.points[i].x *= size;
+        FT.points[i].y *= size;
+      }
+
+      FT_Outline_Render( handle->library, &FT, &params );
+
+      for ( i = 0; i < FT.n_points; i++ )
+      {
+        FT.points[i].x /= size;
+        FT.points[i].y /= size;
+      }
+
+      picon = &icon;
+    }
+
+    if ( picon )
+      grDoneBitmap( picon );
+  }
+
+
+  FT_Error
+  FTDemo_Install_Font( FTDemo_Handle*  handle,
+                       const char*     filepath,
+                       FT_Bool         outline_only,
+                       FT_Bool         no_instances )
+  {
+    FTIndex_File*  entry;
+    FT_Int         i;
+    void*          file_address = NULL;
+    size_t         file_size    = 0;
+    int            file_mapped  = 0;
+
+
+    error = ftindex_get_file( handle->font_index, handle->library,
+                              filepath, &entry );
+    if ( error )
+      return error;
+
+    /* allocate new font object(s) */
+    for ( i = 0; i < entry->num_faces; i++ )
+    {
+      FTIndex_Face*  rec = entry->faces + i;
+      PFont          font;
+
+
+      if ( no_instances && rec->face_index >> 16 )
+        continue;
+
+      if ( outline_only && !rec->scalable )
+        continue;
+
+      font = (PFont)malloc( sizeof ( *font ) );
+
+      font->filepathname = ft_strdup( filepath );
+      if ( !font->filepathname )
+        return FT_Err_Out_Of_Memory;
+
+      font->face_index = (int)rec->face_index;
+
+      if ( handle->encoding != FT_ENCODING_ORDER )
+        font->cmap_index =
+          ftindex_select_charmap( rec, (FT_Encoding)handle->encoding );
+      else
+        font->cmap_index = rec->num_charmaps;
+
+      font->palette_index = 0;
+
+      font->file_preload = PRELOAD_NONE;
+      font->file_mapped  = 0;
+
+      /* all faces share the first one's copy of the file */
+      if ( handle->preload && !file_address )
+      {
+        error = preload_file( font, handle->preload );
+        if ( error )
+        {
+          free( (void*)font->filepathname );
+          free( font );
+          return error;
+        }
+
+        file_address = font->file_address;
+        file_size    = font->file_size;
+        file_mapped  = font->file_mapped;
+      }
+      else
+      {
+        font->file_address = file_address;
+        font->file_size    = file_size;
+        font->file_mapped  = file_mapped;
+      }
+
+      if ( handle->max_fonts == 0 )
+      {
+        handle->max_fonts = 16;
+        handle->fonts     = (PFont*)calloc( (size_t)handle->max_fonts,
+                                            sizeof ( PFont ) );
+      }
+      else if ( handle->num_fonts >= handle->max_fonts )
+      {
+        handle->max_fonts *= 2;
+        handle->fonts      = (PFont*)realloc( handle->fonts,
+                                              (size_t)handle->max_fonts *
+                                                sizeof ( PFont ) );
+
+        memset( &handle->fonts[handle->num_fonts], 0,
+                (size_t)( handle->max_fonts - handle->num_fonts ) *
+                  sizeof ( PFont ) );
+      }
+
+      handle->fonts[handle->num_fonts++] = font;
+    }
+
+    return FT_Err_Ok;
+  }
+
+
+  /* binary search for the last charcode */
+  static int
+  get_last_char( FT_Face     face,
+                 FT_Int      idx,
+                 FT_ULong    max )
+  {
+    FT_ULong  res, mid, min = 0;
+    FT_UInt   gidx;
+
+
+    if ( FT_Set_Charmap ( face, face->charmaps[idx] ) )
+      return -1;
+
+    do
     {
       mid = ( min + max ) >> 1;
       res = FT_Get_Next_Char( face, mid, &gidx );
@@ -853,7 +2382,7 @@
   FTDemo_Set_Preload( FTDemo_Handle*  handle,
                       int             preload )
   {
-    handle->preload = !!preload;
+    handle->preload = preload;
   }
 
 
@@ -925,16 +2454,33 @@
     {
       FTC_FaceID  face_id = handle->scaler.face_id;
       PFont       font    = handle->current_font;
+      double      t0      = HUD_START( handle );
+      FT_UInt     gindex;
 
 
-      return FTC_CMapCache_Lookup( handle->cmap_cache, face_id,
-                                   font->cmap_index, charcode );
+      gindex = FTC_CMapCache_Lookup( handle->cmap_cache, face_id,
+                                     font->cmap_index, charcode );
+
+      handle->hud.cmap_lookups++;
+      HUD_STOP( handle, load_time, t0 );
+
+      return gindex;
     }
     else
       return (FT_UInt)charcode;
   }
 
 
+  FT_Error
+  FTDemo_Open_Face( FTDemo_Handle*  handle,
+                    PFont           font,
+                    FT_Face*        aface )
+  {
+    return my_face_requester( (FTC_FaceID)font, handle->library,
+                              NULL, aface );
+  }
+
+
   FT_Error
   FTDemo_Get_Size( FTDemo_Handle*  handle,
                    FT_Size*        asize )
@@ -1028,6 +2574,11 @@
     /* lazy to walk over all loaded fonts to check whether they */
     /* are of appropriate type, then unloading them explicitly. */
     FTC_Manager_Reset( handle->cache_manager );
+    FTDemo_Row_Flush( handle );
+    FTDemo_Outline_Flush( handle );
+
+    /* the engine is not part of the glyph cache key */
+    glyph_cache_clear( handle->glyph_cache );
 
     return 1;
   }
@@ -1129,6 +2680,129 @@
   }
 
 
+  void
+  FTDemo_Frame_Begin( FTDemo_Handle*  handle )
+  {
+    FTDemo_HUD*  hud = &handle->hud;
+
+
+    hud->load_time   = 0;
+    hud->render_time = 0;
+    hud->blit_time   = 0;
+
+    hud->glyphs_loaded   = 0;
+    hud->glyphs_rendered = 0;
+    hud->glyphs_blitted  = 0;
+
+    hud->image_lookups = 0;
+    hud->image_misses  = 0;
+    hud->sbit_lookups  = 0;
+    hud->sbit_misses   = 0;
+    hud->cmap_lookups  = 0;
+
+    hud->string_lookups = 0;
+    hud->string_misses  = 0;
+    hud->cache_bytes    = 0;
+
+    hud->frame_start = grTime();
+  }
+
+
+  static int
+  compare_times( const void*  a,
+                 const void*  b )
+  {
+    double  ta = *(const double*)a;
+    double  tb = *(const double*)b;
+
+
+    return ta < tb ? -1 : ta > tb;
+  }
+
+
+  /* the lines of the HUD, drawn at the bottom right above a status line */
+#define HUD_LINES  5
+
+  void
+  FTDemo_Frame_End( FTDemo_Handle*   handle,
+                    FTDemo_Display*  display )
+  {
+    FTDemo_HUD*  hud   = &handle->hud;
+    double       frame = grTime() - hud->frame_start;
+    double       times[HUD_FRAMES];
+    char         lines[HUD_LINES][80];
+    int          n, i, width, x, y;
+
+
+    hud->frame_times[hud->num_frames++ % HUD_FRAMES] = frame;
+
+    if ( !hud->shown )
+      return;
+
+    n = hud->num_frames < HUD_FRAMES ? (int)hud->num_frames : HUD_FRAMES;
+    memcpy( times, hud->frame_times, (size_t)n * sizeof ( double ) );
+    qsort( times, (size_t)n, sizeof ( double ), compare_times );
+
+    snprintf( lines[0], sizeof ( lines[0] ),
+              "frame %.2fms, last %d: p50 %.2f p90 %.2f p99 %.2f",
+              frame, n,
+              times[( n - 1 ) * 50 / 100],
+              times[( n - 1 ) * 90 / 100],
+              times[( n - 1 ) * 99 / 100] );
+    snprintf( lines[1], sizeof ( lines[1] ),
+              "load %.2fms  render %.2fms  blit %.2fms",
+              hud->load_time, hud->render_time, hud->blit_time );
+    snprintf( lines[2], sizeof ( lines[2] ),
+              "glyphs: %d loaded, %d rendered, %d blitted",
+              hud->glyphs_loaded, hud->glyphs_rendered,
+              hud->glyphs_blitted );
+    snprintf( lines[3], sizeof ( lines[3] ),
+              "hits: image %d/%d  sbit %d/%d  string %d/%d",
+              hud->image_lookups - hud->image_misses, hud->image_lookups,
+              hud->sbit_lookups - hud->sbit_misses, hud->sbit_lookups,
+              hud->string_lookups - hud->string_misses,
+              hud->string_lookups );
+    snprintf( lines[4], sizeof ( lines[4] ),
+              "cmap lookups: %d  added to FTC: %.1fkB",
+              hud->cmap_lookups, hud->cache_bytes / 1024.0 );
+
+    width = 0;
+    for ( i = 0; i < HUD_LINES; i++ )
+      if ( width < (int)strlen( lines[i] ) )
+        width = (int)strlen( lines[i] );
+
+    width = 8 * width + 4;
+    x     = display->bitmap->width - width;
+    y     = display->bitmap->rows - GR_FONT_SIZE -
+              HUD_LINES * HEADER_HEIGHT - 4;
+
+    grFillRect( display->bitmap, x, y, width, HUD_LINES * HEADER_HEIGHT + 4,
+                display->back_color );
+
+    for ( i = 0; i < HUD_LINES; i++ )
+      grWriteCellString( display->bitmap, x + 2, y + 2 + i * HEADER_HEIGHT,
+                         lines[i], display->fore_color );
+  }
+
+
+  FT_Error
+  FTDemo_Load_Glyph( FTDemo_Handle*  handle,
+                     FT_Face         face,
+                     FT_UInt         glyph_index,
+                     FT_Int32        load_flags )
+  {
+    double  t0 = HUD_START( handle );
+
+
+    error = FT_Load_Glyph( face, glyph_index, load_flags );
+
+    handle->hud.glyphs_loaded++;
+    HUD_STOP( handle, load_time, t0 );
+
+    return error;
+  }
+
+
   void
   FTDemo_Draw_Header( FTDemo_Handle*   handle,
                       FTDemo_Display*  display,
@@ -1317,6 +2991,32 @@
   }
 
 
+  FT_Render_Mode
+  FTDemo_Render_Mode( FTDemo_Handle*  handle )
+  {
+    switch ( handle->lcd_mode )
+    {
+    case LCD_MODE_MONO:
+      return FT_RENDER_MODE_MONO;
+
+    case LCD_MODE_LIGHT:
+    case LCD_MODE_LIGHT_SUBPIXEL:
+      return FT_RENDER_MODE_LIGHT;
+
+    case LCD_MODE_RGB:
+    case LCD_MODE_BGR:
+      return FT_RENDER_MODE_LCD;
+
+    case LCD_MODE_VRGB:
+    case LCD_MODE_VBGR:
+      return FT_RENDER_MODE_LCD_V;
+
+    default:
+      return FT_RENDER_MODE_NORMAL;
+    }
+  }
+
+
   FT_Error
   FTDemo_Glyph_To_Bitmap( FTDemo_Handle*  handle,
                           FT_Glyph        glyf,
@@ -1338,36 +3038,16 @@
     if ( glyf->format == FT_GLYPH_FORMAT_OUTLINE ||
          glyf->format == FT_GLYPH_FORMAT_SVG     )
     {
-      FT_Render_Mode  render_mode;
-
-
-      switch ( handle->lcd_mode )
-      {
-      case LCD_MODE_MONO:
-        render_mode = FT_RENDER_MODE_MONO;
-        break;
-
-      case LCD_MODE_LIGHT:
-      case LCD_MODE_LIGHT_SUBPIXEL:
-        render_mode = FT_RENDER_MODE_LIGHT;
-        break;
+      double  t0 = HUD_START( handle );
 
-      case LCD_MODE_RGB:
-      case LCD_MODE_BGR:
-        render_mode = FT_RENDER_MODE_LCD;
-        break;
 
-      case LCD_MODE_VRGB:
-      case LCD_MODE_VBGR:
-        render_mode = FT_RENDER_MODE_LCD_V;
-        break;
+      /* render the glyph to a bitmap, don't destroy original */
+      error = FT_Glyph_To_Bitmap( &glyf, FTDemo_Render_Mode( handle ),
+                                  NULL, 0 );
 
-      default:
-        render_mode = FT_RENDER_MODE_NORMAL;
-      }
+      handle->hud.glyphs_rendered++;
+      HUD_STOP( handle, render_time, t0 );
 
-      /* render the glyph to a bitmap, don't destroy original */
-      error = FT_Glyph_To_Bitmap( &glyf, render_mode, NULL, 0 );
       if ( error )
         return error;
 
@@ -1469,8 +3149,11 @@
 
     if ( handle->use_sbits_cache && width < 48 && height < 48 )
     {
-      FTC_SBit   sbit;
-      FT_Bitmap  source;
+      FTC_SBit         sbit;
+      FT_Bitmap        source;
+      double           t0 = HUD_START( handle );
+      FT_Glyph_Format  format;
+      FT_GlyphSlot     slot = hud_mark_slot( handle, &format );
 
 
       error = FTC_SBitCache_LookupScaler( handle->sbits_cache,
@@ -1479,6 +3162,29 @@
                                           Index,
                                           &sbit,
                                           NULL );
+
+      if ( handle->hud.shown )
+      {
+        handle->hud.sbit_lookups++;
+
+        /* loading also renders */
+        if ( hud_slot_loaded( slot, format ) )
+        {
+          handle->hud.sbit_misses++;
+          handle->hud.glyphs_loaded++;
+          handle->hud.glyphs_rendered++;
+
+          if ( !error )
+            handle->hud.cache_bytes += sizeof ( FTC_SBitRec ) +
+                                       (unsigned long)sbit->height *
+                                         (unsigned long)( sbit->pitch < 0
+                                                          ? -sbit->pitch
+                                                          : sbit->pitch );
+        }
+
+        HUD_STOP( handle, load_time, t0 );
+      }
+
       if ( error )
         goto Exit;
 
@@ -1552,13 +3258,7 @@
       FT_Glyph  glyf;
 
 
-      error = FTC_ImageCache_LookupScaler( handle->image_cache,
-                                           &handle->scaler,
-                                           (FT_ULong)handle->load_flags,
-                                           Index,
-                                           &glyf,
-                                           NULL );
-
+      error = image_cache_lookup( handle, (FT_UInt)Index, &glyf );
       if ( !error )
         error = FTDemo_Glyph_To_Bitmap( handle, glyf, target, left, top,
                                         x_advance, y_advance, aglyf );
@@ -1595,25 +3295,29 @@
       return error;
 
     /* now render the bitmap into the display surface */
-    grBlitGlyphToSurface( display->surface, &bit3, *pen_x + left,
-                          *pen_y - top, display->fore_color );
+    hud_blit( handle, display->surface, &bit3, *pen_x + left,
+              *pen_y - top, display->fore_color );
 
     if ( glyf )
       FT_Done_Glyph( glyf );
 
+    /* temporary allocations of this glyph are gone now */
+    ftalloc_arena_reset( handle->memory );
+
     *pen_x += x_advance;
 
     return FT_Err_Ok;
   }
 
 
-  FT_Error
-  FTDemo_Draw_Glyph_Color( FTDemo_Handle*   handle,
-                           FTDemo_Display*  display,
-                           FT_Glyph         glyph,
-                           int*             pen_x,
-                           int*             pen_y,
-                           grColor          color )
+  /* `FTDemo_Draw_Glyph_Color' without destroying `glyph' on error */
+  static FT_Error
+  draw_glyph( FTDemo_Handle*   handle,
+              FTDemo_Display*  display,
+              FT_Glyph         glyph,
+              int*             pen_x,
+              int*             pen_y,
+              grColor          color )
   {
     int       left, top, x_advance, y_advance;
     grBitmap  bit3;
@@ -1623,22 +3327,37 @@
     error = FTDemo_Glyph_To_Bitmap( handle, glyph, &bit3, &left, &top,
                                     &x_advance, &y_advance, &glyf );
     if ( error )
-    {
-      FT_Done_Glyph( glyph );
-
       return error;
-    }
 
     /* now render the bitmap into the display surface */
-    grBlitGlyphToSurface( display->surface, &bit3, *pen_x + left,
-                          *pen_y - top, color );
+    hud_blit( handle, display->surface, &bit3, *pen_x + left,
+              *pen_y - top, color );
 
     if ( glyf )
       FT_Done_Glyph( glyf );
 
+    /* temporary allocations of this glyph are gone now */
+    ftalloc_arena_reset( handle->memory );
+
     *pen_x += x_advance;
 
-    return FT_Err_Ok;
+    return FT_Err_Ok;
+  }
+
+
+  FT_Error
+  FTDemo_Draw_Glyph_Color( FTDemo_Handle*   handle,
+                           FTDemo_Display*  display,
+                           FT_Glyph         glyph,
+                           int*             pen_x,
+                           int*             pen_y,
+                           grColor          color )
+  {
+    error = draw_glyph( handle, display, glyph, pen_x, pen_y, color );
+    if ( error )
+      FT_Done_Glyph( glyph );
+
+    return error;
   }
 
 
@@ -1677,6 +3396,21 @@
   }
 
 
+  FT_Error
+  FTDemo_Outline_Draw( FTDemo_Handle*   handle,
+                       FTDemo_Display*  display,
+                       FT_Glyph         glyph,
+                       int*             pen_x,
+                       int*             pen_y )
+  {
+    return draw_glyph( handle, display, glyph, pen_x, pen_y,
+                       display->fore_color );
+  }
+
+
+  /* initial size of the glyph index buffer, which grows by doubling */
+#define STRING_INITIAL_MAX  256
+
   void
   FTDemo_String_Set( FTDemo_Handle*  handle,
                      const char*     string )
@@ -1686,7 +3420,6 @@
     unsigned long  codepoint;
     int            ch;
     int            expect;
-    PGlyph         glyph = handle->string;
 
 
     handle->string_length = 0;
@@ -1698,16 +3431,262 @@
       if ( ch < 0 )
         break;
 
+      if ( handle->string_length >= handle->string_max )
+      {
+        int       new_max = handle->string_max ? 2 * handle->string_max
+                                               : STRING_INITIAL_MAX;
+        FT_UInt*  string  = (FT_UInt*)realloc( handle->string,
+                                               (size_t)new_max *
+                                                 sizeof ( FT_UInt ) );
+
+
+        if ( !string )
+          break;
+
+        handle->string     = string;
+        handle->string_max = new_max;
+      }
+
       codepoint = (unsigned long)ch;
 
-      glyph->glyph_index = FTDemo_Get_Index( handle, codepoint );
+      handle->string[handle->string_length++] =
+        FTDemo_Get_Index( handle, codepoint );
+    }
+  }
+
+
+  static int*
+  string_metrics_slot( TStringLayout*  layout,
+                       FT_UInt         glyph_index )
+  {
+    unsigned int  mask = (unsigned int)layout->num_slots - 1;
+    unsigned int  i    = ( glyph_index * 2654435761U ) & mask;
 
-      glyph++;
-      handle->string_length++;
 
-      if ( handle->string_length >= MAX_GLYPHS )
-        break;
+    while ( layout->slots[i]                                            &&
+            layout->metrics[layout->slots[i] - 1].glyph_index != glyph_index )
+      i = ( i + 1 ) & mask;
+
+    return layout->slots + i;
+  }
+
+
+  static PGlyph
+  string_metrics_find( TStringLayout*  layout,
+                       FT_UInt         glyph_index )
+  {
+    int  slot = *string_metrics_slot( layout, glyph_index );
+
+
+    return slot ? layout->metrics + slot - 1 : NULL;
+  }
+
+
+  /* load the metrics of a glyph that is not yet in `layout' */
+  static FT_Error
+  string_metrics_add( FTDemo_Handle*  handle,
+                      TStringLayout*  layout,
+                      FT_Face         face,
+                      FT_UInt         glyph_index )
+  {
+    FT_GlyphSlot  slot = face->glyph;
+    PGlyph        glyph;
+    int           i;
+
+
+    /* keep the hash table at most half full */
+    if ( 2 * ( layout->num_metrics + 1 ) > layout->num_slots )
+    {
+      int   num_slots = 2 * layout->num_slots;
+      int*  slots     = (int*)calloc( (size_t)num_slots, sizeof ( int ) );
+
+
+      if ( !slots )
+        return FT_Err_Out_Of_Memory;
+
+      free( layout->slots );
+      layout->slots     = slots;
+      layout->num_slots = num_slots;
+
+      for ( i = 0; i < layout->num_metrics; i++ )
+        *string_metrics_slot( layout, layout->metrics[i].glyph_index ) =
+          i + 1;
+    }
+
+    if ( layout->num_metrics == layout->max_metrics )
+    {
+      int     max_metrics = 2 * layout->max_metrics;
+      PGlyph  metrics     = (PGlyph)realloc( layout->metrics,
+                                             (size_t)max_metrics *
+                                               sizeof ( TGlyph ) );
+
+
+      if ( !metrics )
+        return FT_Err_Out_Of_Memory;
+
+      layout->metrics     = metrics;
+      layout->max_metrics = max_metrics;
+    }
+
+    glyph = layout->metrics + layout->num_metrics++;
+    *string_metrics_slot( layout, glyph_index ) = layout->num_metrics;
+
+    memset( glyph, 0, sizeof ( TGlyph ) );
+    glyph->glyph_index = glyph_index;
+
+    /* load the glyph, but only keep its metrics */
+    if ( !FTDemo_Load_Glyph( handle, face, glyph_index,
+                             handle->load_flags )       &&
+         ( slot->format == FT_GLYPH_FORMAT_OUTLINE ||
+           slot->format == FT_GLYPH_FORMAT_BITMAP  ||
+           slot->format == FT_GLYPH_FORMAT_SVG     ) )
+    {
+      FT_Glyph_Metrics*  metrics = &slot->metrics;
+
+
+      glyph->loaded = 1;
+      glyph->bitmap = slot->format == FT_GLYPH_FORMAT_BITMAP;
+
+      if ( slot->format == FT_GLYPH_FORMAT_OUTLINE )
+        FT_Outline_Get_CBox( &slot->outline, &glyph->cbox );
+      else if ( slot->format == FT_GLYPH_FORMAT_BITMAP )
+      {
+        glyph->cbox.xMin = slot->bitmap_left * 64;
+        glyph->cbox.yMax = slot->bitmap_top * 64;
+        glyph->cbox.xMax = glyph->cbox.xMin +
+                             (FT_Pos)slot->bitmap.width * 64;
+        glyph->cbox.yMin = glyph->cbox.yMax -
+                             (FT_Pos)slot->bitmap.rows * 64;
+      }
+      else
+      {
+        glyph->cbox.xMin = metrics->horiBearingX;
+        glyph->cbox.yMax = metrics->horiBearingY;
+        glyph->cbox.xMax = metrics->horiBearingX + metrics->width;
+        glyph->cbox.yMin = metrics->horiBearingY - metrics->height;
+      }
+
+      /* note that in vertical layout, y-positive goes downwards */
+
+      glyph->vvector.x  =  metrics->vertBearingX - metrics->horiBearingX;
+      glyph->vvector.y  = -metrics->vertBearingY - metrics->horiBearingY;
+
+      glyph->vadvance.x = 0;
+      glyph->vadvance.y = -metrics->vertAdvance;
+
+      glyph->lsb_delta = slot->lsb_delta;
+      glyph->rsb_delta = slot->rsb_delta;
+
+      glyph->hadvance.x = metrics->horiAdvance;
+      glyph->hadvance.y = 0;
+    }
+
+    return FT_Err_Ok;
+  }
+
+
+  /* Lay out chunk `c' into `layout->glyphs', kerning the advance of  */
+  /* each glyph with the next one, which may start the next chunk.    */
+  /* Glyphs that could not be loaded are skipped and advance nothing. */
+  static void
+  string_layout_chunk( FTDemo_Handle*  handle,
+                       TStringLayout*  layout,
+                       FT_Face         face,
+                       int             c )
+  {
+    int     start = c * STRING_CHUNK;
+    int     count = layout->length - start;
+    int     i;
+    PGlyph  glyph, next;
+
+
+    if ( count > STRING_CHUNK )
+      count = STRING_CHUNK;
+
+    for ( glyph = layout->glyphs, i = 0; i < count; glyph++, i++ )
+    {
+      *glyph = *string_metrics_find( layout, handle->string[start + i] );
+
+      if ( glyph->loaded && layout->lcd_mode == LCD_MODE_LIGHT_SUBPIXEL )
+        glyph->hadvance.x += glyph->lsb_delta - glyph->rsb_delta;
+    }
+
+    for ( glyph = layout->glyphs, i = 0; i < count; glyph++, i++ )
+    {
+      if ( !glyph->loaded || start + i + 1 == layout->length )
+        continue;
+
+      next = i + 1 < count
+               ? glyph + 1
+               : string_metrics_find( layout, handle->string[start + i + 1] );
+      if ( !next->loaded )
+        continue;
+
+      glyph->hadvance.x += layout->track_kern;
+
+      if ( layout->kerning_mode )
+      {
+        FT_Vector  kern;
+
+
+        FT_Get_Kerning( face, glyph->glyph_index, next->glyph_index,
+                        FT_KERNING_UNFITTED, &kern );
+
+        glyph->hadvance.x += kern.x;
+        glyph->hadvance.y += kern.y;
+
+        if ( layout->lcd_mode != LCD_MODE_LIGHT_SUBPIXEL &&
+             layout->kerning_mode > KERNING_MODE_NORMAL  )
+        {
+          if ( glyph->rsb_delta - next->lsb_delta > 32 )
+            glyph->hadvance.x -= 64;
+          else if ( glyph->rsb_delta - next->lsb_delta < -31 )
+            glyph->hadvance.x += 64;
+        }
+      }
+
+      if ( layout->lcd_mode != LCD_MODE_LIGHT_SUBPIXEL &&
+           layout->hinted                              )
+      {
+        glyph->hadvance.x = ROUND( glyph->hadvance.x );
+        glyph->hadvance.y = ROUND( glyph->hadvance.y );
+      }
     }
+
+    layout->chunk = c;
+  }
+
+
+  /* return the laid out glyph at position `n', modulo the length */
+  static PGlyph
+  string_glyph( FTDemo_Handle*  handle,
+                FT_Face         face,
+                int             n )
+  {
+    TStringLayout*  layout = handle->string_layout;
+    int             m      = n % layout->length;
+
+
+    if ( layout->chunk != m / STRING_CHUNK )
+      string_layout_chunk( handle, layout, face, m / STRING_CHUNK );
+
+    return layout->glyphs + m % STRING_CHUNK;
+  }
+
+
+  static void
+  string_bbox_add( FT_BBox*    bbox,
+                   FT_BBox*    cbox,
+                   FT_Vector*  pen )
+  {
+    if ( cbox->xMin + pen->x < bbox->xMin )
+      bbox->xMin = cbox->xMin + pen->x;
+    if ( cbox->yMin + pen->y < bbox->yMin )
+      bbox->yMin = cbox->yMin + pen->y;
+    if ( cbox->xMax + pen->x > bbox->xMax )
+      bbox->xMax = cbox->xMax + pen->x;
+    if ( cbox->yMax + pen->y > bbox->yMax )
+      bbox->yMax = cbox->yMax + pen->y;
   }
 
 
@@ -1715,12 +3694,12 @@
   FTDemo_String_Load( FTDemo_Handle*          handle,
                       FTDemo_String_Context*  sc )
   {
-    FT_Size  size;
-    FT_Face  face;
-    FT_Int   i;
-    FT_Int   length = handle->string_length;
-    PGlyph   glyph, prev;
-    FT_Pos   track_kern   = 0;
+    FT_Size         size;
+    FT_Face         face;
+    FT_Int          i, c;
+    FT_Int          length = handle->string_length;
+    FT_Int          num_chunks;
+    TStringLayout*  layout = handle->string_layout;
 
 
     error = FTDemo_Get_Size( handle, &size );
@@ -1729,38 +3708,65 @@
 
     face = size->face;
 
-    for ( glyph = handle->string, i = 0; i < length; glyph++, i++ )
+    if ( !layout )
     {
-      /* clear existing image if there is one */
-      if ( glyph->image )
-      {
-        FT_Done_Glyph( glyph->image );
-        glyph->image = NULL;
-      }
+      layout = (TStringLayout*)calloc( 1, sizeof ( TStringLayout ) );
+      if ( !layout )
+        return FT_Err_Out_Of_Memory;
 
-      /* load the glyph and get the image */
-      if ( !FT_Load_Glyph( face, glyph->glyph_index,
-                           handle->load_flags )        &&
-           !FT_Get_Glyph( face->glyph, &glyph->image ) )
-      {
-        FT_Glyph_Metrics*  metrics = &face->glyph->metrics;
+      handle->string_layout = layout;
+    }
 
+    /* invalid until complete */
+    layout->length = 0;
+    layout->chunk  = -1;
 
-        /* note that in vertical layout, y-positive goes downwards */
+    if ( !length )
+      return FT_Err_Ok;
 
-        glyph->vvector.x  =  metrics->vertBearingX - metrics->horiBearingX;
-        glyph->vvector.y  = -metrics->vertBearingY - metrics->horiBearingY;
+    num_chunks = ( length + STRING_CHUNK - 1 ) / STRING_CHUNK;
+    if ( num_chunks > layout->max_chunks )
+    {
+      TStringChunk*  chunks = (TStringChunk*)realloc(
+                                layout->chunks,
+                                (size_t)num_chunks * sizeof ( TStringChunk ) );
 
-        glyph->vadvance.x = 0;
-        glyph->vadvance.y = -metrics->vertAdvance;
 
-        glyph->lsb_delta = face->glyph->lsb_delta;
-        glyph->rsb_delta = face->glyph->rsb_delta;
+      if ( !chunks )
+        return FT_Err_Out_Of_Memory;
 
-        glyph->hadvance.x = metrics->horiAdvance;
-        glyph->hadvance.y = 0;
-      }
+      layout->chunks     = chunks;
+      layout->max_chunks = num_chunks;
+    }
+
+    if ( !layout->slots )
+    {
+      layout->slots   = (int*)calloc( STRING_CHUNK, sizeof ( int ) );
+      layout->metrics = (PGlyph)malloc( STRING_CHUNK / 2 * sizeof ( TGlyph ) );
+      if ( !layout->slots || !layout->metrics )
+        return FT_Err_Out_Of_Memory;
+
+      layout->num_slots   = STRING_CHUNK;
+      layout->max_metrics = STRING_CHUNK / 2;
     }
+    else
+      memset( layout->slots, 0, (size_t)layout->num_slots * sizeof ( int ) );
+
+    layout->num_metrics = 0;
+
+    /* load each distinct glyph once */
+    for ( i = 0; i < length; i++ )
+      if ( !string_metrics_find( layout, handle->string[i] ) )
+      {
+        error = string_metrics_add( handle, layout, face, handle->string[i] );
+        if ( error )
+          return error;
+      }
+
+    layout->track_kern   = 0;
+    layout->kerning_mode = sc->kerning_mode;
+    layout->lcd_mode     = handle->lcd_mode;
+    layout->hinted       = handle->hinted;
 
     if ( sc->kerning_degree )
     {
@@ -1768,50 +3774,53 @@
       if ( !FT_Get_Track_Kerning( face,
                                   (FT_Fixed)handle->scaler.width << 10,
                                   -sc->kerning_degree,
-                                  &track_kern ) )
-        track_kern = (FT_Pos)(
-                       ( track_kern / 1024.0 * handle->scaler.x_res ) /
-                       72.0 );
+                                  &layout->track_kern ) )
+        layout->track_kern = (FT_Pos)(
+                               ( layout->track_kern / 1024.0 *
+                                 handle->scaler.x_res ) / 72.0 );
     }
 
-    for ( prev = handle->string + length, glyph = handle->string, i = 0;
-          i < length;
-          prev = glyph, glyph++, i++ )
+    layout->length = length;
+
+    for ( c = 0; c < num_chunks; c++ )
     {
-      if ( !glyph->image )
-        continue;
+      TStringChunk*  chunk = layout->chunks + c;
+      PGlyph         glyph = layout->glyphs;
+      FT_Vector      vpen;
 
-      if ( handle->lcd_mode == LCD_MODE_LIGHT_SUBPIXEL )
-        glyph->hadvance.x += glyph->lsb_delta - glyph->rsb_delta;
 
-      prev->hadvance.x += track_kern;
+      string_layout_chunk( handle, layout, face, c );
 
-      if ( sc->kerning_mode )
-      {
-        FT_Vector  kern;
+      chunk->hadvance.x = chunk->hadvance.y = 0;
+      chunk->vadvance.x = chunk->vadvance.y = 0;
+      chunk->hmin       = chunk->hmax       = 0;
 
+      chunk->hbox.xMin = chunk->hbox.yMin =  0x7FFFFFFFL;
+      chunk->hbox.xMax = chunk->hbox.yMax = -0x7FFFFFFFL;
+      chunk->vbox      = chunk->hbox;
 
-        FT_Get_Kerning( face, prev->glyph_index, glyph->glyph_index,
-                        FT_KERNING_UNFITTED, &kern );
+      for ( i = c * STRING_CHUNK;
+            i < length && i < ( c + 1 ) * STRING_CHUNK;
+            glyph++, i++ )
+      {
+        if ( !glyph->loaded )
+          continue;
 
-        prev->hadvance.x += kern.x;
-        prev->hadvance.y += kern.y;
+        string_bbox_add( &chunk->hbox, &glyph->cbox, &chunk->hadvance );
 
-        if ( handle->lcd_mode != LCD_MODE_LIGHT_SUBPIXEL &&
-             sc->kerning_mode > KERNING_MODE_NORMAL      )
-        {
-          if ( prev->rsb_delta - glyph->lsb_delta > 32 )
-            prev->hadvance.x -= 64;
-          else if ( prev->rsb_delta - glyph->lsb_delta < -31 )
-            prev->hadvance.x += 64;
-        }
-      }
+        vpen.x = chunk->vadvance.x + glyph->vvector.x;
+        vpen.y = chunk->vadvance.y + glyph->vvector.y;
+        string_bbox_add( &chunk->vbox, &glyph->cbox, &vpen );
 
-      if ( handle->lcd_mode != LCD_MODE_LIGHT_SUBPIXEL &&
-           handle->hinted                              )
-      {
-        prev->hadvance.x = ROUND( prev->hadvance.x );
-        prev->hadvance.y = ROUND( prev->hadvance.y );
+        chunk->hadvance.x += glyph->hadvance.x;
+        chunk->hadvance.y += glyph->hadvance.y;
+        chunk->vadvance.x += glyph->vadvance.x;
+        chunk->vadvance.y += glyph->vadvance.y;
+
+        if ( chunk->hadvance.x < chunk->hmin )
+          chunk->hmin = chunk->hadvance.x;
+        if ( chunk->hadvance.x > chunk->hmax )
+          chunk->hmax = chunk->hadvance.x;
       }
     }
 
@@ -1819,6 +3828,108 @@
   }
 
 
+  /* Tell whether a glyph or chunk spanning `bbox' might be visible, */
+  /* only horizontally if `any_y' is set.  We allow some pixels more */
+  /* for filtering and rounding; the blitter clips the rest.         */
+#define STRING_MARGIN  2
+
+  static int
+  string_bbox_visible( FTDemo_Display*  display,
+                       FT_BBox*         bbox,
+                       int              any_y )
+  {
+    if ( ( bbox->xMax >> 6 ) + STRING_MARGIN <= 0                      ||
+         ( bbox->xMin >> 6 ) - STRING_MARGIN >= display->bitmap->width )
+      return 0;
+
+    return any_y                                                        ||
+           ( ( bbox->yMax >> 6 ) + STRING_MARGIN > 0                    &&
+             ( bbox->yMin >> 6 ) - STRING_MARGIN < display->bitmap->rows );
+  }
+
+
+  /* tell whether a glyph at `origin' might be visible, before loading it */
+  static int
+  string_glyph_visible( FTDemo_Display*         display,
+                        FTDemo_String_Context*  sc,
+                        PGlyph                  glyph,
+                        FT_Vector*              origin,
+                        int                     any_y )
+  {
+    FT_BBox    cbox = glyph->cbox;
+    FT_BBox    bbox;
+    FT_Vector  corner;
+    int        i;
+
+
+    if ( sc->vertical )
+    {
+      cbox.xMin += glyph->vvector.x;
+      cbox.xMax += glyph->vvector.x;
+      cbox.yMin += glyph->vvector.y;
+      cbox.yMax += glyph->vvector.y;
+    }
+
+    bbox.xMin = bbox.yMin =  0x7FFFFFFFL;
+    bbox.xMax = bbox.yMax = -0x7FFFFFFFL;
+
+    for ( i = 0; i < 4; i++ )
+    {
+      corner.x = i & 1 ? cbox.xMax : cbox.xMin;
+      corner.y = i & 2 ? cbox.yMax : cbox.yMin;
+
+      if ( !glyph->bitmap )
+        FT_Vector_Transform( &corner, sc->matrix );
+
+      corner.x += origin->x;
+      corner.y += origin->y;
+
+      if ( corner.x < bbox.xMin )
+        bbox.xMin = corner.x;
+      if ( corner.x > bbox.xMax )
+        bbox.xMax = corner.x;
+      if ( corner.y < bbox.yMin )
+        bbox.yMin = corner.y;
+      if ( corner.y > bbox.yMax )
+        bbox.yMax = corner.y;
+    }
+
+    return string_bbox_visible( display, &bbox, any_y );
+  }
+
+
+  /* tell whether a chunk starting at `origin' might be visible; its   */
+  /* glyphs are only placed at the partial sums if not transformed     */
+  static int
+  string_chunk_visible( FTDemo_Display*         display,
+                        FTDemo_String_Context*  sc,
+                        TStringChunk*           chunk,
+                        FT_Vector*              origin,
+                        int                     any_y )
+  {
+    FT_BBox  bbox = sc->vertical ? chunk->vbox : chunk->hbox;
+
+
+    if ( sc->matrix                     &&
+         ( sc->matrix->xx != 0x10000L ||
+           sc->matrix->yy != 0x10000L ||
+           sc->matrix->xy != 0        ||
+           sc->matrix->yx != 0        ) )
+      return 1;
+
+    /* nothing to draw */
+    if ( bbox.xMin > bbox.xMax )
+      return 0;
+
+    bbox.xMin += origin->x;
+    bbox.xMax += origin->x;
+    bbox.yMin += origin->y;
+    bbox.yMax += origin->y;
+
+    return string_bbox_visible( display, &bbox, any_y );
+  }
+
+
   int
   FTDemo_String_Draw( FTDemo_Handle*          handle,
                       FTDemo_Display*         display,
@@ -1826,11 +3937,20 @@
                       int                     x,
                       int                     y )
   {
-    int        first = sc->offset;
-    int        last  = handle->string_length;
-    int        m, n;
-    FT_Vector  pen = { 0, 0};
-    FT_Vector  advance;
+    TStringLayout*  layout = handle->string_layout;
+    FT_Face         face   = NULL;
+    FT_Size         size;
+    int             first  = sc->offset;
+    int             last   = handle->string_length;
+    int             length = handle->string_length;
+    int             count, n;
+    TStringChunk*   chunk;
+    PGlyph          glyph;
+    FT_Vector       pen = { 0, 0};
+    FT_Vector       advance;
+    TGlyphKey       key;
+    int             recording = handle->row_cache                &&
+                                handle->row_cache->recording != NULL;
 
 
     if ( x < 0                      ||
@@ -1839,34 +3959,77 @@
          y > display->bitmap->rows  )
       return 0;
 
+    /* `FTDemo_String_Load' must have succeeded for this string */
+    if ( !layout || !layout->length || layout->length != length )
+      return 0;
+
+    /* for kerning the chunks we lay out again */
+    if ( layout->kerning_mode )
+    {
+      if ( FTDemo_Get_Size( handle, &size ) )
+        return 0;
+
+      face = size->face;
+    }
+
     /* change to Cartesian coordinates */
     y = display->bitmap->rows - y;
 
-    /* calculate the extent */
+    /* calculate the extent, taking whole chunks if possible */
     if ( sc->extent )
-      for( n = first; n < first + last || pen.x > 0; n++ )  /* chk progress */
+    {
+      for( n = first; n < first + last || pen.x > 0; )  /* chk progress */
       {
-        m = n % handle->string_length;  /* recycling */
-        if ( pen.x + handle->string[m].hadvance.x > sc->extent )
+        if ( n % length % STRING_CHUNK == 0 )
+        {
+          chunk = layout->chunks + n % length / STRING_CHUNK;
+          count = length - n % length;
+          if ( count > STRING_CHUNK )
+            count = STRING_CHUNK;
+
+          if ( pen.x + chunk->hmax <= sc->extent        &&
+               ( n + count <= first + last       ||
+                 pen.x + chunk->hmin > 0         ) )
+          {
+            pen.x += chunk->hadvance.x;
+            pen.y += chunk->hadvance.y;
+            n     += count;
+            continue;
+          }
+        }
+
+        glyph = string_glyph( handle, face, n );  /* recycling */
+        if ( pen.x + glyph->hadvance.x > sc->extent )
         {
           last = n;
           break;
         }
-        pen.x += handle->string[m].hadvance.x;
-        pen.y += handle->string[m].hadvance.y;
-      }
-    else if ( sc->vertical )
-      for ( n = first; n < last; n++ )
-      {
-        pen.x += handle->string[n].vadvance.x;
-        pen.y += handle->string[n].vadvance.y;
+        pen.x += glyph->hadvance.x;
+        pen.y += glyph->hadvance.y;
+        n++;
       }
+    }
     else
-      for ( n = first; n < last; n++ )
+    {
+      for ( n = first; n < last; )
       {
-        pen.x += handle->string[n].hadvance.x;
-        pen.y += handle->string[n].hadvance.y;
+        if ( n % STRING_CHUNK == 0 )
+        {
+          chunk = layout->chunks + n / STRING_CHUNK;
+          advance = sc->vertical ? chunk->vadvance : chunk->hadvance;
+          n      += STRING_CHUNK;
+        }
+        else
+        {
+          glyph   = string_glyph( handle, face, n );
+          advance = sc->vertical ? glyph->vadvance : glyph->hadvance;
+          n++;
+        }
+
+        pen.x += advance.x;
+        pen.y += advance.y;
       }
+    }
 
     /* round to control initial pen position and preserve hinting... */
     pen.x = FT_MulFix( pen.x, sc->center ) & ~63;
@@ -1879,51 +4042,63 @@
     pen.x = ( x << 6 ) - pen.x;
     pen.y = ( y << 6 ) - pen.y;
 
-    for ( n = first; n < last; n++ )
+    if ( !handle->glyph_cache )
     {
-      PGlyph    glyph = handle->string + n % handle->string_length;
-      FT_Glyph  image;
-      FT_BBox   bbox;
+      handle->glyph_cache = (TGlyphCache*)calloc( 1, sizeof ( TGlyphCache ) );
+      if ( !handle->glyph_cache )
+        return 0;
 
+      lru_init( &handle->glyph_cache->lru, handle->glyph_cache->buckets,
+                GLYPH_CACHE_BUCKETS, glyph_free_node );
+    }
 
-      if ( !glyph->image )
-        continue;
+    /* all but the glyph index and the fraction */
+    memset( &key, 0, sizeof ( key ) );  /* also the padding, for hashing */
+    key.scaler     = handle->scaler;
+    key.load_flags = handle->load_flags;
+    key.lcd_mode   = handle->lcd_mode;
+    key.vertical   = sc->vertical;
 
-      /* copy image */
-      error = FT_Glyph_Copy( glyph->image, &image );
-      if ( error )
-        continue;
+    if ( sc->matrix )
+      key.matrix = *sc->matrix;
+    else
+    {
+      key.matrix.xx = key.matrix.yy = 0x10000L;
+      key.matrix.xy = key.matrix.yx = 0;
+    }
 
-      if ( image->format != FT_GLYPH_FORMAT_BITMAP )
-      {
-        if ( sc->vertical )
-          error = FT_Glyph_Transform( image, NULL, &glyph->vvector );
+    for ( n = first; n < last; )
+    {
+      FT_Vector      origin = pen;
+      TCachedGlyph*  entry;
+      grGlyphBlit*   blit;
 
-        if ( !error )
-          error = FT_Glyph_Transform( image, sc->matrix, &pen );
 
-        if ( error )
+      /* skip invisible chunks without laying them out */
+      if ( n % length % STRING_CHUNK == 0 )
+      {
+        chunk = layout->chunks + n % length / STRING_CHUNK;
+        count = length - n % length;
+        if ( count > STRING_CHUNK )
+          count = STRING_CHUNK;
+
+        /* rows are recorded for any vertical position */
+        if ( n + count <= last                                          &&
+             !string_chunk_visible( display, sc, chunk, &origin,
+                                    recording )                         )
         {
-          FT_Done_Glyph( image );
+          advance = sc->vertical ? chunk->vadvance : chunk->hadvance;
+
+          pen.x += advance.x;
+          pen.y += advance.y;
+          n     += count;
           continue;
         }
       }
-      else
-      {
-        FT_BitmapGlyph  bitmap = (FT_BitmapGlyph)image;
 
-
-        if ( sc->vertical )
-        {
-          bitmap->left += ( glyph->vvector.x + pen.x ) >> 6;
-          bitmap->top  += ( glyph->vvector.y + pen.y ) >> 6;
-        }
-        else
-        {
-          bitmap->left += pen.x >> 6;
-          bitmap->top  += pen.y >> 6;
-        }
-      }
+      glyph = string_glyph( handle, face, n++ );
+      if ( !glyph->loaded )
+        continue;
 
       advance = sc->vertical ? glyph->vadvance : glyph->hadvance;
 
@@ -1933,51 +4108,74 @@
       pen.x += advance.x;
       pen.y += advance.y;
 
-      FT_Glyph_Get_CBox( image, FT_GLYPH_BBOX_PIXELS, &bbox );
+      if ( !string_glyph_visible( display, sc, glyph, &origin, recording ) )
+        continue;
 
-#if 0
-      if ( n == 0 )
-      {
-        fprintf( stderr, "bbox = [%ld %ld %ld %ld]\n",
-            bbox.xMin, bbox.yMin, bbox.xMax, bbox.yMax );
-      }
-#endif
+      key.glyph_index = glyph->glyph_index;
 
-      /* check bounding box; if it is completely outside the */
-      /* display surface, we don't need to render it         */
-      if ( bbox.xMax > 0                      &&
-           bbox.yMax > 0                      &&
-           bbox.xMin < display->bitmap->width &&
-           bbox.yMin < display->bitmap->rows  )
+      if ( glyph->bitmap )
       {
-        int       left, top, dummy1, dummy2;
-        grBitmap  bit3;
-        FT_Glyph  glyf;
+        /* bitmaps are placed at the pixel containing the origin */
+        if ( sc->vertical )
+        {
+          origin.x += glyph->vvector.x;
+          origin.y += glyph->vvector.y;
+        }
 
+        key.fraction.x = 0;
+        key.fraction.y = 0;
+      }
+      else
+      {
+        /* outlines are rendered with the fraction of the rounded origin */
+        origin.x = ( origin.x + 32 / STRING_SUBPIXELS ) &
+                     -( 64 / STRING_SUBPIXELS );
+        origin.y = ( origin.y + 32 / STRING_SUBPIXELS ) &
+                     -( 64 / STRING_SUBPIXELS );
+
+        key.fraction.x = origin.x & 63;
+        key.fraction.y = origin.y & 63;
+      }
 
-        error = FTDemo_Glyph_To_Bitmap( handle, image, &bit3, &left, &top,
-                                        &dummy1, &dummy2, &glyf );
-        if ( !error )
-        {
-          /* change back to the usual coordinates */
-          top = display->bitmap->rows - top;
+      entry = glyph_cache_get( handle, display, glyph, &key );
+      if ( !entry || !entry->bitmap.rows || !entry->bitmap.width )
+        continue;
 
-          /* now render the bitmap into the display surface */
-          grBlitGlyphToSurface( display->surface, &bit3, left, top,
-                                display->fore_color );
+      if ( handle->glyph_cache->num_blits == GLYPH_CACHE_BLITS )
+        glyph_cache_flush( handle, display->surface );
 
-          if ( glyf )
-            FT_Done_Glyph( glyf );
-        }
-      }
+      blit = handle->glyph_cache->blits + handle->glyph_cache->num_blits++;
 
-      FT_Done_Glyph( image );
+      /* change back to the usual coordinates */
+      blit->glyph = &entry->bitmap;
+      blit->x     = ( origin.x >> 6 ) + entry->left;
+      blit->y     = display->bitmap->rows - ( origin.y >> 6 ) - entry->top;
+      blit->color = display->fore_color;
     }
 
+    /* now render the bitmaps into the display surface */
+    glyph_cache_flush( handle, display->surface );
+
     return last - first;
   }
 
 
+  void
+  FTDemo_String_Cache_Stats( FTDemo_Handle*  handle,
+                             unsigned long*  hits,
+                             unsigned long*  misses )
+  {
+    TGlyphCache*  cache = handle->glyph_cache;
+
+
+    *hits   = cache ? cache->hits : 0;
+    *misses = cache ? cache->misses : 0;
+
+    if ( cache )
+      cache->hits = cache->misses = 0;
+  }
+
+
   FT_Error
   FTDemo_Sketch_Glyph_Color( FTDemo_Handle*     handle,
                              FTDemo_Display*    display,
@@ -25,6 +25,17 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
+#if defined( _WIN32 )
+#define FTDEMO_THREADS_WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined( __unix__ ) || defined( __APPLE__ )
+#define FTDEMO_THREADS_PTHREAD
+#include <pthread.h>
+#endif
+
   extern FT_Error   error;
 
   /* forward declarations */
@@ -44,6 +55,51 @@
 
 #define LOG( x )  /* */
 
+#endif
+
+
+  /*************************************************************************/
+  /*************************************************************************/
+  /*****                                                               *****/
+  /*****                            THREADS                            *****/
+  /*****                                                               *****/
+  /*************************************************************************/
+  /*************************************************************************/
+
+
+  /* for the idle thread and the demo programs' own worker threads */
+
+#if defined( FTDEMO_THREADS_PTHREAD )
+
+  typedef pthread_mutex_t  TMutex;
+  typedef pthread_cond_t   TCond;
+  typedef pthread_t        TThread;
+
+#define FTDEMO_MUTEX_INIT( m )  pthread_mutex_init( &(m), NULL )
+#define FTDEMO_MUTEX_DONE( m )  pthread_mutex_destroy( &(m) )
+#define FTDEMO_LOCK( m )        pthread_mutex_lock( &(m) )
+#define FTDEMO_UNLOCK( m )      pthread_mutex_unlock( &(m) )
+#define FTDEMO_COND_INIT( c )   pthread_cond_init( &(c), NULL )
+#define FTDEMO_COND_DONE( c )   pthread_cond_destroy( &(c) )
+#define FTDEMO_WAIT( c, m )     pthread_cond_wait( &(c), &(m) )
+#define FTDEMO_BROADCAST( c )   pthread_cond_broadcast( &(c) )
+
+#elif defined( FTDEMO_THREADS_WIN32 )
+
+  typedef CRITICAL_SECTION    TMutex;
+  typedef CONDITION_VARIABLE  TCond;
+  typedef HANDLE              TThread;
+
+#define FTDEMO_MUTEX_INIT( m )  InitializeCriticalSection( &(m) )
+#define FTDEMO_MUTEX_DONE( m )  DeleteCriticalSection( &(m) )
+#define FTDEMO_LOCK( m )        EnterCriticalSection( &(m) )
+#define FTDEMO_UNLOCK( m )      LeaveCriticalSection( &(m) )
+#define FTDEMO_COND_INIT( c )   InitializeConditionVariable( &(c) )
+#define FTDEMO_COND_DONE( c )   (void)0
+#define FTDEMO_WAIT( c, m )     SleepConditionVariableCS( &(c), &(m), \
+                                                          INFINITE )
+#define FTDEMO_BROADCAST( c )   WakeAllConditionVariable( &(c) )
+
 #endif
 
 
@@ -117,14 +173,16 @@
   /*************************************************************************/
   /*************************************************************************/
 
-#define MAX_GLYPHS 512            /* at most 512 glyphs in the string */
 #define MAX_GLYPH_BYTES  150000   /* 150kB for the glyph image cache */
 
 
+  /* glyph images are not kept; they come from the image cache if visible */
   typedef struct  TGlyph_
   {
     FT_UInt    glyph_index;
-    FT_Glyph   image;    /* the glyph image */
+    FT_Bool    loaded;    /* could it be loaded?      */
+    FT_Bool    bitmap;    /* bitmaps aren't transformed */
+    FT_BBox    cbox;      /* control box, in 26.6 units */
 
     FT_Pos     lsb_delta; /* delta caused by hinting */
     FT_Pos     rsb_delta; /* delta caused by hinting */
@@ -145,9 +203,18 @@
     int          num_indices;
     void*        file_address;  /* for preloaded files */
     size_t       file_size;
+    int          file_preload;  /* PRELOAD_XXX if owning `file_address' */
+    int          file_mapped;   /* set for all faces of a mapped file   */
 
   } TFont, *PFont;
 
+  /* how to preload font files, see `FTDemo_Set_Preload' */
+  enum {
+    PRELOAD_NONE = 0,
+    PRELOAD_READ,
+    PRELOAD_MAP
+  };
+
   enum {
     LCD_MODE_MONO = 0,
     LCD_MODE_AA,
@@ -189,6 +256,43 @@
 
   } FTDemo_String_Context;
 
+  /* number of frame times kept for the percentiles of the HUD */
+#define HUD_FRAMES  256
+
+  /*
+   * Performance counters of the current frame, drawn by
+   * `FTDemo_Frame_End' if `shown' is set.  Times are in milliseconds and
+   * only measured while the HUD is shown.  FTC does not report cache
+   * hits; a lookup is counted as a miss if it has loaded a glyph.
+   */
+  typedef struct  FTDemo_HUD_
+  {
+    int            shown;              /* toggled by the programs */
+
+    double         frame_start;
+    double         frame_times[HUD_FRAMES];
+    unsigned long  num_frames;
+
+    double         load_time;          /* including cache lookups */
+    double         render_time;
+    double         blit_time;
+
+    int            glyphs_loaded;
+    int            glyphs_rendered;
+    int            glyphs_blitted;
+
+    int            image_lookups;
+    int            image_misses;
+    int            sbit_lookups;
+    int            sbit_misses;
+    int            cmap_lookups;
+    int            string_lookups;     /* see FTDemo_String_Draw */
+    int            string_misses;
+    unsigned long  cache_bytes;        /* added to the FTC caches */
+
+  } FTDemo_HUD;
+
+
   typedef struct
   {
     FT_Library      library;           /* the FreeType library          */
@@ -201,6 +305,8 @@
     int             num_fonts;
     int             max_fonts;
 
+    struct FTIndex_*  font_index;      /* see ftindex.h */
+
     int             use_sbits_cache;   /* toggle sbits cache */
 
     /* use FTDemo_Set_Current_XXX to set the following two fields */
@@ -215,21 +321,37 @@
     int             use_layers;        /* do we use color-layered glyphs? */
     int             autohint;          /* force auto-hinting              */
     int             lcd_mode;          /* mono, aa, light, vrgb, ...      */
-    int             preload;           /* force font file preloading      */
+    int             preload;           /* PRELOAD_XXX                     */
+
+    FTDemo_HUD      hud;               /* see FTDemo_Frame_End */
 
     /* don't touch the following fields! */
 
     /* used for string rendering */
-    TGlyph          string[MAX_GLYPHS];
+    FT_UInt*        string;            /* glyph indices */
     int             string_length;
+    int             string_max;
+    struct TStringLayout_*  string_layout;  /* see FTDemo_String_Load */
+
+    struct TGlyphCache_*    glyph_cache;    /* rendered string glyphs */
+    struct TRowCache_*      row_cache;      /* see FTDemo_Row_Record   */
+    struct TOutlineCache_*  outline_cache;  /* see FTDemo_Outline_Add  */
+    struct TIdle_*          idle;           /* see FTDemo_Idle_Start   */
 
     unsigned long   encoding;
     FT_Stroker      stroker;
     FT_Bitmap       bitmap;            /* used as bitmap conversion buffer */
 
+    FT_Memory       memory;            /* custom allocator, see ftalloc.h  */
+
   } FTDemo_Handle;
 
 
+  /*
+   * The memory allocator of the library can be selected with the
+   * environment variable `FTDEMO_ALLOCATOR', which is either `system'
+   * (the default), `pool', or `arena'.
+   */
   FTDemo_Handle*
   FTDemo_New( void );
 
@@ -250,7 +372,12 @@
                FTDemo_Display*  display );
 
 
-  /* install a font */
+  /*
+   * Install all faces and named instances of a font file.  What they are
+   * is taken from the font index (see `ftindex.h') if possible, without
+   * opening the file.  The environment variable `FTDEMO_FONT_INDEX' names
+   * a file to keep the index between runs.
+   */
   FT_Error
   FTDemo_Install_Font( FTDemo_Handle*  handle,
                        const char*     filepath,
@@ -258,6 +385,14 @@
                        FT_Bool         no_instances );
 
 
+  /*
+   * Make `FTDemo_Install_Font' either read (PRELOAD_READ) or map
+   * (PRELOAD_MAP) each font file into memory, shared by all its faces.
+   * Mapped files are only paged in once a face of them is opened, and
+   * the pages can be shared with other processes and dropped under
+   * memory pressure.
+   * Where mapping is not available, files are read instead.
+   */
   void
   FTDemo_Set_Preload( FTDemo_Handle*  handle,
                       int             preload );
@@ -285,6 +420,14 @@
                     FT_UInt32       charcode );
 
 
+  /* open a private face object of `font', as the cache manager does; */
+  /* threads must serialize this and `FT_Done_Face' (`error' is kept)  */
+  FT_Error
+  FTDemo_Open_Face( FTDemo_Handle*  handle,
+                    PFont           font,
+                    FT_Face*        aface );
+
+
   /* get FT_Size of current font */
   FT_Error
   FTDemo_Get_Size( FTDemo_Handle*  handle,
@@ -296,6 +439,24 @@
   FTDemo_Hinting_Engine_Change( FTDemo_Handle*  handle );
 
 
+  /* start timing a frame and reset the counters of `handle->hud' */
+  void
+  FTDemo_Frame_Begin( FTDemo_Handle*  handle );
+
+  /* stop timing the frame; if `handle->hud.shown' is set, draw frame */
+  /* time percentiles, glyph counts, time split, and cache statistics */
+  void
+  FTDemo_Frame_End( FTDemo_Handle*   handle,
+                    FTDemo_Display*  display );
+
+  /* `FT_Load_Glyph' counted by the HUD */
+  FT_Error
+  FTDemo_Load_Glyph( FTDemo_Handle*  handle,
+                     FT_Face         face,
+                     FT_UInt         glyph_index,
+                     FT_Int32        load_flags );
+
+
   /* draw common header */
   void
   FTDemo_Draw_Header( FTDemo_Handle*   handle,
@@ -306,6 +467,11 @@
                       int              error_code );
 
 
+  /* render mode of `FTDemo_Glyph_To_Bitmap' for `handle->lcd_mode' */
+  FT_Render_Mode
+  FTDemo_Render_Mode( FTDemo_Handle*  handle );
+
+
   /* convert a FT_Glyph to a grBitmap (don't free target->buffer) */
   /* if aglyf != NULL, you should FT_Glyph_Done the aglyf */
   FT_Error
@@ -365,20 +531,23 @@
                     int*             pen_y);
 
 
-  /* set the string to be drawn */
+  /* set the string to be drawn, of any length */
   void
   FTDemo_String_Set( FTDemo_Handle*  handle,
                      const char*     string );
 
 
-  /* load kerned advances with hinting compensation */
+  /* load kerned advances with hinting compensation; only their sums  */
+  /* are kept for each chunk of 256 glyphs, so that memory grows only  */
+  /* slightly with the length                                          */
   FT_Error
   FTDemo_String_Load( FTDemo_Handle*          handle,
                       FTDemo_String_Context*  sc );
 
 
   /* draw a string centered at (center_x, center_y) --  */
-  /* returns the number of rendered glyphs              */
+  /* returns the number of rendered glyphs, but only    */
+  /* those in the display are loaded and drawn          */
   /* note that handle->use_sbits_cache is not supported */
   int
   FTDemo_String_Draw( FTDemo_Handle*          handle,
@@ -388,6 +557,148 @@
                       int                     center_y );
 
 
+  /*
+   * `FTDemo_String_Draw' keeps the bitmaps it renders, keyed by face,
+   * size, glyph index, load flags, LCD mode, matrix, and the fractional
+   * pen position rounded to a quarter pixel, up to a few megabytes;
+   * redrawing a string then only blits.  Return the number of bitmaps
+   * found in and added to this cache since the last call.
+   */
+  void
+  FTDemo_String_Cache_Stats( FTDemo_Handle*  handle,
+                             unsigned long*  hits,
+                             unsigned long*  misses );
+
+
+  /*
+   * A row is a recording of the glyphs blitted by `FTDemo_Draw_Index',
+   * `FTDemo_String_Draw', and similar functions, which can be drawn
+   * again, shifted, without loading or rendering anything.  Rows
+   * are kept up to a few megabytes, keyed by the current font, size,
+   * load flags, LCD mode, encoding, palette, foreground color, and the
+   * bytes of `key', which must describe everything else the row depends
+   * on (and should be zeroed before being filled to clear any padding).
+   */
+  typedef struct  FTDemo_Row_
+  {
+    /* for use by the caller */
+    FT_Error         error;
+    FT_Size_Metrics  metrics;
+    int              first_char;
+    int              num_fails;
+
+  } FTDemo_Row;
+
+
+  /* return the row recorded for `key' with the current settings, or NULL */
+  FTDemo_Row*
+  FTDemo_Row_Lookup( FTDemo_Handle*   handle,
+                     FTDemo_Display*  display,
+                     const void*      key,
+                     size_t           key_size );
+
+
+  /* start recording a row; until `FTDemo_Row_End' the glyphs drawn on */
+  /* `display' are only recorded, and strings are recorded for any     */
+  /* vertical position; return NULL if out of memory                  */
+  FTDemo_Row*
+  FTDemo_Row_Record( FTDemo_Handle*   handle,
+                     FTDemo_Display*  display,
+                     const void*      key,
+                     size_t           key_size );
+
+
+  /* stop recording and return the row; like those returned by */
+  /* `FTDemo_Row_Lookup', it stays valid until the next call of  */
+  /* `FTDemo_Row_End' or `FTDemo_Row_Flush'                      */
+  FTDemo_Row*
+  FTDemo_Row_End( FTDemo_Handle*  handle );
+
+
+  /* blit a row, shifted by (x, y) */
+  void
+  FTDemo_Row_Draw( FTDemo_Handle*   handle,
+                   FTDemo_Display*  display,
+                   FTDemo_Row*      row,
+                   int              x,
+                   int              y );
+
+
+  /* drop all rows, for example after changing a library property */
+  void
+  FTDemo_Row_Flush( FTDemo_Handle*  handle );
+
+
+  /*
+   * Glyphs that the caller has loaded with the current scaler and load
+   * flags and then transformed (for example, stroked or emboldened) in
+   * a way described by `key', so that they need not be transformed
+   * again.  The least recently used ones are dropped if the cache grows
+   * larger than its share of the byte limit, which it splits evenly
+   * with the FTC manager.
+   */
+
+  /* return the glyph added for `glyph_index' and `key', or NULL */
+  FT_Glyph
+  FTDemo_Outline_Lookup( FTDemo_Handle*  handle,
+                         FT_UInt         glyph_index,
+                         const void*     key,
+                         size_t          key_size );
+
+
+  /* add a glyph, which then belongs to the cache, and return it, or  */
+  /* NULL if out of memory; like those returned by                     */
+  /* `FTDemo_Outline_Lookup', it stays valid until the next call of    */
+  /* `FTDemo_Outline_Add' or `FTDemo_Outline_Flush'                    */
+  FT_Glyph
+  FTDemo_Outline_Add( FTDemo_Handle*  handle,
+                      FT_UInt         glyph_index,
+                      const void*     key,
+                      size_t          key_size,
+                      FT_Glyph        glyph );
+
+
+  /* like `FTDemo_Draw_Glyph', but for a glyph of the cache, which is */
+  /* not destroyed if drawing fails                                   */
+  FT_Error
+  FTDemo_Outline_Draw( FTDemo_Handle*   handle,
+                       FTDemo_Display*  display,
+                       FT_Glyph         glyph,
+                       int*             pen_x,
+                       int*             pen_y );
+
+
+  /* drop all glyphs */
+  void
+  FTDemo_Outline_Flush( FTDemo_Handle*  handle );
+
+
+  /*
+   * Call `func' in a background thread until `FTDemo_Idle_Stop' returns,
+   * which waits for it.  Between the two calls, the main thread must
+   * not use `handle' (typically, it waits for an event), and `func' can
+   * use it freely; it should return soon after `FTDemo_Idle_Stopping'
+   * becomes true.  Without thread support, `func' is never called.
+   */
+  typedef void
+  (*FTDemo_Idle_Func)( FTDemo_Handle*  handle,
+                       void*           data );
+
+
+  void
+  FTDemo_Idle_Start( FTDemo_Handle*    handle,
+                     FTDemo_Idle_Func  func,
+                     void*             data );
+
+
+  void
+  FTDemo_Idle_Stop( FTDemo_Handle*  handle );
+
+
+  int
+  FTDemo_Idle_Stopping( FTDemo_Handle*  handle );
+
+
   /* draw an outline glyph directly onto display surface */
   FT_Error
   FTDemo_Sketch_Glyph_Color( FTDemo_Handle*     handle,
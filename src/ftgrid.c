@@ -547,7 +547,8 @@
     _af_debug_disable_blue_hints = !st->do_blue_hints;
 #endif
 
-    if ( FT_Load_Glyph( size->face, glyph_idx, handle->load_flags ) )
+    if ( FTDemo_Load_Glyph( handle, size->face, glyph_idx,
+                            handle->load_flags ) )
       return;
 
     slot = size->face->glyph;
@@ -880,6 +881,7 @@
     grWriteln( "             filters                    q, ESC      quit ftgrid             " );
     grLn();
     grWriteln( "g, v        adjust gamma value" );
+    grWriteln( "T           toggle performance HUD" );
     /*          |----------------------------------|    |----------------------------------| */
     grLn();
     grLn();
@@ -1333,14 +1335,20 @@
   static int
   Process_Event( void )
   {
-    grEvent  event;
-    int      ret = 0;
+    static grEvent  event;   /* kept to replay merged repetitions */
+    int             ret = 0;
+    int             steps;
 
-    if ( *status.keys )
-      event.key = grKEY( *status.keys++ );
+    if ( event.count > 1 )
+      event.count--;
+    else if ( *status.keys )
+    {
+      event.key   = grKEY( *status.keys++ );
+      event.count = 1;
+    }
     else
     {
-      grListenSurface( display->surface, 0, &event );
+      grListenSurface( display->surface, gr_event_coalesce, &event );
 
       if ( event.type == gr_event_resize )
       {
@@ -1352,6 +1360,34 @@
 
     status.header = NULL;
 
+    /* moving, zooming, and stepping through sizes and glyph indices */
+    /* take all merged repetitions at once; other keys are replayed  */
+    switch ( event.key )
+    {
+    case grKeyLeft:
+    case grKeyRight:
+    case grKeyF7:
+    case grKeyF8:
+    case grKeyF9:
+    case grKeyF10:
+    case grKeyF11:
+    case grKeyF12:
+    case grKeyUp:
+    case grKeyDown:
+    case grKEY( 'i' ):
+    case grKEY( 'k' ):
+    case grKEY( 'j' ):
+    case grKEY( 'l' ):
+    case grKeyPageUp:
+    case grKeyPageDown:
+      steps       = event.count;
+      event.count = 1;
+      break;
+
+    default:
+      steps = 1;
+    }
+
     switch ( event.key )
     {
     case grKeyEsc:
@@ -1464,6 +1500,10 @@
       event_font_change( 0 );
       break;
 
+    case grKEY( 'T' ):
+      handle->hud.shown = !handle->hud.shown;
+      break;
+
     case grKEY( 'G' ):
       status.do_grid = !status.do_grid;
       status.header = status.do_grid ? "grid drawing enabled"
@@ -1554,17 +1594,17 @@
       break;
 #endif /* FT_DEBUG_AUTOFIT */
 
-    case grKeyLeft:     event_index_change(      -1 ); break;
-    case grKeyRight:    event_index_change(       1 ); break;
-    case grKeyF7:       event_index_change(   -0x10 ); break;
-    case grKeyF8:       event_index_change(    0x10 ); break;
-    case grKeyF9:       event_index_change(  -0x100 ); break;
-    case grKeyF10:      event_index_change(   0x100 ); break;
-    case grKeyF11:      event_index_change( -0x1000 ); break;
-    case grKeyF12:      event_index_change(  0x1000 ); break;
+    case grKeyLeft:     event_index_change(      -1 * steps ); break;
+    case grKeyRight:    event_index_change(       1 * steps ); break;
+    case grKeyF7:       event_index_change(   -0x10 * steps ); break;
+    case grKeyF8:       event_index_change(    0x10 * steps ); break;
+    case grKeyF9:       event_index_change(  -0x100 * steps ); break;
+    case grKeyF10:      event_index_change(   0x100 * steps ); break;
+    case grKeyF11:      event_index_change( -0x1000 * steps ); break;
+    case grKeyF12:      event_index_change(  0x1000 * steps ); break;
 
-    case grKeyUp:       event_size_change(  32 ); break;
-    case grKeyDown:     event_size_change( -32 ); break;
+    case grKeyUp:       event_size_change(  32 * steps ); break;
+    case grKeyDown:     event_size_change( -32 * steps ); break;
 
     case grKEY( ' ' ):  event_grid_reset( &status );
 #if 0
@@ -1574,13 +1614,13 @@
 #endif
                         break;
 
-    case grKEY( 'i' ):  event_grid_translate(  0, -1 ); break;
-    case grKEY( 'k' ):  event_grid_translate(  0,  1 ); break;
-    case grKEY( 'j' ):  event_grid_translate( -1,  0 ); break;
-    case grKEY( 'l' ):  event_grid_translate(  1,  0 ); break;
+    case grKEY( 'i' ):  event_grid_translate(      0, -steps ); break;
+    case grKEY( 'k' ):  event_grid_translate(      0,  steps ); break;
+    case grKEY( 'j' ):  event_grid_translate( -steps,      0 ); break;
+    case grKEY( 'l' ):  event_grid_translate(  steps,      0 ); break;
 
-    case grKeyPageUp:   event_grid_zoom(  1 ); break;
-    case grKeyPageDown: event_grid_zoom( -1 ); break;
+    case grKeyPageUp:   event_grid_zoom(  steps ); break;
+    case grKeyPageDown: event_grid_zoom( -steps ); break;
 
     case grKeyF2:       if ( status.mm )
                         {
@@ -1836,6 +1876,9 @@
     if ( !display )
       Fatal( "could not allocate display surface" );
 
+    /* only repaint what changes between frames */
+    grSetSurfaceTracking( display->surface, 1 );
+
     grSetTitle( display->surface,
                 "FreeType Glyph Grid Viewer - press ? for help" );
     FTDemo_Icon( handle, display );
@@ -1849,6 +1892,7 @@
 
     do
     {
+      FTDemo_Frame_Begin( handle );
       FTDemo_Display_Clear( display );
 
       if ( status.do_grid )
@@ -1857,6 +1901,7 @@
       if ( status.work )
         grid_status_draw_outline( &status, handle, display );
 
+      FTDemo_Frame_End( handle, display );
       write_header( 0 );
 
     } while ( !Process_Event() );
@@ -0,0 +1,791 @@
+/****************************************************************************/
+/*                                                                          */
+/*  The FreeType project -- a free and portable quality TrueType renderer.  */
+/*                                                                          */
+/*  Copyright (C) 2022 by                                                   */
+/*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
+/*                                                                          */
+/*                                                                          */
+/*  ftindex.c - persistent index of font file metadata.                     */
+/*                                                                          */
+/****************************************************************************/
+
+
+#ifndef  _GNU_SOURCE
+#define  _GNU_SOURCE /* we use `realpath' */
+#endif
+
+#include "ftindex.h"
+
+#include <freetype/ttnameid.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+
+  /*
+   * The index file starts with a version line, which also gives the
+   * version of FreeType that has opened the fonts.  Each font file has
+   * a line
+   *
+   *   F <size> <mtime> <number of faces> <path>
+   *
+   * followed by one line per face or named instance,
+   *
+   *   <face index> <scalable> <number of charmaps>
+   *     [<encoding> <platform id> <encoding id>]...\t<family>\t<style>
+   *
+   * (without the line break).  Tabs and line breaks in the names are
+   * replaced with spaces.  Paths are absolute; version 1 used them as
+   * given on the command line.  Version 2 did not record the FreeType
+   * version.
+   */
+#define INDEX_VERSION  "ft2demos font index 3"
+
+  /* sanity limits for reading the file */
+#define INDEX_MAX_FACES     0x10000
+#define INDEX_MAX_CHARMAPS  0x100
+
+
+  typedef struct  IndexEntry_
+  {
+    struct IndexEntry_*  next;
+
+    char*           path;
+    unsigned long   hash;
+    unsigned long   size;
+    long            mtime;
+
+    FTIndex_File    file;
+
+  } IndexEntry;
+
+
+  struct  FTIndex_
+  {
+    char*         filename;
+    char          version[64];   /* the first line of the file */
+    int           dirty;
+
+    IndexEntry**  buckets;
+    size_t        num_buckets;   /* a power of 2 */
+    size_t        num_entries;
+
+  };
+
+
+  static unsigned long
+  index_hash( const char*  path )
+  {
+    unsigned long  hash = 2166136261UL;    /* FNV-1a */
+
+
+    for ( ; *path; path++ )
+      hash = ( hash ^ (unsigned char)*path ) * 16777619UL;
+
+    return hash;
+  }
+
+
+  static char*
+  index_strdup( const char*  str )
+  {
+    size_t  len  = strlen( str );
+    char*   copy = (char*)malloc( len + 1 );
+
+
+    if ( copy )
+      memcpy( copy, str, len + 1 );
+
+    return copy;
+  }
+
+
+  /* copy a family or style name; it must fit into a line field */
+  static char*
+  index_name( const char*  name )
+  {
+    char*  copy = index_strdup( name ? name : "" );
+    char*  p;
+
+
+    if ( copy )
+      for ( p = copy; *p; p++ )
+        if ( *p == '\t' || *p == '\n' || *p == '\r' )
+          *p = ' ';
+
+    return copy;
+  }
+
+
+  static void
+  index_free_file( FTIndex_File*  file )
+  {
+    FT_Int  i;
+
+
+    for ( i = 0; i < file->num_faces; i++ )
+    {
+      free( file->faces[i].charmaps );
+      free( file->faces[i].family_name );
+      free( file->faces[i].style_name );
+    }
+    free( file->faces );
+
+    file->num_faces = 0;
+    file->faces     = NULL;
+  }
+
+
+  static void
+  index_free_entry( IndexEntry*  entry )
+  {
+    index_free_file( &entry->file );
+    free( entry->path );
+    free( entry );
+  }
+
+
+  static IndexEntry*
+  index_lookup( FTIndex*       index,
+                const char*    path,
+                unsigned long  hash )
+  {
+    IndexEntry*  entry = index->buckets[hash & ( index->num_buckets - 1 )];
+
+
+    for ( ; entry; entry = entry->next )
+      if ( entry->hash == hash && !strcmp( entry->path, path ) )
+        break;
+
+    return entry;
+  }
+
+
+  static int
+  index_insert( FTIndex*     index,
+                IndexEntry*  entry )
+  {
+    size_t  slot;
+
+
+    if ( index->num_entries >= index->num_buckets )
+    {
+      size_t        num_buckets = index->num_buckets * 2;
+      IndexEntry**  buckets;
+      size_t        i;
+
+
+      buckets = (IndexEntry**)calloc( num_buckets, sizeof ( IndexEntry* ) );
+      if ( !buckets )
+        return -1;
+
+      for ( i = 0; i < index->num_buckets; i++ )
+      {
+        IndexEntry*  cur = index->buckets[i];
+
+
+        while ( cur )
+        {
+          IndexEntry*  next = cur->next;
+
+
+          slot          = cur->hash & ( num_buckets - 1 );
+          cur->next     = buckets[slot];
+          buckets[slot] = cur;
+
+          cur = next;
+        }
+      }
+
+      free( index->buckets );
+      index->buckets     = buckets;
+      index->num_buckets = num_buckets;
+    }
+
+    slot                  = entry->hash & ( index->num_buckets - 1 );
+    entry->next           = index->buckets[slot];
+    index->buckets[slot]  = entry;
+    index->num_entries   += 1;
+
+    return 0;
+  }
+
+
+  static void
+  index_remove( FTIndex*     index,
+                IndexEntry*  entry )
+  {
+    IndexEntry**  pentry =
+                    &index->buckets[entry->hash & ( index->num_buckets - 1 )];
+
+
+    while ( *pentry != entry )
+      pentry = &(*pentry)->next;
+
+    *pentry             = entry->next;
+    index->num_entries -= 1;
+
+    index_free_entry( entry );
+  }
+
+
+  /* read a line of any length, without the line break; NULL at the end */
+  static char*
+  index_read_line( FILE*    stream,
+                   char**   abuffer,
+                   size_t*  asize )
+  {
+    size_t  len = 0;
+
+
+    for (;;)
+    {
+      if ( *asize - len < 2 )
+      {
+        size_t  size   = *asize ? *asize * 2 : 1024;
+        char*   buffer = (char*)realloc( *abuffer, size );
+
+
+        if ( !buffer )
+          return NULL;
+
+        *abuffer = buffer;
+        *asize   = size;
+      }
+
+      if ( !fgets( *abuffer + len, (int)( *asize - len ), stream ) )
+        return len ? *abuffer : NULL;
+
+      len += strlen( *abuffer + len );
+      if ( len && (*abuffer)[len - 1] == '\n' )
+      {
+        (*abuffer)[--len] = '\0';
+        return *abuffer;
+      }
+    }
+  }
+
+
+  static int
+  index_parse_face( char*          line,
+                    FTIndex_Face*  face )
+  {
+    char*          p = line;
+    char*          tab;
+    long           face_index, scalable, num_charmaps;
+    unsigned long  values[3];
+    FT_Int         i, k;
+
+
+    face_index   = strtol( p, &p, 10 );
+    scalable     = strtol( p, &p, 10 );
+    num_charmaps = strtol( p, &p, 10 );
+    if ( face_index < 0                                     ||
+         num_charmaps < 0 || num_charmaps > INDEX_MAX_CHARMAPS )
+      return -1;
+
+    face->face_index   = face_index;
+    face->scalable     = scalable != 0;
+    face->num_charmaps = 0;
+    face->charmaps     = NULL;
+    face->family_name  = NULL;
+    face->style_name   = NULL;
+
+    if ( num_charmaps )
+    {
+      face->charmaps = (FTIndex_CharMap*)malloc( (size_t)num_charmaps *
+                                                 sizeof ( FTIndex_CharMap ) );
+      if ( !face->charmaps )
+        return -1;
+      face->num_charmaps = (FT_Int)num_charmaps;
+    }
+
+    for ( i = 0; i < num_charmaps; i++ )
+    {
+      for ( k = 0; k < 3; k++ )
+      {
+        char*  end;
+
+
+        values[k] = strtoul( p, &end, 10 );
+        if ( end == p )
+          return -1;
+        p = end;
+      }
+
+      face->charmaps[i].encoding    = (FT_Encoding)values[0];
+      face->charmaps[i].platform_id = (FT_UShort)values[1];
+      face->charmaps[i].encoding_id = (FT_UShort)values[2];
+    }
+
+    if ( *p++ != '\t' )
+      return -1;
+    tab = strchr( p, '\t' );
+    if ( !tab )
+      return -1;
+    *tab = '\0';
+
+    face->family_name = index_strdup( p );
+    face->style_name  = index_strdup( tab + 1 );
+    if ( !face->family_name || !face->style_name )
+      return -1;
+
+    return 0;
+  }
+
+
+  /* read the index file; stop at the first malformed entry */
+  static void
+  index_load( FTIndex*  index )
+  {
+    FILE*   stream = fopen( index->filename, "r" );
+    char*   buffer = NULL;
+    size_t  size   = 0;
+    char*   line;
+
+
+    if ( !stream )
+      return;
+
+    line = index_read_line( stream, &buffer, &size );
+    if ( !line || strcmp( line, index->version ) )
+      goto Exit;
+
+    while ( ( line = index_read_line( stream, &buffer, &size ) ) != NULL )
+    {
+      IndexEntry*    entry;
+      unsigned long  file_size;
+      long           mtime;
+      int            num_faces, pos = 0;
+      FT_Int         i;
+
+
+      if ( sscanf( line, "F %lu %ld %d %n",
+                   &file_size, &mtime, &num_faces, &pos ) != 3 ||
+           !pos || !line[pos]                                  ||
+           num_faces < 0 || num_faces > INDEX_MAX_FACES        )
+        break;
+
+      entry = (IndexEntry*)calloc( 1, sizeof ( IndexEntry ) );
+      if ( !entry )
+        break;
+
+      entry->path  = index_strdup( line + pos );
+      entry->hash  = entry->path ? index_hash( entry->path ) : 0;
+      entry->size  = file_size;
+      entry->mtime = mtime;
+
+      if ( num_faces )
+        entry->file.faces = (FTIndex_Face*)calloc( (size_t)num_faces,
+                                                   sizeof ( FTIndex_Face ) );
+
+      if ( !entry->path || ( num_faces && !entry->file.faces ) )
+      {
+        index_free_entry( entry );
+        break;
+      }
+
+      for ( i = 0; i < num_faces; i++ )
+      {
+        line = index_read_line( stream, &buffer, &size );
+
+        /* count the face first so that it gets freed in any case */
+        entry->file.num_faces++;
+        if ( !line || index_parse_face( line, entry->file.faces + i ) )
+          break;
+      }
+
+      if ( i < num_faces                               ||
+           index_lookup( index, entry->path, entry->hash ) ||
+           index_insert( index, entry )                    )
+      {
+        index_free_entry( entry );
+        break;
+      }
+    }
+
+  Exit:
+    free( buffer );
+    fclose( stream );
+  }
+
+
+  static void
+  index_save( FTIndex*  index )
+  {
+    size_t  len      = strlen( index->filename );
+    char*   tempname = (char*)malloc( len + 5 );
+    FILE*   stream;
+    size_t  i;
+    int     failed;
+
+
+    if ( !tempname )
+      return;
+
+    memcpy( tempname, index->filename, len );
+    memcpy( tempname + len, ".tmp", 5 );
+
+    stream = fopen( tempname, "w" );
+    if ( !stream )
+    {
+      free( tempname );
+      return;
+    }
+
+    fprintf( stream, "%s\n", index->version );
+
+    for ( i = 0; i < index->num_buckets; i++ )
+    {
+      IndexEntry*  entry;
+
+
+      for ( entry = index->buckets[i]; entry; entry = entry->next )
+      {
+        FT_Int  j, k;
+
+
+        fprintf( stream, "F %lu %ld %d %s\n",
+                 entry->size, entry->mtime, entry->file.num_faces,
+                 entry->path );
+
+        for ( j = 0; j < entry->file.num_faces; j++ )
+        {
+          FTIndex_Face*  face = entry->file.faces + j;
+
+
+          fprintf( stream, "%ld %d %d",
+                   face->face_index, face->scalable, face->num_charmaps );
+          for ( k = 0; k < face->num_charmaps; k++ )
+            fprintf( stream, " %lu %u %u",
+                     (unsigned long)face->charmaps[k].encoding,
+                     face->charmaps[k].platform_id,
+                     face->charmaps[k].encoding_id );
+          fprintf( stream, "\t%s\t%s\n",
+                   face->family_name, face->style_name );
+        }
+      }
+    }
+
+    failed = ferror( stream );
+    if ( fclose( stream ) || failed )
+      remove( tempname );
+    else
+    {
+#ifdef _WIN32
+      /* `rename' does not replace existing files on Windows */
+      remove( index->filename );
+#endif
+      if ( rename( tempname, index->filename ) )
+        remove( tempname );
+    }
+
+    free( tempname );
+  }
+
+
+  /* Return `filepath' as an absolute path without `.', `..', or     */
+  /* symbolic links, so that a file has a single entry however it is */
+  /* named, or as given if that fails; NULL if out of memory.         */
+  static char*
+  index_canonical_path( const char*  filepath )
+  {
+    char*  path;
+
+
+#if defined( _WIN32 )
+    path = _fullpath( NULL, filepath, 0 );
+#elif defined( __unix__ ) || defined( __APPLE__ )
+    path = realpath( filepath, NULL );
+#else
+    path = NULL;
+#endif
+
+    return path ? path : index_strdup( filepath );
+  }
+
+
+  /* open all faces and named instances of `filepath' */
+  static FT_Error
+  index_scan( FT_Library     library,
+              const char*    filepath,
+              FTIndex_File*  file )
+  {
+    FT_Error  error;
+    FT_Face   face;
+    FT_Long   i, j, num_faces, num_instances;
+    FT_Int    max_faces = 0;
+
+
+    /* We use a conservative approach here, at the cost of calling     */
+    /* `FT_New_Face' quite often.  The idea is that our demo programs  */
+    /* should be able to try all faces and named instances of a font,  */
+    /* expecting that some faces don't work for various reasons, e.g., */
+    /* a broken subfont, or an unsupported NFNT bitmap font in a Mac   */
+    /* dfont resource that holds more than a single font.              */
+
+    error = FT_New_Face( library, filepath, -1, &face );
+    if ( error )
+      return error;
+    num_faces = face->num_faces;
+    FT_Done_Face( face );
+
+    for ( i = 0; i < num_faces; i++ )
+    {
+      error = FT_New_Face( library, filepath, -( i + 1 ), &face );
+      if ( error )
+        continue;
+      num_instances = face->style_flags >> 16;
+      FT_Done_Face( face );
+
+      /* load face with and without named instances */
+      for ( j = 0; j < num_instances + 1; j++ )
+      {
+        FTIndex_Face*  rec;
+        FT_Int         k;
+
+
+        error = FT_New_Face( library, filepath, ( j << 16 ) + i, &face );
+        if ( error )
+          continue;
+
+        if ( file->num_faces == max_faces )
+        {
+          FTIndex_Face*  faces;
+
+
+          max_faces = max_faces ? max_faces * 2 : 4;
+          faces     = (FTIndex_Face*)realloc( file->faces,
+                                              (size_t)max_faces *
+                                                sizeof ( FTIndex_Face ) );
+          if ( !faces )
+            goto Fail;
+          file->faces = faces;
+        }
+
+        rec = file->faces + file->num_faces++;
+
+        rec->face_index   = ( j << 16 ) + i;
+        rec->scalable     = FT_IS_SCALABLE( face ) != 0;
+        rec->num_charmaps = 0;
+        rec->charmaps     = NULL;
+        rec->family_name  = index_name( face->family_name );
+        rec->style_name   = index_name( face->style_name );
+        if ( !rec->family_name || !rec->style_name )
+          goto Fail;
+
+        if ( face->num_charmaps > 0 )
+        {
+          rec->charmaps = (FTIndex_CharMap*)malloc(
+                            (size_t)face->num_charmaps *
+                              sizeof ( FTIndex_CharMap ) );
+          if ( !rec->charmaps )
+            goto Fail;
+          rec->num_charmaps = face->num_charmaps;
+        }
+
+        for ( k = 0; k < face->num_charmaps; k++ )
+        {
+          rec->charmaps[k].encoding    = face->charmaps[k]->encoding;
+          rec->charmaps[k].platform_id = face->charmaps[k]->platform_id;
+          rec->charmaps[k].encoding_id = face->charmaps[k]->encoding_id;
+        }
+
+        FT_Done_Face( face );
+      }
+    }
+
+    return FT_Err_Ok;
+
+  Fail:
+    FT_Done_Face( face );
+    index_free_file( file );
+    return FT_Err_Out_Of_Memory;
+  }
+
+
+  FTIndex*
+  ftindex_new( FT_Library   library,
+               const char*  filename )
+  {
+    FTIndex*  index = (FTIndex*)calloc( 1, sizeof ( FTIndex ) );
+    FT_Int    major, minor, patch;
+
+
+    if ( !index )
+      return NULL;
+
+    /* what FreeType finds in a font may change with its version */
+    FT_Library_Version( library, &major, &minor, &patch );
+    sprintf( index->version, "%s (FreeType %d.%d.%d)",
+             INDEX_VERSION, major, minor, patch );
+
+    index->num_buckets = 256;
+    index->buckets     = (IndexEntry**)calloc( index->num_buckets,
+                                               sizeof ( IndexEntry* ) );
+    if ( !index->buckets )
+    {
+      free( index );
+      return NULL;
+    }
+
+    if ( filename && *filename )
+    {
+      index->filename = index_strdup( filename );
+      if ( index->filename )
+        index_load( index );
+    }
+
+    return index;
+  }
+
+
+  void
+  ftindex_done( FTIndex*  index )
+  {
+    size_t  i;
+
+
+    if ( !index )
+      return;
+
+    if ( index->filename && index->dirty )
+      index_save( index );
+
+    for ( i = 0; i < index->num_buckets; i++ )
+    {
+      IndexEntry*  entry = index->buckets[i];
+
+
+      while ( entry )
+      {
+        IndexEntry*  next = entry->next;
+
+
+        index_free_entry( entry );
+        entry = next;
+      }
+    }
+
+    free( index->buckets );
+    free( index->filename );
+    free( index );
+  }
+
+
+  FT_Error
+  ftindex_get_file( FTIndex*        index,
+                    FT_Library      library,
+                    const char*     filepath,
+                    FTIndex_File**  afile )
+  {
+    struct stat    st;
+    char*          path;
+    unsigned long  hash;
+    IndexEntry*    entry;
+    FT_Error       error;
+
+
+    *afile = NULL;
+
+    if ( stat( filepath, &st ) )
+      return FT_Err_Cannot_Open_Resource;
+
+    path = index_canonical_path( filepath );
+    if ( !path )
+      return FT_Err_Out_Of_Memory;
+
+    hash  = index_hash( path );
+    entry = index_lookup( index, path, hash );
+    if ( entry                                         &&
+         entry->size  == (unsigned long)st.st_size     &&
+         entry->mtime == (long)st.st_mtime             )
+    {
+      free( path );
+
+      *afile = &entry->file;
+      return FT_Err_Ok;
+    }
+
+    if ( entry )
+    {
+      index_remove( index, entry );
+      index->dirty = 1;
+    }
+
+    entry = (IndexEntry*)calloc( 1, sizeof ( IndexEntry ) );
+    if ( !entry )
+    {
+      free( path );
+      return FT_Err_Out_Of_Memory;
+    }
+
+    entry->path  = path;
+    entry->hash  = hash;
+    entry->size  = (unsigned long)st.st_size;
+    entry->mtime = (long)st.st_mtime;
+
+    error = index_scan( library, filepath, &entry->file );
+
+    /* files that are not fonts at all are not indexed */
+    if ( !error && index_insert( index, entry ) )
+      error = FT_Err_Out_Of_Memory;
+    if ( error )
+    {
+      index_free_entry( entry );
+      return error;
+    }
+
+    index->dirty = 1;
+    *afile       = &entry->file;
+
+    return FT_Err_Ok;
+  }
+
+
+  FT_Int
+  ftindex_select_charmap( const FTIndex_Face*  face,
+                          FT_Encoding          encoding )
+  {
+    FT_Int  i;
+
+
+    if ( encoding == FT_ENCODING_NONE )
+      return face->num_charmaps;
+
+    /* this follows `find_unicode_charmap' of FreeType: prefer UCS-4 */
+    /* charmaps, which are usually the last ones                      */
+    if ( encoding == FT_ENCODING_UNICODE )
+    {
+      for ( i = face->num_charmaps - 1; i >= 0; i-- )
+      {
+        const FTIndex_CharMap*  cmap = face->charmaps + i;
+
+
+        if ( cmap->encoding == FT_ENCODING_UNICODE                 &&
+             ( ( cmap->platform_id == TT_PLATFORM_MICROSOFT      &&
+                 cmap->encoding_id == TT_MS_ID_UCS_4             ) ||
+               ( cmap->platform_id == TT_PLATFORM_APPLE_UNICODE  &&
+                 cmap->encoding_id == TT_APPLE_ID_UNICODE_32     ) ) )
+          return i;
+      }
+
+      for ( i = face->num_charmaps - 1; i >= 0; i-- )
+        if ( face->charmaps[i].encoding == FT_ENCODING_UNICODE )
+          return i;
+
+      return face->num_charmaps;
+    }
+
+    for ( i = 0; i < face->num_charmaps; i++ )
+      if ( face->charmaps[i].encoding == encoding )
+        return i;
+
+    return face->num_charmaps;
+  }
+
+
+/* End */
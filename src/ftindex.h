@@ -0,0 +1,116 @@
+/****************************************************************************/
+/*                                                                          */
+/*  The FreeType project -- a free and portable quality TrueType renderer.  */
+/*                                                                          */
+/*  Copyright (C) 2022 by                                                   */
+/*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
+/*                                                                          */
+/*                                                                          */
+/*  ftindex.h - persistent index of font file metadata.                     */
+/*                                                                          */
+/****************************************************************************/
+
+
+#ifndef FTINDEX_H
+#define FTINDEX_H
+
+#include <ft2build.h>
+#include <freetype/freetype.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+  /*
+   * Finding all faces and named instances of a font file means opening
+   * it once per face and instance.  The font index remembers what has
+   * been found, keyed by the absolute path (with symbolic links
+   * resolved), size, and modification time of the file, so that
+   * unchanged files need not be opened again, neither in the current
+   * run nor, if the index has a file name, in the next one.
+   *
+   * The index file is plain text.  It is read when the index is created
+   * and rewritten by `ftindex_done' if anything has changed.  Entries of
+   * files not looked up in a run are kept.  The whole file is discarded
+   * if it was written with another version of FreeType.
+   */
+  typedef struct FTIndex_  FTIndex;
+
+
+  typedef struct  FTIndex_CharMap_
+  {
+    FT_Encoding  encoding;
+    FT_UShort    platform_id;
+    FT_UShort    encoding_id;
+
+  } FTIndex_CharMap;
+
+
+  /* a face or named instance that could be opened */
+  typedef struct  FTIndex_Face_
+  {
+    FT_Long           face_index;    /* including the instance index */
+    FT_Bool           scalable;
+
+    FT_Int            num_charmaps;
+    FTIndex_CharMap*  charmaps;
+
+    char*             family_name;   /* never NULL */
+    char*             style_name;    /* never NULL */
+
+  } FTIndex_Face;
+
+
+  typedef struct  FTIndex_File_
+  {
+    FT_Int         num_faces;
+    FTIndex_Face*  faces;
+
+  } FTIndex_File;
+
+
+  /*
+   * Create an index for the FreeType version of `library', reading
+   * `filename' if it exists.  If `filename' is NULL, the index is only
+   * kept in memory.  Return NULL if out of memory.
+   */
+  extern FTIndex*
+  ftindex_new( FT_Library   library,
+               const char*  filename );
+
+
+  /* Save the index if it has a file name and has changed, then free it. */
+  extern void
+  ftindex_done( FTIndex*  index );
+
+
+  /*
+   * Return the faces of font file `filepath', using `library' to open
+   * it if the index has no entry or an outdated one.  The result stays
+   * valid until the index is destroyed.
+   */
+  extern FT_Error
+  ftindex_get_file( FTIndex*        index,
+                    FT_Library      library,
+                    const char*     filepath,
+                    FTIndex_File**  afile );
+
+
+  /*
+   * Return the index of the charmap that `FT_Select_Charmap' would
+   * select for `encoding', or `face->num_charmaps' if there is none.
+   */
+  extern FT_Int
+  ftindex_select_charmap( const FTIndex_Face*  face,
+                          FT_Encoding          encoding );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTINDEX_H */
+
+
+/* End */
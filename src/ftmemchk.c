@@ -27,89 +27,193 @@
 /****************************************************************************/
 /****************************************************************************/
 
-/* Our own memory allocator. To check that a single block isn't freed */
-/* several time, we simply do not call "free"..                       */
+/* Our own memory allocator.  To check that a single block isn't freed   */
+/* several times, we simply do not call `free'.  Every block is recorded */
+/* in a hash table indexed by its address, together with its size, the   */
+/* phase it was allocated in, and its birth time, measured in allocator  */
+/* calls.  This gives us size and lifetime statistics for each phase.    */
 
-#define MAX_RECORDED_BLOCKS  1638400
-#define CHECK_DUPLICATES
+typedef enum  MyPhase_
+{
+  PHASE_LIBRARY,
+  PHASE_FACE_OPEN,
+  PHASE_SIZE_SET,
+  PHASE_GLYPH_LOAD,
+  PHASE_RENDER,
+  PHASE_FACE_DONE,
+
+  PHASE_MAX
+
+} MyPhase;
+
+static const char*  phase_names[PHASE_MAX] =
+{
+  "library", "face open", "size set", "glyph load", "render", "face done"
+};
+
+static MyPhase  current_phase = PHASE_LIBRARY;
+
+
+/* size class `n' holds blocks in the range ]2^(n-1),2^n]; */
+/* lifetime class `n' blocks living less than 2^n calls    */
+#define NUM_SIZE_CLASSES      32
+#define NUM_LIFETIME_CLASSES  32
 
 typedef  struct MyBlock
 {
-  void*  base;
-  long   size;
+  void*          base;
+  long           size;   /* zero if the block has been released */
+  unsigned long  birth;
+  MyPhase        phase;
 
 } MyBlock;
 
-static  MyBlock my_blocks[ MAX_RECORDED_BLOCKS ];
-static  int     num_my_blocks = 0;
+typedef  struct MyPhaseStats
+{
+  unsigned long  num_allocs;
+  unsigned long  num_reallocs;
+  unsigned long  num_frees;
+  unsigned long  num_transient;  /* blocks released in their own phase */
+  unsigned long  num_released;   /* blocks of this phase released ever */
+  double         bytes;
+
+  unsigned long  sizes[NUM_SIZE_CLASSES];
+  unsigned long  lifetimes[NUM_LIFETIME_CLASSES];
+
+} MyPhaseStats;
+
+static  MyBlock*       my_blocks;
+static  unsigned long  my_blocks_max;  /* table size, a power of 2 */
+static  unsigned long  num_my_blocks;
+
+static  unsigned long  my_clock;       /* number of allocator calls */
+static  long           live_bytes;
+static  long           peak_live_bytes;
+
+static  MyPhaseStats   phase_stats[PHASE_MAX];
+
+
+static
+unsigned int  size_class( unsigned long  value )
+{
+  unsigned int  n = 0;
+
+  while ( n < NUM_SIZE_CLASSES - 1 && ( 1UL << n ) < value )
+    n++;
+
+  return n;
+}
+
+/* return the slot for `base', or the empty slot where it belongs */
+static
+MyBlock*  find_my_block( void*  base )
+{
+  unsigned long  mask = my_blocks_max - 1;
+  unsigned long  idx;
 
+  /* Fibonacci hashing; the lowest bits are always zero */
+  idx = ( ( (unsigned long)(size_t)base >> 4 ) * 2654435761UL ) & mask;
+
+  while ( my_blocks[idx].base && my_blocks[idx].base != base )
+    idx = ( idx + 1 ) & mask;
+
+  return my_blocks + idx;
+}
+
+static
+void  grow_my_blocks( void )
+{
+  MyBlock*       old     = my_blocks;
+  unsigned long  old_max = my_blocks_max;
+  unsigned long  n;
+
+  my_blocks_max = old_max ? 2 * old_max : 65536;
+  my_blocks     = (MyBlock*)calloc( my_blocks_max, sizeof ( MyBlock ) );
+  if ( !my_blocks )
+  {
+    fprintf( stderr, "Too many memory blocks -- test exited !!\n" );
+    exit(1);
+  }
+
+  for ( n = 0; n < old_max; n++ )
+    if ( old[n].base )
+      *find_my_block( old[n].base ) = old[n];
+
+  free( old );
+}
 
 /* record a new block in the table, check for duplicates too */
 static
 void  record_my_block( void*  base, long  size )
 {
+  MyBlock*       block;
+  MyPhaseStats*  stats = phase_stats + current_phase;
+
   if (size <= 0)
   {
     fprintf( stderr, "adding a block with non-positive length - should not happen \n" );
     exit(1);
   }
 
-  if ( num_my_blocks < MAX_RECORDED_BLOCKS )
-  {
-    MyBlock*  block;
+  /* keep the load factor below 1/2 */
+  if ( 2 * ( num_my_blocks + 1 ) > my_blocks_max )
+    grow_my_blocks();
 
-#ifdef CHECK_DUPLICATES
-    MyBlock*  limit;
-    block = my_blocks;
-    limit = block + num_my_blocks;
-    for ( ; block < limit; block++ )
-    {
-      if ( block->base == base && block->size != 0 )
-      {
-        fprintf( stderr, "duplicate memory block at %p\n", block->base );
-        exit(1);
-      }
-    }
-#endif
-
-    block = my_blocks + num_my_blocks++;
-    block->base = base;
-    block->size = size;
-  }
-  else
+  block = find_my_block( base );
+  if ( block->base && block->size != 0 )
   {
-    fprintf( stderr, "Too many memory blocks -- test exited !!\n" );
+    fprintf( stderr, "duplicate memory block at %p\n", block->base );
     exit(1);
   }
+
+  if ( !block->base )
+    num_my_blocks++;
+
+  block->base  = base;
+  block->size  = size;
+  block->birth = my_clock;
+  block->phase = current_phase;
+
+  stats->num_allocs++;
+  stats->bytes += size;
+  stats->sizes[size_class( (unsigned long)size )]++;
+
+  live_bytes += size;
+  if ( live_bytes > peak_live_bytes )
+    peak_live_bytes = live_bytes;
 }
 
 /* forget a block, and check that it isn't part of our table already */
 static
 void  forget_my_block( void*  base )
 {
-  MyBlock*  block = my_blocks + num_my_blocks-1;
+  MyBlock*       block;
+  MyPhaseStats*  stats;
 
-  /* we scan in reverse, because transient blocks are always located */
-  /* at the end of the table.. (it supposedly faster then..)         */
-  for ( ; block >= my_blocks; block-- )
+  block = my_blocks_max ? find_my_block( base ) : NULL;
+  if ( !block || !block->base )
   {
-    if ( block->base == base )
-    {
-      if (block->size > 0)
-      {
-        block->size = 0;
-        return;
-      }
-      else
-      {
-        fprintf( stderr, "Block at %p released twice \n", base );
-        exit(1);
-      }
-    }
+    fprintf( stderr, "Trying to release an unallocated block at %p\n",
+                     base );
+    exit(1);
+  }
+
+  if ( block->size == 0 )
+  {
+    fprintf( stderr, "Block at %p released twice \n", base );
+    exit(1);
   }
-  fprintf( stderr, "Trying to release an unallocated block at %p\n",
-                   base );
-  exit(1);
+
+  stats = phase_stats + block->phase;
+  stats->num_released++;
+  stats->lifetimes[size_class( my_clock - block->birth + 1 )]++;
+  if ( block->phase == current_phase )
+    stats->num_transient++;
+
+  phase_stats[current_phase].num_frees++;
+
+  live_bytes  -= block->size;
+  block->size  = 0;
 }
 
 static
@@ -117,6 +221,8 @@ void*  my_alloc( FT_Memory  memory,
                  long       size )
 {
   void*  p = malloc(size);
+
+  my_clock++;
   if (p)
     record_my_block(p,size);
 
@@ -128,6 +234,7 @@ static
 void  my_free( FT_Memory  memory,
                void*      block )
 {
+  my_clock++;
   memory=memory;
   forget_my_block(block);
   /* free(block);  WE DO NOT REALLY FREE THE BLOCK */
@@ -141,6 +248,8 @@ void*  my_realloc( FT_Memory  memory,
 {
   void*  p;
 
+  phase_stats[current_phase].num_reallocs++;
+
   p = my_alloc( memory, new_size );
   if (p)
   {
@@ -180,16 +289,16 @@ static FT_Memory  my_memory( void )
 
 static void  dump_mem( void )
 {
-  MyBlock*  block = my_blocks + num_my_blocks-1;
-  int       bad   = 0;
+  unsigned long  n;
+  int            bad   = 0;
 
-  printf( "total allocated blocks = %d\n", num_my_blocks );
+  printf( "total allocated blocks = %lu\n", num_my_blocks );
 
-  /* we scan in reverse, because transient blocks are always located */
-  /* at the end of the table.. (it supposedly faster then..)         */
-  for ( ; block >= my_blocks; block-- )
+  for ( n = 0; n < my_blocks_max; n++ )
   {
-    if (block->size > 0)
+    MyBlock*  block = my_blocks + n;
+
+    if (block->base && block->size > 0)
     {
       fprintf( stderr, "%p (%6ld bytes) leaked !!\n", block->base, (long)block->size );
       bad = 1;
@@ -199,6 +308,82 @@ static void  dump_mem( void )
     fprintf( stderr, "no leaked memory block\n\n" );
 }
 
+/* print a histogram with one column per phase, omitting empty rows */
+static void  dump_histogram( const char*  title,
+                             int          lifetimes )
+{
+  int  n, p;
+
+  printf( "\n%s\n\n", title );
+  printf( "%12s", lifetimes ? "< calls" : "<= bytes" );
+  for ( p = 0; p < PHASE_MAX; p++ )
+    printf( " %11s", phase_names[p] );
+  printf( "\n" );
+
+  for ( n = 0; n < ( lifetimes ? NUM_LIFETIME_CLASSES : NUM_SIZE_CLASSES ); n++ )
+  {
+    unsigned long  total = 0;
+
+    for ( p = 0; p < PHASE_MAX; p++ )
+      total += lifetimes ? phase_stats[p].lifetimes[n]
+                         : phase_stats[p].sizes[n];
+    if ( !total )
+      continue;
+
+    printf( "%12lu", 1UL << n );
+    for ( p = 0; p < PHASE_MAX; p++ )
+      printf( " %11lu", lifetimes ? phase_stats[p].lifetimes[n]
+                                  : phase_stats[p].sizes[n] );
+    printf( "\n" );
+  }
+
+  if ( lifetimes )
+  {
+    printf( "%12s", "never" );
+    for ( p = 0; p < PHASE_MAX; p++ )
+      printf( " %11lu",
+              phase_stats[p].num_allocs - phase_stats[p].num_released );
+    printf( "\n" );
+  }
+}
+
+static void  dump_stats( void )
+{
+  int  p;
+
+  printf( "\n"
+          "allocator calls = %lu, peak live memory = %ld bytes\n"
+          "\n",
+          my_clock, peak_live_bytes );
+
+  printf( "%-11s %11s %11s %11s %13s %11s %10s\n",
+          "phase", "allocs", "reallocs", "frees", "bytes",
+          "avg. size", "transient" );
+  for ( p = 0; p < PHASE_MAX; p++ )
+  {
+    MyPhaseStats*  stats = phase_stats + p;
+
+    printf( "%-11s %11lu %11lu %11lu %13.0f %11.1f %9.1f%%\n",
+            phase_names[p],
+            stats->num_allocs,
+            stats->num_reallocs,
+            stats->num_frees,
+            stats->bytes,
+            stats->num_allocs ? stats->bytes / stats->num_allocs : 0.0,
+            stats->num_allocs
+              ? 100.0 * stats->num_transient / stats->num_allocs
+              : 0.0 );
+  }
+
+  printf( "\n"
+          "`transient' blocks are released in the phase that allocated\n"
+          "them; these are candidates for a pool or arena allocator.\n" );
+
+  dump_histogram( "block sizes, by allocating phase", 0 );
+  dump_histogram( "block lifetimes in allocator calls, by allocating phase",
+                  1 );
+}
+
 /****************************************************************************/
 /****************************************************************************/
 /****************************************************************************/
@@ -207,8 +392,8 @@ static void  dump_mem( void )
 
   static void  Usage( char*  name )
   {
-    printf( "ftmemchk: simple memory tester -- part of the FreeType project\n" );
-    printf( "--------------------------------------------------------------\n" );
+    printf( "ftmemchk: memory tester and allocation profiler -- part of the FreeType project\n" );
+    printf( "--------------------------------------------------------------------------------\n" );
     printf( "\n" );
     printf( "Usage: %s ppem fontname[.ttf|.ttc] [fontname2..]\n", name );
     printf( "\n" );
@@ -287,6 +472,7 @@ int  main( int argc, char** argv )
       printf( "%s: ", fname );
 
       /* Load face */
+      current_phase = PHASE_FACE_OPEN;
       error = FT_New_Face( library, filename, 0, &face );
       if (error)
       {
@@ -300,6 +486,7 @@ int  main( int argc, char** argv )
 
       num_glyphs = face->num_glyphs;
 
+      current_phase = PHASE_SIZE_SET;
       error = FT_Set_Char_Size( face, ptsize << 6, ptsize << 6, 72, 72 );
       if (error) Panic( "Could not set character size" );
 
@@ -307,7 +494,14 @@ int  main( int argc, char** argv )
       {
         for ( id = 0; id < num_glyphs; id++ )
         {
-          error = FT_Load_Glyph( face, id, FT_LOAD_RENDER );
+          /* load and render separately to attribute the allocations */
+          current_phase = PHASE_GLYPH_LOAD;
+          error = FT_Load_Glyph( face, id, FT_LOAD_DEFAULT );
+          if (!error)
+          {
+            current_phase = PHASE_RENDER;
+            error = FT_Render_Glyph( face->glyph, FT_RENDER_MODE_NORMAL );
+          }
           if (error)
           {
             if ( Fail < 10 )
@@ -325,12 +519,15 @@ int  main( int argc, char** argv )
         else
           printf( "%d fails.\n", Fail );
 
+      current_phase = PHASE_FACE_DONE;
       FT_Done_Face( face );
+      current_phase = PHASE_LIBRARY;
     }
 
     FT_Done_FreeType(library);
 
     dump_mem();
+    dump_stats();
 
     exit( 0 );      /* for safety reasons */
     return 0;       /* never reached */
@@ -277,6 +277,8 @@
     grWriteln( "  Space     : cycle through color" );
     grWriteln( "  Tab       : cycle through sample strings" );
     grWriteln( "  V         : toggle vertical rendering" );
+    grWriteln( "  c         : show glyph cache hits since last time" );
+    grWriteln( "  T         : toggle performance HUD" );
     grLn();
     grWriteln( "  g, v      : adjust gamma by 0.1" );
     grLn();
@@ -478,6 +480,157 @@
   }
 
 
+  /* A waterfall row, drawn at vertical position 0; it depends on the */
+  /* size, the text, the string context, and the display width.       */
+  typedef struct  TWaterfallKey_
+  {
+    int          pt_size;
+    int          width;
+    const char*  text;
+    int          kerning_mode;
+    int          kerning_degree;
+    FT_Fixed     center;
+    FT_Matrix    matrix;
+    FT_Pos       extent;
+    int          offset;
+
+  } TWaterfallKey;
+
+
+  /* set `*aloaded' if the string had to be loaded at `pt_size' */
+  static FTDemo_Row*
+  waterfall_row( FTDemo_Display*  disp,
+                 int              pt_size,
+                 int*             aloaded )
+  {
+    TWaterfallKey          key;
+    FTDemo_Row*            row;
+    FT_Size                size;
+    FTDemo_String_Context  sc = status.sc;
+
+
+    sc.vertical = 0;
+
+    FTDemo_Set_Current_Charsize( handle, pt_size, status.res );
+
+    memset( &key, 0, sizeof ( key ) );
+    key.pt_size        = pt_size;
+    key.width          = disp->bitmap->width;
+    key.text           = status.text;
+    key.kerning_mode   = sc.kerning_mode;
+    key.kerning_degree = sc.kerning_degree;
+    key.center         = sc.center;
+    key.extent         = sc.extent;
+    key.offset         = sc.offset;
+
+    if ( sc.matrix )
+      key.matrix = *sc.matrix;
+    else
+    {
+      key.matrix.xx = key.matrix.yy = 0x10000L;
+      key.matrix.xy = key.matrix.yx = 0;
+    }
+
+    row = FTDemo_Row_Lookup( handle, disp, &key, sizeof ( key ) );
+    if ( row )
+      return row;
+
+    row = FTDemo_Row_Record( handle, disp, &key, sizeof ( key ) );
+    if ( !row )
+      return NULL;
+
+    FTDemo_String_Load( handle, &status.sc );
+    *aloaded = 1;
+
+    row->error = FTDemo_Get_Size( handle, &size );
+    if ( !row->error )
+    {
+      row->metrics = size->metrics;
+
+      FTDemo_String_Draw( handle, disp, &sc,
+                          FT_MulFix( disp->bitmap->width, sc.center ), 0 );
+    }
+
+    return FTDemo_Row_End( handle );
+  }
+
+
+  /* the point sizes of a waterfall around `mid_size' for `rows' */
+  /* pixels follow `*pt_size'                                     */
+  static int
+  waterfall_step( int   rows,
+                  int   mid_size,
+                  int*  pt_size )
+  {
+    int  pt_height = 64 * 72 * rows / status.res;
+    int  step      = ( mid_size * mid_size / pt_height + 64 ) & ~63;
+
+
+    *pt_size = mid_size - step * ( mid_size / step );  /* remainder */
+
+    return step;
+  }
+
+
+  /* the display as seen by `waterfall_prefetch' */
+  static FTDemo_Display  prefetch_display;
+  static grBitmap        prefetch_bitmap;
+
+
+  /* While waiting for input, record the rows of the next smaller and */
+  /* larger waterfall, so that the `Up' and `Down' keys only blit.    */
+  static void
+  waterfall_prefetch( FTDemo_Handle*  h,
+                      void*           data )
+  {
+    static const int  deltas[2] = { 64, -64 };
+
+    int  loaded = 0;
+    int  i;
+
+    FT_UNUSED( data );
+
+
+    for ( i = 0; i < 2; i++ )
+    {
+      int  y        = 40;
+      int  mid_size = status.ptsize + deltas[i];
+      int  pt_size, step;
+
+
+      if ( mid_size < 64 || mid_size > MAXPTSIZE * 64 )
+        continue;
+
+      step = waterfall_step( prefetch_bitmap.rows, mid_size, &pt_size );
+
+      while ( !FTDemo_Idle_Stopping( h ) )
+      {
+        FTDemo_Row*  row;
+
+
+        pt_size += step;
+        if ( pt_size > MAXPTSIZE * 64 )
+          break;
+
+        row = waterfall_row( &prefetch_display, pt_size, &loaded );
+        if ( !row )
+          break;
+        if ( row->error )
+          continue;
+
+        y += ( row->metrics.height >> 6 ) + 1;
+
+        if ( y >= prefetch_bitmap.rows )
+          break;
+      }
+    }
+
+    FTDemo_Set_Current_Charsize( h, status.ptsize, status.res );
+    if ( loaded )
+      FTDemo_String_Load( h, &status.sc );
+  }
+
+
   static int
   Process_Event( void )
   {
@@ -490,8 +643,21 @@
       event.key = grKEY( *status.keys++ );
     else
     {
+      if ( status.render_mode == RENDER_MODE_WATERFALL )
+      {
+        prefetch_bitmap          = *display->bitmap;
+        prefetch_bitmap.buffer   = NULL;
+        prefetch_display         = *display;
+        prefetch_display.bitmap  = &prefetch_bitmap;
+        prefetch_display.surface = NULL;
+
+        FTDemo_Idle_Start( handle, waterfall_prefetch, NULL );
+      }
+
       grListenSurface( display->surface, 0, &event );
 
+      FTDemo_Idle_Stop( handle );
+
       if ( event.type == gr_event_resize )
         return ret;
     }
@@ -593,6 +759,24 @@
                       : "using horizontal layout";
       goto Exit;
 
+    case grKEY( 'T' ):
+      handle->hud.shown = !handle->hud.shown;
+      goto Exit;
+
+    case grKEY( 'c' ):
+      {
+        unsigned long  hits, misses;
+
+
+        FTDemo_String_Cache_Stats( handle, &hits, &misses );
+        snprintf( status.header_buffer, sizeof ( status.header_buffer ),
+                  "glyph cache: %lu hits, %lu misses (%.1f%% hits)",
+                  hits, misses,
+                  hits + misses ? 100.0 * hits / ( hits + misses ) : 0.0 );
+        status.header = status.header_buffer;
+      }
+      goto Exit;
+
     case grKEY( 'g' ):
       FTDemo_Display_Gamma_Change( display,  1 );
       goto Exit;
@@ -837,29 +1021,25 @@
   static FT_Error
   Render_Waterfall( void )
   {
-    int      pt_size = status.ptsize, step, pt_height;
-    int      y = 40;
-    int      x = FT_MulFix( display->bitmap->width, status.sc.center);
-    FT_Size  size;
-
-    FTDemo_String_Context sc = status.sc;
+    int          pt_size, step;
+    int          y = 40;
+    int          x = FT_MulFix( display->bitmap->width, status.sc.center);
+    int          loaded = 0;
+    FTDemo_Row*  row;
 
 
-    sc.vertical = 0;
-
-    pt_height = 64 * 72 * display->bitmap->rows / status.res;
-    step      = ( pt_size * pt_size / pt_height + 64 ) & ~63;
-    pt_size   = pt_size - step * ( pt_size / step ); /* remainder */
+    step = waterfall_step( display->bitmap->rows, status.ptsize, &pt_size );
 
     while ( 1 )
     {
       pt_size += step;
 
-      FTDemo_Set_Current_Charsize( handle, pt_size, status.res );
-      FTDemo_String_Load( handle, &status.sc );
+      /* rows drawn before are only blitted */
+      row = waterfall_row( display, pt_size, &loaded );
+      if ( !row )
+        break;
 
-      error = FTDemo_Get_Size( handle, &size );
-      if ( error )
+      if ( row->error )
       {
         /* probably a non-existent bitmap font size */
         continue;
@@ -868,7 +1048,7 @@
       if ( pt_size == status.ptsize )
         grFillHLine( display->bitmap, x - 4, y, 8, display->warn_color );
 
-      y += ( size->metrics.height >> 6 ) + 1;
+      y += ( row->metrics.height >> 6 ) + 1;
 
       if ( y >= display->bitmap->rows )
         break;
@@ -876,12 +1056,13 @@
       if ( pt_size == status.ptsize )
         grFillHLine( display->bitmap, x - 4, y, 8, display->warn_color );
 
-      FTDemo_String_Draw( handle, display, &sc,
-                          x, y + ( size->metrics.descender >> 6 ) );
+      FTDemo_Row_Draw( handle, display, row,
+                       0, y + ( row->metrics.descender >> 6 ) );
     }
 
     FTDemo_Set_Current_Charsize( handle, status.ptsize, status.res );
-    FTDemo_String_Load( handle, &status.sc );
+    if ( loaded )
+      FTDemo_String_Load( handle, &status.sc );
 
     return FT_Err_Ok;
   }
@@ -993,6 +1174,7 @@
 
     do
     {
+      FTDemo_Frame_Begin( handle );
       FTDemo_Display_Clear( display );
 
       switch ( status.render_mode )
@@ -1014,6 +1196,7 @@
         break;
       }
 
+      FTDemo_Frame_End( handle, display );
       write_header( error );
 
       status.header = 0;
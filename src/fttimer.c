@@ -5,8 +5,10 @@
 /*  Copyright (C) 1996-2022 by                                              */
 /*  D. Turner, R.Wilhelm, and W. Lemberg                                    */
 /*                                                                          */
-/*  fttimer: A simple performance benchmark.  Now with graylevel rendering  */
-/*           with the '-g' option.                                          */
+/*  fttimer: A rasterizer benchmark.  All outlines are loaded and           */
+/*           transformed before timing starts, so that only scan           */
+/*           conversion gets measured, in monochrome, gray, and LCD         */
+/*           modes, and for many sizes.                                     */
 /*                                                                          */
 /*           Be aware that the timer program benchmarks different things    */
 /*           in each release of the FreeType library.  Thus, performance    */
@@ -21,13 +23,21 @@
 
 #include <ft2build.h>
 #include <freetype/freetype.h>
-#include <freetype/ftglyph.h>
+#include <freetype/ftimage.h>
+#include <freetype/ftoutln.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>    /* for clock() */
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined UNIX || defined __unix__
+#include <unistd.h>  /* for `_POSIX_TIMERS' */
+#endif
+
   /* SunOS 4.1.* does not define CLOCKS_PER_SEC, so include <sys/param.h> */
   /* to get the HZ macro which is the equivalent.                         */
 #if defined( __sun__ ) && !defined( SVR4 ) && !defined( __SVR4 )
@@ -35,30 +45,56 @@
 #define CLOCKS_PER_SEC HZ
 #endif
 
-#define CHARSIZE    400   /* character point size */
-#define MAX_GLYPHS  512   /* Maximum number of glyphs rendered at one time */
+#define DEFAULT_SIZES  "8,10,12,16,24,32,48,72,128,256"
+#define MAX_SIZES      64
+#define BENCH_TIME     0.25  /* minimal time per measurement, in seconds */
+
+
+  /* render modes */
+  enum
+  {
+    MODE_MONO = 0,
+    MODE_GRAY,
+    MODE_LCD,
+
+    N_MODES
+  };
+
+  static const char*  mode_names[N_MODES] = { "mono", "gray", "lcd" };
+
+
+  /* a pre-transformed outline, moved to the origin of its bitmap */
+  typedef struct  TGlyph_
+  {
+    FT_Outline  outline;
+    int         width;     /* bitmap dimensions */
+    int         rows;
+
+  } TGlyph;
 
-  char  Header[128];
 
   FT_Error    error;
   FT_Library  library;
 
   FT_Face     face;
 
-  int         num_glyphs;
-  FT_Glyph    glyphs[MAX_GLYPHS];
+  TGlyph*     glyphs;
+  int         num_glyphs;     /* number of prepared glyphs */
+  int         max_glyphs;     /* size of `glyphs' array    */
+  double      num_pixels;     /* sum of all bitmap areas   */
+
+  unsigned char*  buffer;     /* reused bitmap buffer */
+  size_t          buffer_size;
 
-  int         tab_glyphs;
-  int         cur_glyph;
+  int         sizes[MAX_SIZES];
+  int         num_sizes;
 
-  int         pixel_size   = CHARSIZE;
   int         repeat_count = 1;
+  double      bench_time   = BENCH_TIME;
+  FT_Int32    load_flags   = FT_LOAD_NO_BITMAP;
+  int         modes[N_MODES] = { 1, 1, 1 };
 
   int         Fail;
-  int         Num;
-
-  short       antialias = 1; /* smooth fonts with gray levels  */
-  short       force_low;
 
 
   static void
@@ -73,85 +109,468 @@
   /*                                                                 */
   /*  Get_Time:                                                      */
   /*                                                                 */
-  /*    Returns the current time in milliseconds.                    */
+  /*    Returns the current time in microseconds, as precise as the  */
+  /*    platform allows.                                             */
   /*                                                                 */
   /*******************************************************************/
 
-  static long
+  static double
   Get_Time( void )
   {
-    return clock() * 10000 / CLOCKS_PER_SEC;
+#if defined _WIN32
+    LARGE_INTEGER  ticks, freq;
+
+
+    QueryPerformanceCounter( &ticks );
+    QueryPerformanceFrequency( &freq );
+
+    return 1E6 * (double)ticks.QuadPart / (double)freq.QuadPart;
+
+#elif defined _POSIX_TIMERS && _POSIX_TIMERS > 0
+    struct timespec  tv;
+
+
+#ifdef _POSIX_MONOTONIC_CLOCK
+    clock_gettime( CLOCK_MONOTONIC, &tv );
+#else
+    clock_gettime( CLOCK_REALTIME, &tv );
+#endif
+
+    return 1E6 * (double)tv.tv_sec + 1E-3 * (double)tv.tv_nsec;
+
+#else
+    return 1E6 * (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
   }
 
 
   /*******************************************************************/
   /*                                                                 */
-  /*  LoadChar:                                                      */
+  /*  Free_Glyphs:                                                   */
   /*                                                                 */
-  /*    Loads a glyph into memory.                                   */
+  /*    Discards all prepared outlines.                              */
   /*                                                                 */
   /*******************************************************************/
 
-  static FT_Error
-  LoadChar( int  idx )
+  static void
+  Free_Glyphs( void )
   {
-    FT_Glyph  glyph;
+    int  i;
 
 
-    /* load the glyph in the glyph slot */
-    error = FT_Load_Glyph( face, idx, FT_LOAD_DEFAULT ) ||
-            FT_Get_Glyph ( face->glyph, &glyph );
-    if ( !error )
-      glyphs[cur_glyph++] = glyph;
+    for ( i = 0; i < num_glyphs; i++ )
+      FT_Outline_Done( library, &glyphs[i].outline );
 
-    return error;
+    num_glyphs = 0;
+    num_pixels = 0;
   }
 
 
   /*******************************************************************/
   /*                                                                 */
-  /*  ConvertRaster:                                                 */
+  /*  Prepare_Glyphs:                                                */
+  /*                                                                 */
+  /*    Loads all glyph outlines at the current size and transforms  */
+  /*    them for `mode': LCD outlines get stretched horizontally by  */
+  /*    a factor of three, and all outlines are moved so that their  */
+  /*    control box starts at the origin.  The bitmap buffer is      */
+  /*    resized to hold the largest glyph.                           */
+  /*                                                                 */
+  /*******************************************************************/
+
+  static void
+  Prepare_Glyphs( int  mode )
+  {
+    FT_Matrix  lcd_matrix = { 3 * 0x10000L, 0, 0, 0x10000L };
+    size_t     max_size   = 1;
+    int        idx;
+
+
+    Free_Glyphs();
+
+    if ( max_glyphs < face->num_glyphs )
+    {
+      max_glyphs = (int)face->num_glyphs;
+      glyphs     = (TGlyph*)realloc( glyphs,
+                                     (size_t)max_glyphs * sizeof ( TGlyph ) );
+      if ( !glyphs )
+        Panic( "Out of memory" );
+    }
+
+    for ( idx = 0; idx < face->num_glyphs; idx++ )
+    {
+      FT_Outline*  source;
+      TGlyph*      glyph = glyphs + num_glyphs;
+      FT_BBox      cbox;
+      size_t       size;
+      int          pitch;
+
+
+      error = FT_Load_Glyph( face, (FT_UInt)idx, load_flags );
+      if ( error )
+      {
+        Fail++;
+        continue;
+      }
+
+      /* skip bitmap glyphs and empty outlines like `space' */
+      if ( face->glyph->format != FT_GLYPH_FORMAT_OUTLINE ||
+           face->glyph->outline.n_points == 0             )
+        continue;
+
+      source = &face->glyph->outline;
+      error  = FT_Outline_New( library,
+                               (FT_UInt)source->n_points,
+                               source->n_contours,
+                               &glyph->outline );
+      if ( error )
+        Panic( "Out of memory" );
+
+      FT_Outline_Copy( source, &glyph->outline );
+
+      if ( mode == MODE_LCD )
+        FT_Outline_Transform( &glyph->outline, &lcd_matrix );
+
+      FT_Outline_Get_CBox( &glyph->outline, &cbox );
+
+      cbox.xMin = cbox.xMin & ~63;
+      cbox.yMin = cbox.yMin & ~63;
+      cbox.xMax = ( cbox.xMax + 63 ) & ~63;
+      cbox.yMax = ( cbox.yMax + 63 ) & ~63;
+
+      FT_Outline_Translate( &glyph->outline, -cbox.xMin, -cbox.yMin );
+
+      glyph->width = (int)( ( cbox.xMax - cbox.xMin ) >> 6 );
+      glyph->rows  = (int)( ( cbox.yMax - cbox.yMin ) >> 6 );
+
+      pitch = mode == MODE_MONO ? ( glyph->width + 7 ) >> 3 : glyph->width;
+      size  = (size_t)pitch * (size_t)glyph->rows;
+      if ( size > max_size )
+        max_size = size;
+
+      /* count pixels, not LCD subpixels */
+      num_pixels += (double)glyph->rows *
+                    ( mode == MODE_LCD ? glyph->width / 3 : glyph->width );
+
+      num_glyphs++;
+    }
+
+    if ( max_size > buffer_size )
+    {
+      free( buffer );
+      buffer_size = max_size;
+      buffer      = (unsigned char*)malloc( buffer_size );
+      if ( !buffer )
+        Panic( "Out of memory" );
+    }
+  }
+
+
+  /*******************************************************************/
   /*                                                                 */
-  /*    Performs scan conversion.                                    */
+  /*  Benchmark passes.  Each one processes all prepared glyphs      */
+  /*  once.                                                          */
   /*                                                                 */
   /*******************************************************************/
 
-  static FT_Error
-  ConvertRaster( int  idx )
+  static int
+  Move_To( const FT_Vector*  to,
+           void*             user )
+  {
+    FT_UNUSED( to );
+
+    (*(unsigned long*)user)++;
+
+    return 0;
+  }
+
+
+  static int
+  Line_To( const FT_Vector*  to,
+           void*             user )
+  {
+    FT_UNUSED( to );
+
+    (*(unsigned long*)user)++;
+
+    return 0;
+  }
+
+
+  static int
+  Conic_To( const FT_Vector*  control,
+            const FT_Vector*  to,
+            void*             user )
+  {
+    FT_UNUSED( control );
+    FT_UNUSED( to );
+
+    (*(unsigned long*)user)++;
+
+    return 0;
+  }
+
+
+  static int
+  Cubic_To( const FT_Vector*  control1,
+            const FT_Vector*  control2,
+            const FT_Vector*  to,
+            void*             user )
+  {
+    FT_UNUSED( control1 );
+    FT_UNUSED( control2 );
+    FT_UNUSED( to );
+
+    (*(unsigned long*)user)++;
+
+    return 0;
+  }
+
+
+  static const FT_Outline_Funcs  decompose_funcs =
+  {
+    Move_To, Line_To, Conic_To, Cubic_To, 0, 0
+  };
+
+
+  /* walk the outline only, like the rasterizer's first stage */
+  static void
+  Pass_Decompose( int  mode )
+  {
+    unsigned long  segments = 0;
+    int            i;
+
+    FT_UNUSED( mode );
+
+
+    for ( i = 0; i < num_glyphs; i++ )
+      FT_Outline_Decompose( &glyphs[i].outline, &decompose_funcs,
+                            &segments );
+  }
+
+
+  static void
+  Null_Spans( int             y,
+              int             count,
+              const FT_Span*  spans,
+              void*           user )
+  {
+    FT_UNUSED( y );
+    FT_UNUSED( spans );
+
+    *(int*)user += count;
+  }
+
+
+  /* decompose and sweep, but throw away the spans */
+  static void
+  Pass_Sweep( int  mode )
+  {
+    FT_Raster_Params  params;
+    int               num_spans = 0;
+    int               i;
+
+    FT_UNUSED( mode );
+
+
+    memset( &params, 0, sizeof ( params ) );
+    params.flags      = FT_RASTER_FLAG_AA | FT_RASTER_FLAG_DIRECT;
+    params.gray_spans = Null_Spans;
+    params.user       = &num_spans;
+
+    for ( i = 0; i < num_glyphs; i++ )
+    {
+      params.source = &glyphs[i].outline;
+
+      if ( FT_Outline_Render( library, &glyphs[i].outline, &params ) )
+        Fail++;
+    }
+  }
+
+
+  static void
+  Bitmap_Spans( int             y,
+                int             count,
+                const FT_Span*  spans,
+                void*           user )
+  {
+    FT_Bitmap*      bitmap = (FT_Bitmap*)user;
+    unsigned char*  row;
+
+
+    /* outlines start at the origin; flip to bitmap coordinates */
+    row = bitmap->buffer + ( (int)bitmap->rows - 1 - y ) * bitmap->pitch;
+
+    for ( ; count > 0; count--, spans++ )
+      memset( row + spans->x, spans->coverage, spans->len );
+  }
+
+
+  /* decompose and sweep, writing the spans into the bitmap buffer */
+  static void
+  Pass_Spans( int  mode )
+  {
+    FT_Raster_Params  params;
+    FT_Bitmap         bitmap;
+    int               i;
+
+    FT_UNUSED( mode );
+
+
+    memset( &bitmap, 0, sizeof ( bitmap ) );
+    bitmap.buffer = buffer;
+
+    memset( &params, 0, sizeof ( params ) );
+    params.flags      = FT_RASTER_FLAG_AA | FT_RASTER_FLAG_DIRECT;
+    params.gray_spans = Bitmap_Spans;
+    params.user       = &bitmap;
+
+    for ( i = 0; i < num_glyphs; i++ )
+    {
+      TGlyph*  glyph = glyphs + i;
+
+
+      bitmap.rows  = (unsigned int)glyph->rows;
+      bitmap.pitch = glyph->width;
+
+      memset( buffer, 0, (size_t)bitmap.pitch * bitmap.rows );
+
+      params.source = &glyph->outline;
+
+      if ( FT_Outline_Render( library, &glyph->outline, &params ) )
+        Fail++;
+    }
+  }
+
+
+  /* complete rendering into the (cleared) bitmap buffer */
+  static void
+  Pass_Render( int  mode )
   {
-    FT_Glyph  bitmap;
+    FT_Bitmap  bitmap;
+    int        i;
+
 
+    memset( &bitmap, 0, sizeof ( bitmap ) );
+    bitmap.buffer = buffer;
 
-    bitmap = glyphs[idx];
-    if ( bitmap->format == FT_GLYPH_FORMAT_BITMAP )
-      error = 0;  /* we already have a (embedded) bitmap */
+    if ( mode == MODE_MONO )
+      bitmap.pixel_mode = FT_PIXEL_MODE_MONO;
     else
     {
-      error = FT_Glyph_To_Bitmap( &bitmap,
-                                  antialias ? FT_RENDER_MODE_NORMAL
-                                            : FT_RENDER_MODE_MONO,
-                                  0,
-                                  0 );
-      if ( !error )
-        FT_Done_Glyph( bitmap );
+      bitmap.pixel_mode = FT_PIXEL_MODE_GRAY;
+      bitmap.num_grays  = 256;
+    }
+
+    for ( i = 0; i < num_glyphs; i++ )
+    {
+      TGlyph*  glyph = glyphs + i;
+
+
+      bitmap.width = (unsigned int)glyph->width;
+      bitmap.rows  = (unsigned int)glyph->rows;
+      bitmap.pitch = mode == MODE_MONO ? ( glyph->width + 7 ) >> 3
+                                       : glyph->width;
+
+      memset( buffer, 0, (size_t)bitmap.pitch * bitmap.rows );
+
+      if ( FT_Outline_Get_Bitmap( library, &glyph->outline, &bitmap ) )
+        Fail++;
+    }
+  }
+
+
+  /*******************************************************************/
+  /*                                                                 */
+  /*  Benchmark:                                                     */
+  /*                                                                 */
+  /*    Repeats a pass until both the repeat count and the minimal   */
+  /*    time are reached.  Returns the time per glyph in             */
+  /*    microseconds.                                                */
+  /*                                                                 */
+  /*******************************************************************/
+
+  static double
+  Benchmark( void  (*pass)( int ),
+             int   mode )
+  {
+    double  t0, elapsed;
+    long    n = 0;
+
+
+    if ( !num_glyphs )
+      return 0;
+
+    /* warm up caches */
+    pass( mode );
+
+    t0 = Get_Time();
+    do
+    {
+      pass( mode );
+      n++;
+
+      elapsed = Get_Time() - t0;
+
+    } while ( n < repeat_count || elapsed < 1E6 * bench_time );
+
+    return elapsed / ( (double)n * num_glyphs );
+  }
+
+
+  static void
+  Parse_Sizes( const char*  list )
+  {
+    const char*  p = list;
+
+
+    num_sizes = 0;
+
+    while ( *p && num_sizes < MAX_SIZES )
+    {
+      char*  end;
+      long   size = strtol( p, &end, 10 );
+
+
+      if ( end == p || size <= 0 )
+        break;
+
+      sizes[num_sizes++] = (int)size;
+
+      p = end;
+      if ( *p == ',' )
+        p++;
     }
 
-    return error;
+    if ( *p || !num_sizes )
+      Panic( "Invalid size list" );
   }
 
 
   static void
   Usage( void )
   {
-    fprintf( stderr, "fttimer: simple performance timer -- part of the FreeType project\n" );
-    fprintf( stderr, "-----------------------------------------------------------------\n\n" );
+    fprintf( stderr, "fttimer: rasterizer benchmark -- part of the FreeType project\n" );
+    fprintf( stderr, "-------------------------------------------------------------\n\n" );
     fprintf( stderr, "Usage: fttimer [options] fontname[.ttf|.ttc]\n\n" );
     fprintf( stderr, "options:\n");
-    fprintf( stderr, "   -r : repeat count to be used (default is 1)\n" );
-    fprintf( stderr, "   -s : character pixel size (default is 600)\n" );
-    fprintf( stderr, "   -m : render monochrome glyphs (default is anti-aliased)\n" );
-    fprintf( stderr, "   -a : use smooth anti-aliaser\n" );
-    fprintf( stderr, "   -l : force low quality even at small sizes\n" );
+    fprintf( stderr, "   -r N    : minimal repeat count for each test (default is 1)\n" );
+    fprintf( stderr, "   -t SEC  : minimal time for each test (default is %g s)\n",
+                     BENCH_TIME );
+    fprintf( stderr, "   -s LIST : comma-separated list of pixel sizes\n" );
+    fprintf( stderr, "             (default is %s)\n", DEFAULT_SIZES );
+    fprintf( stderr, "   -M MODES: render modes, any of `m' (mono), `g' (gray),\n" );
+    fprintf( stderr, "             and `l' (LCD, without filtering) (default is `mgl')\n" );
+    fprintf( stderr, "   -m      : render monochrome glyphs only (same as `-M m')\n" );
+    fprintf( stderr, "   -n      : don't hint outlines\n" );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "All outlines are loaded and prepared before timing starts.\n" );
+    fprintf( stderr, "Throughput is given for complete rendering into a bitmap.\n" );
+    fprintf( stderr, "The costs of the rasterizer stages are derived from separate\n" );
+    fprintf( stderr, "passes: outline decomposition only, decomposition and sweep\n" );
+    fprintf( stderr, "with spans discarded, and the same with spans written into a\n" );
+    fprintf( stderr, "cleared bitmap (for `output').  The mono rasterizer can't\n" );
+    fprintf( stderr, "deliver spans, so only its total sweep cost is shown.\n" );
 
     exit( 1 );
   }
@@ -161,33 +580,54 @@
   main( int     argc,
         char**  argv )
   {
-    int    i, total, base, rendered_glyphs;
-    char   filename[1024 + 4];
+    int   i, m;
+    char  filename[1024 + 4];
 
-    long   t, t0, tz0;
+    double  tz0;
 
 
-    antialias = 1;
-    force_low = 0;
+    Parse_Sizes( DEFAULT_SIZES );
 
     while ( argc > 1 && argv[1][0] == '-' )
     {
       switch ( argv[1][1] )
       {
       case 'm':
-        antialias = 0;
+        modes[MODE_MONO] = 1;
+        modes[MODE_GRAY] = 0;
+        modes[MODE_LCD]  = 0;
+        break;
+
+      case 'M':
+        argc--;
+        argv++;
+        if ( argc < 2 )
+          Usage();
+        modes[MODE_MONO] = strchr( argv[1], 'm' ) != NULL;
+        modes[MODE_GRAY] = strchr( argv[1], 'g' ) != NULL;
+        modes[MODE_LCD]  = strchr( argv[1], 'l' ) != NULL;
         break;
 
-      case 'l':
-        force_low = 1;
+      case 'n':
+        load_flags |= FT_LOAD_NO_HINTING;
         break;
 
       case 's':
+        argc--;
+        argv++;
+        if ( argc < 2 )
+          Usage();
+        Parse_Sizes( argv[1] );
+        break;
+
+      case 't':
         argc--;
         argv++;
         if ( argc < 2 ||
-             sscanf( argv[1], "%d", &pixel_size ) != 1 )
+             sscanf( argv[1], "%lf", &bench_time ) != 1 )
           Usage();
+        if ( bench_time < 0 )
+          bench_time = 0;
         break;
 
       case 'r':
@@ -213,7 +653,7 @@
     if ( argc != 2 )
       Usage();
 
-    i = strlen( argv[1] );
+    i = (int)strlen( argv[1] );
     while ( i > 0 && argv[1][i] != '\\' )
     {
       if ( argv[1][i] == '.' )
@@ -237,98 +677,77 @@
     else if ( error )
       Panic( "Error while opening font resource" );
 
-    /* get face properties and allocate preload arrays */
-
-    num_glyphs = face->num_glyphs;
-
-    tab_glyphs = MAX_GLYPHS;
-    if ( tab_glyphs > num_glyphs )
-      tab_glyphs = num_glyphs;
+    if ( !FT_IS_SCALABLE( face ) )
+      Panic( "Font has no outlines" );
 
-    /* create size */
+    printf( "font: %s %s, %ld glyphs, %s outlines\n\n",
+            face->family_name ? face->family_name : "(unknown)",
+            face->style_name ? face->style_name : "",
+            face->num_glyphs,
+            ( load_flags & FT_LOAD_NO_HINTING ) ? "unhinted" : "hinted" );
 
-    error = FT_Set_Pixel_Sizes( face, pixel_size, pixel_size );
-    if ( error )
-      Panic( "Could not reset instance" );
+    printf( " size  mode  glyphs    glyphs/s  Mpixels/s"
+            "  decompose    sweep   output  (us/glyph)\n" );
 
-    Num  = 0;
     Fail = 0;
 
-    total = num_glyphs;
-    base  = 0;
-
-    rendered_glyphs = 0;
-
-    t0 = 0;  /* Initial time */
-
     tz0 = Get_Time();
 
-    while ( total > 0 )
+    for ( i = 0; i < num_sizes; i++ )
     {
-      int  repeat;
+      error = FT_Set_Pixel_Sizes( face, (FT_UInt)sizes[i],
+                                        (FT_UInt)sizes[i] );
+      if ( error )
+        Panic( "Could not reset instance" );
 
-
-      /* First, preload 'tab_glyphs' in memory */
-      cur_glyph = 0;
-
-      printf( "loading %d glyphs", tab_glyphs );
-
-      for ( Num = 0; Num < tab_glyphs; Num++ )
+      for ( m = 0; m < N_MODES; m++ )
       {
-        error = LoadChar( base + Num );
-        if ( error )
-          Fail++;
-
-        total--;
-      }
-
-      base += tab_glyphs;
-
-      if ( tab_glyphs > total )
-        tab_glyphs = total;
+        double  t_decompose, t_sweep = 0, t_spans = 0, t_render;
 
-      printf( ", rendering... " );
 
-      /* Now, render the loaded glyphs */
+        if ( !modes[m] )
+          continue;
 
-      t = Get_Time();
+        Prepare_Glyphs( m );
 
-      for ( repeat = 0; repeat < repeat_count; repeat++ )
-      {
-        for ( Num = 0; Num < cur_glyph; Num++ )
+        t_decompose = Benchmark( Pass_Decompose, m );
+        if ( m != MODE_MONO )
         {
-          if ( ( error = ConvertRaster( Num ) ) != 0 )
-            Fail++;
-          else
-            rendered_glyphs++;
+          t_sweep = Benchmark( Pass_Sweep, m );
+          t_spans = Benchmark( Pass_Spans, m );
         }
+        t_render = Benchmark( Pass_Render, m );
+
+        printf( "%5d  %-4s  %6d  %10.0f  %9.2f  %9.3f",
+                sizes[i], mode_names[m], num_glyphs,
+                t_render > 0 ? 1E6 / t_render : 0.0,
+                t_render > 0 ? num_pixels / num_glyphs / t_render : 0.0,
+                t_decompose );
+
+        /* the difference between the passes is the cost of a stage */
+        if ( m == MODE_MONO )
+          printf( " %8.3f %8s\n",
+                  t_render > t_decompose ? t_render - t_decompose : 0.0,
+                  "-" );
+        else
+          printf( " %8.3f %8.3f\n",
+                  t_sweep > t_decompose ? t_sweep - t_decompose : 0.0,
+                  t_spans > t_sweep ? t_spans - t_sweep : 0.0 );
+        fflush( stdout );
       }
-
-      t = Get_Time() - t;
-      if ( t < 0 )
-        t += 1000 * 60 * 60;
-
-      printf( " = %f s\n", (double)t / 10000 );
-      t0 += t;
-
-      /* Now free all loaded outlines */
-      for ( Num = 0; Num < cur_glyph; Num++ )
-        FT_Done_Glyph( glyphs[Num] );
     }
 
     tz0 = Get_Time() - tz0;
 
+    Free_Glyphs();
+    free( glyphs );
+    free( buffer );
+
     FT_Done_Face( face );
 
     printf( "\n" );
-    printf( "rendered glyphs  = %d\n", rendered_glyphs );
-    printf( "render time      = %f s\n", (double)t0 / 10000 );
     printf( "fails            = %d\n", Fail );
-    printf( "average glyphs/s = %f\n",
-            (double)rendered_glyphs / t0 * 10000 );
-
-    printf( "total timing     = %f s\n", (double)tz0 / 10000 );
-    printf( "Fails = %d\n", Fail );
+    printf( "total timing     = %f s\n", tz0 / 1E6 );
 
     FT_Done_FreeType( library );
 
@@ -88,6 +88,7 @@
   static struct  status_
   {
     int            update;
+    int            truncated;         /* by the frame budget */
 
     const char*    keys;
     const char*    dims;
@@ -107,15 +108,16 @@
     int            topleft;           /* as displayed by ftview  */
     int            num_fails;
     int            preload;
+    int            threads;           /* of `Render_All', 1 if serial */
 
     int            lcd_filter;
     unsigned char  filter_weights[5];
     int            fw_idx;
 
-  } status = { 1,
+  } status = { 1, 0,
                "", DIM, NULL, RENDER_MODE_ALL,
                72, 48, 1, 0.04, 0.04, 0.02, 0.22,
-               0, 0, 0, 0, 0,
+               0, 0, 0, 0, 0, 1,
                FT_LCD_FILTER_DEFAULT, { 0x08, 0x4D, 0x56, 0x4D, 0x08 }, 2 };
 
 
@@ -156,6 +158,33 @@
   }
 
 
+  /* how `Render_Stroke' and `Render_Fancy' transform the glyphs */
+  /* they keep with `FTDemo_Outline_Add'                           */
+  typedef struct  TTransformKey_
+  {
+    int       render_mode;
+    FT_Fixed  radius;
+    FT_Fixed  slant;
+    FT_Pos    xstr;
+    FT_Pos    ystr;
+
+  } TTransformKey;
+
+
+  /* a frame abandoned for pending input is drawn again */
+  /* even if that input does not change anything        */
+  static int
+  frame_over_budget( void )
+  {
+    if ( !grFrameOverBudget( display->surface ) )
+      return 0;
+
+    status.truncated = 1;
+
+    return 1;
+  }
+
+
   static int
   Render_Stroke( int  num_indices,
                  int  offset )
@@ -166,7 +195,8 @@
     FT_Face       face;
     FT_GlyphSlot  slot;
 
-    FT_Fixed  radius;
+    FT_Fixed       radius;
+    TTransformKey  key;
 
 
     error = FTDemo_Get_Size( handle, &size );
@@ -187,22 +217,31 @@
                     FT_STROKER_LINEJOIN_ROUND,
                     0 );
 
+    memset( &key, 0, sizeof ( key ) );  /* also the padding */
+    key.render_mode = RENDER_MODE_STROKE;
+    key.radius      = radius;
+
     have_topleft = 0;
 
     for ( i = offset; i < num_indices; i++ )
     {
-      FT_UInt  glyph_idx;
+      FT_UInt   glyph_idx;
+      FT_Glyph  glyph;
 
 
-      glyph_idx = FTDemo_Get_Index( handle, (FT_UInt32)i );
+      if ( frame_over_budget() )
+        break;
 
-      error = FT_Load_Glyph( face, glyph_idx,
-                             handle->load_flags | FT_LOAD_NO_BITMAP );
+      glyph_idx = FTDemo_Get_Index( handle, (FT_UInt32)i );
 
-      if ( !error && slot->format == FT_GLYPH_FORMAT_OUTLINE )
+      glyph = FTDemo_Outline_Lookup( handle, glyph_idx,
+                                     &key, sizeof ( key ) );
+      if ( !glyph )
       {
-        FT_Glyph  glyph;
-
+        error = FTDemo_Load_Glyph( handle, face, glyph_idx,
+                                   handle->load_flags | FT_LOAD_NO_BITMAP );
+        if ( error || slot->format != FT_GLYPH_FORMAT_OUTLINE )
+          goto Next;
 
         error = FT_Get_Glyph( slot, &glyph );
         if ( error )
@@ -215,44 +254,47 @@
           goto Next;
         }
 
-        width = slot->advance.x ? slot->advance.x >> 6
-                                : size->metrics.y_ppem / 2;
+        glyph = FTDemo_Outline_Add( handle, glyph_idx,
+                                    &key, sizeof ( key ), glyph );
+        if ( !glyph )
+          goto Next;
+      }
 
-        if ( X_TOO_LONG( x + width, display ) )
-        {
-          x  = start_x;
-          y += step_y;
+      /* the advance is in 16.16 format */
+      width = glyph->advance.x ? glyph->advance.x >> 16
+                               : size->metrics.y_ppem / 2;
 
-          if ( Y_TOO_LONG( y, display ) )
-          {
-            FT_Done_Glyph( glyph );
-            break;
-          }
-        }
+      if ( X_TOO_LONG( x + width, display ) )
+      {
+        x  = start_x;
+        y += step_y;
 
-        /* extra space between glyphs */
-        x++;
-        if ( slot->advance.x == 0 )
-        {
-          grFillRect( display->bitmap, x, y - width, width, width,
-                      display->warn_color );
-          x += width;
-        }
+        if ( Y_TOO_LONG( y, display ) )
+          break;
+      }
+
+      /* extra space between glyphs */
+      x++;
+      if ( glyph->advance.x == 0 )
+      {
+        grFillRect( display->bitmap, x, y - width, width, width,
+                    display->warn_color );
+        x += width;
+      }
 
-        error = FTDemo_Draw_Glyph( handle, display, glyph, &x, &y );
+      error = FTDemo_Outline_Draw( handle, display, glyph, &x, &y );
 
-        if ( error )
-          goto Next;
-        else
-          FT_Done_Glyph( glyph );
+      if ( error )
+        goto Next;
 
-        if ( !have_topleft )
-        {
-          have_topleft   = 1;
-          status.topleft = i;
-        }
+      if ( !have_topleft )
+      {
+        have_topleft   = 1;
+        status.topleft = i;
       }
-      else
+
+      continue;
+
     Next:
       status.num_fails++;
     }
@@ -271,8 +313,9 @@
     FT_Face       face;
     FT_GlyphSlot  slot;
 
-    FT_Matrix  shear;
-    FT_Pos     xstr, ystr;
+    FT_Matrix      shear;
+    FT_Pos         xstr, ystr;
+    TTransformKey  key;
 
 
     error = FTDemo_Get_Size( handle, &size );
@@ -308,16 +351,42 @@
     xstr = (FT_Pos)( size->metrics.y_ppem * 64 * status.xbold_factor );
     ystr = (FT_Pos)( size->metrics.y_ppem * 64 * status.ybold_factor );
 
+    memset( &key, 0, sizeof ( key ) );  /* also the padding */
+    key.render_mode = RENDER_MODE_FANCY;
+    key.slant       = shear.xy;
+
     have_topleft = 0;
 
     for ( i = offset; i < num_indices; i++ )
     {
-      FT_UInt  glyph_idx;
+      FT_UInt   glyph_idx;
+      FT_Glyph  glyph;
 
 
+      if ( frame_over_budget() )
+        break;
+
       glyph_idx = FTDemo_Get_Index( handle, (FT_UInt32)i );
 
-      error = FT_Load_Glyph( face, glyph_idx, handle->load_flags );
+      key.xstr = xstr;
+      key.ystr = ystr;
+
+      glyph = FTDemo_Outline_Lookup( handle, glyph_idx,
+                                     &key, sizeof ( key ) );
+      if ( glyph )
+      {
+        /* the strengths stay rounded for the following glyphs */
+        if ( glyph->format == FT_GLYPH_FORMAT_BITMAP )
+        {
+          xstr &= ~63;
+          ystr &= ~63;
+        }
+
+        goto Draw;
+      }
+
+      error = FTDemo_Load_Glyph( handle, face, glyph_idx,
+                                 handle->load_flags );
       if ( error )
         goto Next;
 
@@ -363,8 +432,19 @@
       if ( slot->format == FT_GLYPH_FORMAT_BITMAP )
         slot->bitmap_top += ystr >> 6;
 
-      width = slot->advance.x ? slot->advance.x >> 6
-                              : size->metrics.y_ppem / 2;
+      error = FT_Get_Glyph( slot, &glyph );
+      if ( error )
+        goto Next;
+
+      glyph = FTDemo_Outline_Add( handle, glyph_idx,
+                                  &key, sizeof ( key ), glyph );
+      if ( !glyph )
+        goto Next;
+
+    Draw:
+      /* the advance is in 16.16 format */
+      width = glyph->advance.x ? glyph->advance.x >> 16
+                               : size->metrics.y_ppem / 2;
 
       if ( X_TOO_LONG( x + width, display ) )
       {
@@ -377,14 +457,14 @@
 
       /* extra space between glyphs */
       x++;
-      if ( slot->advance.x == 0 )
+      if ( glyph->advance.x == 0 )
       {
         grFillRect( display->bitmap, x, y - width, width, width,
                     display->warn_color );
         x += width;
       }
 
-      error = FTDemo_Draw_Slot( handle, display, slot, &x, &y );
+      error = FTDemo_Outline_Draw( handle, display, glyph, &x, &y );
 
       if ( error )
         goto Next;
@@ -395,14 +475,663 @@
         status.topleft = i;
       }
 
-      continue;
+      continue;
+
+    Next:
+      status.num_fails++;
+    }
+
+    return i - 1;
+  }
+
+
+  /* the color palette of a face for `load_glyph' */
+  typedef struct  TPalette_
+  {
+    FT_UShort        index;
+    FT_Color*        colors;    /* NULL if the face has none */
+    FT_Palette_Data  data;
+
+  } TPalette;
+
+
+  static FT_Error
+  select_palette( FT_Face    face,
+                  FT_UShort  index,
+                  TPalette*  palette )
+  {
+    palette->index = index;
+    if ( FT_Palette_Select( face, index, &palette->colors ) )
+      palette->colors = NULL;
+
+    return FT_Palette_Data_Get( face, &palette->data );
+  }
+
+
+  /* `hud' is NULL in worker threads, which must not touch `handle' */
+  static FT_Error
+  load_layer( FTDemo_Handle*  hud,
+              FT_Face         face,
+              FT_UInt         glyph_idx,
+              FT_Int32        load_flags )
+  {
+    if ( hud )
+      return FTDemo_Load_Glyph( hud, face, glyph_idx, load_flags );
+    else
+      return FT_Load_Glyph( face, glyph_idx, load_flags );
+  }
+
+
+  /* load a glyph into the slot of `face', blending its color layers */
+  /* ourselves if `use_layers' is set                                 */
+  static FT_Error
+  load_glyph( FTDemo_Handle*  hud,
+              FT_Face         face,
+              FT_UInt         glyph_idx,
+              FT_Int32        load_flags,
+              int             use_layers,
+              TPalette*       palette )
+  {
+    FT_GlyphSlot      slot = face->glyph;
+    FT_LayerIterator  iterator;
+    FT_Error          err = FT_Err_Ok;
+
+    FT_Bool  have_layers;
+    FT_UInt  layer_glyph_idx;
+    FT_UInt  layer_color_idx;
+
+
+    /* check whether we have glyph color layers */
+    iterator.p  = NULL;
+    have_layers = FT_Get_Color_Glyph_Layer( face,
+                                            glyph_idx,
+                                            &layer_glyph_idx,
+                                            &layer_color_idx,
+                                            &iterator );
+
+    if ( palette->colors && have_layers && use_layers )
+    {
+      FT_Bitmap  bitmap;
+      FT_Vector  bitmap_offset = { 0, 0 };
+
+
+      /*
+       * We want to handle glyph layers manually, thus switching off
+       * `FT_LOAD_COLOR' and ensuring normal AA render mode.
+       */
+      load_flags &= ~FT_LOAD_COLOR;
+      load_flags |=  FT_LOAD_RENDER;
+
+      load_flags &= ~FT_LOAD_TARGET_( 0xF );
+      load_flags |=  FT_LOAD_TARGET_NORMAL;
+
+      FT_Bitmap_Init( &bitmap );
+
+      do
+      {
+        FT_Vector  slot_offset;
+        FT_Color   color;
+
+
+        err = load_layer( hud, face, layer_glyph_idx, load_flags );
+        if ( err )
+          break;
+
+        slot_offset.x = slot->bitmap_left * 64;
+        slot_offset.y = slot->bitmap_top * 64;
+
+        if ( layer_color_idx == 0xFFFF )
+        {
+          // TODO: FT_Palette_Get_Foreground_Color
+          if ( palette->data.palette_flags                  &&
+             ( palette->data.palette_flags[palette->index] &
+                 FT_PALETTE_FOR_DARK_BACKGROUND            ) )
+          {
+            /* white opaque */
+            color.blue  = 0xFF;
+            color.green = 0xFF;
+            color.red   = 0xFF;
+            color.alpha = 0xFF;
+          }
+          else
+          {
+            /* black opaque */
+            color.blue  = 0x00;
+            color.green = 0x00;
+            color.red   = 0x00;
+            color.alpha = 0xFF;
+          }
+        }
+        else if ( layer_color_idx < palette->data.num_palette_entries )
+          color = palette->colors[layer_color_idx];
+        else
+          continue;
+
+        err = FT_Bitmap_Blend( slot->library,
+                               &slot->bitmap,
+                               slot_offset,
+                               &bitmap,
+                               &bitmap_offset,
+                               color );
+
+      } while ( FT_Get_Color_Glyph_Layer( face,
+                                          glyph_idx,
+                                          &layer_glyph_idx,
+                                          &layer_color_idx,
+                                          &iterator ) );
+
+      if ( err )
+        FT_Bitmap_Done( slot->library, &bitmap );
+      else
+      {
+        FT_Bitmap_Done( slot->library, &slot->bitmap );
+
+        slot->bitmap      = bitmap;
+        slot->bitmap_left = bitmap_offset.x / 64;
+        slot->bitmap_top  = bitmap_offset.y / 64;
+      }
+    }
+    else
+      err = load_layer( hud, face, glyph_idx, load_flags );
+
+    return err;
+  }
+
+
+  /*
+   * With option `-j N', `Render_All' has the glyphs loaded and rendered
+   * by N worker threads, while the main thread lays them out and blits
+   * them.  Every worker opens its own face object of the current font,
+   * with its own size, glyph slot, and palette; only the library is
+   * shared, which requires serializing the creation and destruction of
+   * faces.  The workers run at most VIEW_AHEAD glyphs ahead, and their
+   * results are blitted in order, so the output is identical to serial
+   * rendering.
+   *
+   * The workers bypass the caches of `handle', and the pool and arena
+   * allocators of `ftalloc.c' are not thread-safe; with one of those
+   * ftview renders serially.
+   */
+
+#define VIEW_THREADS_MAX  16
+#define VIEW_AHEAD       256
+
+
+#if defined( FTDEMO_THREADS_PTHREAD ) || defined( FTDEMO_THREADS_WIN32 )
+
+  /* the result for one index */
+  typedef struct  TRenderJob_
+  {
+    int       ready;
+    FT_Error  load_error;
+    FT_Pos    advance;      /* of the glyph slot                    */
+    FT_Error  error;        /* of `FT_Get_Glyph' or the rendering    */
+    FT_Glyph  glyph;        /* a bitmap glyph unless `error' is set */
+    int       loaded;       /* number of `FT_Load_Glyph' calls      */
+    int       rendered;
+    double    load_time;
+    double    render_time;
+
+  } TRenderJob;
+
+
+  typedef struct  TRenderWorker_
+  {
+    TThread        thread;
+    unsigned int   frame;        /* the frame set up for          */
+    PFont          font;         /* of `face'                     */
+    FT_Face        face;
+    FT_Error       face_error;
+    FTC_ScalerRec  scaler;       /* of `face->size'               */
+    FT_Error       size_error;
+    FT_Error       error;        /* of the frame setup            */
+    TPalette       palette;
+
+  } TRenderWorker;
+
+
+  static struct  render_pool_
+  {
+    int             num_threads;  /* 0 if not started, -1 if failed */
+    TRenderWorker   workers[VIEW_THREADS_MAX];
+
+    TMutex          lock;
+    TCond           work;         /* signals indices to take, `quit' */
+    TCond           done;         /* signals finished jobs           */
+    TMutex          faces;        /* serializes face (de)allocation  */
+
+    /* the current frame */
+    unsigned int    frame;
+    PFont           font;
+    FTC_ScalerRec   scaler;
+    FT_Int32        load_flags;
+    FT_Render_Mode  render_mode;
+    int             use_layers;
+    FT_UShort       palette_index;
+    FT_Encoding     encoding;
+    int             timed;
+
+    int             next;         /* next index to render            */
+    int             limit;        /* number of indices               */
+    int             shown;        /* indices taken by the main thread */
+    int             stop;
+    int             busy;         /* workers rendering an index      */
+    int             quit;
+
+    TRenderJob      jobs[VIEW_AHEAD];
+
+  } render_pool;
+
+
+  /* get the worker's face ready for the current frame */
+  static void
+  render_pool_setup( TRenderWorker*  worker )
+  {
+    FTC_Scaler  scaler = &render_pool.scaler;
+    FT_Face     face;
+    int         cmap_index;
+
+
+    worker->frame = render_pool.frame;
+
+    if ( worker->font != render_pool.font )
+    {
+      FTDEMO_LOCK( render_pool.faces );
+
+      if ( worker->face )
+        FT_Done_Face( worker->face );
+
+      worker->face       = NULL;
+      worker->font       = render_pool.font;
+      worker->face_error = FTDemo_Open_Face( handle, worker->font,
+                                             &worker->face );
+
+      FTDEMO_UNLOCK( render_pool.faces );
+
+      worker->scaler.face_id = NULL;
+    }
+
+    worker->error = worker->face_error;
+    if ( worker->error )
+      return;
+
+    face = worker->face;
+
+    /* size the face as the cache manager does */
+    if ( worker->scaler.face_id != scaler->face_id ||
+         worker->scaler.width   != scaler->width   ||
+         worker->scaler.height  != scaler->height  ||
+         worker->scaler.pixel   != scaler->pixel   ||
+         worker->scaler.x_res   != scaler->x_res   ||
+         worker->scaler.y_res   != scaler->y_res   )
+    {
+      if ( scaler->pixel )
+        worker->size_error = FT_Set_Pixel_Sizes( face,
+                                                 scaler->width,
+                                                 scaler->height );
+      else
+        worker->size_error = FT_Set_Char_Size( face,
+                                               (FT_F26Dot6)scaler->width,
+                                               (FT_F26Dot6)scaler->height,
+                                               scaler->x_res,
+                                               scaler->y_res );
+
+      worker->scaler = *scaler;
+    }
+
+    worker->error = worker->size_error;
+    if ( worker->error )
+      return;
+
+    cmap_index = worker->font->cmap_index;
+    if ( render_pool.encoding != FT_ENCODING_ORDER &&
+         cmap_index < face->num_charmaps           )
+      FT_Set_Charmap( face, face->charmaps[cmap_index] );
+
+    worker->error = select_palette( face, render_pool.palette_index,
+                                    &worker->palette );
+  }
+
+
+  static void
+  render_pool_render( TRenderWorker*  worker,
+                      int             i )
+  {
+    TRenderJob*  job   = &render_pool.jobs[i % VIEW_AHEAD];
+    FT_Face      face  = worker->face;
+    FT_Glyph     glyph = NULL;
+    FT_UInt      glyph_idx;
+    double       t0    = render_pool.timed ? grTime() : 0.0;
+
+
+    job->loaded      = 0;
+    job->rendered    = 0;
+    job->load_time   = 0.0;
+    job->render_time = 0.0;
+    job->glyph       = NULL;
+    job->error       = FT_Err_Ok;
+
+    job->load_error = worker->error;
+    if ( job->load_error )
+      return;
+
+    if ( render_pool.encoding != FT_ENCODING_ORDER )
+      glyph_idx = FT_Get_Char_Index( face, (FT_ULong)i );
+    else
+      glyph_idx = (FT_UInt)i;
+
+    job->load_error = load_glyph( NULL, face, glyph_idx,
+                                  render_pool.load_flags,
+                                  render_pool.use_layers,
+                                  &worker->palette );
+    job->loaded     = 1;
+    job->advance    = face->glyph->advance.x;
+
+    if ( render_pool.timed )
+    {
+      double  t1 = grTime();
+
+
+      job->load_time = t1 - t0;
+      t0             = t1;
+    }
+
+    if ( job->load_error )
+      return;
+
+    job->error = FT_Get_Glyph( face->glyph, &glyph );
+    if ( job->error )
+      return;
+
+    if ( glyph->format == FT_GLYPH_FORMAT_OUTLINE ||
+         glyph->format == FT_GLYPH_FORMAT_SVG     )
+    {
+      job->error    = FT_Glyph_To_Bitmap( &glyph, render_pool.render_mode,
+                                          NULL, 1 );
+      job->rendered = 1;
+
+      if ( render_pool.timed )
+        job->render_time = grTime() - t0;
+
+      if ( job->error )
+      {
+        FT_Done_Glyph( glyph );
+        return;
+      }
+    }
+
+    job->glyph = glyph;
+  }
+
+
+  static void
+  render_pool_thread( TRenderWorker*  worker )
+  {
+    FTDEMO_LOCK( render_pool.lock );
+
+    for (;;)
+    {
+      int  i;
+
+
+      while ( !render_pool.quit                                    &&
+              ( render_pool.stop                                 ||
+                render_pool.next >= render_pool.limit            ||
+                render_pool.next >= render_pool.shown + VIEW_AHEAD ) )
+        FTDEMO_WAIT( render_pool.work, render_pool.lock );
+
+      if ( render_pool.quit )
+        break;
+
+      i = render_pool.next++;
+      render_pool.busy++;
+
+      if ( worker->frame != render_pool.frame )
+      {
+        FTDEMO_UNLOCK( render_pool.lock );
+        render_pool_setup( worker );
+      }
+      else
+        FTDEMO_UNLOCK( render_pool.lock );
+
+      render_pool_render( worker, i );
+
+      FTDEMO_LOCK( render_pool.lock );
+
+      render_pool.jobs[i % VIEW_AHEAD].ready = 1;
+      render_pool.busy--;
+      FTDEMO_BROADCAST( render_pool.done );
+    }
+
+    FTDEMO_UNLOCK( render_pool.lock );
+  }
+
+
+#if defined( FTDEMO_THREADS_PTHREAD )
+
+  static void*
+  render_pool_thread_main( void*  arg )
+  {
+    render_pool_thread( (TRenderWorker*)arg );
+    return NULL;
+  }
+
+#else
+
+  static DWORD WINAPI
+  render_pool_thread_main( LPVOID  arg )
+  {
+    render_pool_thread( (TRenderWorker*)arg );
+    return 0;
+  }
+
+#endif
+
+
+  /* start the pool once; return the number of workers */
+  static int
+  render_pool_start( void )
+  {
+    int  n = status.threads;
+    int  i;
+
+
+    if ( render_pool.num_threads )
+      return render_pool.num_threads;
+
+    render_pool.num_threads = -1;
+
+    /* the other allocators are not thread-safe */
+    if ( handle->memory || n < 2 )
+      return -1;
+
+    if ( n > VIEW_THREADS_MAX )
+      n = VIEW_THREADS_MAX;
+
+    FTDEMO_MUTEX_INIT( render_pool.lock );
+    FTDEMO_MUTEX_INIT( render_pool.faces );
+    FTDEMO_COND_INIT( render_pool.work );
+    FTDEMO_COND_INIT( render_pool.done );
+
+    for ( i = 0; i < n; i++ )
+    {
+      TRenderWorker*  worker = &render_pool.workers[i];
+
+
+#if defined( FTDEMO_THREADS_PTHREAD )
+      if ( pthread_create( &worker->thread, NULL,
+                           render_pool_thread_main, worker ) )
+#else
+      worker->thread = CreateThread( NULL, 0, render_pool_thread_main,
+                                     worker, 0, NULL );
+      if ( !worker->thread )
+#endif
+        break;
+    }
+
+    if ( i == 0 )
+    {
+      FTDEMO_COND_DONE( render_pool.done );
+      FTDEMO_COND_DONE( render_pool.work );
+      FTDEMO_MUTEX_DONE( render_pool.faces );
+      FTDEMO_MUTEX_DONE( render_pool.lock );
+
+      return -1;
+    }
+
+    render_pool.num_threads = i;
+
+    return i;
+  }
+
+
+  /* hand out indices `offset' to `num_indices - 1' of the frame */
+  static void
+  render_pool_begin( int  num_indices,
+                     int  offset )
+  {
+    FTDEMO_LOCK( render_pool.lock );
+
+    render_pool.frame++;
+    render_pool.font          = handle->current_font;
+    render_pool.scaler        = handle->scaler;
+    render_pool.load_flags    = handle->load_flags;
+    render_pool.render_mode   = FTDemo_Render_Mode( handle );
+    render_pool.use_layers    = handle->use_layers;
+    render_pool.palette_index =
+      (FT_UShort)handle->current_font->palette_index;
+    render_pool.encoding      = handle->encoding;
+    render_pool.timed         = handle->hud.shown;
+
+    render_pool.next  = offset;
+    render_pool.limit = num_indices;
+    render_pool.shown = offset;
+    render_pool.stop  = 0;
+
+    FTDEMO_BROADCAST( render_pool.work );
+    FTDEMO_UNLOCK( render_pool.lock );
+  }
+
+
+  /* wait for the result of index `i', which is the next one to show */
+  static void
+  render_pool_take( int          i,
+                    TRenderJob*  result )
+  {
+    TRenderJob*  job = &render_pool.jobs[i % VIEW_AHEAD];
+
+
+    FTDEMO_LOCK( render_pool.lock );
+
+    while ( !job->ready )
+      FTDEMO_WAIT( render_pool.done, render_pool.lock );
+
+    *result    = *job;
+    job->ready = 0;
+    job->glyph = NULL;
+
+    render_pool.shown++;
+    FTDEMO_BROADCAST( render_pool.work );
+    FTDEMO_UNLOCK( render_pool.lock );
+
+    handle->hud.glyphs_loaded   += result->loaded;
+    handle->hud.glyphs_rendered += result->rendered;
+
+    if ( render_pool.timed )
+    {
+      handle->hud.load_time   += result->load_time;
+      handle->hud.render_time += result->render_time;
+    }
+  }
+
+
+  /* stop the workers and drop the glyphs that were not shown */
+  static void
+  render_pool_end( void )
+  {
+    int  i;
+
+
+    FTDEMO_LOCK( render_pool.lock );
+
+    render_pool.stop = 1;
+    while ( render_pool.busy )
+      FTDEMO_WAIT( render_pool.done, render_pool.lock );
+
+    for ( i = 0; i < VIEW_AHEAD; i++ )
+    {
+      TRenderJob*  job = &render_pool.jobs[i];
+
+
+      if ( job->ready && job->glyph )
+        FT_Done_Glyph( job->glyph );
+
+      job->ready = 0;
+      job->glyph = NULL;
+    }
+
+    FTDEMO_UNLOCK( render_pool.lock );
+  }
+
+
+  static void
+  render_pool_done( void )
+  {
+    int  i;
+
+
+    if ( render_pool.num_threads <= 0 )
+      return;
+
+    FTDEMO_LOCK( render_pool.lock );
+    render_pool.quit = 1;
+    FTDEMO_BROADCAST( render_pool.work );
+    FTDEMO_UNLOCK( render_pool.lock );
+
+    for ( i = 0; i < render_pool.num_threads; i++ )
+    {
+      TRenderWorker*  worker = &render_pool.workers[i];
+
+
+#if defined( FTDEMO_THREADS_PTHREAD )
+      pthread_join( worker->thread, NULL );
+#else
+      WaitForSingleObject( worker->thread, INFINITE );
+      CloseHandle( worker->thread );
+#endif
+
+      if ( worker->face )
+        FT_Done_Face( worker->face );
+    }
+
+    FTDEMO_COND_DONE( render_pool.done );
+    FTDEMO_COND_DONE( render_pool.work );
+    FTDEMO_MUTEX_DONE( render_pool.faces );
+    FTDEMO_MUTEX_DONE( render_pool.lock );
+
+    render_pool.num_threads = 0;
+  }
+
+#else /* !FTDEMO_THREADS_PTHREAD && !FTDEMO_THREADS_WIN32 */
+
+  typedef struct  TRenderJob_
+  {
+    FT_Error  load_error;
+    FT_Pos    advance;
+    FT_Error  error;
+    FT_Glyph  glyph;
+
+  } TRenderJob;
 
-    Next:
-      status.num_fails++;
-    }
 
-    return i - 1;
-  }
+  /* without threads, `Render_All' always renders serially */
+#define render_pool_start()               -1
+#define render_pool_begin( n, offset )    (void)0
+#define render_pool_take( i, result )     (void)0
+#define render_pool_end()                 (void)0
+#define render_pool_done()                (void)0
+
+#endif /* !FTDEMO_THREADS_PTHREAD && !FTDEMO_THREADS_WIN32 */
 
 
   static int
@@ -410,15 +1139,13 @@
               int  offset )
   {
     int  start_x, start_y, step_y, x, y, width;
-    int  i, have_topleft;
+    int  i, have_topleft, parallel;
 
     FT_Size       size;
     FT_Face       face;
     FT_GlyphSlot  slot;
 
-    FT_Color*        palette;
-    FT_Palette_Data  palette_data;
-    FT_UShort        palette_index;
+    TPalette  palette;
 
 
     error = FTDemo_Get_Size( handle, &size );
@@ -432,130 +1159,47 @@
     face = size->face;
     slot = face->glyph;
 
-    palette_index = (FT_UShort)handle->current_font->palette_index;
-    if ( FT_Palette_Select( face, palette_index, &palette ) )
-      palette = NULL;
-    if ( FT_Palette_Data_Get( face, &palette_data ) )
+    if ( select_palette( face,
+                         (FT_UShort)handle->current_font->palette_index,
+                         &palette ) )
       return -1;
 
     have_topleft = 0;
 
+    parallel = status.threads > 1 && render_pool_start() > 0;
+    if ( parallel )
+      render_pool_begin( num_indices, offset );
+
     for ( i = offset; i < num_indices; i++ )
     {
-      FT_LayerIterator  iterator;
-      FT_UInt           glyph_idx;
-
-      FT_Bool  have_layers;
-      FT_UInt  layer_glyph_idx;
-      FT_UInt  layer_color_idx;
+      TRenderJob  job;
 
 
-      glyph_idx = FTDemo_Get_Index( handle, (FT_UInt32)i );
-
-      /* check whether we have glyph color layers */
-      iterator.p  = NULL;
-      have_layers = FT_Get_Color_Glyph_Layer( face,
-                                              glyph_idx,
-                                              &layer_glyph_idx,
-                                              &layer_color_idx,
-                                              &iterator );
+      if ( frame_over_budget() )
+        break;
 
-      if ( palette && have_layers && handle->use_layers )
+      if ( parallel )
+        render_pool_take( i, &job );
+      else
       {
-        FT_Int32  load_flags = handle->load_flags;
-
-        FT_Bitmap  bitmap;
-        FT_Vector  bitmap_offset = { 0, 0 };
-
-
-        /*
-         * We want to handle glyph layers manually, thus switching off
-         * `FT_LOAD_COLOR' and ensuring normal AA render mode.
-         */
-        load_flags &= ~FT_LOAD_COLOR;
-        load_flags |=  FT_LOAD_RENDER;
-
-        load_flags &= ~FT_LOAD_TARGET_( 0xF );
-        load_flags |=  FT_LOAD_TARGET_NORMAL;
-
-        FT_Bitmap_Init( &bitmap );
-
-        do
-        {
-          FT_Vector  slot_offset;
-          FT_Color   color;
-
-
-          error = FT_Load_Glyph( face, layer_glyph_idx, load_flags );
-          if ( error )
-            break;
-
-          slot_offset.x = slot->bitmap_left * 64;
-          slot_offset.y = slot->bitmap_top * 64;
-
-          if ( layer_color_idx == 0xFFFF )
-          {
-            // TODO: FT_Palette_Get_Foreground_Color
-            if ( palette_data.palette_flags                  &&
-               ( palette_data.palette_flags[palette_index] &
-                   FT_PALETTE_FOR_DARK_BACKGROUND          ) )
-            {
-              /* white opaque */
-              color.blue  = 0xFF;
-              color.green = 0xFF;
-              color.red   = 0xFF;
-              color.alpha = 0xFF;
-            }
-            else
-            {
-              /* black opaque */
-              color.blue  = 0x00;
-              color.green = 0x00;
-              color.red   = 0x00;
-              color.alpha = 0xFF;
-            }
-          }
-          else if ( layer_color_idx < palette_data.num_palette_entries )
-            color = palette[layer_color_idx];
-          else
-            continue;
-
-          error = FT_Bitmap_Blend( handle->library,
-                                   &slot->bitmap,
-                                   slot_offset,
-                                   &bitmap,
-                                   &bitmap_offset,
-                                   color );
-
-        } while ( FT_Get_Color_Glyph_Layer( face,
-                                            glyph_idx,
-                                            &layer_glyph_idx,
-                                            &layer_color_idx,
-                                            &iterator ) );
+        FT_UInt  glyph_idx = FTDemo_Get_Index( handle, (FT_UInt32)i );
 
-        if ( error )
-        {
-          FT_Bitmap_Done( handle->library, &bitmap );
-          goto Next;
-        }
-        else
-        {
-          FT_Bitmap_Done( handle->library, &slot->bitmap );
 
-          slot->bitmap      = bitmap;
-          slot->bitmap_left = bitmap_offset.x / 64;
-          slot->bitmap_top  = bitmap_offset.y / 64;
-        }
-      }
-      else
-      {
-        error = FT_Load_Glyph( face, glyph_idx, handle->load_flags );
-        if ( error )
-          goto Next;
+        job.load_error = load_glyph( handle, face, glyph_idx,
+                                     handle->load_flags,
+                                     handle->use_layers,
+                                     &palette );
+        job.advance    = slot->advance.x;
+        job.error      = FT_Err_Ok;
+        job.glyph      = NULL;
       }
 
-      width = slot->advance.x ? slot->advance.x >> 6
-                              : size->metrics.y_ppem / 2;
+      error = job.load_error;
+      if ( error )
+        goto Next;
+
+      width = job.advance ? job.advance >> 6
+                          : size->metrics.y_ppem / 2;
 
       if ( X_TOO_LONG( x + width, display ) )
       {
@@ -563,19 +1207,35 @@
         y += step_y;
 
         if ( Y_TOO_LONG( y, display ) )
+        {
+          if ( parallel && job.glyph )
+            FT_Done_Glyph( job.glyph );
           break;
+        }
       }
 
       /* extra space between glyphs */
       x++;
-      if ( slot->advance.x == 0 )
+      if ( job.advance == 0 )
       {
         grFillRect( display->bitmap, x, y - width, width, width,
                     display->warn_color );
         x += width;
       }
 
-      error = FTDemo_Draw_Slot( handle, display, slot, &x, &y );
+      if ( parallel )
+      {
+        error = job.error;
+        if ( !error )
+        {
+          /* this frees the glyph on error */
+          error = FTDemo_Draw_Glyph( handle, display, job.glyph, &x, &y );
+          if ( !error )
+            FT_Done_Glyph( job.glyph );
+        }
+      }
+      else
+        error = FTDemo_Draw_Slot( handle, display, slot, &x, &y );
 
       if ( error )
         goto Next;
@@ -592,6 +1252,9 @@
       status.num_fails++;
     }
 
+    if ( parallel )
+      render_pool_end();
+
     return i - 1;
   }
 
@@ -638,6 +1301,9 @@
       FT_UInt  glyph_idx;
 
 
+      if ( frame_over_budget() )
+        break;
+
       ch = utf8_next( &p, pEnd );
       if ( ch < 0 )
       {
@@ -681,117 +1347,372 @@
   }
 
 
-  static int
-  Render_Waterfall( int  mid_size,
-                    int  offset )
+  /* A waterfall row, drawn from pen position (START_X, 0); it depends */
+  /* on the size, the offset into `Text', and the display width.       */
+  typedef struct  TWaterfallKey_
   {
-    int      start_x, start_y, step_y, x, y;
-    int      pt_size, step, pt_height;
-    FT_Size  size;
-    int      have_topleft, start;
+    int  pt_size;
+    int  offset;
+    int  width;
+
+  } TWaterfallKey;
+
+
+  static FTDemo_Row*
+  waterfall_row( FTDemo_Display*  disp,
+                 int              pt_size,
+                 int              offset )
+  {
+    TWaterfallKey  key;
+    FTDemo_Row*    row;
+    FT_Size        size;
+    int            x, y, ch, start;
 
     char         text[256];
     const char*  p;
     const char*  pEnd;
 
 
-    start_x = START_X;
+    FTDemo_Set_Current_Charsize( handle, pt_size, status.res );
+
+    memset( &key, 0, sizeof ( key ) );
+    key.pt_size = pt_size;
+    key.offset  = offset;
+    key.width   = disp->bitmap->width;
+
+    row = FTDemo_Row_Lookup( handle, disp, &key, sizeof ( key ) );
+    if ( row )
+      return row;
+
+    row = FTDemo_Row_Record( handle, disp, &key, sizeof ( key ) );
+    if ( !row )
+      return NULL;
+
+    row->first_char = -1;
+    row->num_fails  = 0;
+
+    row->error = FTDemo_Get_Size( handle, &size );
+    if ( row->error )
+    {
+      /* probably a non-existent bitmap font size */
+      return FTDemo_Row_End( handle );
+    }
+
+    row->metrics = size->metrics;
+
+    p    = Text;
+    pEnd = p + strlen( Text );
+
+    while ( offset-- )
+    {
+      ch = utf8_next( &p, pEnd );
+      if ( ch < 0 )
+      {
+        p  = Text;
+        ch = utf8_next( &p, pEnd );
+      }
+    }
+
+    start = snprintf( text, 256, "%g: ", pt_size / 64.0 );
+    snprintf( text + start, (unsigned int)( 256 - start ), "%s", p );
+
+    p    = text;
+    pEnd = p + strlen( text );
+
+    x = START_X;
+    y = 0;
+
+    while ( 1 )
+    {
+      FT_UInt      glyph_idx;
+      const char*  oldp;
+
+
+      oldp = p;
+      ch   = utf8_next( &p, pEnd );
+      if ( ch < 0 )
+      {
+        /* end of the text (or invalid UTF-8) */
+        break;
+      }
+
+      glyph_idx = FTDemo_Get_Index( handle, (FT_UInt32)ch );
+
+      error = FTDemo_Draw_Index( handle, disp, glyph_idx, &x, &y );
+
+      if ( error )
+        goto Next;
+
+      /* `topleft' should be the first character after the size string */
+      if ( oldp - text == start )
+        row->first_char = ch;
+
+      if ( X_TOO_LONG( x + ( size->metrics.max_advance >> 6 ), disp ) )
+        break;
+
+      continue;
+
+    Next:
+      row->num_fails++;
+    }
+
+    return FTDemo_Row_End( handle );
+  }
+
+
+  /* the point sizes of a waterfall for `rows' pixels follow `*pt_size' */
+  static int
+  waterfall_step( int   rows,
+                  int   mid_size,
+                  int*  pt_size )
+  {
+    int  pt_height = 64 * 72 * rows / status.res;
+    int  step      = ( mid_size * mid_size / pt_height + 64 ) & ~63;
+
+
+    *pt_size = mid_size - step * ( mid_size / step );  /* remainder */
+
+    return step;
+  }
+
+
+  static int
+  Render_Waterfall( int  mid_size,
+                    int  offset )
+  {
+    int          start_y, step_y, y;
+    int          pt_size, step;
+    int          have_topleft;
+    FT_Size      size;
+    FTDemo_Row*  row;
+
+
     start_y = START_Y;
 
     have_topleft = 0;
 
-    pt_height = 64 * 72 * display->bitmap->rows / status.res;
-    step      = ( mid_size * mid_size / pt_height + 64 ) & ~63;
-    pt_size   = mid_size - step * ( mid_size / step );  /* remainder */
+    step = waterfall_step( display->bitmap->rows, mid_size, &pt_size );
 
     while ( 1 )
     {
-      int first = offset;
-      int ch;
-
+      if ( frame_over_budget() )
+        break;
 
       pt_size += step;
 
-      FTDemo_Set_Current_Charsize( handle, pt_size, status.res );
+      /* rows drawn before are only blitted */
+      row = waterfall_row( display, pt_size, offset );
+      if ( !row )
+      {
+        error = FT_Err_Out_Of_Memory;
+        break;
+      }
 
-      error = FTDemo_Get_Size( handle, &size );
+      error = row->error;
       if ( error )
-      {
-        /* probably a non-existent bitmap font size */
         continue;
-      }
 
-      step_y = ( size->metrics.height >> 6 ) + 1;
+      step_y = ( row->metrics.height >> 6 ) + 1;
 
-      x = start_x;
-      y = start_y + ( size->metrics.ascender >> 6 );
+      y = start_y + ( row->metrics.ascender >> 6 );
 
       start_y += step_y;
 
       if ( y >= display->bitmap->rows )
         break;
 
-      p    = Text;
-      pEnd = p + strlen( Text );
+      FTDemo_Row_Draw( handle, display, row, 0, y );
 
-      while ( first-- )
+      status.num_fails += row->num_fails;
+
+      if ( row->first_char >= 0 && !have_topleft )
       {
-        ch = utf8_next( &p, pEnd );
-        if ( ch < 0 )
-        {
-          p  = Text;
-          ch = utf8_next( &p, pEnd );
-        }
+        have_topleft   = 1;
+        status.topleft = row->first_char;
       }
+    }
+
+    FTDemo_Set_Current_Charsize( handle, mid_size, status.res );
+    FTDemo_Get_Size( handle, &size );
+
+    return -1;
+  }
+
+
+  /* the display as seen by the prefetch functions */
+  static FTDemo_Display  prefetch_display;
+  static grBitmap        prefetch_bitmap;
+
+
+  /* While waiting for input, record the rows of the next smaller and */
+  /* larger waterfall, so that the `Up' and `Down' keys only blit.    */
+  static void
+  waterfall_prefetch( FTDemo_Handle*  h,
+                      void*           data )
+  {
+    static const int  deltas[2] = { 64, -64 };
+
+    FT_Size  size;
+    int      i;
 
-      start = snprintf( text, 256, "%g: ", pt_size / 64.0 );
-      snprintf( text + start, (unsigned int)( 256 - start ), "%s", p );
+    FT_UNUSED( data );
 
-      p    = text;
-      pEnd = p + strlen( text );
 
-      while ( 1 )
+    for ( i = 0; i < 2; i++ )
+    {
+      int  mid_size = status.ptsize + deltas[i];
+      int  start_y  = START_Y;
+      int  pt_size, step;
+
+
+      if ( mid_size < 64 || mid_size > MAXPTSIZE * 64 )
+        continue;
+
+      step = waterfall_step( prefetch_bitmap.rows, mid_size, &pt_size );
+
+      while ( !FTDemo_Idle_Stopping( h ) )
       {
-        FT_UInt      glyph_idx;
-        const char*  oldp;
+        FTDemo_Row*  row;
+        int          y;
 
 
-        oldp = p;
-        ch   = utf8_next( &p, pEnd );
-        if ( ch < 0 )
-        {
-          /* end of the text (or invalid UTF-8); continue to next size */
+        pt_size += step;
+        if ( pt_size > MAXPTSIZE * 64 )
           break;
-        }
 
-        glyph_idx = FTDemo_Get_Index( handle, (FT_UInt32)ch );
-
-        error = FTDemo_Draw_Index( handle, display, glyph_idx, &x, &y );
+        row = waterfall_row( &prefetch_display, pt_size, status.offset );
+        if ( !row )
+          break;
+        if ( row->error )
+          continue;
 
-        if ( error )
-          goto Next;
+        y = start_y + ( row->metrics.ascender >> 6 );
 
-        /* `topleft' should be the first character after the size string */
-        if ( oldp - text == start && !have_topleft )
-        {
-          have_topleft   = 1;
-          status.topleft = ch;
-        }
+        start_y += ( row->metrics.height >> 6 ) + 1;
 
-        if ( X_TOO_LONG( x + ( size->metrics.max_advance >> 6 ), display ) )
+        if ( y >= prefetch_bitmap.rows )
           break;
+      }
+    }
+
+    FTDemo_Set_Current_Charsize( h, status.ptsize, status.res );
+    FTDemo_Get_Size( h, &size );
+  }
+
+
+  /* the fonts before and after the current one opened in the background */
+#define VIEW_PREFETCH_FONTS  2
+
+  /* what `font_prefetch' has done */
+  static struct
+  {
+    int       done;
+    int       font_idx;
+    int       ptsize;
+    int       res;
+    FT_Int32  load_flags;
+    int       offset;
+
+  } prefetched;
+
+
+  /* Open `font' at the current size, which also reads its charmap   */
+  /* and runs its hinting programs, and load the first glyph shown.  */
+  /* The other glyphs are left to `Render_All', which does not use   */
+  /* the FreeType caches, so that `FTDemo_Idle_Stop' waits for this  */
+  /* function no longer than for opening the font.                   */
+  static void
+  font_prefetch_one( FTDemo_Handle*  h,
+                     PFont           font )
+  {
+    PFont          current_font = h->current_font;
+    FTC_ScalerRec  scaler       = h->scaler;
+    unsigned long  encoding     = h->encoding;
+    int            num_indices  = font->num_indices;
+
+    FT_Size  size;
+    int      i;
+
+
+    FTDemo_Set_Current_Font( h, font );
+    FTDemo_Set_Current_Charsize( h, status.ptsize, status.res );
+
+    if ( !FTDemo_Get_Size( h, &size ) )
+    {
+      i = status.offset < font->num_indices ? status.offset
+                                            : font->num_indices - 1;
+      if ( i < 0 )
+        i = 0;
+
+      FT_Load_Glyph( size->face, FTDemo_Get_Index( h, (FT_UInt32)i ),
+                     h->load_flags );
+    }
+
+    /* `FTDemo_Set_Current_Font' sets it again when switching */
+    font->num_indices = num_indices;
+
+    h->current_font = current_font;
+    h->scaler       = scaler;
+    h->encoding     = encoding;
+  }
+
+
+  /* While waiting for input, open the adjacent fonts so that `n' and */
+  /* `p' need not wait for files to be read and sizes to be set.      */
+  static void
+  font_prefetch( FTDemo_Handle*  h )
+  {
+    int  d, n;
+
+
+    if ( prefetched.done                           &&
+         prefetched.font_idx   == status.font_idx &&
+         prefetched.ptsize     == status.ptsize   &&
+         prefetched.res        == status.res      &&
+         prefetched.load_flags == h->load_flags   &&
+         prefetched.offset     == status.offset   )
+      return;
+
+    prefetched.done = 0;
+
+    for ( d = 1; d <= VIEW_PREFETCH_FONTS; d++ )
+    {
+      /* first the next font, then the previous one */
+      int  idx[2];
 
-        continue;
 
-      Next:
-        status.num_fails++;
+      idx[0] = status.font_idx + d;
+      idx[1] = status.font_idx - d;
+
+      for ( n = 0; n < 2; n++ )
+      {
+        if ( idx[n] < 0 || idx[n] >= h->num_fonts )
+          continue;
+
+        if ( FTDemo_Idle_Stopping( h ) )
+          return;
+
+        font_prefetch_one( h, h->fonts[idx[n]] );
       }
     }
 
-    FTDemo_Set_Current_Charsize( handle, mid_size, status.res );
-    FTDemo_Get_Size( handle, &size );
+    prefetched.done       = 1;
+    prefetched.font_idx   = status.font_idx;
+    prefetched.ptsize     = status.ptsize;
+    prefetched.res        = status.res;
+    prefetched.load_flags = h->load_flags;
+    prefetched.offset     = status.offset;
+  }
 
-    return -1;
+
+  static void
+  idle_prefetch( FTDemo_Handle*  h,
+                 void*           data )
+  {
+    if ( status.render_mode == RENDER_MODE_WATERFALL )
+      waterfall_prefetch( h, data );
+
+    font_prefetch( h );
   }
 
 
@@ -864,7 +1785,7 @@
     grWriteln( "             engines (if available)                                         " );
     grWriteln( "f           toggle forced auto-         Tab         cycle through charmaps  " );
     grWriteln( "             hinting (if hinting)                                           " );
-    grWriteln( "                                        P           print PNG file          " );
+    grWriteln( "T           toggle performance HUD      P           print PNG file          " );
     grWriteln( "                                        q, ESC      quit ftview             " );
     /*          |----------------------------------|    |----------------------------------| */
     grLn();
@@ -885,6 +1806,7 @@
 
     FTC_Manager_RemoveFaceID( handle->cache_manager,
                               handle->scaler.face_id );
+    FTDemo_Row_Flush( handle );
 
     /* keep it normalized and balanced */
     status.filter_weights[    i] += delta;
@@ -1094,15 +2016,35 @@
   static int
   Process_Event( void )
   {
-    grEvent  event;
-    int      ret = 0;
+    static grEvent  event;   /* kept to replay merged repetitions */
+    int             ret = 0;
+    int             steps;
 
 
-    if ( *status.keys )
-      event.key = grKEY( *status.keys++ );
+    if ( event.count > 1 )
+      event.count--;
+    else if ( *status.keys )
+    {
+      event.key   = grKEY( *status.keys++ );
+      event.count = 1;
+    }
     else
     {
-      grListenSurface( display->surface, 0, &event );
+      /* don't delay pending events */
+      if ( !grSurfaceEventPending( display->surface ) )
+      {
+        prefetch_bitmap          = *display->bitmap;
+        prefetch_bitmap.buffer   = NULL;
+        prefetch_display         = *display;
+        prefetch_display.bitmap  = &prefetch_bitmap;
+        prefetch_display.surface = NULL;
+
+        FTDemo_Idle_Start( handle, idle_prefetch, NULL );
+      }
+
+      grListenSurface( display->surface, gr_event_coalesce, &event );
+
+      FTDemo_Idle_Stop( handle );
 
       if ( event.type == gr_event_resize )
       {
@@ -1113,6 +2055,31 @@
 
     status.update = 0;
 
+    /* keys stepping through sizes and glyph indices take all merged */
+    /* repetitions at once, getting a single frame; other keys are   */
+    /* replayed by the next calls                                    */
+    switch ( event.key )
+    {
+    case grKeyUp:
+    case grKeyDown:
+    case grKeyPageUp:
+    case grKeyPageDown:
+    case grKeyLeft:
+    case grKeyRight:
+    case grKeyF7:
+    case grKeyF8:
+    case grKeyF9:
+    case grKeyF10:
+    case grKeyF11:
+    case grKeyF12:
+      steps       = event.count;
+      event.count = 1;
+      break;
+
+    default:
+      steps = 1;
+    }
+
     if ( status.render_mode == (int)( event.key - '1' ) )
       return ret;
     if ( event.key >= '1' && event.key < '1' + N_RENDER_MODES )
@@ -1163,6 +2130,11 @@
       status.update = 0;
       break;
 
+    case grKEY( 'T' ):
+      handle->hud.shown = !handle->hud.shown;
+      status.update     = 1;
+      break;
+
     case grKEY( 'b' ):
       handle->use_sbits = !handle->use_sbits;
       FTDemo_Update_Current_Flags( handle );
@@ -1210,7 +2182,8 @@
       break;
 
     case grKEY( 'H' ):
-      status.update = FTDemo_Hinting_Engine_Change( handle );
+      status.update   = FTDemo_Hinting_Engine_Change( handle );
+      prefetched.done = 0;   /* the cache manager has been reset */
       break;
 
     case grKEY( 'l' ):
@@ -1298,41 +2271,41 @@
       break;
 
     case grKeyUp:
-      status.update = event_size_change( 64 );
+      status.update = event_size_change( 64 * steps );
       break;
     case grKeyDown:
-      status.update = event_size_change( -64 );
+      status.update = event_size_change( -64 * steps );
       break;
     case grKeyPageUp:
-      status.update = event_size_change( 640 );
+      status.update = event_size_change( 640 * steps );
       break;
     case grKeyPageDown:
-      status.update = event_size_change( -640 );
+      status.update = event_size_change( -640 * steps );
       break;
 
     case grKeyLeft:
-      status.update = event_index_change( -1 );
+      status.update = event_index_change( -steps );
       break;
     case grKeyRight:
-      status.update = event_index_change( 1 );
+      status.update = event_index_change( steps );
       break;
     case grKeyF7:
-      status.update = event_index_change( -0x10 );
+      status.update = event_index_change( -0x10 * steps );
       break;
     case grKeyF8:
-      status.update = event_index_change( 0x10 );
+      status.update = event_index_change( 0x10 * steps );
       break;
     case grKeyF9:
-      status.update = event_index_change( -0x100 );
+      status.update = event_index_change( -0x100 * steps );
       break;
     case grKeyF10:
-      status.update = event_index_change( 0x100 );
+      status.update = event_index_change( 0x100 * steps );
       break;
     case grKeyF11:
-      status.update = event_index_change( -0x1000 );
+      status.update = event_index_change( -0x1000 * steps );
       break;
     case grKeyF12:
-      status.update = event_index_change( 0x1000 );
+      status.update = event_index_change( 0x1000 * steps );
       break;
 
     default:
@@ -1349,6 +2322,7 @@
     case grKEY( 'L' ):
       FTC_Manager_RemoveFaceID( handle->cache_manager,
                                 handle->scaler.face_id );
+      FTDemo_Row_Flush( handle );
 
       status.lcd_filter++;
       switch ( status.lcd_filter )
@@ -1676,6 +2650,9 @@
     fprintf( stderr,
       "  -L N,...  Set LCD filter or geometry by comma-separated values.\n"
       "  -p        Preload file in memory to simulate memory-mapping.\n"
+      "  -P        Map file into memory.\n"
+      "  -j N      Load and render the glyphs of the `all glyphs' mode\n"
+      "            with N threads (default: 1, i.e., serially).\n"
       "\n"
       "  -v        Show version.\n"
       "\n" );
@@ -1696,7 +2673,7 @@
 
     while ( 1 )
     {
-      option = getopt( *argc, *argv, "d:e:f:k:L:l:m:pr:v" );
+      option = getopt( *argc, *argv, "d:e:f:j:k:L:l:m:pPr:v" );
 
       if ( option == -1 )
         break;
@@ -1715,6 +2692,12 @@
         status.offset = atoi( optarg );
         break;
 
+      case 'j':
+        status.threads = atoi( optarg );
+        if ( status.threads < 1 )
+          usage( execname );
+        break;
+
       case 'k':
         status.keys = optarg;
         while ( *optarg && *optarg != 'q' )
@@ -1776,7 +2759,11 @@
         break;
 
       case 'p':
-        status.preload = 1;
+        status.preload = PRELOAD_READ;
+        break;
+
+      case 'P':
+        status.preload = PRELOAD_MAP;
         break;
 
       case 'r':
@@ -1834,7 +2821,7 @@
                                (FT_LcdFilter)status.lcd_filter );
 
     if ( status.preload )
-      FTDemo_Set_Preload( handle, 1 );
+      FTDemo_Set_Preload( handle, status.preload );
 
     for ( ; argc > 0; argc--, argv++ )
       FTDemo_Install_Font( handle, argv[0], 0, 0 );
@@ -1846,6 +2833,9 @@
     if ( !display )
       Fatal( "could not allocate display surface" );
 
+    /* only repaint what changes between frames */
+    grSetSurfaceTracking( display->surface, 1 );
+
     grSetTitle( display->surface,
                 "FreeType Glyph Viewer - press ? for help" );
     FTDemo_Icon( handle, display );
@@ -1856,9 +2846,12 @@
 
     do
     {
-      if ( !status.update )
+      if ( !status.update && !status.truncated )
         continue;
 
+      status.truncated = 0;
+
+      FTDemo_Frame_Begin( handle );
       FTDemo_Display_Clear( display );
 
       switch ( status.render_mode )
@@ -1887,6 +2880,7 @@
         break;
       }
 
+      FTDemo_Frame_End( handle, display );
       write_header( last );
 
     } while ( Process_Event() == 0 );
@@ -1894,6 +2888,8 @@
     printf( "Execution completed successfully.\n" );
     printf( "Fails = %d\n", status.num_fails );
 
+    render_pool_done();
+
     FTDemo_Display_Done( display );
     FTDemo_Done( handle );
     exit( 0 );      /* for safety reasons */
@@ -13,6 +13,9 @@
 /*                typical usage patterns yet, and the algorithm             */
 /*                can still be tuned.                                       */
 /*                                                                          */
+/*  It also measures the blitters of the graphics library for all source    */
+/*  and target formats, drawing lines of text rendered from a font.         */
+/*                                                                          */
 /****************************************************************************/
 
 
@@ -30,6 +33,9 @@
   *                typical usage patterns yet, and the algorithm
   *                can still be tuned
   *
+  *  The `blitter matrix' at the end measures the real blitters of
+  *  `graph/gblblit.c' instead.
+  *
   */
 
 #ifdef UNIX
@@ -37,6 +43,14 @@
 #endif
 #include "gbench.h"
 
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_LCD_FILTER_H
+
+#include "graph.h"
+#include "gblblit.h"
+#include "grswizzle.h"
+
 #define  xxCACHE
 
   static  int             use_gamma = 0;
@@ -646,102 +660,1540 @@ dump_cache_stats( void )
 }
 
 
-void usage(void)
+  /*************************************************************************/
+  /*                                                                       */
+  /*  The blitter matrix.  Unlike the prototype above, this measures the   */
+  /*  real blitters of the graphics library: every source format is drawn  */
+  /*  with `grBlitGlyphToSurface' onto every target format, using glyphs   */
+  /*  of a font (or the built-in `W' if none is given) laid out in lines   */
+  /*  of text, as the demo programs do.                                    */
+  /*                                                                       */
+  /*************************************************************************/
+
+#define  MATRIX_TIME  0.2
+
+double  matrix_time = MATRIX_TIME;
+
+static const char  matrix_text[] =
+  "The quick brown fox jumps over the lazy dog. "
+  "Pack my box with five dozen liquor jugs! "
+  "(0123456789) {glyph_blit[n] = x + y * 2;} "
+  "SPHINX OF BLACK QUARTZ, JUDGE MY VOW? ";
+
+
+  typedef struct  MatrixGlyphRec_
+  {
+    grBitmap  bitmap;
+    int       left;
+    int       top;
+    int       advance;
+
+  } MatrixGlyphRec, *MatrixGlyph;
+
+
+  typedef struct  MatrixSourceRec_
+  {
+    const char*     name;
+    grPixelMode     mode;
+    MatrixGlyphRec  glyphs[128];
+
+  } MatrixSourceRec;
+
+
+  /* indexed by `GBlenderSourceFormat' */
+  static MatrixSourceRec  matrix_sources[GBLENDER_SOURCE_MAX] =
+  {
+    { "gray8", gr_pixel_mode_gray,  { { { 0 }, 0, 0, 0 } } },
+    { "hrgb",  gr_pixel_mode_lcd,   { { { 0 }, 0, 0, 0 } } },
+    { "hbgr",  gr_pixel_mode_lcd2,  { { { 0 }, 0, 0, 0 } } },
+    { "vrgb",  gr_pixel_mode_lcdv,  { { { 0 }, 0, 0, 0 } } },
+    { "vbgr",  gr_pixel_mode_lcdv2, { { { 0 }, 0, 0, 0 } } },
+    { "bgra",  gr_pixel_mode_bgra,  { { { 0 }, 0, 0, 0 } } },
+    { "mono",  gr_pixel_mode_mono,  { { { 0 }, 0, 0, 0 } } },
+  };
+
+
+  /* indexed by `GBlenderTargetFormat' */
+  static const struct
+  {
+    const char*  name;
+    grPixelMode  mode;
+
+  } matrix_targets[GBLENDER_TARGET_MAX] =
+  {
+    { "gray8",  gr_pixel_mode_gray   },
+    { "rgb32",  gr_pixel_mode_rgb32  },
+    { "rgb24",  gr_pixel_mode_rgb24  },
+    { "rgb565", gr_pixel_mode_rgb565 },
+    { "rgb555", gr_pixel_mode_rgb555 },
+  };
+
+
+  /* the colors of a text page, as 0xRRGGBB */
+  typedef struct  MatrixSceneRec_
+  {
+    char          key;
+    const char*   title;
+    unsigned int  back_left;   /* a horizontal gradient if different */
+    unsigned int  back_right;
+    unsigned int  fore[6];     /* cycled at each word */
+
+  } MatrixSceneRec;
+
+  static const MatrixSceneRec  matrix_scenes[] =
+  {
+    { 't', "dark text on white",
+      0xFFFFFF, 0xFFFFFF, { 0x000000, 0x000000, 0x000000,
+                            0x000000, 0x000000, 0x000000 } },
+    { 'i', "light text on dark gray",
+      0x202020, 0x202020, { 0xE0E0E0, 0xE0E0E0, 0xE0E0E0,
+                            0xE0E0E0, 0xE0E0E0, 0xE0E0E0 } },
+    { 'p', "syntax colors on beige",
+      0xFDF6E3, 0xFDF6E3, { 0x586E75, 0xB58900, 0x268BD2,
+                            0x859900, 0xD33682, 0x2AA198 } },
+    { 'g', "dark text on a gradient",
+      0x3060C0, 0xF0E0A0, { 0x101010, 0x101010, 0x101010,
+                            0x101010, 0x101010, 0x101010 } },
+  };
+
+#define  MATRIX_SCENES  (int)( sizeof ( matrix_scenes ) /   \
+                               sizeof ( matrix_scenes[0] ) )
+
+
+  /* one page of text: glyph positions and colors */
+  typedef struct  MatrixItemRec_
+  {
+    MatrixGlyph  glyph;
+    int          x;
+    int          y;
+    int          color;   /* index in `fore' */
+
+  } MatrixItemRec;
+
+#define  MATRIX_ITEMS  8192
+
+  static MatrixItemRec  matrix_items[MATRIX_ITEMS];
+
+
+static int
+matrix_bitmap_new( grBitmap*    bitmap,
+                   grPixelMode  mode,
+                   int          width,
+                   int          rows,
+                   int          pitch )
 {
-  fprintf( stderr,
-    "gbench: graphics glyph blending benchmark\n"
-    "-----------------------------------------\n\n"
-    "Usage: gbench [options]\n\n"
-    "options:\n" );
-  fprintf( stderr,
-  "   -t : max time per bench in seconds (default is %.0f)\n", BENCH_TIME );
-  fprintf( stderr,
-  "   -s seed  : specify random seed\n" );
-  fprintf( stderr,
-  "   -g gamma : specify gamma\n" );
-  exit( 1 );
+  bitmap->mode   = mode;
+  bitmap->grays  = mode == gr_pixel_mode_mono ? 0 : 256;
+  bitmap->width  = width;
+  bitmap->rows   = rows;
+  bitmap->pitch  = pitch;
+  bitmap->buffer = (unsigned char*)calloc( (size_t)( pitch * rows ) + 1,
+                                           1 );
+
+  return bitmap->buffer == NULL;
 }
 
-#define TEST(x) (!tests || strchr(tests, x))
 
-int
-main(int argc,
-     char** argv)
+ /* derive the other source formats from a gray glyph */
+static void
+matrix_glyph_derive( MatrixGlyph           glyph,
+                     GBlenderSourceFormat  format,
+                     const grBitmap*       gray,
+                     int                   charcode )
 {
-  char* tests = NULL;
-  int size;
-  double gamma = 1.0;
+  int  w = gray->width;
+  int  h = gray->rows;
+  int  x, y, c;
 
-  while (argc > 1 && argv[1][0] == '-')
+  /* a different opaque color for each character */
+  unsigned int  rgb[3];
+
+
+  rgb[0] = 64 + ( charcode * 53 ) % 192;
+  rgb[1] = 64 + ( charcode * 97 ) % 192;
+  rgb[2] = 64 + ( charcode * 29 ) % 192;
+
+  switch ( format )
   {
-    switch (argv[1][1])
-    {
-    case 't':
-      argc--;
-      argv++;
-      if (argc < 1 ||
-          sscanf(argv[1], "%lf", &bench_time) != 1)
-        usage();
+  case GBLENDER_SOURCE_HRGB:
+  case GBLENDER_SOURCE_HBGR:
+    if ( matrix_bitmap_new( &glyph->bitmap, matrix_sources[format].mode,
+                            3 * w, h, 3 * w ) )
       break;
-
-    case 'g':
-      argc--;
-      argv++;
-      if (argc < 1 ||
-          sscanf(argv[1], "%lf", &gamma) != 1)
-        usage();
+    for ( y = 0; y < h; y++ )
+      for ( x = 0; x < 3 * w; x++ )
+        glyph->bitmap.buffer[y * 3 * w + x] =
+          gray->buffer[y * gray->pitch + x / 3];
+    break;
+
+  case GBLENDER_SOURCE_VRGB:
+  case GBLENDER_SOURCE_VBGR:
+    if ( matrix_bitmap_new( &glyph->bitmap, matrix_sources[format].mode,
+                            w, 3 * h, w ) )
       break;
+    for ( y = 0; y < 3 * h; y++ )
+      memcpy( glyph->bitmap.buffer + y * w,
+              gray->buffer + ( y / 3 ) * gray->pitch, (size_t)w );
+    break;
+
+  case GBLENDER_SOURCE_BGRA:
+    if ( matrix_bitmap_new( &glyph->bitmap, gr_pixel_mode_bgra,
+                            w, h, 4 * w ) )
+      break;
+    for ( y = 0; y < h; y++ )
+      for ( x = 0; x < w; x++ )
+      {
+        unsigned int    a = gray->buffer[y * gray->pitch + x];
+        unsigned char*  p = glyph->bitmap.buffer + y * 4 * w + 4 * x;
 
 
-    case 's':
-      if ( argc < 1 )
-        usage();
+        /* premultiplied */
+        for ( c = 0; c < 3; c++ )
+          p[c] = (unsigned char)( rgb[2 - c] * a / 255 );
+        p[3] = (unsigned char)a;
+      }
+    break;
 
-      seed = (unsigned long)atol( argv[1] );
-      argc -= 2;
-      argv += 2;
+  case GBLENDER_SOURCE_MONO:
+    if ( matrix_bitmap_new( &glyph->bitmap, gr_pixel_mode_mono,
+                            w, h, ( w + 7 ) >> 3 ) )
       break;
-
-#if 0
-    case 'b':
-      argc--;
-      argv++;
-      if (argc < 2)
-        usage();
-      tests = argv[1];
+    for ( y = 0; y < h; y++ )
+      for ( x = 0; x < w; x++ )
+        if ( gray->buffer[y * gray->pitch + x] >= 128 )
+          glyph->bitmap.buffer[y * glyph->bitmap.pitch + ( x >> 3 )] |=
+            (unsigned char)( 0x80 >> ( x & 7 ) );
+    break;
+
+  default:
+    if ( matrix_bitmap_new( &glyph->bitmap, gr_pixel_mode_gray,
+                            w, h, w ) )
       break;
-#endif
+    for ( y = 0; y < h; y++ )
+      memcpy( glyph->bitmap.buffer + y * w,
+              gray->buffer + y * gray->pitch, (size_t)w );
+  }
+}
 
-    default:
-      fprintf(stderr, "Unknown argument `%s'\n\n", argv[1]);
-      usage();
+
+static int
+matrix_glyph_render( FT_Face               face,
+                     MatrixGlyph           glyph,
+                     GBlenderSourceFormat  format,
+                     int                   charcode )
+{
+  FT_Int32        load_flags;
+  FT_Render_Mode  render_mode;
+  grPixelMode     mode = matrix_sources[format].mode;
+  FT_Bitmap*      bitmap;
+  int             y;
+
+
+  switch ( format )
+  {
+  case GBLENDER_SOURCE_HRGB:
+  case GBLENDER_SOURCE_HBGR:
+    load_flags  = FT_LOAD_TARGET_LCD;
+    render_mode = FT_RENDER_MODE_LCD;
+    break;
+  case GBLENDER_SOURCE_VRGB:
+  case GBLENDER_SOURCE_VBGR:
+    load_flags  = FT_LOAD_TARGET_LCD_V;
+    render_mode = FT_RENDER_MODE_LCD_V;
+    break;
+  case GBLENDER_SOURCE_BGRA:
+    load_flags  = FT_LOAD_COLOR;
+    render_mode = FT_RENDER_MODE_NORMAL;
+    break;
+  case GBLENDER_SOURCE_MONO:
+    load_flags  = FT_LOAD_TARGET_MONO;
+    render_mode = FT_RENDER_MODE_MONO;
+    break;
+  default:
+    load_flags  = FT_LOAD_DEFAULT;
+    render_mode = FT_RENDER_MODE_NORMAL;
+  }
+
+  if ( FT_Load_Char( face, (FT_ULong)charcode, load_flags )     ||
+       FT_Render_Glyph( face->glyph, render_mode ) )
+    return 1;
+
+  bitmap         = &face->glyph->bitmap;
+  glyph->left    = face->glyph->bitmap_left;
+  glyph->top     = face->glyph->bitmap_top;
+  glyph->advance = (int)( ( face->glyph->advance.x + 32 ) >> 6 );
+
+  /* most fonts have no color glyphs; tint the gray ones then */
+  if ( format == GBLENDER_SOURCE_BGRA                &&
+       bitmap->pixel_mode != FT_PIXEL_MODE_BGRA      )
+  {
+    grBitmap  gray;
+
+
+    if ( bitmap->pixel_mode != FT_PIXEL_MODE_GRAY )
+      return 1;
+
+    gray.width  = (int)bitmap->width;
+    gray.rows   = (int)bitmap->rows;
+    gray.pitch  = bitmap->pitch;
+    gray.buffer = bitmap->buffer;
+
+    matrix_glyph_derive( glyph, format, &gray, charcode );
+    return glyph->bitmap.buffer == NULL;
+  }
+
+  if ( matrix_bitmap_new( &glyph->bitmap, mode,
+                          (int)bitmap->width, (int)bitmap->rows,
+                          bitmap->pitch < 0 ? -bitmap->pitch
+                                            : bitmap->pitch ) )
+    return 1;
+
+  for ( y = 0; y < glyph->bitmap.rows; y++ )
+    memcpy( glyph->bitmap.buffer + y * glyph->bitmap.pitch,
+            bitmap->buffer + y * bitmap->pitch,
+            (size_t)glyph->bitmap.pitch );
+
+  return 0;
+}
+
+
+static int
+matrix_load_glyphs( const char*  filename,
+                    int          ppem )
+{
+  FT_Library  library = NULL;
+  FT_Face     face    = NULL;
+  int         format;
+  int         n;
+
+
+  if ( !filename )
+  {
+    grBitmap  gray;
+
+
+    /* the built-in glyph for all characters */
+    gray.width  = glyph.width;
+    gray.rows   = glyph.height;
+    gray.pitch  = glyph.pitch;
+    gray.buffer = glyph.buffer;
+
+    for ( format = 0; format < GBLENDER_SOURCE_MAX; format++ )
+      for ( n = 32; n < 128; n++ )
+      {
+        MatrixGlyph  g = &matrix_sources[format].glyphs[n];
+
+
+        matrix_glyph_derive( g, (GBlenderSourceFormat)format, &gray, n );
+        if ( !g->bitmap.buffer )
+          return 1;
+
+        g->left    = 0;
+        g->top     = glyph.height;
+        g->advance = glyph.width + 1;
+      }
+
+    return 0;
+  }
+
+  if ( FT_Init_FreeType( &library )                         ||
+       FT_New_Face( library, filename, 0, &face )           ||
+       FT_Set_Pixel_Sizes( face, 0, (FT_UInt)ppem )         )
+  {
+    fprintf( stderr, "gbench: could not load `%s' at %d ppem\n",
+             filename, ppem );
+    return 1;
+  }
+
+  FT_Library_SetLcdFilter( library, FT_LCD_FILTER_DEFAULT );
+
+  for ( format = 0; format < GBLENDER_SOURCE_MAX; format++ )
+    for ( n = 32; n < 128; n++ )
+      if ( matrix_glyph_render( face, &matrix_sources[format].glyphs[n],
+                                (GBlenderSourceFormat)format, n ) )
+      {
+        fprintf( stderr, "gbench: could not render character 0x%02X\n",
+                 n );
+        return 1;
+      }
+
+  FT_Done_Face( face );
+  FT_Done_FreeType( library );
+
+  return 0;
+}
+
+
+/* the number of target pixels covered by a glyph bitmap */
+static long
+matrix_glyph_pixels( const grBitmap*  bitmap )
+{
+  switch ( bitmap->mode )
+  {
+  case gr_pixel_mode_lcd:
+  case gr_pixel_mode_lcd2:
+    return (long)( bitmap->width / 3 ) * bitmap->rows;
+  case gr_pixel_mode_lcdv:
+  case gr_pixel_mode_lcdv2:
+    return (long)bitmap->width * ( bitmap->rows / 3 );
+  default:
+    return (long)bitmap->width * bitmap->rows;
+  }
+}
+
+
+/* lay out lines of text on one page, return the number of glyphs */
+static int
+matrix_layout( GBlenderSourceFormat  format,
+               int                   ppem,
+               long*                 pixels )
+{
+  const char*  p        = matrix_text;
+  int          line     = ppem + ppem / 4 + 2;
+  int          pen_x    = 4;
+  int          baseline = line;
+  int          color    = 0;
+  int          count    = 0;
+
+
+  *pixels = 0;
+
+  while ( count < MATRIX_ITEMS )
+  {
+    MatrixGlyph  g = &matrix_sources[format].glyphs[(unsigned char)*p];
+    int          x, y, w, h;
+
+
+    w = g->bitmap.width;
+    h = g->bitmap.rows;
+    if ( g->bitmap.mode == gr_pixel_mode_lcd  ||
+         g->bitmap.mode == gr_pixel_mode_lcd2 )
+      w /= 3;
+    if ( g->bitmap.mode == gr_pixel_mode_lcdv  ||
+         g->bitmap.mode == gr_pixel_mode_lcdv2 )
+      h /= 3;
+
+    x = pen_x + g->left;
+    y = baseline - g->top;
+
+    if ( x + w > SIZE_X - 4 )
+    {
+      pen_x     = 4;
+      baseline += line;
+      continue;
+    }
+
+    if ( y + h > SIZE_Y )
       break;
+
+    if ( *p == ' ' )
+      color = ( color + 1 ) % 6;
+    else if ( w > 0 && h > 0 && x >= 0 && y >= 0 )
+    {
+      matrix_items[count].glyph = g;
+      matrix_items[count].x     = x;
+      matrix_items[count].y     = y;
+      matrix_items[count].color = color;
+
+      *pixels += matrix_glyph_pixels( &g->bitmap );
+      count++;
     }
 
-    argc--;
-    argv++;
+    pen_x += g->advance;
+
+    if ( !*++p )
+      p = matrix_text;
   }
 
-  if ( argc != 1 )
-    usage();
+  return count;
+}
 
-  ggamma_set( gamma );
 
-  memset( buffer, 0, sizeof ( buffer ) );
-  if (TEST('a')) bench( do_glyph, 0, "direct white glyph", 0 );
+static void
+matrix_fill( grSurface*             surface,
+             const MatrixSceneRec*  scene )
+{
+  grBitmap*     bitmap = &surface->bitmap;
+  unsigned int  l      = scene->back_left;
+  unsigned int  r      = scene->back_right;
+  int           x;
 
-  chits = cmiss1 = cmiss2 = 0;
-  memset( buffer, 0, sizeof ( buffer ) );
-  if (TEST('b')) bench( do_glyph, 1, "cache white glyph", 0 );
-  dump_cache_stats();
 
-  memset( buffer, 0, sizeof ( buffer ) );
-  if (TEST('c')) bench( do_glyph_color, 0, "direct color glyph", 0 );
+  if ( l == r )
+  {
+    grFillRect( bitmap, 0, 0, bitmap->width, bitmap->rows,
+                grFindColor( bitmap,
+                             l >> 16, ( l >> 8 ) & 255, l & 255, 255 ) );
+    return;
+  }
 
-  chits = cmiss1 = cmiss2 = 0;
-  memset( buffer, 0, sizeof ( buffer ) );
-  if (TEST('d')) bench( do_glyph_color, 1, "cache color glyph", 0 );
-  dump_cache_stats();
+  for ( x = 0; x < bitmap->width; x++ )
+  {
+    int  t = 255 * x / ( bitmap->width - 1 );
+
+#define  MIX( s )  (int)( ( ( ( l >> s ) & 255 ) * ( 255 - t ) +   \
+                            ( ( r >> s ) & 255 ) * t ) / 255 )
+
+    grFillVLine( bitmap, x, 0, bitmap->rows,
+                 grFindColor( bitmap, MIX( 16 ), MIX( 8 ), MIX( 0 ), 255 ) );
+
+#undef MIX
+  }
+}
+
+
+/* time one cell of the matrix, return Mpixels/s */
+static double
+matrix_cell( grSurface*             surface,
+             const MatrixSceneRec*  scene,
+             int                    count,
+             long                   page_pixels,
+             double                 gamma,
+             GBlenderStatsRec*      stats,
+             double*                pixels )
+{
+  grColor  colors[6];
+  double   total = 0.0;
+  long     pages = 0;
+  int      n;
+
+
+  for ( n = 0; n < 6; n++ )
+  {
+    unsigned int  c = scene->fore[n];
+
+
+    colors[n] = grFindColor( &surface->bitmap,
+                             c >> 16, ( c >> 8 ) & 255, c & 255, 255 );
+  }
+
+  /* start with an empty cell cache */
+  grSetTargetGamma( surface, gamma );
+
+  do
+  {
+    double  t0;
+
+
+    matrix_fill( surface, scene );
+
+    t0 = get_time();
+    for ( n = 0; n < count; n++ )
+      grBlitGlyphToSurface( surface, &matrix_items[n].glyph->bitmap,
+                            matrix_items[n].x, matrix_items[n].y,
+                            colors[matrix_items[n].color] );
+    total += get_time() - t0;
+
+    pages++;
+  }
+  while ( total < matrix_time );
+
+  gblender_get_stats( surface->gblender, stats );
+
+  *pixels = (double)page_pixels * (double)pages;
+
+  return *pixels / total / 1E6;
+}
+
+
+/* load the glyphs and create a surface for each target */
+static int
+matrix_open( const char*  filename,
+             int          ppem,
+             grSurface**  surfaces )
+{
+  int  dst;
+
+
+  if ( matrix_load_glyphs( filename, ppem ) )
+    return 1;
+
+  grInitDevices();
+
+  for ( dst = 0; dst < GBLENDER_TARGET_MAX; dst++ )
+  {
+    grBitmap  bit;
+
+
+    bit.mode  = matrix_targets[dst].mode;
+    bit.grays = 256;
+    bit.width = SIZE_X;
+    bit.rows  = SIZE_Y;
+
+    surfaces[dst] = grNewSurface( "batch", &bit );
+    if ( !surfaces[dst] )
+    {
+      fprintf( stderr, "gbench: could not create a %s surface\n",
+               matrix_targets[dst].name );
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+static void
+matrix_close( grSurface**  surfaces )
+{
+  int  src, dst, n;
+
+
+  for ( dst = 0; dst < GBLENDER_TARGET_MAX; dst++ )
+    grDoneSurface( surfaces[dst] );
+  grDoneDevices();
+
+  for ( src = 0; src < GBLENDER_SOURCE_MAX; src++ )
+    for ( n = 0; n < 128; n++ )
+    {
+      free( matrix_sources[src].glyphs[n].bitmap.buffer );
+      matrix_sources[src].glyphs[n].bitmap.buffer = NULL;
+    }
+}
+
+
+static int
+matrix_bench( const char*  filename,
+              int          ppem,
+              double       gamma,
+              const char*  scenes )
+{
+  grSurface*  surfaces[GBLENDER_TARGET_MAX];
+  int         src, dst, s;
+
+
+  if ( matrix_open( filename, ppem, surfaces ) )
+    return 1;
+
+  printf( "\n"
+          "blitter matrix: %s at %d ppem, gamma %.2f, SIMD %s\n"
+          "Mpixels/s per source (rows) and target (columns), and the"
+          " share of glyph\n"
+          "pixels blended without computing new cells (`-' if the"
+          " cache is unused);\n"
+          "`*' marks cells that switched to direct blending\n",
+          filename ? filename : "built-in glyph", ppem, gamma,
+          gblender_simd_name( gblender_simd_get() ) );
+
+  for ( s = 0; s < MATRIX_SCENES; s++ )
+  {
+    const MatrixSceneRec*  scene = &matrix_scenes[s];
+
+
+    if ( scenes && !strchr( scenes, scene->key ) )
+      continue;
+
+    printf( "\n%s\n      ", scene->title );
+    for ( dst = 0; dst < GBLENDER_TARGET_MAX; dst++ )
+      printf( "%14s", matrix_targets[dst].name );
+    printf( "\n" );
+
+    for ( src = 0; src < GBLENDER_SOURCE_MAX; src++ )
+    {
+      long  pixels;
+      int   count = matrix_layout( (GBlenderSourceFormat)src,
+                                   filename ? ppem : glyph.height,
+                                   &pixels );
+
+
+      printf( "%-6s", matrix_sources[src].name );
+
+      for ( dst = 0; dst < GBLENDER_TARGET_MAX; dst++ )
+      {
+        GBlenderStatsRec  stats;
+        double            rate, total, computed;
+
+
+        rate = matrix_cell( surfaces[dst], scene, count, pixels,
+                            gamma, &stats, &total );
+
+        /* a miss computes the cells of one row of pixels at most */
+        computed = (double)stats.misses * ( GBLENDER_SHADE_COUNT - 1 ) +
+                   (double)stats.direct;
+        if ( computed > total )
+          computed = total;
+
+        if ( stats.lookups || stats.direct )
+          printf( "%8.1f %3.0f%%%c", rate,
+                  100.0 * ( 1.0 - computed / total ),
+                  stats.switches ? '*' : ' ' );
+        else
+          printf( "%8.1f    - ", rate );
+        fflush( stdout );
+      }
+      printf( "\n" );
+    }
+  }
+
+  matrix_close( surfaces );
+
+  return 0;
+}
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /*  Parallel blitting.  The pages of the blitter matrix are drawn with   */
+  /*  `grBlitGlyphsToSurface' as well, comparing the speed and checking    */
+  /*  that the pixels are identical.                                       */
+  /*                                                                       */
+  /*************************************************************************/
+
+  static grGlyphBlit  parallel_blits[MATRIX_ITEMS];
+
+
+/* time pages drawn glyph by glyph or as one batch, return s/page */
+static double
+parallel_page_time( grSurface*             surface,
+                    const MatrixSceneRec*  scene,
+                    int                    count,
+                    double                 gamma,
+                    int                    batch )
+{
+  double  total = 0.0;
+  long    pages = 0;
+  int     n;
+
+
+  /* start with empty cell caches */
+  grSetTargetGamma( surface, gamma );
+
+  do
+  {
+    double  t0;
+
+
+    matrix_fill( surface, scene );
+
+    t0 = get_time();
+    if ( batch )
+      grBlitGlyphsToSurface( surface, parallel_blits, count );
+    else
+      for ( n = 0; n < count; n++ )
+        grBlitGlyphToSurface( surface, parallel_blits[n].glyph,
+                              parallel_blits[n].x, parallel_blits[n].y,
+                              parallel_blits[n].color );
+    total += get_time() - t0;
+
+    pages++;
+  }
+  while ( total < matrix_time );
+
+  return total / (double)pages;
+}
+
+
+static int
+parallel_bench( const char*  filename,
+                int          ppem,
+                double       gamma,
+                const char*  scenes )
+{
+  grSurface*      surfaces[GBLENDER_TARGET_MAX];
+  unsigned char*  copy;
+  int             src, dst, s, n;
+
+
+  copy = (unsigned char*)malloc( SIZE_X * 4 * SIZE_Y );
+  if ( !copy || matrix_open( filename, ppem, surfaces ) )
+    return 1;
+
+  printf( "\n"
+          "parallel blitting: %s at %d ppem, gamma %.2f\n"
+          "speed-up of `grBlitGlyphsToSurface' over single glyphs per"
+          " source (rows)\n"
+          "and target (columns); `!' marks pages with different pixels\n",
+          filename ? filename : "built-in glyph", ppem, gamma );
+
+  for ( s = 0; s < MATRIX_SCENES; s++ )
+  {
+    const MatrixSceneRec*  scene = &matrix_scenes[s];
+
+
+    if ( scenes && !strchr( scenes, scene->key ) )
+      continue;
+
+    printf( "\n%s\n      ", scene->title );
+    for ( dst = 0; dst < GBLENDER_TARGET_MAX; dst++ )
+      printf( "%10s", matrix_targets[dst].name );
+    printf( "\n" );
+
+    for ( src = 0; src < GBLENDER_SOURCE_MAX; src++ )
+    {
+      long  pixels;
+      int   count = matrix_layout( (GBlenderSourceFormat)src,
+                                   filename ? ppem : glyph.height,
+                                   &pixels );
+
+
+      printf( "%-6s", matrix_sources[src].name );
+
+      for ( dst = 0; dst < GBLENDER_TARGET_MAX; dst++ )
+      {
+        grBitmap*  bitmap = &surfaces[dst]->bitmap;
+        size_t     size   = (size_t)bitmap->rows *
+                            (size_t)( bitmap->pitch < 0 ? -bitmap->pitch
+                                                        : bitmap->pitch );
+        double     single, batch;
+
+
+        for ( n = 0; n < count; n++ )
+        {
+          unsigned int  c = scene->fore[matrix_items[n].color];
+
+
+          parallel_blits[n].glyph = &matrix_items[n].glyph->bitmap;
+          parallel_blits[n].x     = matrix_items[n].x;
+          parallel_blits[n].y     = matrix_items[n].y;
+          parallel_blits[n].color = grFindColor( bitmap,
+                                                 c >> 16,
+                                                 ( c >> 8 ) & 255,
+                                                 c & 255, 255 );
+        }
+
+        /* both leave a complete page in the surface */
+        single = parallel_page_time( surfaces[dst], scene, count,
+                                     gamma, 0 );
+        memcpy( copy, bitmap->buffer, size );
+
+        batch  = parallel_page_time( surfaces[dst], scene, count,
+                                     gamma, 1 );
+
+        printf( "%8.2fx%c", single / batch,
+                memcmp( copy, bitmap->buffer, size ) ? '!' : ' ' );
+        fflush( stdout );
+      }
+      printf( "\n" );
+    }
+  }
+
+  matrix_close( surfaces );
+  free( copy );
+
+  return 0;
+}
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /*  Verification.  The pages of the blitter matrix are drawn on RGB32    */
+  /*  with the generic blitters and with each supported instruction set,  */
+  /*  at a few gammas and shifted by a few pixels (also out of the left   */
+  /*  and top edges), checking that the pixels are identical.             */
+  /*                                                                       */
+  /*************************************************************************/
+
+  static const double  verify_gammas[] = { 1.0, 1.8, 2.2 };
+  static const int     verify_shifts[] = { 0, 1, 3, -5 };
+
+#define  VERIFY_GAMMAS  (int)( sizeof ( verify_gammas ) /   \
+                               sizeof ( verify_gammas[0] ) )
+#define  VERIFY_SHIFTS  (int)( sizeof ( verify_shifts ) /   \
+                               sizeof ( verify_shifts[0] ) )
+
+
+/* draw one page with the blitters of `level' */
+static void
+verify_page( grSurface*             surface,
+             const MatrixSceneRec*  scene,
+             int                    count,
+             double                 gamma,
+             int                    shift,
+             GBlenderSimd           level )
+{
+  grColor  colors[6];
+  int      n;
+
+
+  for ( n = 0; n < 6; n++ )
+  {
+    unsigned int  c = scene->fore[n];
+
+
+    colors[n] = grFindColor( &surface->bitmap,
+                             c >> 16, ( c >> 8 ) & 255, c & 255, 255 );
+  }
+
+  gblender_simd_set( level );
+
+  /* start with an empty cell cache */
+  grSetTargetGamma( surface, gamma );
+
+  matrix_fill( surface, scene );
+
+  for ( n = 0; n < count; n++ )
+    grBlitGlyphToSurface( surface, &matrix_items[n].glyph->bitmap,
+                          matrix_items[n].x + shift,
+                          matrix_items[n].y + shift,
+                          colors[matrix_items[n].color] );
+}
+
+
+/* return the number of pages that differ */
+static int
+verify_bench( const char*  filename,
+              int          ppem,
+              const char*  scenes )
+{
+  GBlenderSimd    simd = gblender_simd_get();
+  grSurface*      surfaces[GBLENDER_TARGET_MAX];
+  grBitmap*       bitmap;
+  unsigned char*  copy;
+  size_t          size;
+  int             src, s, g, n, level;
+  int             failures = 0;
+
+
+  copy = (unsigned char*)malloc( SIZE_X * 4 * SIZE_Y );
+  if ( !copy || matrix_open( filename, ppem, surfaces ) )
+    return 1;
+
+  bitmap = &surfaces[GBLENDER_TARGET_RGB32]->bitmap;
+  size   = (size_t)bitmap->rows *
+           (size_t)( bitmap->pitch < 0 ? -bitmap->pitch : bitmap->pitch );
+
+  printf( "\n"
+          "verification: %s at %d ppem\n"
+          "pages on rgb32 with differing pixels per source (rows) and"
+          " instruction\n"
+          "set (columns), out of %d each; `-' if unsupported\n",
+          filename ? filename : "built-in glyph", ppem,
+          VERIFY_GAMMAS * VERIFY_SHIFTS );
+
+  for ( s = 0; s < MATRIX_SCENES; s++ )
+  {
+    const MatrixSceneRec*  scene = &matrix_scenes[s];
+
+
+    if ( scenes && !strchr( scenes, scene->key ) )
+      continue;
+
+    printf( "\n%s\n      ", scene->title );
+    for ( level = GBLENDER_SIMD_NONE + 1; level < GBLENDER_SIMD_MAX;
+          level++ )
+      printf( "%8s", gblender_simd_name( (GBlenderSimd)level ) );
+    printf( "\n" );
+
+    for ( src = 0; src < GBLENDER_SOURCE_MAX; src++ )
+    {
+      long  pixels;
+      int   count = matrix_layout( (GBlenderSourceFormat)src,
+                                   filename ? ppem : glyph.height,
+                                   &pixels );
+
+
+      printf( "%-6s", matrix_sources[src].name );
+
+      for ( level = GBLENDER_SIMD_NONE + 1; level < GBLENDER_SIMD_MAX;
+            level++ )
+      {
+        int  differ = 0;
+
+
+        if ( !gblender_simd_supported( (GBlenderSimd)level ) )
+        {
+          printf( "%7s ", "-" );
+          continue;
+        }
+
+        for ( g = 0; g < VERIFY_GAMMAS; g++ )
+          for ( n = 0; n < VERIFY_SHIFTS; n++ )
+          {
+            verify_page( surfaces[GBLENDER_TARGET_RGB32], scene, count,
+                         verify_gammas[g], verify_shifts[n],
+                         GBLENDER_SIMD_NONE );
+            memcpy( copy, bitmap->buffer, size );
+
+            verify_page( surfaces[GBLENDER_TARGET_RGB32], scene, count,
+                         verify_gammas[g], verify_shifts[n],
+                         (GBlenderSimd)level );
+
+            if ( memcmp( copy, bitmap->buffer, size ) )
+              differ++;
+          }
+
+        printf( "%7d%c", differ, differ ? '!' : ' ' );
+        fflush( stdout );
+
+        failures += differ;
+      }
+      printf( "\n" );
+    }
+  }
+
+  gblender_simd_set( simd );
+
+  matrix_close( surfaces );
+  free( copy );
+
+  if ( failures )
+    printf( "\n%d pages differ from the generic blitters\n", failures );
+
+  return failures;
+}
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /*  Swizzling.  The LCD filters of `graph/grswizzle.c' are timed with    */
+  /*  the generic code and with the selected instruction set, checking    */
+  /*  that the results are identical, for whole frames and for small,     */
+  /*  odd-sized rectangles at odd positions and at the edges, where the   */
+  /*  vector code has to handle partial blocks.                           */
+  /*                                                                       */
+  /*************************************************************************/
+
+  typedef void
+  (*SwizzleRectFunc)( unsigned char*  read_buff,
+                      int             read_pitch,
+                      unsigned char*  write_buff,
+                      int             write_pitch,
+                      int             buff_width,
+                      int             buff_height,
+                      int             x,
+                      int             y,
+                      int             width,
+                      int             height );
+
+  static const struct
+  {
+    const char*      name;
+    int              pix_bytes;
+    SwizzleRectFunc  func;
+
+  } swizzle_formats[] =
+  {
+    { "rgb24",  3, gr_swizzle_rect_rgb24  },
+    { "rgb565", 2, gr_swizzle_rect_rgb565 },
+    { "xrgb32", 4, gr_swizzle_rect_xrgb32 },
+  };
+
+
+/* time whole frames, return Mpixels/s */
+static double
+swizzle_rate( SwizzleRectFunc       func,
+              const unsigned char*  frame,
+              unsigned char*        target,
+              int                   pitch )
+{
+  double  total = 0.0;
+  long    frames = 0;
+
+
+  do
+  {
+    double  t0 = get_time();
+
+
+    func( (unsigned char*)frame, pitch, target, pitch,
+          SIZE_X, SIZE_Y, 0, 0, SIZE_X, SIZE_Y );
+    total += get_time() - t0;
+
+    frames++;
+  }
+  while ( total < matrix_time );
+
+  return (double)SIZE_X * SIZE_Y * (double)frames / total / 1E6;
+}
+
+
+/* compare sub-rectangles, return the number that differ */
+static int
+swizzle_verify( const char*           name,
+                SwizzleRectFunc       func,
+                GBlenderSimd          simd,
+                const unsigned char*  frame,
+                unsigned char*        out1,
+                unsigned char*        out2,
+                int                   pitch )
+{
+  size_t  size     = (size_t)pitch * SIZE_Y;
+  int     failures = 0;
+  int     n;
+
+
+  for ( n = 0; n < 256; n++ )
+  {
+    /* every vector tail length, then anything */
+    int  width  = 1 + (int)RAND( n < 128 ? 33 : SIZE_X );
+    int  height = 1 + (int)RAND( 9 );
+    int  x      = (int)RAND( SIZE_X - width + 1 );
+    int  y      = (int)RAND( SIZE_Y - height + 1 );
+
+
+    if ( n % 4 == 1 )
+      x = 0;
+    else if ( n % 4 == 2 )
+      x = SIZE_X - width;
+
+    if ( n % 8 == 3 )
+      y = 0;
+    else if ( n % 8 == 7 )
+      y = SIZE_Y - height;
+
+    /* anything written outside of the rectangle shows up, too */
+    memset( out1, 0x5A, size );
+    memset( out2, 0x5A, size );
+
+    gblender_simd_set( GBLENDER_SIMD_NONE );
+    func( (unsigned char*)frame, pitch, out1, pitch,
+          SIZE_X, SIZE_Y, x, y, width, height );
+
+    gblender_simd_set( simd );
+    func( (unsigned char*)frame, pitch, out2, pitch,
+          SIZE_X, SIZE_Y, x, y, width, height );
+
+    if ( memcmp( out1, out2, size ) )
+    {
+      if ( !failures )
+        printf( "%s: %dx%d at (%d,%d) differs!\n",
+                name, width, height, x, y );
+      failures++;
+    }
+  }
+
+  return failures;
+}
+
+
+static int
+swizzle_bench( void )
+{
+  GBlenderSimd    simd  = gblender_simd_get();
+  int             pitch = SIZE_X * 4;
+  unsigned char*  frame = (unsigned char*)malloc( (size_t)pitch * SIZE_Y );
+  unsigned char*  out1  = (unsigned char*)malloc( (size_t)pitch * SIZE_Y );
+  unsigned char*  out2  = (unsigned char*)malloc( (size_t)pitch * SIZE_Y );
+  int             f, n;
+  int             failures = 0;
+
+
+  if ( !frame || !out1 || !out2 )
+    return 1;
+
+  /* text-like content: mostly background, some edges */
+  for ( n = 0; n < pitch * SIZE_Y; n++ )
+    frame[n] = ( my_rand() & 7 ) ? 255 : (unsigned char)my_rand();
+
+  printf( "\n"
+          "swizzling: Mpixels/s of the generic code and of %s,\n"
+          "           and differing frames and sub-rectangles\n\n",
+          gblender_simd_name( simd ) );
+
+  for ( f = 0; f < (int)( sizeof ( swizzle_formats ) /
+                          sizeof ( swizzle_formats[0] ) ); f++ )
+  {
+    double  generic, vector;
+    int     frames, rects;
+
+
+    gblender_simd_set( GBLENDER_SIMD_NONE );
+    generic = swizzle_rate( swizzle_formats[f].func, frame, out1, pitch );
+
+    gblender_simd_set( simd );
+    vector  = swizzle_rate( swizzle_formats[f].func, frame, out2, pitch );
+
+    frames = memcmp( out1, out2, (size_t)pitch * SIZE_Y ) != 0;
+    rects  = swizzle_verify( swizzle_formats[f].name,
+                             swizzle_formats[f].func, simd,
+                             frame, out1, out2, pitch );
+
+    printf( "%-8s %8.1f %8.1f  %5.2fx  %5d %5d\n",
+            swizzle_formats[f].name, generic, vector, vector / generic,
+            frames, rects );
+
+    failures += frames + rects;
+  }
+
+  gblender_simd_set( simd );
+
+  free( frame );
+  free( out1 );
+  free( out2 );
+
+  return failures;
+}
+
+
+  /*************************************************************************/
+  /*                                                                       */
+  /*  Filling.  Frames are cleared and some boxes are filled as in the     */
+  /*  demo programs, on bitmaps with the pitch of grNewBitmap and with     */
+  /*  cache-line aligned rows.  The former code of `grFillRect', setting   */
+  /*  the first row pixel by pixel and copying it to the others, is        */
+  /*  compared to the generic and the vector code.                         */
+  /*                                                                       */
+  /*************************************************************************/
+
+  /* odd widths, so that rows of grNewBitmap are not 16-byte aligned; */
+  /* the larger frames do not fit in most caches                      */
+  static const int  fill_sizes[][2] =
+  {
+    { 1917, 1080 },
+    { 3837, 2160 },
+  };
+
+  static const struct
+  {
+    const char*  name;
+    grPixelMode  mode;
+    int          pix_bytes;
+
+  } fill_formats[] =
+  {
+    { "gray",   gr_pixel_mode_gray,   1 },
+    { "rgb565", gr_pixel_mode_rgb565, 2 },
+    { "rgb24",  gr_pixel_mode_rgb24,  3 },
+    { "rgb32",  gr_pixel_mode_rgb32,  4 },
+  };
+
+
+/* the fill of `grfill.c' before it was vectorized */
+static void
+fill_rect_former( grBitmap*  bitmap,
+                  int        x,
+                  int        y,
+                  int        width,
+                  int        height,
+                  grColor    color,
+                  int        size )
+{
+  unsigned char*  line = bitmap->buffer + y * bitmap->pitch + x * size;
+  unsigned char*  p    = line;
+  int             i;
+
+
+  if ( size == 1 )
+  {
+    for ( ; height > 0; height--, line += bitmap->pitch )
+      memset( line, (int)color.value, (size_t)width );
+    return;
+  }
+
+  for ( i = 0; i < width; i++, p += size )
+  {
+    if ( size == 4 )
+      *(uint32_t*)p = color.value;
+    else if ( size == 2 )
+      *(unsigned short*)p = (unsigned short)color.value;
+    else
+    {
+      p[0] = color.chroma[0];
+      p[1] = color.chroma[1];
+      p[2] = color.chroma[2];
+    }
+  }
+
+  for ( ; --height > 0; line += bitmap->pitch )
+    memcpy( line + bitmap->pitch, line, (size_t)( size * width ) );
+}
+
+
+/* clear a frame and fill a header, a status line, and 64 boxes; */
+/* return the number of pixels written                           */
+static double
+fill_frame( grBitmap*  bitmap,
+            int        former,
+            int        size )
+{
+  int      width = bitmap->width;
+  int      rows  = bitmap->rows;
+  grColor  back  = grFindColor( bitmap, 255, 255, 255, 255 );
+  grColor  box   = grFindColor( bitmap, 255, 192, 192, 255 );
+  double   count = 0;
+  int      n;
+
+
+  for ( n = -2; n < 64; n++ )
+  {
+    int      x, y, w, h;
+    grColor  color = box;
+
+
+    if ( n == -2 )
+    {
+      x = 0;  y = 0;  w = width;  h = rows;
+      color = back;
+    }
+    else if ( n == -1 )
+    {
+      x = 0;  y = rows - 24;  w = width;  h = 24;
+    }
+    else
+    {
+      /* deterministic boxes of glyph cells */
+      x = ( n * 211 ) % ( width - 128 );
+      y = ( n * 97 ) % ( rows - 128 );
+      w = 16 + ( n * 37 ) % 112;
+      h = 16 + ( n * 53 ) % 112;
+    }
+
+    if ( former )
+      fill_rect_former( bitmap, x, y, w, h, color, size );
+    else
+      grFillRect( bitmap, x, y, w, h, color );
+
+    count += (double)w * h;
+  }
+
+  return count;
+}
+
+
+/* return milliseconds per written megapixel */
+static double
+fill_cost( grBitmap*  bitmap,
+           int        former,
+           int        size )
+{
+  double  total  = 0.0;
+  double  pixels = 0.0;
+
+
+  do
+  {
+    double  t0 = get_time();
+
+
+    pixels += fill_frame( bitmap, former, size );
+    total  += get_time() - t0;
+  }
+  while ( total < matrix_time );
+
+  return total * 1E3 / ( pixels / 1E6 );
+}
+
+
+static int
+fill_bench( void )
+{
+  GBlenderSimd  simd = gblender_simd_get();
+  int           f, n, align;
+
+
+  printf( "\n"
+          "filling: ms per megapixel with the former, the generic code,\n"
+          "and %s\n\n",
+          gblender_simd_name( simd ) );
+
+  printf( "%-8s %-10s %-8s %8s %8s %8s\n",
+          "mode", "frame", "rows", "former", "generic",
+          gblender_simd_name( simd ) );
+
+  for ( f = 0; f < (int)( sizeof ( fill_formats ) /
+                          sizeof ( fill_formats[0] ) ); f++ )
+    for ( n = 0; n < (int)( sizeof ( fill_sizes ) /
+                            sizeof ( fill_sizes[0] ) ); n++ )
+      for ( align = 0; align <= 64; align += 64 )
+      {
+        grBitmap  bitmap;
+        double    former, generic, vector;
+        int       size = fill_formats[f].pix_bytes;
+        char      frame[32];
+
+
+        bitmap.buffer = NULL;
+        if ( grNewAlignedBitmap( fill_formats[f].mode, 256,
+                                 fill_sizes[n][0], fill_sizes[n][1],
+                                 align, &bitmap ) )
+          return 1;
+
+        former = fill_cost( &bitmap, 1, size );
+
+        gblender_simd_set( GBLENDER_SIMD_NONE );
+        generic = fill_cost( &bitmap, 0, size );
+
+        gblender_simd_set( simd );
+        vector = fill_cost( &bitmap, 0, size );
+
+        sprintf( frame, "%dx%d", fill_sizes[n][0], fill_sizes[n][1] );
+        printf( "%-8s %-10s %-8s %8.3f %8.3f %8.3f  %5.2fx\n",
+                fill_formats[f].name, frame, align ? "aligned" : "pitch",
+                former, generic, vector, former / vector );
+
+        grDoneBitmap( &bitmap );
+      }
+
+  return 0;
+}
+
+
+void usage(void)
+{
+  fprintf( stderr,
+    "gbench: graphics glyph blending benchmark\n"
+    "-----------------------------------------\n\n"
+    "Usage: gbench [options] [fontfile]\n\n"
+    "options:\n" );
+  fprintf( stderr,
+  "   -t : max time per bench in seconds (default is %.0f)\n", BENCH_TIME );
+  fprintf( stderr,
+  "   -s seed  : specify random seed\n" );
+  fprintf( stderr,
+  "   -g gamma : specify gamma\n" );
+  fprintf( stderr,
+  "   -b tests : perform chosen tests (default is all)\n"
+  "              a  direct white glyph   b  cache white glyph\n"
+  "              c  direct color glyph   d  cache color glyph\n"
+  "              m  blitter matrix       p  parallel blitting\n"
+  "              w  swizzling            f  filling\n"
+  "              v  verify SIMD blitters (fails if any pixel differs)\n" );
+  fprintf( stderr,
+  "   -c scenes: text colors of the blitter matrix (default is all)\n"
+  "              t  dark on white        i  light on dark gray\n"
+  "              p  syntax colors        g  dark on a gradient\n" );
+  fprintf( stderr,
+  "   -m time  : time per matrix cell, swizzling, or filling test\n"
+  "              in seconds (default is %.1f)\n",
+  MATRIX_TIME );
+  fprintf( stderr,
+  "   -p ppem  : size of the font glyphs in pixels (default is 16)\n" );
+  fprintf( stderr,
+  "   -j count : threads for parallel blitting (default is all CPUs)\n" );
+  fprintf( stderr,
+  "\n"
+  "The blitter matrix draws lines of text with the printable ASCII\n"
+  "characters of `fontfile', or with a built-in glyph if none is given.\n"
+  "Set the environment variable `GBLENDER_SIMD' to `none' to measure\n"
+  "the generic blitters.\n" );
+  exit( 1 );
+}
+
+#define TEST(x) (!tests || strchr(tests, x))
+
+int
+main(int argc,
+     char** argv)
+{
+  char* tests = NULL;
+  char* scenes = NULL;
+  int ppem = 16;
+  int threads;
+  double gamma = 1.0;
+
+  while (argc > 1 && argv[1][0] == '-')
+  {
+    switch (argv[1][1])
+    {
+    case 't':
+      argc--;
+      argv++;
+      if (argc < 2 ||
+          sscanf(argv[1], "%lf", &bench_time) != 1)
+        usage();
+      break;
+
+    case 'g':
+      argc--;
+      argv++;
+      if (argc < 2 ||
+          sscanf(argv[1], "%lf", &gamma) != 1)
+        usage();
+      break;
+
+    case 's':
+      argc--;
+      argv++;
+      if (argc < 2)
+        usage();
+      seed = (unsigned long)atol( argv[1] );
+      break;
+
+    case 'b':
+      argc--;
+      argv++;
+      if (argc < 2)
+        usage();
+      tests = argv[1];
+      break;
+
+    case 'c':
+      argc--;
+      argv++;
+      if (argc < 2)
+        usage();
+      scenes = argv[1];
+      break;
+
+    case 'm':
+      argc--;
+      argv++;
+      if (argc < 2 ||
+          sscanf(argv[1], "%lf", &matrix_time) != 1)
+        usage();
+      break;
+
+    case 'p':
+      argc--;
+      argv++;
+      if (argc < 2 ||
+          sscanf(argv[1], "%d", &ppem) != 1 || ppem <= 0)
+        usage();
+      break;
+
+    case 'j':
+      argc--;
+      argv++;
+      if (argc < 2 ||
+          sscanf(argv[1], "%d", &threads) != 1 || threads <= 0)
+        usage();
+      grSetBlitThreads( threads );
+      break;
+
+    default:
+      fprintf(stderr, "Unknown argument `%s'\n\n", argv[1]);
+      usage();
+      break;
+    }
+
+    argc--;
+    argv++;
+  }
+
+  if ( argc > 2 )
+    usage();
+
+  ggamma_set( gamma );
+
+  memset( buffer, 0, sizeof ( buffer ) );
+  if (TEST('a')) bench( do_glyph, 0, "direct white glyph", 0 );
+
+  chits = cmiss1 = cmiss2 = 0;
+  memset( buffer, 0, sizeof ( buffer ) );
+  if (TEST('b'))
+  {
+    bench( do_glyph, 1, "cache white glyph", 0 );
+    dump_cache_stats();
+  }
+
+  memset( buffer, 0, sizeof ( buffer ) );
+  if (TEST('c')) bench( do_glyph_color, 0, "direct color glyph", 0 );
+
+  chits = cmiss1 = cmiss2 = 0;
+  memset( buffer, 0, sizeof ( buffer ) );
+  if (TEST('d'))
+  {
+    bench( do_glyph_color, 1, "cache color glyph", 0 );
+    dump_cache_stats();
+  }
+
+  if ( TEST( 'm' ) &&
+       matrix_bench( argc == 2 ? argv[1] : NULL, ppem, gamma, scenes ) )
+    return 1;
+
+  if ( TEST( 'p' ) &&
+       parallel_bench( argc == 2 ? argv[1] : NULL, ppem, gamma, scenes ) )
+    return 1;
+
+  if ( TEST( 'v' ) &&
+       verify_bench( argc == 2 ? argv[1] : NULL, ppem, scenes ) )
+    return 1;
+
+  if ( TEST( 'w' ) && swizzle_bench() )
+    return 1;
+
+  if ( TEST( 'f' ) && fill_bench() )
+    return 1;
 
   return 0;
 }
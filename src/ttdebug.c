@@ -13,6 +13,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 
 #ifdef UNIX
@@ -100,6 +101,7 @@
   static FT_Bool  use_hex    = 1;              /* for integers    */
                                                /* (except points) */
   static FT_Error  error;
+  static FT_Bool   interactive;                /* keyboard set up? */
 
 
   typedef char  ByteStr[2];
@@ -1553,7 +1555,8 @@
 
     fprintf( stderr, "%s\n  error = 0x%04x, %s\n", message, error, str );
 
-    Reset_Keyboard();
+    if ( interactive )
+      Reset_Keyboard();
     exit( 1 );
   }
 
@@ -1594,6 +1597,38 @@
   }
 
 
+  /* apply the coordinates given with option `-d' to `face' */
+  static void
+  set_design_coords( void )
+  {
+    unsigned int  n;
+
+
+    FT_Done_MM_Var( library, multimaster );
+    error = FT_Get_MM_Var( (FT_Face)face, &multimaster );
+    if ( error )
+    {
+      multimaster = NULL;
+      return;
+    }
+
+    if ( requested_cnt > multimaster->num_axis )
+      requested_cnt = multimaster->num_axis;
+
+    for ( n = 0; n < requested_cnt; n++ )
+    {
+      if ( requested_pos[n] < multimaster->axis[n].minimum )
+        requested_pos[n] = multimaster->axis[n].minimum;
+      else if ( requested_pos[n] > multimaster->axis[n].maximum )
+        requested_pos[n] = multimaster->axis[n].maximum;
+    }
+
+    FT_Set_Var_Design_Coordinates( (FT_Face)face,
+                                   requested_cnt,
+                                   requested_pos );
+  }
+
+
   /******************************************************************
    *
    *  Function:    Calc_Length
@@ -2853,6 +2888,819 @@
   }
 
 
+  /*********************************************************************
+   *
+   * Trace recording and comparison.
+   *
+   * With option `-t', ttdebug runs without user interaction and writes
+   * a binary trace of all executed instructions to a file.  Each
+   * instruction record holds the code range, the IP, the opcode, the
+   * stack depth after execution, and the glyph and twilight points the
+   * instruction has modified (i.e., the data `display_changed_points'
+   * shows).  All numbers are stored as LEB128 variable-length integers;
+   * signed values are zigzag-encoded.
+   *
+   * Option `-D' compares two such traces, created either with different
+   * interpreter versions or with different FreeType builds, and reports
+   * the first divergence for each glyph.  Both traces are read
+   * sequentially record by record, so memory usage does not depend on
+   * the number of executed instructions.
+   *
+   *********************************************************************/
+
+#define TRACE_MAGIC    "TTtr"
+#define TRACE_VERSION  1
+
+  /* record tags */
+#define TRACE_GLYPH  'G'   /* start of glyph; value is glyph index     */
+#define TRACE_RANGE  'R'   /* start of code range                      */
+#define TRACE_INSTR  'I'   /* executed instruction                     */
+#define TRACE_END    'E'   /* end of code range; value is error code   */
+
+  /* bits of `TraceChange.mask', as used in `display_changed_points' */
+#define TRACE_ORG_X  1
+#define TRACE_ORG_Y  2
+#define TRACE_CUR_X  4
+#define TRACE_CUR_Y  8
+#define TRACE_TAGS   16
+
+
+  typedef struct  TraceChange_
+  {
+    FT_UInt  point;       /* point index                     */
+    FT_Bool  is_twilight;
+    FT_Byte  mask;        /* which values have been changed  */
+    FT_Byte  tags;
+    FT_Pos   org_x, org_y;
+    FT_Pos   cur_x, cur_y;
+
+  } TraceChange;
+
+
+  typedef struct  TraceRecord_
+  {
+    int       tag;
+    FT_Int    range;
+    FT_Long   IP;
+    FT_Byte   opcode;
+    FT_Long   top;
+    FT_ULong  value;
+
+    FT_UInt       num_changes;
+    FT_UInt       max_changes;
+    TraceChange*  changes;
+
+  } TraceRecord;
+
+
+  typedef struct  TraceReader_
+  {
+    FILE*        file;
+    const char*  name;
+    FT_ULong     version;         /* interpreter version of trace */
+    FT_ULong     ppem;
+
+    TraceRecord  rec;             /* current record                */
+    FT_Bool      eof;
+    FT_Long      section;         /* current glyph, -1 for setup   */
+    FT_ULong     count;           /* instructions in section so far */
+
+  } TraceReader;
+
+
+  static FILE*  trace_out;        /* non-NULL in trace recording mode */
+
+
+  static void
+  trace_put_uint( FT_ULong  value )
+  {
+    while ( value >= 0x80 )
+    {
+      putc( (int)( ( value & 0x7F ) | 0x80 ), trace_out );
+      value >>= 7;
+    }
+    putc( (int)value, trace_out );
+  }
+
+
+  static void
+  trace_put_int( FT_Long  value )
+  {
+    if ( value < 0 )
+      trace_put_uint( ( (FT_ULong)~value << 1 ) | 1 );
+    else
+      trace_put_uint( (FT_ULong)value << 1 );
+  }
+
+
+  static void
+  trace_write_record( TraceRecord*  rec )
+  {
+    FT_UInt  n;
+
+
+    putc( rec->tag, trace_out );
+
+    switch ( rec->tag )
+    {
+    case TRACE_GLYPH:
+    case TRACE_END:
+      trace_put_uint( rec->value );
+      break;
+
+    case TRACE_RANGE:
+      putc( rec->range, trace_out );
+      break;
+
+    case TRACE_INSTR:
+      putc( rec->range, trace_out );
+      trace_put_uint( (FT_ULong)rec->IP );
+      putc( rec->opcode, trace_out );
+      trace_put_int( rec->top );
+      trace_put_uint( rec->num_changes );
+
+      for ( n = 0; n < rec->num_changes; n++ )
+      {
+        TraceChange*  c = rec->changes + n;
+
+
+        trace_put_uint( ( (FT_ULong)c->point << 1 ) | c->is_twilight );
+        putc( c->mask, trace_out );
+
+        if ( c->mask & TRACE_ORG_X )
+          trace_put_int( c->org_x );
+        if ( c->mask & TRACE_ORG_Y )
+          trace_put_int( c->org_y );
+        if ( c->mask & TRACE_CUR_X )
+          trace_put_int( c->cur_x );
+        if ( c->mask & TRACE_CUR_Y )
+          trace_put_int( c->cur_y );
+        if ( c->mask & TRACE_TAGS )
+          putc( c->tags, trace_out );
+      }
+      break;
+    }
+  }
+
+
+  static TraceChange*
+  trace_new_change( TraceRecord*  rec )
+  {
+    if ( rec->num_changes == rec->max_changes )
+    {
+      rec->max_changes = rec->max_changes ? 2 * rec->max_changes : 16;
+      rec->changes     = (TraceChange*)realloc(
+                           rec->changes,
+                           rec->max_changes * sizeof ( TraceChange ) );
+      if ( !rec->changes )
+        Panic( "out of memory\n" );
+    }
+
+    return rec->changes + rec->num_changes++;
+  }
+
+
+  /* Append the differences between `prev' and `curr' to `rec', */
+  /* then update `prev' so that it mirrors `curr' again.         */
+  static void
+  trace_collect_changes( TraceRecord*      rec,
+                         TT_GlyphZoneRec*  prev,
+                         TT_GlyphZoneRec*  curr,
+                         FT_Bool           is_twilight )
+  {
+    FT_Int  A;
+
+
+    for ( A = 0; A < curr->n_points; A++ )
+    {
+      FT_Byte       diff = 0;
+      TraceChange*  c;
+
+
+      if ( prev->org[A].x != curr->org[A].x )
+        diff |= TRACE_ORG_X;
+      if ( prev->org[A].y != curr->org[A].y )
+        diff |= TRACE_ORG_Y;
+      if ( prev->cur[A].x != curr->cur[A].x )
+        diff |= TRACE_CUR_X;
+      if ( prev->cur[A].y != curr->cur[A].y )
+        diff |= TRACE_CUR_Y;
+      if ( prev->tags[A] != curr->tags[A] )
+        diff |= TRACE_TAGS;
+
+      if ( !diff )
+        continue;
+
+      c = trace_new_change( rec );
+
+      c->point       = (FT_UInt)A;
+      c->is_twilight = is_twilight;
+      c->mask        = diff;
+      c->org_x       = curr->org[A].x;
+      c->org_y       = curr->org[A].y;
+      c->cur_x       = curr->cur[A].x;
+      c->cur_y       = curr->cur[A].y;
+      c->tags        = curr->tags[A];
+
+      prev->org[A]  = curr->org[A];
+      prev->cur[A]  = curr->cur[A];
+      prev->tags[A] = curr->tags[A];
+    }
+  }
+
+
+  static void
+  trace_save_zone( TT_GlyphZoneRec*  save,
+                   TT_GlyphZoneRec*  zone )
+  {
+    size_t  n = (size_t)zone->n_points;
+
+
+    save->n_points   = zone->n_points;
+    save->n_contours = zone->n_contours;
+
+    save->org  = (FT_Vector*)malloc( n * sizeof ( FT_Vector ) + 1 );
+    save->cur  = (FT_Vector*)malloc( n * sizeof ( FT_Vector ) + 1 );
+    save->tags = (FT_Byte*)malloc( n + 1 );
+    if ( !save->org || !save->cur || !save->tags )
+      Panic( "out of memory\n" );
+
+    if ( n )
+    {
+      memcpy( save->org, zone->org, n * sizeof ( FT_Vector ) );
+      memcpy( save->cur, zone->cur, n * sizeof ( FT_Vector ) );
+      memcpy( save->tags, zone->tags, n );
+    }
+  }
+
+
+  static void
+  trace_free_zone( TT_GlyphZoneRec*  save )
+  {
+    free( save->org );
+    free( save->cur );
+    free( save->tags );
+  }
+
+
+  /* the debug hook used in trace recording mode */
+  static FT_Error
+  TraceIns( TT_ExecContext  exc )
+  {
+    TT_GlyphZoneRec  save_pts;
+    TT_GlyphZoneRec  save_twilight;
+
+    TraceRecord  rec;
+    FT_Error     err = FT_Err_Ok;
+
+
+    memset( &rec, 0, sizeof ( rec ) );
+
+    trace_save_zone( &save_pts, &CUR.pts );
+    trace_save_zone( &save_twilight, &CUR.twilight );
+
+    CUR.instruction_trap = 1;
+
+    rec.tag   = TRACE_RANGE;
+    rec.range = CUR.curRange;
+    trace_write_record( &rec );
+
+    rec.tag = TRACE_INSTR;
+
+    while ( CUR.IP < CUR.codeSize )
+    {
+      rec.range       = CUR.curRange;
+      rec.IP          = CUR.IP;
+      rec.opcode      = CUR.code[CUR.IP];
+      rec.num_changes = 0;
+
+      err = TT_RunIns( exc );
+
+      rec.top = CUR.top;
+      trace_collect_changes( &rec, &save_pts, &CUR.pts, 0 );
+      trace_collect_changes( &rec, &save_twilight, &CUR.twilight, 1 );
+      trace_write_record( &rec );
+
+      if ( err )
+        break;
+    }
+
+    rec.tag   = TRACE_END;
+    rec.value = (FT_ULong)err;
+    trace_write_record( &rec );
+
+    trace_free_zone( &save_pts );
+    trace_free_zone( &save_twilight );
+    free( rec.changes );
+
+    return err;
+  }
+
+
+  static FT_Bool
+  trace_get_uint( FILE*      file,
+                  FT_ULong*  value )
+  {
+    FT_ULong  result = 0;
+    int       shift  = 0;
+    int       c;
+
+
+    do
+    {
+      c = getc( file );
+      if ( c == EOF || shift > 63 )
+        return 0;
+
+      result |= (FT_ULong)( c & 0x7F ) << shift;
+      shift  += 7;
+
+    } while ( c & 0x80 );
+
+    *value = result;
+    return 1;
+  }
+
+
+  static FT_Bool
+  trace_get_int( FILE*     file,
+                 FT_Long*  value )
+  {
+    FT_ULong  u;
+
+
+    if ( !trace_get_uint( file, &u ) )
+      return 0;
+
+    *value = ( u & 1 ) ? (FT_Long)~( u >> 1 ) : (FT_Long)( u >> 1 );
+    return 1;
+  }
+
+
+  /* read the next record; set `eof' at the end of the trace */
+  static void
+  trace_advance( TraceReader*  r )
+  {
+    TraceRecord*  rec = &r->rec;
+    FT_ULong      u;
+    FT_UInt       n;
+    int           c;
+
+
+    c = getc( r->file );
+    if ( c == EOF )
+    {
+      r->eof = 1;
+      return;
+    }
+
+    rec->tag = c;
+
+    switch ( c )
+    {
+    case TRACE_GLYPH:
+    case TRACE_END:
+      if ( !trace_get_uint( r->file, &rec->value ) )
+        goto Corrupt;
+      break;
+
+    case TRACE_RANGE:
+      if ( ( c = getc( r->file ) ) == EOF )
+        goto Corrupt;
+      rec->range = c;
+      break;
+
+    case TRACE_INSTR:
+      if ( ( c = getc( r->file ) ) == EOF )
+        goto Corrupt;
+      rec->range = c;
+
+      if ( !trace_get_uint( r->file, &u ) )
+        goto Corrupt;
+      rec->IP = (FT_Long)u;
+
+      if ( ( c = getc( r->file ) ) == EOF )
+        goto Corrupt;
+      rec->opcode = (FT_Byte)c;
+
+      if ( !trace_get_int( r->file, &rec->top ) ||
+           !trace_get_uint( r->file, &u )       )
+        goto Corrupt;
+
+      rec->num_changes = 0;
+      for ( n = 0; n < u; n++ )
+      {
+        TraceChange*  ch = trace_new_change( rec );
+        FT_ULong      point;
+
+
+        memset( ch, 0, sizeof ( *ch ) );
+
+        if ( !trace_get_uint( r->file, &point ) ||
+             ( c = getc( r->file ) ) == EOF     )
+          goto Corrupt;
+
+        ch->point       = (FT_UInt)( point >> 1 );
+        ch->is_twilight = (FT_Bool)( point & 1 );
+        ch->mask        = (FT_Byte)c;
+
+        if ( ( ch->mask & TRACE_ORG_X )               &&
+             !trace_get_int( r->file, &ch->org_x ) )
+          goto Corrupt;
+        if ( ( ch->mask & TRACE_ORG_Y )               &&
+             !trace_get_int( r->file, &ch->org_y ) )
+          goto Corrupt;
+        if ( ( ch->mask & TRACE_CUR_X )               &&
+             !trace_get_int( r->file, &ch->cur_x ) )
+          goto Corrupt;
+        if ( ( ch->mask & TRACE_CUR_Y )               &&
+             !trace_get_int( r->file, &ch->cur_y ) )
+          goto Corrupt;
+        if ( ch->mask & TRACE_TAGS )
+        {
+          if ( ( c = getc( r->file ) ) == EOF )
+            goto Corrupt;
+          ch->tags = (FT_Byte)c;
+        }
+      }
+      break;
+
+    default:
+      goto Corrupt;
+    }
+
+    return;
+
+  Corrupt:
+    Panic( "`%s' is not a valid or complete trace file\n", r->name );
+  }
+
+
+  static void
+  trace_open( TraceReader*  r,
+              const char*   name )
+  {
+    char  magic[4];
+
+
+    memset( r, 0, sizeof ( *r ) );
+
+    r->name = name;
+    r->file = fopen( name, "rb" );
+    if ( !r->file )
+      Panic( "could not open trace file `%s'\n", name );
+
+    if ( fread( magic, 1, 4, r->file ) != 4      ||
+         memcmp( magic, TRACE_MAGIC, 4 )         ||
+         getc( r->file ) != TRACE_VERSION        ||
+         !trace_get_uint( r->file, &r->version ) ||
+         !trace_get_uint( r->file, &r->ppem )    )
+      Panic( "`%s' is not a ttdebug trace file\n", name );
+
+    r->section = -1;
+    trace_advance( r );
+  }
+
+
+  static void
+  trace_close( TraceReader*  r )
+  {
+    fclose( r->file );
+    free( r->rec.changes );
+  }
+
+
+  /* skip to the start of the next glyph; return 0 at end of trace */
+  static FT_Bool
+  trace_next_section( TraceReader*  r )
+  {
+    while ( !r->eof && r->rec.tag != TRACE_GLYPH )
+      trace_advance( r );
+
+    if ( r->eof )
+      return 0;
+
+    r->section = (FT_Long)r->rec.value;
+    r->count   = 0;
+    trace_advance( r );
+
+    return 1;
+  }
+
+
+  static FT_Bool
+  trace_records_equal( TraceRecord*  a,
+                       TraceRecord*  b )
+  {
+    FT_UInt  n;
+
+
+    if ( a->tag != b->tag )
+      return 0;
+
+    switch ( a->tag )
+    {
+    case TRACE_RANGE:
+      return a->range == b->range;
+
+    case TRACE_END:
+      return a->value == b->value;
+
+    case TRACE_INSTR:
+      if ( a->range       != b->range       ||
+           a->IP          != b->IP          ||
+           a->opcode      != b->opcode      ||
+           a->top         != b->top         ||
+           a->num_changes != b->num_changes )
+        return 0;
+
+      for ( n = 0; n < a->num_changes; n++ )
+      {
+        TraceChange*  ca = a->changes + n;
+        TraceChange*  cb = b->changes + n;
+
+
+        if ( ca->point != cb->point             ||
+             ca->is_twilight != cb->is_twilight ||
+             ca->mask != cb->mask               ||
+             ca->org_x != cb->org_x             ||
+             ca->org_y != cb->org_y             ||
+             ca->cur_x != cb->cur_x             ||
+             ca->cur_y != cb->cur_y             ||
+             ca->tags != cb->tags               )
+          return 0;
+      }
+      return 1;
+    }
+
+    return 0;
+  }
+
+
+  static char
+  trace_range_char( FT_Int  range )
+  {
+    return range == tt_coderange_glyph
+             ? 'g'
+             : ( range == tt_coderange_cvt ? 'c' : 'f' );
+  }
+
+
+  static void
+  trace_print_record( const char*   label,
+                      TraceReader*  r )
+  {
+    TraceRecord*  rec = &r->rec;
+    FT_UInt       n;
+
+
+    printf( "  %s: ", label );
+
+    if ( r->eof || rec->tag == TRACE_GLYPH )
+    {
+      printf( "end of glyph\n" );
+      return;
+    }
+
+    switch ( rec->tag )
+    {
+    case TRACE_RANGE:
+      printf( "entering `%c' code range\n", trace_range_char( rec->range ) );
+      break;
+
+    case TRACE_END:
+      printf( "leaving code range, error 0x%04lx\n", rec->value );
+      break;
+
+    case TRACE_INSTR:
+      printf( "%c%04lx: %02x  %-16s stack depth %ld\n",
+              trace_range_char( rec->range ),
+              rec->IP,
+              rec->opcode,
+              OpStr[rec->opcode],
+              rec->top );
+
+      for ( n = 0; n < rec->num_changes; n++ )
+      {
+        TraceChange*  c = rec->changes + n;
+
+
+        printf( "     %3u%s ", c->point, c->is_twilight ? "T" : " " );
+
+        if ( c->mask & TRACE_TAGS )
+          printf( "(%c%c%c)",
+                  c->tags & FT_CURVE_TAG_ON ? 'P' : 'C',
+                  c->tags & FT_CURVE_TAG_TOUCH_X ? 'X' : ' ',
+                  c->tags & FT_CURVE_TAG_TOUCH_Y ? 'Y' : ' ' );
+        else
+          printf( "     " );
+
+        if ( c->mask & TRACE_ORG_X )
+          print_number( c->org_x,
+                        "[%5ld'%2ld]", "[   -0'%2ld]", "[%8.2f]", "[%8ld]" );
+        else
+          printf( "          " );
+        if ( c->mask & TRACE_ORG_Y )
+          print_number( c->org_y,
+                        "[%5ld'%2ld]", "[   -0'%2ld]", "[%8.2f]", "[%8ld]" );
+        else
+          printf( "          " );
+        if ( c->mask & TRACE_CUR_X )
+          print_number( c->cur_x,
+                        "[%5ld'%2ld]", "[   -0'%2ld]", "[%8.2f]", "[%8ld]" );
+        else
+          printf( "          " );
+        if ( c->mask & TRACE_CUR_Y )
+          print_number( c->cur_y,
+                        "[%5ld'%2ld]", "[   -0'%2ld]", "[%8.2f]", "[%8ld]" );
+
+        printf( "\n" );
+      }
+      break;
+    }
+  }
+
+
+  /* Compare the current glyph section of both traces, stopping at the */
+  /* first difference.  Return 1 if the sections diverge.              */
+  static int
+  trace_diff_section( TraceReader*  a,
+                      TraceReader*  b )
+  {
+    for (;;)
+    {
+      FT_Bool  end_a = a->eof || a->rec.tag == TRACE_GLYPH;
+      FT_Bool  end_b = b->eof || b->rec.tag == TRACE_GLYPH;
+
+
+      if ( end_a && end_b )
+        return 0;
+
+      if ( end_a || end_b || !trace_records_equal( &a->rec, &b->rec ) )
+        break;
+
+      if ( a->rec.tag == TRACE_INSTR )
+      {
+        a->count++;
+        b->count++;
+      }
+
+      trace_advance( a );
+      trace_advance( b );
+    }
+
+    if ( a->section < 0 )
+      printf( "setup (`fpgm' and `prep'):" );
+    else
+      printf( "glyph %ld:", a->section );
+    printf( " first divergence after %lu instructions\n", a->count );
+
+    trace_print_record( "A", a );
+    trace_print_record( "B", b );
+    printf( "\n" );
+
+    return 1;
+  }
+
+
+  static int
+  trace_diff( const char*  name_a,
+              const char*  name_b )
+  {
+    TraceReader  a, b;
+    FT_Bool      have_a, have_b;
+
+    unsigned long  num_glyphs  = 0;
+    unsigned long  num_diverge = 0;
+    unsigned long  num_missing = 0;
+
+
+    trace_open( &a, name_a );
+    trace_open( &b, name_b );
+
+    printf( "A: %s (interpreter version %lu, %lu ppem)\n"
+            "B: %s (interpreter version %lu, %lu ppem)\n"
+            "\n",
+            name_a, a.version, a.ppem,
+            name_b, b.version, b.ppem );
+
+    /* the data before the first glyph comes from `fpgm' and `prep' */
+    num_diverge += (unsigned long)trace_diff_section( &a, &b );
+
+    have_a = trace_next_section( &a );
+    have_b = trace_next_section( &b );
+
+    while ( have_a || have_b )
+    {
+      /* glyph sections are stored in increasing order */
+      if ( !have_b || ( have_a && a.section < b.section ) )
+      {
+        printf( "glyph %ld: only in A\n", a.section );
+        num_missing++;
+        have_a = trace_next_section( &a );
+        continue;
+      }
+
+      if ( !have_a || b.section < a.section )
+      {
+        printf( "glyph %ld: only in B\n", b.section );
+        num_missing++;
+        have_b = trace_next_section( &b );
+        continue;
+      }
+
+      num_glyphs++;
+      num_diverge += (unsigned long)trace_diff_section( &a, &b );
+
+      have_a = trace_next_section( &a );
+      have_b = trace_next_section( &b );
+    }
+
+    printf( "%lu glyphs compared, %lu sections diverging,"
+            " %lu glyphs in one trace only\n",
+            num_glyphs, num_diverge, num_missing );
+
+    trace_close( &a );
+    trace_close( &b );
+
+    return num_diverge || num_missing;
+  }
+
+
+  /* record traces for glyphs `first' to `last' */
+  static void
+  trace_glyphs( const char*   trace_name,
+                const char*   font_name,
+                int           face_index,
+                int           ppem,
+                unsigned int  first,
+                unsigned int  last )
+  {
+    unsigned int  version;
+    unsigned int  idx;
+
+
+    trace_out = fopen( trace_name, "wb" );
+    if ( !trace_out )
+      Panic( "could not open trace file `%s'\n", trace_name );
+
+    FT_Property_Get( library,
+                     "truetype",
+                     "interpreter-version", &version );
+
+    fwrite( TRACE_MAGIC, 1, 4, trace_out );
+    putc( TRACE_VERSION, trace_out );
+    trace_put_uint( version );
+    trace_put_uint( (FT_ULong)ppem );
+
+    FT_Set_Debug_Hook( library,
+                       FT_DEBUG_HOOK_TRUETYPE,
+                       (FT_DebugHook_Func)TraceIns );
+
+    error = FT_New_Face( library, font_name, face_index, (FT_Face*)&face );
+    if ( error )
+      Abort( "could not open input font file" );
+
+    if ( face->root.driver != driver )
+    {
+      error = FT_Err_Invalid_File_Format;
+      Abort( "this is not a TrueType font" );
+    }
+
+    set_design_coords();
+
+    error = FT_Set_Char_Size( (FT_Face)face,
+                              ppem << 6,
+                              ppem << 6,
+                              72,
+                              72 );
+    if ( error )
+      Abort( "could not set character size" );
+
+    if ( last >= (unsigned int)face->root.num_glyphs )
+      last = (unsigned int)face->root.num_glyphs - 1;
+
+    for ( idx = first; idx <= last; idx++ )
+    {
+      TraceRecord  rec;
+
+
+      rec.tag   = TRACE_GLYPH;
+      rec.value = idx;
+      trace_write_record( &rec );
+
+      /* bytecode errors are part of the trace */
+      FT_Load_Glyph( (FT_Face)face, idx, FT_LOAD_NO_BITMAP );
+    }
+
+    FT_Done_Face( (FT_Face)face );
+
+    if ( fclose( trace_out ) )
+      Panic( "could not write trace file `%s'\n", trace_name );
+    trace_out = NULL;
+  }
+
+
   static void
   Usage( char*  execname )
   {
@@ -2879,7 +3727,9 @@
       "\n" );
     fprintf( stderr,
       "Usage: %s [options] idx size font\n"
-      "\n", execname );
+      "       %s -t trace [options] idx[-idx2] size font\n"
+      "       %s -D traceA traceB\n"
+      "\n", execname, execname, execname );
     fprintf( stderr,
       "  idx       The index of the glyph to debug.\n"
       "  size      The size of the glyph in pixels (ppem).\n"
@@ -2891,6 +3741,11 @@
       "  -d \"axis1 axis2 ...\"\n"
       "            Specify the design coordinates for each variation axis\n"
       "            at start-up (ignored if not a variation font).\n"
+      "  -t trace  Don't run interactively but write a binary trace of all\n"
+      "            executed instructions and modified points to file TRACE.\n"
+      "            A glyph range `idx-idx2' can be given in this mode.\n"
+      "  -D        Compare two trace files and report the first\n"
+      "            divergence for each glyph.\n"
       "  -v        Show version.\n"
       "\n"
       "While running, press the `?' key for help.\n"
@@ -2924,6 +3779,10 @@
 
     int  tmp;
 
+    char*         trace_name = NULL;
+    int           trace_diff_mode = 0;
+    unsigned int  last_glyph_index;
+
 
     /* init library, read face object, get driver, create size */
     error = FT_Init_FreeType( &library );
@@ -2971,7 +3830,7 @@
 
     while ( 1 )
     {
-      option = getopt( argc, argv, "I:d:f:v" );
+      option = getopt( argc, argv, "DI:d:f:t:v" );
 
       if ( option == -1 )
         break;
@@ -3005,10 +3864,18 @@
         }
         break;
 
+      case 'D':
+        trace_diff_mode = 1;
+        break;
+
       case 'd':
         parse_design_coords( optarg );
         break;
 
+      case 't':
+        trace_name = optarg;
+        break;
+
       case 'f':
         face_index = atoi( optarg );
         break;
@@ -3027,6 +3894,17 @@
     argc -= optind;
     argv += optind;
 
+    if ( trace_diff_mode )
+    {
+      if ( argc != 2 )
+        Usage( execname );
+
+      tmp = trace_diff( argv[0], argv[1] );
+
+      FT_Done_FreeType( library );
+      return tmp;
+    }
+
     if ( argc < 3 )
       Usage( execname );
 
@@ -3036,7 +3914,20 @@
       printf( "invalid glyph index = %s\n", argv[1] );
       Usage( execname );
     }
-    glyph_index = (unsigned int)tmp;
+    glyph_index      = (unsigned int)tmp;
+    last_glyph_index = glyph_index;
+
+    /* a glyph range is only meaningful for tracing */
+    if ( trace_name && strchr( argv[0], '-' ) )
+    {
+      if ( sscanf( strchr( argv[0], '-' ) + 1, "%d", &tmp ) != 1 ||
+           tmp < (int)glyph_index                                )
+      {
+        printf( "invalid glyph range = %s\n", argv[0] );
+        Usage( execname );
+      }
+      last_glyph_index = (unsigned int)tmp;
+    }
 
     /* get glyph size */
     if ( sscanf( argv[1], "%d", &glyph_size ) != 1 || glyph_size < 0 )
@@ -3048,7 +3939,19 @@
     /* get file name */
     file_name = argv[2];
 
+    if ( trace_name )
+    {
+      trace_glyphs( trace_name, file_name, face_index, glyph_size,
+                    glyph_index, last_glyph_index );
+
+      FT_Done_FreeType( library );
+      free( requested_pos );
+
+      return 0;
+    }
+
     Init_Keyboard();
+    interactive = 1;
 
     FT_Set_Debug_Hook( library,
                        FT_DEBUG_HOOK_TRUETYPE,
@@ -3071,30 +3974,7 @@
         Abort( "this is not a TrueType font" );
       }
 
-      FT_Done_MM_Var( library, multimaster );
-      error = FT_Get_MM_Var( (FT_Face)face, &multimaster );
-      if ( error )
-        multimaster = NULL;
-      else
-      {
-        unsigned int  n;
-
-
-        if ( requested_cnt > multimaster->num_axis )
-          requested_cnt = multimaster->num_axis;
-
-        for ( n = 0; n < requested_cnt; n++ )
-        {
-          if ( requested_pos[n] < multimaster->axis[n].minimum )
-            requested_pos[n] = multimaster->axis[n].minimum;
-          else if ( requested_pos[n] > multimaster->axis[n].maximum )
-            requested_pos[n] = multimaster->axis[n].maximum;
-        }
-
-        FT_Set_Var_Design_Coordinates( (FT_Face)face,
-                                       requested_cnt,
-                                       requested_pos );
-      }
+      set_design_coords();
 
       size = (TT_Size)face->root.size;
 